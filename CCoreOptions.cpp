@@ -0,0 +1,212 @@
+#include "stdafx.h"
+#include "CCoreOptions.h"
+#include "ini.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+CCoreOptions::CCoreOptions()
+{
+	clear();
+}
+
+void CCoreOptions::clear()
+{
+	options.clear();
+	hashes.clear();
+	table.clear();
+	path.clear();
+	// starts at 1 so option::seen can use 0 for never read
+	generation = 1;
+	reported = 1;
+	dirty = false;
+}
+
+// FNV-1a, good enough for a few hundred short keys
+uint32_t CCoreOptions::hash(const char *s)
+{
+	uint32_t h = 2166136261u;
+	while (*s)
+	{
+		h ^= (uint8_t)*s++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+void CCoreOptions::build_table()
+{
+	size_t cap = 16;
+	while (cap < options.size() * 2)
+		cap <<= 1;
+	table.assign(cap, 0);
+	for (size_t i = 0; i < options.size(); i++)
+	{
+		size_t slot = hashes[i] & (cap - 1);
+		while (table[slot])
+			slot = (slot + 1) & (cap - 1);
+		table[slot] = (uint32_t)i + 1;
+	}
+}
+
+int CCoreOptions::lookup(const char *key) const
+{
+	if (!key || table.empty())
+		return -1;
+	uint32_t h = hash(key);
+	size_t mask = table.size() - 1;
+	for (size_t slot = h & mask; table[slot]; slot = (slot + 1) & mask)
+	{
+		uint32_t i = table[slot] - 1;
+		if (hashes[i] == h && strcmp(options[i].name.c_str(), key) == 0)
+			return (int)i;
+	}
+	return -1;
+}
+
+void CCoreOptions::init(const struct retro_variable *vars, const wchar_t *ini_path)
+{
+	clear();
+	path = ini_path ? ini_path : L"";
+
+	for (; vars && vars->key && vars->value; vars++)
+	{
+		// "Description; first|second|third"
+		option opt;
+		opt.name = vars->key;
+		opt.version = 0;
+		opt.seen = 0;
+		const char *semi = strchr(vars->value, ';');
+		if (!semi)
+			continue;
+		opt.description.assign(vars->value, semi - vars->value);
+		const char *list = semi + 1;
+		while (*list == ' ')
+			list++;
+		opt.usevars = list;
+		for (const char *p = list;;)
+		{
+			const char *bar = strchr(p, '|');
+			if (!bar)
+			{
+				opt.values.push_back(p);
+				break;
+			}
+			opt.values.push_back(std::string(p, bar - p));
+			p = bar + 1;
+		}
+		opt.value = opt.values[0];
+		hashes.push_back(hash(opt.name.c_str()));
+		options.push_back(opt);
+	}
+	// duplicate keys probe in insertion order, so the first definition wins
+	build_table();
+
+	FILE *fp = path.empty() ? NULL : _wfopen(path.c_str(), L"r");
+	if (!fp)
+	{
+		// first run, write out the defaults
+		dirty = true;
+		flush();
+		return;
+	}
+	fseek(fp, 0, SEEK_END);
+	int size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	char* data = (char*)malloc(size + 1);
+	size = (int)fread(data, 1, size, fp);
+	data[size] = '\0';
+	fclose(fp);
+	ini_t* ini = ini_load(data, NULL);
+	free(data);
+	for (size_t i = 0; i < options.size(); i++)
+	{
+		int index = ini_find_property(ini, INI_GLOBAL_SECTION, options[i].name.c_str(), (int)options[i].name.size());
+		const char *saved = ini_property_value(ini, INI_GLOBAL_SECTION, index);
+		if (saved)
+			options[i].value = saved;
+		else
+			dirty = true; // option new to this version of the core
+	}
+	ini_destroy(ini);
+}
+
+const CCoreOptions::option* CCoreOptions::find(const char *key) const
+{
+	int i = lookup(key);
+	return i < 0 ? NULL : &options[i];
+}
+
+const char* CCoreOptions::get(const char *key) const
+{
+	int i = lookup(key);
+	return i < 0 ? NULL : options[i].value.c_str();
+}
+
+const char* CCoreOptions::read(const char *key)
+{
+	int i = lookup(key);
+	if (i < 0)
+		return NULL;
+	options[i].seen = generation;
+	return options[i].value.c_str();
+}
+
+bool CCoreOptions::set(const char *key, const char *value)
+{
+	int i = lookup(key);
+	if (i < 0 || !value || options[i].value == value)
+		return false;
+	options[i].value = value;
+	options[i].version = ++generation;
+	dirty = true;
+	return true;
+}
+
+bool CCoreOptions::poll_update()
+{
+	// the per-frame case stays O(1); only a change costs a scan
+	if (reported == generation)
+		return false;
+	bool update = false;
+	for (size_t i = 0; i < options.size() && !update; i++)
+	{
+		const option &opt = options[i];
+		// read by the core, changed since, and not reported already
+		update = opt.seen && opt.version > opt.seen && opt.version > reported;
+	}
+	reported = generation;
+	return update;
+}
+
+std::vector<const CCoreOptions::option*> CCoreOptions::changed_since(unsigned gen) const
+{
+	std::vector<const option*> changed;
+	for (size_t i = 0; i < options.size(); i++)
+		if (options[i].version > gen)
+			changed.push_back(&options[i]);
+	return changed;
+}
+
+bool CCoreOptions::flush()
+{
+	if (!dirty || path.empty())
+		return true;
+	ini_t* ini = ini_create(NULL);
+	for (size_t i = 0; i < options.size(); i++)
+		ini_property_add(ini, INI_GLOBAL_SECTION, options[i].name.c_str(), (int)options[i].name.size(),
+			options[i].value.c_str(), (int)options[i].value.size());
+	int size = ini_save(ini, NULL, 0); // Find the size needed
+	char* data = (char*)malloc(size);
+	size = ini_save(ini, data, size); // Actually save the file
+	ini_destroy(ini);
+	FILE *fp = _wfopen(path.c_str(), L"w");
+	if (fp)
+	{
+		fwrite(data, 1, size, fp);
+		fclose(fp);
+		dirty = false;
+	}
+	free(data);
+	return !dirty;
+}
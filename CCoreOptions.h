@@ -0,0 +1,65 @@
+#ifndef CCOREOPTIONS_H
+#define CCOREOPTIONS_H
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "libretro.h"
+
+// Core options (RETRO_ENVIRONMENT_SET_VARIABLES) parsed once, looked up
+// through an open-addressed hash table. Every change bumps a generation
+// counter and stamps the option with it; GET_VARIABLE_UPDATE reports only
+// options the core has read and that changed since, and the .ini is only
+// rewritten when something was actually changed.
+class CCoreOptions
+{
+public:
+	struct option
+	{
+		std::string name;
+		std::string description;
+		// the raw "a|b|c" list as given by the core
+		std::string usevars;
+		std::vector<std::string> values;
+		std::string value;
+		// generation of the last change to this option
+		unsigned version;
+		// generation when the core last read it, 0 if it never did
+		unsigned seen;
+	};
+
+	CCoreOptions();
+	void clear();
+	// Takes the core's definitions and the saved values from path (if any).
+	void init(const struct retro_variable *vars, const wchar_t *path);
+	const char* get(const char *key) const;
+	// GET_VARIABLE: get() that also records the core has seen the value.
+	const char* read(const char *key);
+	const option* find(const char *key) const;
+	// Returns true if the value actually changed.
+	bool set(const char *key, const char *value);
+	// GET_VARIABLE_UPDATE: true once per batch of changes to options the
+	// core has read; edits to options it never asked for don't count.
+	bool poll_update();
+	// Options changed after generation gen, in definition order.
+	std::vector<const option*> changed_since(unsigned gen) const;
+	// Writes the .ini if anything changed since the last load/flush.
+	bool flush();
+	size_t size() const { return options.size(); }
+	const option& operator[](size_t i) const { return options[i]; }
+	unsigned generation;
+
+private:
+	std::vector<option> options;
+	std::vector<uint32_t> hashes;
+	// slots hold option index + 1, 0 marks an empty slot
+	std::vector<uint32_t> table;
+	unsigned reported;
+	bool dirty;
+	std::wstring path;
+
+	static uint32_t hash(const char *s);
+	int lookup(const char *key) const;
+	void build_table();
+};
+
+#endif
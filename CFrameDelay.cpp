@@ -0,0 +1,55 @@
+#include "stdafx.h"
+#include "CFrameDelay.h"
+
+CFrameDelay::CFrameDelay()
+{
+	enabled = false;
+	margin_usec = 2000.0;
+	reset(1000000.0 / 60.0);
+}
+
+void CFrameDelay::reset(double frame_usec)
+{
+	budget = frame_usec;
+	delay_usec = 0.0;
+	frames = 0;
+	misses = 0;
+	head = 0;
+	backoff = 0;
+	for (unsigned i = 0; i < HISTORY; i++)history[i] = 0.0;
+}
+
+void CFrameDelay::update(double run_usec, bool missed)
+{
+	frames++;
+	history[head] = run_usec;
+	head = (head + 1) % HISTORY;
+	if (missed)
+	{
+		misses++;
+		// drop straight back to running early; the cost window will keep
+		// the spike in view while the delay climbs back up
+		delay_usec = 0.0;
+		backoff = HISTORY / 4;
+		return;
+	}
+	if (backoff)
+	{
+		backoff--;
+		return;
+	}
+	// the worst recent frame, not the average: a frame that overruns the
+	// deadline costs a whole repeated frame, one that runs early costs little
+	double worst = 0.0;
+	for (unsigned i = 0; i < HISTORY; i++)
+		if (history[i] > worst)worst = history[i];
+	double target = budget - worst - margin_usec;
+	if (target < 0.0)target = 0.0;
+	// never spend more than most of the frame waiting
+	if (target > budget * 0.8)target = budget * 0.8;
+	// shrink at once, grow slowly so a single cheap stretch doesn't overshoot
+	if (target < delay_usec)
+		delay_usec = target;
+	else
+		delay_usec += (target - delay_usec) * 0.125;
+}
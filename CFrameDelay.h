@@ -0,0 +1,36 @@
+#ifndef CFRAMEDELAY_H
+#define CFRAMEDELAY_H
+#include <stdint.h>
+
+// Frame delay: instead of running the core right after the previous present
+// and then idling until the next one, idle first and run the core as late as
+// recent frame costs allow, so input is polled closer to when its frame is
+// shown. Fed each frame's cost and whether it made its deadline, it picks
+// how long to wait after a frame boundary before calling retro_run.
+class CFrameDelay
+{
+public:
+	bool enabled;
+	// slack kept between the predicted end of a frame and its deadline
+	double margin_usec;
+	// current wait after the frame boundary
+	double delay_usec;
+	uint64_t frames;
+	uint64_t misses;
+
+	CFrameDelay();
+	void reset(double frame_usec);
+	// Returns the delay to apply to the next frame (0 when disabled).
+	double delay() const { return enabled ? delay_usec : 0.0; }
+	void update(double run_usec, bool missed);
+
+private:
+	enum { HISTORY = 32 };
+	double budget;
+	double history[HISTORY];
+	unsigned head;
+	// frames to hold the delay at zero after a miss
+	unsigned backoff;
+};
+
+#endif
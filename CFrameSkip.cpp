@@ -0,0 +1,43 @@
+#include "stdafx.h"
+#include "CFrameSkip.h"
+
+CFrameSkip::CFrameSkip()
+{
+	enabled = false;
+	max_skip = 3;
+	low_fill = 0.25;
+	reset(1000000.0 / 60.0);
+}
+
+void CFrameSkip::reset(double frame_usec)
+{
+	budget = frame_usec;
+	debt = 0.0;
+	run = 0;
+	skipping = false;
+	frames = 0;
+	skipped = 0;
+}
+
+bool CFrameSkip::update(double spent_usec, double audio_fill)
+{
+	frames++;
+	if (skipping)skipped++;
+	// overruns accumulate, spare time pays them back but never banks credit;
+	// a frame stalled for longer than a second is a hitch, not load
+	debt += spent_usec - budget;
+	if (debt < 0.0)debt = 0.0;
+	if (debt > 1000000.0)debt = 0.0;
+	bool behind = debt > budget * 0.25 || audio_fill < low_fill;
+	if (enabled && behind && run < max_skip)
+	{
+		run++;
+		skipping = true;
+	}
+	else
+	{
+		run = 0;
+		skipping = false;
+	}
+	return skipping;
+}
@@ -0,0 +1,34 @@
+#ifndef CFRAMESKIP_H
+#define CFRAMESKIP_H
+#include <stdint.h>
+
+// Adaptive frameskip. Fed the cost of every frame (core + present) and the
+// audio fifo fill after it, it decides whether the next frame should skip
+// presentation so the emulation catches up before the audio runs dry.
+class CFrameSkip
+{
+public:
+	bool enabled;
+	// never skip more than this many frames in a row
+	unsigned max_skip;
+	// start skipping once the audio fifo is less full than this (0..1)
+	double low_fill;
+	// state of the frame about to run
+	bool skipping;
+	uint64_t frames;
+	uint64_t skipped;
+
+	CFrameSkip();
+	void reset(double frame_usec);
+	// Returns whether the next frame should skip presentation.
+	bool update(double spent_usec, double audio_fill);
+	double skip_rate() const { return frames ? (double)skipped / frames : 0.0; }
+
+private:
+	double budget;
+	// how far behind real time we are, in microseconds
+	double debt;
+	unsigned run;
+};
+
+#endif
@@ -0,0 +1,316 @@
+#include "stdafx.h"
+#include "CInflate.h"
+#include <string.h>
+
+static const uint16_t length_base[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t length_extra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t dist_base[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t dist_extra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+CInflate::CInflate(const uint8_t *in, size_t in_size, uint8_t *out, size_t out_size)
+{
+	init(out, out_size);
+	this->in = in;
+	this->in_size = in_size;
+}
+
+CInflate::CInflate(reader read, void *user, size_t in_size, uint8_t *out, size_t out_size)
+{
+	init(out, out_size);
+	this->read = read;
+	this->user = user;
+	in_left = in_size;
+	window.resize(in_size < WINDOW ? (in_size ? in_size : 1) : WINDOW);
+}
+
+void CInflate::init(uint8_t *out, size_t out_size)
+{
+	this->out = out;
+	this->out_size = out_size;
+	in = NULL;
+	in_size = 0;
+	in_pos = 0;
+	read = NULL;
+	user = NULL;
+	in_left = 0;
+	out_pos = 0;
+	bitbuf = 0;
+	bitcnt = 0;
+	bad = false;
+	done = false;
+}
+
+// once the bytes at hand are used up: the next window, false at the end of
+// the input or on a short read
+bool CInflate::fetch()
+{
+	if (!read || !in_left)return false;
+	size_t want = in_left < window.size() ? in_left : window.size();
+	size_t got = read(user, &window[0], want);
+	if (got != want)
+	{
+		in_left = 0;
+		return false;
+	}
+	in = &window[0];
+	in_size = got;
+	in_pos = 0;
+	in_left -= got;
+	return true;
+}
+
+void CInflate::refill()
+{
+	do
+	{
+		while (bitcnt <= 56 && in_pos < in_size)
+		{
+			bitbuf |= (uint64_t)in[in_pos++] << bitcnt;
+			bitcnt += 8;
+		}
+	} while (bitcnt <= 56 && fetch());
+}
+
+// n <= 16; running out of input sets bad and returns 0
+unsigned CInflate::bits(unsigned n)
+{
+	if (bitcnt < n)
+	{
+		refill();
+		if (bitcnt < n)
+		{
+			bad = true;
+			return 0;
+		}
+	}
+	unsigned v = (unsigned)(bitbuf & ((1u << n) - 1));
+	bitbuf >>= n;
+	bitcnt -= n;
+	return v;
+}
+
+int CInflate::decode(const huffman &h)
+{
+	if (bitcnt < 15)refill();
+	uint16_t e = h.fast[bitbuf & ((1 << FAST_BITS) - 1)];
+	if (e)
+	{
+		unsigned len = e >> 9;
+		if (len > bitcnt)
+		{
+			bad = true;
+			return -1;
+		}
+		bitbuf >>= len;
+		bitcnt -= len;
+		return e & 511;
+	}
+	// longer codes: walk the canonical code a bit at a time (codes are stored MSB first)
+	int code = 0, first = 0, index = 0;
+	for (unsigned len = 1; len < 16; len++)
+	{
+		code |= (int)bits(1);
+		if (bad)return -1;
+		int count = h.count[len];
+		if (code - count < first)
+			return h.symbol[index + (code - first)];
+		index += count;
+		first += count;
+		first <<= 1;
+		code <<= 1;
+	}
+	bad = true;
+	return -1;
+}
+
+bool CInflate::build(huffman &h, const uint8_t *lengths, unsigned n)
+{
+	uint16_t offs[16];
+	uint16_t next_code[16];
+	memset(h.count, 0, sizeof(h.count));
+	for (unsigned sym = 0; sym < n; sym++)
+		h.count[lengths[sym]]++;
+	h.count[0] = 0;
+	// over-subscribed sets can't be decoded; incomplete ones (a single
+	// distance code, say) are legal
+	int left = 1;
+	for (unsigned len = 1; len < 16; len++)
+	{
+		left <<= 1;
+		left -= h.count[len];
+		if (left < 0)return false;
+	}
+	offs[1] = 0;
+	for (unsigned len = 1; len < 15; len++)
+		offs[len + 1] = offs[len] + h.count[len];
+	for (unsigned sym = 0; sym < n; sym++)
+		if (lengths[sym])h.symbol[offs[lengths[sym]]++] = (uint16_t)sym;
+
+	memset(h.fast, 0, sizeof(h.fast));
+	unsigned code = 0;
+	next_code[0] = 0;
+	for (unsigned len = 1; len < 16; len++)
+	{
+		code = (code + h.count[len - 1]) << 1;
+		next_code[len] = (uint16_t)code;
+	}
+	for (unsigned sym = 0; sym < n; sym++)
+	{
+		unsigned len = lengths[sym];
+		if (!len)continue;
+		unsigned c = next_code[len]++;
+		if (len > FAST_BITS)continue;
+		// the stream holds codes MSB first, the bit buffer LSB first
+		unsigned rev = 0;
+		for (unsigned i = 0; i < len; i++)
+			rev |= ((c >> i) & 1) << (len - 1 - i);
+		for (unsigned j = rev; j < (1u << FAST_BITS); j += 1u << len)
+			h.fast[j] = (uint16_t)(sym | (len << 9));
+	}
+	return true;
+}
+
+bool CInflate::stored()
+{
+	// the length fields start on a byte boundary
+	bits(bitcnt & 7);
+	unsigned len = bits(16);
+	unsigned nlen = bits(16);
+	if (bad || len != (~nlen & 0xffff) || len > out_size - out_pos)return false;
+	// bytes the bit buffer already holds, then the rest straight from the input
+	while (len && bitcnt >= 8)
+	{
+		out[out_pos++] = (uint8_t)bitbuf;
+		bitbuf >>= 8;
+		bitcnt -= 8;
+		len--;
+	}
+	while (len)
+	{
+		if (in_pos == in_size && !fetch())return false;
+		size_t n = in_size - in_pos;
+		if (n > len)n = len;
+		memcpy(out + out_pos, in + in_pos, n);
+		in_pos += n;
+		out_pos += n;
+		len -= (unsigned)n;
+	}
+	return true;
+}
+
+bool CInflate::fixed()
+{
+	uint8_t lengths[320];
+	unsigned sym = 0;
+	for (; sym < 144; sym++)lengths[sym] = 8;
+	for (; sym < 256; sym++)lengths[sym] = 9;
+	for (; sym < 280; sym++)lengths[sym] = 7;
+	for (; sym < 288; sym++)lengths[sym] = 8;
+	for (; sym < 320; sym++)lengths[sym] = 5;
+	build(lencode, lengths, 288);
+	build(distcode, lengths + 288, 30);
+	return codes();
+}
+
+bool CInflate::dynamic()
+{
+	static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+	uint8_t lengths[320];
+	unsigned nlen = bits(5) + 257;
+	unsigned ndist = bits(5) + 1;
+	unsigned ncode = bits(4) + 4;
+	if (bad || nlen > 286 || ndist > 30)return false;
+
+	memset(lengths, 0, 19);
+	for (unsigned i = 0; i < ncode; i++)
+		lengths[order[i]] = (uint8_t)bits(3);
+	if (bad || !build(lencode, lengths, 19))return false;
+
+	for (unsigned i = 0; i < nlen + ndist;)
+	{
+		int sym = decode(lencode);
+		if (sym < 0)return false;
+		if (sym < 16)
+		{
+			lengths[i++] = (uint8_t)sym;
+			continue;
+		}
+		uint8_t value = 0;
+		unsigned repeat;
+		if (sym == 16)
+		{
+			if (!i)return false;
+			value = lengths[i - 1];
+			repeat = 3 + bits(2);
+		}
+		else if (sym == 17)repeat = 3 + bits(3);
+		else repeat = 11 + bits(7);
+		if (bad || i + repeat > nlen + ndist)return false;
+		while (repeat--)lengths[i++] = value;
+	}
+	// a block without an end-of-block code can't terminate
+	if (!lengths[256])return false;
+	if (!build(lencode, lengths, nlen) || !build(distcode, lengths + nlen, ndist))return false;
+	return codes();
+}
+
+bool CInflate::codes()
+{
+	for (;;)
+	{
+		int sym = decode(lencode);
+		if (sym < 0)return false;
+		if (sym < 256)
+		{
+			if (out_pos == out_size)return false;
+			out[out_pos++] = (uint8_t)sym;
+			continue;
+		}
+		if (sym == 256)return true;
+		sym -= 257;
+		if (sym >= 29)return false;
+		size_t len = length_base[sym] + bits(length_extra[sym]);
+		int dsym = decode(distcode);
+		if (dsym < 0 || dsym >= 30)return false;
+		size_t dist = dist_base[dsym] + bits(dist_extra[dsym]);
+		if (bad || dist > out_pos || len > out_size - out_pos)return false;
+		uint8_t *dst = out + out_pos;
+		const uint8_t *src = dst - dist;
+		out_pos += len;
+		if (dist >= len)
+			memcpy(dst, src, len);
+		else
+			// overlapping copies repeat the last dist bytes
+			while (len--)*dst++ = *src++;
+	}
+}
+
+int CInflate::block()
+{
+	if (done)return 0;
+	if (bad)return -1;
+	unsigned last = bits(1);
+	unsigned type = bits(2);
+	if (bad)return -1;
+	bool ok;
+	if (type == 0)ok = stored();
+	else if (type == 1)ok = fixed();
+	else if (type == 2)ok = dynamic();
+	else ok = false;
+	if (!ok || bad)
+	{
+		bad = true;
+		return -1;
+	}
+	if (!last)return 1;
+	done = true;
+	return 0;
+}
@@ -0,0 +1,70 @@
+#ifndef CINFLATE_H
+#define CINFLATE_H
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Raw DEFLATE (RFC 1951) decoder for ZIP entries, so deflated archives load
+// without linking zlib. Output goes straight into the whole buffer handed to
+// the core. Input is either a buffer or pulled through a read callback into
+// a fixed 64 KB window, so an entry never needs a second full-size copy.
+// block() decodes one deflate block per call so the caller can checksum what
+// just landed while it is still in cache.
+class CInflate
+{
+public:
+	// fills buf with up to len bytes, returns how many it read
+	typedef size_t (*reader)(void *user, uint8_t *buf, size_t len);
+
+	CInflate(const uint8_t *in, size_t in_size, uint8_t *out, size_t out_size);
+	// reads exactly in_size compressed bytes through read, a window at a time
+	CInflate(reader read, void *user, size_t in_size, uint8_t *out, size_t out_size);
+	// 1 when a block was decoded and more follow, 0 once the final block is
+	// done, -1 for corrupt or truncated input or output that doesn't fit
+	int block();
+	// bytes written to out so far
+	size_t out_pos;
+
+private:
+	enum { FAST_BITS = 10, WINDOW = 64 * 1024 };
+	struct huffman
+	{
+		// codes up to FAST_BITS long, indexed by the next bits of input:
+		// symbol | length << 9, 0 for longer codes
+		uint16_t fast[1 << FAST_BITS];
+		// canonical tables for the slow path
+		uint16_t count[16];
+		uint16_t symbol[288];
+	};
+
+	// the bytes at hand: the whole input, or the current window
+	const uint8_t *in;
+	size_t in_size;
+	size_t in_pos;
+	reader read;
+	void *user;
+	// compressed bytes not read into the window yet
+	size_t in_left;
+	std::vector<uint8_t> window;
+	uint8_t *out;
+	size_t out_size;
+	uint64_t bitbuf;
+	unsigned bitcnt;
+	bool bad;
+	bool done;
+	huffman lencode;
+	huffman distcode;
+
+	void init(uint8_t *out, size_t out_size);
+	bool fetch();
+	void refill();
+	unsigned bits(unsigned n);
+	int decode(const huffman &h);
+	static bool build(huffman &h, const uint8_t *lengths, unsigned n);
+	bool stored();
+	bool fixed();
+	bool dynamic();
+	bool codes();
+};
+
+#endif
@@ -0,0 +1,53 @@
+#include "stdafx.h"
+#include "CLatePoll.h"
+
+CLatePoll::CLatePoll()
+{
+	enabled = false;
+	reset();
+}
+
+void CLatePoll::reset()
+{
+	pending = false;
+	used = false;
+	poll_time = 0;
+	read_time = 0;
+	reset_stats();
+}
+
+void CLatePoll::reset_stats()
+{
+	age_total = 0.0;
+	age_max = 0.0;
+	age_count = 0;
+}
+
+bool CLatePoll::poll(long long now)
+{
+	poll_time = now;
+	// cores often poll at the start of retro_run and only read input much later
+	if (enabled)
+	{
+		pending = true;
+		return false;
+	}
+	return true;
+}
+
+void CLatePoll::read(long long now)
+{
+	pending = false;
+	read_time = now;
+	used = false;
+}
+
+void CLatePoll::state(long long now)
+{
+	if (used || !read_time)return;
+	used = true;
+	double age = (double)(now - read_time);
+	age_total += age;
+	if (age > age_max)age_max = age;
+	age_count++;
+}
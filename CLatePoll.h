@@ -0,0 +1,41 @@
+#ifndef CLATEPOLL_H
+#define CLATEPOLL_H
+#include <stdint.h>
+
+// Late input polling and the input-age figure. With late polling on, the
+// core's input_poll only marks a device read as pending and the read happens
+// on the first input_state of the frame, so the state the core sees is as
+// fresh as it can be. Timestamps are the caller's, in microseconds; the age
+// is how old the device state is when the core first reads it.
+class CLatePoll
+{
+public:
+	bool enabled;
+	// a device read is owed before the core sees any input
+	bool pending;
+	// 0 before the first
+	long long poll_time;
+	long long read_time;
+	// summed until reset_stats
+	double age_total;
+	double age_max;
+	uint64_t age_count;
+
+	CLatePoll();
+	void reset();
+	void reset_stats();
+	// The core called input_poll. Returns whether to read the devices now;
+	// when it doesn't, the read is pending.
+	bool poll(long long now);
+	// The devices were read.
+	void read(long long now);
+	// The core called input_state, after any pending read was done. The
+	// first call after a read counts the state's age.
+	void state(long long now);
+	double age() const { return age_count ? age_total / age_count : 0.0; }
+
+private:
+	bool used;
+};
+
+#endif
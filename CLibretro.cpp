@@ -8,6 +8,9 @@
 #include "gui/utf8conv.h"
 #define INI_IMPLEMENTATION
 #include "ini.h"
+#include <encodings/crc32.h>
+#include "CTrace.h"
+#include "CRomFile.h"
 #include <algorithm>
 using namespace std;
 using namespace utf8util;
@@ -15,25 +18,60 @@ using namespace utf8util;
 #define SAMPLE_COUNT (1024 * 12)
 #define INLINE 
 
-static struct {
-	HMODULE handle;
-	bool initialized;
-
-	void(*retro_init)(void);
-	void(*retro_deinit)(void);
-	unsigned(*retro_api_version)(void);
-	void(*retro_get_system_info)(struct retro_system_info *info);
-	void(*retro_get_system_av_info)(struct retro_system_av_info *info);
-	void(*retro_set_controller_port_device)(unsigned port, unsigned device);
-	void(*retro_reset)(void);
-	void(*retro_run)(void);
-	size_t(*retro_serialize_size)(void);
-	bool(*retro_serialize)(void *data, size_t size);
-	bool(*retro_unserialize)(const void *data, size_t size);
-	bool(*retro_load_game)(const struct retro_game_info *game);
-	//	bool retro_load_game_special(unsigned game_type, const struct retro_game_info *info, size_t num_info);
-	void(*retro_unload_game)(void);
-} g_retro;
+static CLibretro* instances[MAX_CORE_INSTANCES];
+static std::mutex instances_lock;
+
+// libretro callbacks carry no context pointer, so each instance slot gets its
+// own set of static functions that forward to whichever CLibretro owns it.
+template <unsigned N> struct core_trampoline
+{
+	static bool environment(unsigned cmd, void *data) {
+		return instances[N]->core_environment(cmd, data);
+	}
+	static void video_refresh(const void *data, unsigned width, unsigned height, size_t pitch) {
+		instances[N]->core_video_refresh(data, width, height, pitch);
+	}
+	static void input_poll(void) {
+		instances[N]->core_input_poll();
+	}
+	static int16_t input_state(unsigned port, unsigned device, unsigned index, unsigned id) {
+		return instances[N]->core_input_state(port, device, index, id);
+	}
+	static void audio_sample(int16_t left, int16_t right) {
+		instances[N]->core_audio_sample(left, right);
+	}
+	static size_t audio_sample_batch(const int16_t *data, size_t frames) {
+		instances[N]->core_audio_sample_batch(data, frames);
+		return frames;
+	}
+	static void RETRO_CALLCONV perf_register(struct retro_perf_counter *counter) {
+		instances[N]->perf.add(counter);
+	}
+	static void RETRO_CALLCONV perf_log(void) {
+		instances[N]->core_perf_log();
+	}
+};
+
+static const struct {
+	retro_environment_t environment;
+	retro_video_refresh_t video_refresh;
+	retro_input_poll_t input_poll;
+	retro_input_state_t input_state;
+	retro_audio_sample_t audio_sample;
+	retro_audio_sample_batch_t audio_sample_batch;
+	retro_perf_register_t perf_register;
+	retro_perf_log_t perf_log;
+} trampolines[MAX_CORE_INSTANCES] = {
+#define TRAMPOLINE(N) { core_trampoline<N>::environment, core_trampoline<N>::video_refresh, \
+	core_trampoline<N>::input_poll, core_trampoline<N>::input_state, \
+	core_trampoline<N>::audio_sample, core_trampoline<N>::audio_sample_batch, \
+	core_trampoline<N>::perf_register, core_trampoline<N>::perf_log }
+	TRAMPOLINE(0), TRAMPOLINE(1), TRAMPOLINE(2), TRAMPOLINE(3),
+	TRAMPOLINE(4), TRAMPOLINE(5), TRAMPOLINE(6), TRAMPOLINE(7),
+	TRAMPOLINE(8), TRAMPOLINE(9), TRAMPOLINE(10), TRAMPOLINE(11),
+	TRAMPOLINE(12), TRAMPOLINE(13), TRAMPOLINE(14), TRAMPOLINE(15),
+#undef TRAMPOLINE
+};
 
 static mal_uint32 audio_callback(mal_device* pDevice, mal_uint32 frameCount, void* pSamples)
 {
@@ -45,7 +83,7 @@ static mal_uint32 audio_callback(mal_device* pDevice, mal_uint32 frameCount, voi
 }
 
 mal_uint32 Audio::fill_buffer(uint8_t* out, mal_uint32 count) {
-	std::lock_guard<std::mutex> lg(mutex);	
+	std::lock_guard<std::mutex> lg(lock);
 	size_t avail = fifo_read_avail(_fifo);
 	size_t write_size = count > avail ? avail : count;
 	buffer_full.notify_all();
@@ -80,15 +118,27 @@ long long microseconds_now() {
 	}
 }
 
-static retro_time_t frame_limit_minimum_time = 0.0;
-static retro_time_t frame_limit_last_time = 0.0;
+Audio::Audio()
+{
+	_fifo = NULL;
+	input_float = NULL;
+	output_float = NULL;
+	resample = NULL;
+	offline = false;
+	initialized = false;
+	device_open = false;
+	frame_limit_minimum_time = 0;
+	frame_limit_last_time = 0;
+}
 
-bool Audio::init(double refreshra)
+bool Audio::init(double refreshra, const retro_system_av_info *av, bool offline)
 {
-	retro_system_av_info av = { 0 };
-	g_retro.retro_get_system_av_info(&av);
-	system_rate = av.timing.sample_rate;
-	system_fps = av.timing.fps;
+	if (initialized)destroy();
+	this->offline = offline;
+	frame_limit_last_time = microseconds_now();
+	frame_limit_minimum_time = (retro_time_t)roundf(1000000.0f / (av->timing.fps));
+	system_rate = av->timing.sample_rate;
+	system_fps = av->timing.fps;
 	skew = fabs(1.0f - system_fps / refreshra);
 	if (skew >= 0.005)skew = 0.005;
 	if (skew <= 0.005)
@@ -101,34 +151,48 @@ bool Audio::init(double refreshra)
 
 	output_float = new float[SAMPLE_COUNT * 4];
 	input_float = new float[SAMPLE_COUNT];
+	volume = 1.0f;
+	convert_s16_to_float_init_simd();
 
 	resample = resampler_sinc_init(resamp_original);
+	_fifo = fifo_new(SAMPLE_COUNT);
+	initialized = true;
+	if (offline)return true;
 	if (mal_context_init(NULL, 0, NULL, &context) != MAL_SUCCESS) {
 		printf("Failed to initialize context.");
 		return false;
 	}
 	mal_device_config config = mal_device_config_init_playback(mal_format_f32, 2, client_rate, audio_callback);
 	config.bufferSizeInFrames = 2048;
-	_fifo = fifo_new(SAMPLE_COUNT);
 	if (mal_device_init(&context, mal_device_type_playback, NULL, &config, this, &device) != MAL_SUCCESS) {
 		mal_context_uninit(&context);
 		return false;
 	}
+	device_open = true;
 	mal_device_start(&device);
 	frame_limit_last_time = microseconds_now();
-	frame_limit_minimum_time = (retro_time_t)roundf(1000000.0f/ (av.timing.fps));
 
 	return true;
 }
 void Audio::destroy()
 {
+	if (!initialized)return;
+	if (device_open)
 	{
 		mal_device_stop(&device);
+		mal_device_uninit(&device);
 		mal_context_uninit(&context);
-		delete[] input_float;
-		delete[] output_float;
-		resampler_sinc_free(resample);
+		device_open = false;
 	}
+	fifo_free(_fifo);
+	delete[] input_float;
+	delete[] output_float;
+	resampler_sinc_free(resample);
+	_fifo = NULL;
+	input_float = NULL;
+	output_float = NULL;
+	resample = NULL;
+	initialized = false;
 }
 void Audio::reset()
 {
@@ -136,50 +200,98 @@ void Audio::reset()
 }
 
 
-void Audio::sleeplil()
+void Audio::sleeplil(double speed)
 {
-	retro_time_t to_sleep_ms = ((frame_limit_last_time + frame_limit_minimum_time) - microseconds_now()) / 1000;
+	TRACE_SCOPE("sleeplil");
+	if (speed <= 0.0)
+	{
+		frame_limit_last_time = microseconds_now();
+		return;
+	}
+	retro_time_t frame_time = (retro_time_t)(frame_limit_minimum_time / speed);
+	retro_time_t to_sleep_ms = ((frame_limit_last_time + frame_time) - microseconds_now()) / 1000;
 	if (to_sleep_ms > 0)
 	{
 		float sleep_ms = (unsigned)to_sleep_ms;
 		/* Combat jitter a bit. */
-		frame_limit_last_time += frame_limit_minimum_time;
+		frame_limit_last_time += frame_time;
 		Sleep(sleep_ms);
 		return;
 	}
 	frame_limit_last_time = microseconds_now();
 }
 
-void Audio::mix(const int16_t* samples, size_t frames)
+long long Audio::delay_frame(double usec)
 {
+	TRACE_SCOPE("frame_delay");
+	retro_time_t target = frame_limit_last_time + (retro_time_t)usec;
+	retro_time_t left = target - microseconds_now();
+	// Sleep() only has millisecond resolution; give up the last one to a yield loop
+	if (left > 1500)Sleep((DWORD)((left - 1000) / 1000));
+	while (microseconds_now() < target)
+		Sleep(0);
+	return frame_limit_last_time + frame_limit_minimum_time;
+}
+
+double Audio::fill()
+{
+	std::lock_guard<std::mutex> lg(lock);
+	return 1.0 - (double)fifo_write_avail(_fifo) / (_fifo->size - 1);
+}
+
+void Audio::mix(const int16_t* samples, size_t frames, double speed, bool block)
+{
+	TRACE_SCOPE("Audio::mix");
 	uint32_t in_len = frames * 2;
 	int available = fifo_write_avail(_fifo);
 	double drc_ratio = resamp_original *  (1.0 + skew * ((double)(available - SAMPLE_COUNT * 2) / SAMPLE_COUNT));
-	mal_pcm_s16_to_f32(input_float, samples, in_len);
+	if (speed > 1.0)drc_ratio /= speed;
+	{
+		TRACE_SCOPE("convert");
+		convert_s16_to_float(input_float, samples, in_len, volume);
+	}
 
 	struct resampler_data src_data = { 0 };
 	src_data.input_frames = frames;
 	src_data.ratio = drc_ratio;
 	src_data.data_in = input_float;
 	src_data.data_out = output_float;
-	resampler_sinc_process(resample, &src_data);
+	{
+		TRACE_SCOPE("resample");
+		resampler_sinc_process(resample, &src_data);
+	}
 	int out_len = src_data.output_frames * 2 * sizeof(float);
+	if (offline)return;
 
+	TRACE_SCOPE("fifo wait");
 	std::unique_lock<std::mutex> l(lock);
-	buffer_full.wait(l, [this, out_len]() {return out_len < fifo_write_avail(_fifo); });
+	if (!block)
+	{
+		// drop the tail rather than stall; keep whole stereo frames
+		size_t avail = fifo_write_avail(_fifo) & ~(2 * sizeof(float) - 1);
+		if ((size_t)out_len > avail)out_len = (int)avail;
+	}
+	else
+		buffer_full.wait(l, [this, out_len]() {return out_len < fifo_write_avail(_fifo); });
 
 	fifo_write(_fifo, output_float, out_len);
 }
 
-static void core_unload() {
-	if (g_retro.initialized)
-	g_retro.retro_deinit();
-	if (g_retro.handle)
+void CLibretro::core_unload() {
+	if (retro.initialized)
+	retro.retro_deinit();
+	retro.initialized = false;
+	perf.clear();
+	if (retro.handle)
 	{
-		FreeLibrary(g_retro.handle);
-		g_retro.handle = NULL;
+		FreeLibrary(retro.handle);
+		retro.handle = NULL;
+	}
+	if (core_copy_path[0])
+	{
+		DeleteFile(core_copy_path);
+		core_copy_path[0] = 0;
 	}
-	
 }
 
 static void core_log(enum retro_log_level level, const char *fmt, ...) {
@@ -200,117 +312,22 @@ static void core_log(enum retro_log_level level, const char *fmt, ...) {
 }
 
 
+void CLibretro::core_perf_log()
+{
+	fprintf(stdout, "%s", perf.report().c_str());
+}
+
 uintptr_t core_get_current_framebuffer() {
 	return g_video.fbo_id;
 }
 
 #include <Shlwapi.h>
 #pragma comment(lib, "shlwapi.lib")
-#pragma optimize( "", off )  
-void init_coresettings(retro_variable *var)
-{
-	CLibretro * retro = CLibretro::GetSingleton();
-	FILE *fp = NULL;
-	fp = _wfopen(retro->corevar_path, L"r");
-	if (!fp)
-	{
-
-		//create a new file with defaults
-		ini_t* ini = ini_create(NULL);
-		while (var->key && var->value)
-		{
-			CLibretro::core_vars vars_struct;
-			strcpy(vars_struct.name, var->key);
-		   
-			char descript[50] = { 0 };
-			char *e = strchr((char*)var->value, ';');
-			strncpy(descript, var->value, (int)(e - (char*)var->value));
-			strcpy(vars_struct.description,descript);
-
-			char * pch = strstr((char*)var->value, (char*)"; ");
-			pch += strlen("; ");
-			int vars = 0;
-			strcpy(vars_struct.usevars, pch);
-			while (pch != NULL)
-			{
-				char val[255] = { 0 };
-				char* str2 = strstr(pch, (char*)"|");
-				if (!str2)
-				{
-					strcpy(val, pch);
-					break;
-				}
-				strncpy(val, pch, str2 - pch);
-				if (!vars) {
-					strcpy(vars_struct.var,val);
-					ini_property_add(ini, INI_GLOBAL_SECTION, var->key, strlen(var->key), val, strlen(val));
-				}
-				pch += str2 - pch++;
-				vars++;
-				
-			}
-			retro->variables.push_back(vars_struct);
-			++var;
-		}
-		int size = ini_save(ini, NULL, 0); // Find the size needed
-		char* data = (char*)malloc(size);
-		size = ini_save(ini, data, size); // Actually save the file
-		ini_destroy(ini);
-		fp = _wfopen(retro->corevar_path, L"w");
-		fwrite(data, 1, size, fp);
-		fclose(fp);
-		free(data);
-	}
-	else
-	{	
-		fseek(fp, 0, SEEK_END);
-		int size = ftell(fp);
-		fseek(fp, 0, SEEK_SET);
-		char* data = (char*)malloc(size + 1);
-		fread(data, 1, size, fp);
-		data[size] = '\0';
-		fclose(fp);
-		ini_t* ini = ini_load(data, NULL);
-		free(data);
-		while (var->key && var->value)
-		{
-			CLibretro::core_vars vars_struct = { 0 };
-			strcpy(vars_struct.name, var->key);
-			char *e = strchr((char*)var->value, ';');
-			strncpy(vars_struct.description, var->value, (int)(e - var->value));
-			char * pch = strstr((char*)var->value, (char*)"; ");
-			pch += strlen("; ");
-			int vars = 0;
-			strcpy(vars_struct.usevars, pch);
-			int second_index = ini_find_property(ini, INI_GLOBAL_SECTION, (char*)var->key, strlen(var->key));
-			const char* variable_val = ini_property_value(ini, INI_GLOBAL_SECTION, second_index);
-			strcpy(vars_struct.var, variable_val);
-			retro->variables.push_back(vars_struct);
-			++var;
-		}
-		ini_destroy(ini);
-	}
-}
-
-const char* load_coresettings(retro_variable *var)
-{
-	CLibretro *retro = CLibretro::GetSingleton();
-	for (int i = 0; i < retro->variables.size(); i++)
-	{
-		if (strcmp(retro->variables[i].name, var->key) == 0)
-		{
-			return retro->variables[i].var;
-		}
-	}
-	return NULL;
-}
-#pragma optimize( "", on )  
 
 
 
-bool core_environment(unsigned cmd, void *data) {
+bool CLibretro::core_environment(unsigned cmd, void *data) {
 	bool *bval;
-	CLibretro * retro = CLibretro::GetSingleton();
 	input *input_device = input::GetSingleton();
 	switch (cmd) {
 	case RETRO_ENVIRONMENT_SET_MESSAGE: {
@@ -329,29 +346,28 @@ bool core_environment(unsigned cmd, void *data) {
 	case RETRO_ENVIRONMENT_GET_SYSTEM_DIRECTORY: // 9
 	case RETRO_ENVIRONMENT_GET_SAVE_DIRECTORY: // 31
 	{
-		static char *sys_path = NULL;
-		if (!sys_path)
-		{
+		// initialised once, even with several cores asking from their own threads
+		static const string sys_path = []() {
 			TCHAR sys_filename[MAX_PATH] = { 0 };
 			GetCurrentDirectory(MAX_PATH, sys_filename);
 			PathAppend(sys_filename, L"system");
-			string ansi = utf8_from_utf16(sys_filename);
-			sys_path = strdup(ansi.c_str());
-		}
+			return utf8_from_utf16(sys_filename);
+		}();
 		char **ppDir = (char**)data;
-		*ppDir = sys_path;
+		*ppDir = (char*)sys_path.c_str();
 		return true;
 	}
 	break;
 
 	case RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS: // 31
 	{
-		
+		if (headless)
+			return true;
 		
 		char variable_val2[50] = { 0 };
 		Std_File_Reader_u out;
-		lstrcpy(input_device->path, retro->inputcfg_path);
-		if (!out.open(retro->inputcfg_path))
+		lstrcpy(input_device->path, inputcfg_path);
+		if (!out.open(inputcfg_path))
 		{
 			input_device->load(out);
 			out.close();
@@ -393,7 +409,7 @@ bool core_environment(unsigned cmd, void *data) {
 				++var;
 			}
 			Std_File_Writer_u out2;
-			if (!out2.open(retro->inputcfg_path))
+			if (!out2.open(inputcfg_path))
 			{
 				input_device->save(out2);
 				out2.close();
@@ -407,22 +423,20 @@ bool core_environment(unsigned cmd, void *data) {
 
 	case RETRO_ENVIRONMENT_SET_VARIABLES:
 	{
-		struct retro_variable *var = (struct retro_variable *)data;
-		init_coresettings(var);
+		options.init((const struct retro_variable *)data, corevar_path);
 		return true;
 	}
 	break;
 	case RETRO_ENVIRONMENT_GET_VARIABLE:
 	{
 		struct retro_variable * variable = (struct retro_variable*)data;
-		variable->value = load_coresettings(variable);
+		variable->value = options.read(variable->key);
 		return true;
 	}
 	break;
 	case RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE:
 	{
-	*(bool*)data = retro->variables_changed;
-	retro->variables_changed = false;
+	*(bool*)data = options.poll_update();
 	return true;
 	}
 	break;
@@ -431,16 +445,29 @@ bool core_environment(unsigned cmd, void *data) {
 		const enum retro_pixel_format *fmt = (enum retro_pixel_format *)data;
 		if (*fmt > RETRO_PIXEL_FORMAT_RGB565)
 			return false;
+		pixel_format = *fmt;
+		if (headless)return true;
 		return video_set_pixel_format(*fmt);
 	}
 	case RETRO_ENVIRONMENT_SET_HW_RENDER: {
 		struct retro_hw_render_callback *hw = (struct retro_hw_render_callback*)data;
+		if (headless)return false;
 		if (hw->context_type == RETRO_HW_CONTEXT_VULKAN)return false;
 		hw->get_current_framebuffer = core_get_current_framebuffer;
 		hw->get_proc_address = (retro_hw_get_proc_address_t)get_proc;
 		g_video.hw = *hw;
 		return true;
 	}
+	case RETRO_ENVIRONMENT_GET_FASTFORWARDING:
+		// a frame the frameskip throws away may as well be rendered cheaply
+		*(bool*)data = fastforward || frameskip.skipping;
+		return true;
+	case RETRO_ENVIRONMENT_GET_PERF_INTERFACE:
+	{
+		struct retro_perf_callback *cb = (struct retro_perf_callback *)data;
+		CPerf::get_callback(cb, trampolines[slot].perf_register, trampolines[slot].perf_log);
+		return true;
+	}
 	default:
 		core_log(RETRO_LOG_DEBUG, "Unhandled env #%u", cmd);
 		return false;
@@ -449,18 +476,89 @@ bool core_environment(unsigned cmd, void *data) {
 	return false;
 }
 
-static void core_video_refresh(const void *data, unsigned width, unsigned height, size_t pitch) {
+void CLibretro::core_video_refresh(const void *data, unsigned width, unsigned height, size_t pitch) {
+	TRACE_SCOPE("video_refresh");
+	// every frame the core renders, shown or not; dupes and GPU frames have no pixels
+	if (shm && data && data != RETRO_HW_FRAME_BUFFER_VALID)
+	{
+		TRACE_SCOPE("export_video");
+		shm_export_video(shm, frame_count, data, width, height, pitch, pixel_format);
+	}
+	if (skip_present)return;
+	if (headless)
+	{
+		// NULL is a duped frame, keep the previous hash
+		if (!data || data == RETRO_HW_FRAME_BUFFER_VALID)return;
+		size_t row = width * (pixel_format == RETRO_PIXEL_FORMAT_XRGB8888 ? 4 : 2);
+		const uint8_t *line = (const uint8_t*)data;
+		if (headless_video)
+		{
+			TRACE_SCOPE("upload");
+			video_staging.resize(row * height);
+			for (unsigned y = 0; y < height; y++)
+				memcpy(&video_staging[y * row], line + y * pitch, row);
+		}
+		if (!hash_frames)return;
+		uint32_t crc = 0;
+		for (unsigned y = 0; y < height; y++, line += pitch)
+			crc = encoding_crc32(crc, line, row);
+		frame_hash = crc;
+		return;
+	}
 	video_refresh(data, width, height, pitch);
 }
 
 
-static void core_input_poll(void) {
+void CLibretro::core_input_poll(void) {
+	TRACE_SCOPE("input_poll");
+	// playback feeds input_frame from the movie, dinput stays untouched
+	if (headless || movie.playing)return;
+	// in late mode the devices are read on the first input_state instead
+	if (!latepoll.poll(microseconds_now()))return;
+	read_input();
+}
+
+void CLibretro::read_input()
+{
+	TRACE_SCOPE("read_input");
+	latepoll.read(microseconds_now());
 	input *input_device = input::GetSingleton();
 	input_device->poll();
+	if (movie.recording)capture_input();
 }
 
-static int16_t core_input_state(unsigned port, unsigned device, unsigned index, unsigned id) {
+int16_t CLibretro::core_input_state(unsigned port, unsigned device, unsigned index, unsigned id) {
+	if (latepoll.pending)read_input();
+	latepoll.state(microseconds_now());
+	if (net_input_active)
+		return port < 2 && device == RETRO_DEVICE_JOYPAD && id < 16 ? (net_input[port] >> id) & 1 : 0;
 	if (port != 0)return 0;
+	if (movie.playing || movie.recording)return movie_input_state(device, index, id);
+	if (headless)return 0;
+	return live_input_state(device, index, id);
+}
+
+int16_t CLibretro::movie_input_state(unsigned device, unsigned index, unsigned id)
+{
+	if (device == RETRO_DEVICE_JOYPAD)
+		return id < 16 ? (input_frame.buttons >> id) & 1 : 0;
+	if (device == RETRO_DEVICE_ANALOG && index <= RETRO_DEVICE_INDEX_ANALOG_RIGHT && id <= RETRO_DEVICE_ID_ANALOG_Y)
+		return input_frame.analog[index * 2 + id];
+	return 0;
+}
+
+// What the core would read this frame, in the form a movie stores it.
+void CLibretro::capture_input()
+{
+	memset(&input_frame, 0, sizeof(input_frame));
+	if (headless)return;
+	for (unsigned id = 0; id < 16; id++)
+		if (live_input_state(RETRO_DEVICE_JOYPAD, 0, id))input_frame.buttons |= 1 << id;
+	for (unsigned i = 0; i < 4; i++)
+		input_frame.analog[i] = live_input_state(RETRO_DEVICE_ANALOG, i / 2, i % 2);
+}
+
+int16_t CLibretro::live_input_state(unsigned device, unsigned index, unsigned id) {
 	input *input_device = input::GetSingleton();
 	if (input_device && input_device->bl != NULL)
 	{
@@ -526,14 +624,14 @@ bool CLibretro::savestate(TCHAR* filename, bool save)
 	if (isEmulating)
 	{
 		paused = true;
-		size_t size = g_retro.retro_serialize_size();
+		size_t size = retro.retro_serialize_size();
 		if (save)
 		{
 			FILE *Input = _wfopen(filename, L"wb");
 			if (!Input) return(NULL);
 			// Get the filesize
 			BYTE *Memory = (BYTE *)malloc(size);
-			g_retro.retro_serialize(Memory, size);
+			retro.retro_serialize(Memory, size);
 			fwrite(Memory, 1, size, Input);
 			fclose(Input);
 			Input = NULL;
@@ -549,7 +647,7 @@ bool CLibretro::savestate(TCHAR* filename, bool save)
 			fseek(Input, 0, SEEK_SET);
 			BYTE *Memory = (BYTE *)malloc(Size);
 			fread(Memory, 1, Size, Input);
-			g_retro.retro_unserialize(Memory, size);
+			retro.retro_unserialize(Memory, size);
 			if (Input) fclose(Input);
 			Input = NULL;
 			paused = false;
@@ -561,11 +659,12 @@ bool CLibretro::savestate(TCHAR* filename, bool save)
 
 void CLibretro::reset()
 {
-	if(isEmulating)g_retro.retro_reset();
+	if(isEmulating)retro.retro_reset();
 }
 
 size_t CLibretro::core_audio_sample_batch(const int16_t *data, size_t frames)
 {
+	TRACE_SCOPE("audio_sample_batch");
 	if (_samplesCount < SAMPLE_COUNT - frames * 2 + 1)
 	{
 		memcpy(_samples + _samplesCount, data, frames * 2 * sizeof(int16_t));
@@ -575,29 +674,38 @@ size_t CLibretro::core_audio_sample_batch(const int16_t *data, size_t frames)
 }
 
 
-static void core_audio_sample(int16_t left, int16_t right) {
-	CLibretro* lib = CLibretro::GetSingleton();
-	lib->core_audio_sample(left, right);
-}
-
-
-static size_t core_audio_sample_batch(const int16_t *data, size_t frames) {
-	CLibretro* lib = CLibretro::GetSingleton();
-	lib->core_audio_sample_batch(data, frames);
-	return frames;
-}
 
 bool CLibretro::core_load(TCHAR *sofile,bool gamespecificoptions, TCHAR* filename,TCHAR* core_filename) {
 	
-	memset(&g_retro, 0, sizeof(g_retro));
-	g_retro.handle = LoadLibrary(sofile);
-	if (!g_retro.handle)return false;
+	if (slot >= MAX_CORE_INSTANCES)return false;
+	memset(&retro, 0, sizeof(retro));
+	core_copy_path[0] = 0;
+	if (slot)
+	{
+		// LoadLibrary hands back the already mapped module for the same path,
+		// so give every extra instance a private copy of the core and its globals.
+		TCHAR temp_dir[MAX_PATH] = { 0 };
+		GetTempPath(MAX_PATH, temp_dir);
+		swprintf(core_copy_path, MAX_PATH, L"%seinweggerat_%lu_%u_%s", temp_dir,
+			GetCurrentProcessId(), slot, PathFindFileName(sofile));
+		if (!CopyFile(sofile, core_copy_path, FALSE))
+		{
+			core_copy_path[0] = 0;
+			return false;
+		}
+	}
+	retro.handle = LoadLibrary(core_copy_path[0] ? core_copy_path : sofile);
+	if (!retro.handle)
+	{
+		core_unload();
+		return false;
+	}
 
-#define die() do { FreeLibrary(g_retro.handle); return false; } while(0)
-#define libload(name) GetProcAddress(g_retro.handle, name)
-#define load(name) if (!(*(void**)(&g_retro.#name)=(void*)libload(#name))) die()
+#define die() do { core_unload(); return false; } while(0)
+#define libload(name) GetProcAddress(retro.handle, name)
+#define load(name) if (!(*(void**)(&retro.#name)=(void*)libload(#name))) die()
 #define load_sym(V,name) if (!(*(void**)(&V)=(void*)libload(#name))) die()
-#define load_retro_sym(S) load_sym(g_retro.S, S)
+#define load_retro_sym(S) load_sym(retro.S, S)
 	load_retro_sym(retro_init);
 	load_retro_sym(retro_deinit);
 	load_retro_sym(retro_api_version);
@@ -611,6 +719,8 @@ bool CLibretro::core_load(TCHAR *sofile,bool gamespecificoptions, TCHAR* filenam
 	load_retro_sym(retro_serialize);
 	load_retro_sym(retro_unserialize);
 	load_retro_sym(retro_serialize_size);
+	load_retro_sym(retro_get_memory_data);
+	load_retro_sym(retro_get_memory_size);
 	void(*set_environment)(retro_environment_t) = NULL;
 	void(*set_video_refresh)(retro_video_refresh_t) = NULL;
 	void(*set_input_poll)(retro_input_poll_t) = NULL;
@@ -626,8 +736,12 @@ bool CLibretro::core_load(TCHAR *sofile,bool gamespecificoptions, TCHAR* filenam
 	load_sym(set_audio_sample_batch, retro_set_audio_sample_batch);
 
 
+	// for extra instances GetModuleFileName would name the private copy
 	TCHAR core_filename2[MAX_PATH] = { 0 };
-	GetModuleFileNameW(g_retro.handle, core_filename2, sizeof(core_filename2));
+	if (core_copy_path[0])
+		GetFullPathName(sofile, MAX_PATH, core_filename2, NULL);
+	else
+		GetModuleFileNameW(retro.handle, core_filename2, MAX_PATH);
 
 
 	if (gamespecificoptions)
@@ -659,14 +773,14 @@ bool CLibretro::core_load(TCHAR *sofile,bool gamespecificoptions, TCHAR* filenam
 	}
 
 	//set libretro func pointers
-	set_environment(core_environment);
-	set_video_refresh(core_video_refresh);
-	set_input_poll(core_input_poll);
-	set_input_state(core_input_state);
-	set_audio_sample(::core_audio_sample);
-	set_audio_sample_batch(::core_audio_sample_batch);
-	g_retro.retro_init();
-	g_retro.initialized = true;
+	set_environment(trampolines[slot].environment);
+	set_video_refresh(trampolines[slot].video_refresh);
+	set_input_poll(trampolines[slot].input_poll);
+	set_input_state(trampolines[slot].input_state);
+	set_audio_sample(trampolines[slot].audio_sample);
+	set_audio_sample_batch(trampolines[slot].audio_sample_batch);
+	retro.retro_init();
+	retro.initialized = true;
 	return true;
 }
 
@@ -690,6 +804,47 @@ CLibretro* CLibretro::GetSingleton( )
 {
 	return m_Instance ;
 }
+
+CLibretro* CLibretro::CreateHeadless()
+{
+	CLibretro *instance = new CLibretro();
+	if (instance->slot >= MAX_CORE_INSTANCES)
+	{
+		delete instance;
+		return NULL;
+	}
+	instance->headless = true;
+	instance->init(NULL);
+	return instance;
+}
+
+DWORD WINAPI CLibretro::libretro_thread(void* Param)
+{
+	CLibretro *instance = (CLibretro*)Param;
+	char name[32];
+	snprintf(name, sizeof(name), "core %u", instance->slot);
+	CTrace::set_thread_name(name);
+	while (!instance->thread_quit && instance->isEmulating)
+		instance->run();
+	return 0;
+}
+
+bool CLibretro::start_thread()
+{
+	if (!isEmulating || thread_handle)return false;
+	thread_quit = false;
+	thread_handle = CreateThread(NULL, 0, libretro_thread, this, 0, &thread_id);
+	return thread_handle != NULL;
+}
+
+void CLibretro::stop_thread()
+{
+	if (!thread_handle)return;
+	thread_quit = true;
+	WaitForSingleObject(thread_handle, INFINITE);
+	CloseHandle(thread_handle);
+	thread_handle = NULL;
+}
 //////////////////////////////////////////////////////////////////////////////////////////
 
 bool CLibretro::running()
@@ -700,12 +855,49 @@ bool CLibretro::running()
 CLibretro::CLibretro()
 {
 	isEmulating = false;
+	headless = false;
+	hash_frames = false;
+	headless_video = false;
+	headless_audio = false;
+	frame_hash = 0;
+	content_crc = 0;
+	pixel_format = RETRO_PIXEL_FORMAT_0RGB1555;
+	fastforward = false;
+	ff_ratio = 0.0f;
+	ff_present = 4;
+	ff_mute = false;
+	speed = 1.0;
+	skip_present = false;
+	thread_handle = NULL;
+	thread_quit = false;
+	sram = NULL;
+	net_input_active = false;
+	net_input[0] = net_input[1] = 0;
+	shm = NULL;
+	shm_rate = 0;
+	core_copy_path[0] = 0;
+	memset(&retro, 0, sizeof(retro));
+	_samples = NULL;
+	game_loaded = false;
+
+	std::lock_guard<std::mutex> lg(instances_lock);
+	for (slot = 0; slot < MAX_CORE_INSTANCES; slot++)
+	{
+		if (!instances[slot])
+		{
+			instances[slot] = this;
+			break;
+		}
+	}
 }
 
 CLibretro::~CLibretro(void)
 {
 	if (isEmulating)isEmulating = false;
 	kill();
+	free(_samples);
+	std::lock_guard<std::mutex> lg(instances_lock);
+	if (slot < MAX_CORE_INSTANCES)instances[slot] = NULL;
 }
 
 #include <sys/stat.h>
@@ -715,15 +907,19 @@ CLibretro::~CLibretro(void)
 bool CLibretro::loadfile(TCHAR* filename, TCHAR* core_filename,bool gamespecificoptions)
 {
 	if (isEmulating)isEmulating = false;
-	variables.clear();
+	options.clear();
 	struct retro_system_info system = {0};	
-	g_video = { 0 };
-	g_video.hw.version_major = 3;
-	g_video.hw.version_minor = 3;
-	g_video.hw.context_type = RETRO_HW_CONTEXT_NONE;
-	g_video.hw.context_reset = NULL;
-	g_video.hw.context_destroy = NULL;
-	variables_changed = false;
+	if (!headless)
+	{
+		g_video = { 0 };
+		g_video.hw.version_major = 3;
+		g_video.hw.version_minor = 3;
+		g_video.hw.context_type = RETRO_HW_CONTEXT_NONE;
+		g_video.hw.context_reset = NULL;
+		g_video.hw.context_destroy = NULL;
+	}
+	pixel_format = RETRO_PIXEL_FORMAT_0RGB1555;
+	frame_hash = 0;
 
 	if (!core_load(core_filename,gamespecificoptions,filename,core_filename))
 	{
@@ -735,59 +931,65 @@ bool CLibretro::loadfile(TCHAR* filename, TCHAR* core_filename,bool gamespecific
 	string ansi = utf8_from_utf16(filename);
 	strcpy(szFileName, ansi.c_str());
 	struct retro_game_info info = {0};
-	struct stat st;
+	struct stat st = { 0 };
 	stat(szFileName, &st);
 	info.path = szFileName;
 	info.data = NULL;
 	info.size = st.st_size;
 	info.meta = NULL;
 
-	g_retro.retro_get_system_info(&system);
+	retro.retro_get_system_info(&system);
+	// cores that want a path get it as given, archives included; they
+	// open (or unpack) the content themselves
+	CRomFile content;
+	content_crc = 0;
 	if (!system.need_fullpath) {
-		FILE *Input = _wfopen(filename, L"rb");
-		if (!Input)
+		TRACE_SCOPE("load_content");
+		if (!content.load(filename, system.valid_extensions))
 		{
-			printf("FAILED TO LOAD ROMz!!!!!!!!!!!!!!!!!!");
+			printf("FAILED TO LOAD ROM: %s\n", content.error.c_str());
 			return false;
 		}
-		
-		// Get the filesize
-		fseek(Input, 0, SEEK_END);
-		int Size = ftell(Input);
-		fseek(Input, 0, SEEK_SET);
-		BYTE *Memory = (BYTE *)malloc(Size);
-		if (!Memory) return(NULL);
-		if (fread(Memory, 1, Size, Input) != (size_t)Size) return(NULL);
-		if (Input) fclose(Input);
-		Input = NULL;
-		info.data = malloc(info.size);
-		memcpy((BYTE*)info.data, Memory, info.size);
-		free(Memory);
-	}
-	if (!g_retro.retro_load_game(&info))
+		info.data = content.data;
+		info.size = content.size;
+		content_crc = content.crc;
+	}
+	if (!retro.retro_load_game(&info))
 	{
 		printf("FAILED TO LOAD ROM!!!!!!!!!!!!!!!!!!");
 		return false;
 	}
-	if (info.data)free((void*)info.data);
+	game_loaded = true;
+	// cores copy what they need during retro_load_game
+	content.close();
+	// batch jobs and benchmarks leave the player's saves alone
+	if (!headless)sram_open(filename);
 
 	retro_system_av_info av = { 0 };
-	g_retro.retro_get_system_av_info(&av);
+	retro.retro_get_system_av_info(&av);
+	if (!export_name.empty())export_open(av);
 
-	::video_configure(&av.geometry, emulator_hwnd);
+	free(_samples);
+	_samples = (int16_t*)calloc(SAMPLE_COUNT, sizeof(int16_t));
 
-	_samples = (int16_t*)malloc(SAMPLE_COUNT);
-	memset(_samples, 0, SAMPLE_COUNT);
+	if (!headless)
+	{
+		::video_configure(&av.geometry, emulator_hwnd);
 
-	DWM_TIMING_INFO timing_info;
-	timing_info.cbSize = sizeof(timing_info);
-	DwmGetCompositionTimingInfo(NULL, &timing_info);
-	double refreshr = (timing_info.qpcRefreshPeriod) / 1000;
-	_audio.init(refreshr);
+		DWM_TIMING_INFO timing_info;
+		timing_info.cbSize = sizeof(timing_info);
+		DwmGetCompositionTimingInfo(NULL, &timing_info);
+		double refreshr = (timing_info.qpcRefreshPeriod) / 1000;
+		_audio.init(refreshr, &av);
+	}
+	else if (headless_audio)
+		_audio.init(av.timing.fps, &av, true);
+	frameskip.reset(1000000.0 / av.timing.fps);
+	framedelay.reset(1000000.0 / av.timing.fps);
 	frame_count = 0;
 	paused = false;
 	isEmulating = true;
-	lastTime = milliseconds_now()/1000;
+	lastTime = microseconds_now() / 1000000.0;
     nbFrames = 0;
 
 	return true;
@@ -810,31 +1012,200 @@ void CLibretro::splash()
 
 void CLibretro::run()
 {
-	if(isEmulating)
+	TRACE_SCOPE("frame");
+	if(isEmulating && headless)
 	{
+		_samplesCount = 0;
+		if (!paused)
+		{
+			if (movie.playing && !movie.read(input_frame))movie_stop();
+			TRACE_SCOPE("retro_run");
+			retro.retro_run();
+			perf.frame_end();
+			if (movie.recording)movie.write(input_frame);
+			export_audio();
+		}
+		if (headless_audio && _samplesCount)_audio.mix(_samples, _samplesCount / 2);
+		frame_count++;
+	}
+	else if(isEmulating)
+	{
+		// only delay frames that will be shown at normal speed
+		bool delaying = framedelay.enabled && !fastforward && !frameskip.skipping && !paused;
+		long long deadline = delaying ? _audio.delay_frame(framedelay.delay()) : 0;
+		long long frame_start = microseconds_now();
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
 		glClearColor(0, 0, 0, 1);
 		glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
 		_samplesCount = 0;
-		if (!paused)g_retro.retro_run();
-	    if(_samplesCount)_audio.mix(_samples, _samplesCount/2);
-		_audio.sleeplil();
+		skip_present = (fastforward && ff_present > 1 && (frame_count % ff_present) != 0) ||
+			(!fastforward && frameskip.skipping);
+		if (!paused)
+		{
+			if (movie.playing && !movie.read(input_frame))movie_stop();
+			TRACE_SCOPE("retro_run");
+			retro.retro_run();
+			// the core polled but never asked for input; still drain the devices
+			if (latepoll.pending)read_input();
+			perf.frame_end();
+			if (sram)
+			{
+				TRACE_SCOPE("sram_check");
+				autosave_check(sram);
+			}
+			if (movie.recording)movie.write(input_frame);
+			export_audio();
+		}
+		skip_present = false;
+		frame_count++;
+		if (!fastforward)
+		{
+			// time blocked on the audio device is pacing, not load
+			long long frame_end = microseconds_now();
+			double spent = (double)(frame_end - frame_start);
+			if (delaying)framedelay.update(spent, frame_end > deadline);
+			if(_samplesCount)_audio.mix(_samples, _samplesCount/2);
+			// while skipping, let the fifo refill at full speed; mix() still paces us
+			_audio.sleeplil(frameskip.skipping ? 0.0 : 1.0);
+			frameskip.update(spent, _audio.fill());
+		}
+		else
+		{
+			// squeeze audio by the capped (or last measured) speed and never wait on the device
+			double squeeze = ff_ratio > 0.0f ? ff_ratio : speed;
+			if (_samplesCount && !ff_mute)_audio.mix(_samples, _samplesCount / 2, squeeze, false);
+			_audio.sleeplil(ff_ratio);
+		}
 
-			// Measure speed
-			double currentTime = milliseconds_now()/1000;
+			// Measure speed over at least half a second of frames
+			double currentTime = microseconds_now() / 1000000.0;
+			double elapsed = currentTime - lastTime;
 			nbFrames++;
-			if (currentTime - lastTime >= 0.5) { // If last prinf() was more than 1 sec ago
-												 // printf and reset timer
-				TCHAR buffer[100] = { 0 };
-				int len = swprintf(buffer, 100, L"einweggerat: %2f ms/frame\n, %d FPS", 1000.0 / double(nbFrames),nbFrames);
+			if (elapsed >= 0.5) {
+				TCHAR buffer[160] = { 0 };
+				speed = _audio.system_fps > 0 ? nbFrames / elapsed / _audio.system_fps : 1.0;
+				int len = swprintf(buffer, 160, L"einweggerat: %.2f ms/frame, %.1f FPS, %.0f%%%s, %.1f%% skipped, delay %.1f ms (%llu late), input %.1f ms",
+					elapsed * 1000.0 / nbFrames, nbFrames / elapsed, speed * 100.0,
+					fastforward ? L" (fast-forward)" : L"", frameskip.skip_rate() * 100.0,
+					framedelay.delay() / 1000.0, (unsigned long long)framedelay.misses, latepoll.age() / 1000.0);
+				latepoll.reset_stats();
+				input *input_device = input::GetSingleton();
+				if (input_device && input_device->sampler.running())
+				{
+					// time events waited in the sampler queue before a poll picked them up;
+					// swprintf returns -1 once it truncates, leave the title as it is then
+					if (len >= 0 && len < 160)
+						swprintf(buffer + len, 160 - len, L", sampled %.1f ms", input_device->sampler.age() / 1000.0);
+					input_device->sampler.reset_stats();
+				}
 				SetWindowText(emulator_hwnd, buffer);
 				nbFrames = 0;
-				lastTime += 1.0;
+				lastTime = currentTime;
 			}
 		
 	}
 	
 }
+bool CLibretro::movie_record(const TCHAR *path, bool from_power_on)
+{
+	if (!isEmulating)return false;
+	std::vector<uint8_t> state;
+	size_t size = from_power_on ? 0 : retro.retro_serialize_size();
+	if (size)
+	{
+		state.resize(size);
+		if (!retro.retro_serialize(&state[0], size))state.clear();
+	}
+	// without a savestate the closest thing to power-on is a reset
+	if (state.empty())retro.retro_reset();
+	memset(&input_frame, 0, sizeof(input_frame));
+	return movie.record(path, state.empty() ? NULL : &state[0], state.size());
+}
+
+bool CLibretro::movie_play(const TCHAR *path)
+{
+	if (!isEmulating || !movie.play(path))return false;
+	if (movie.state.empty())
+		retro.retro_reset();
+	else if (!retro.retro_unserialize(&movie.state[0], movie.state.size()))
+	{
+		movie.close();
+		return false;
+	}
+	memset(&input_frame, 0, sizeof(input_frame));
+	return true;
+}
+
+void CLibretro::movie_stop()
+{
+	movie.close();
+}
+
+void CLibretro::sram_open(const TCHAR *content)
+{
+	sram_close();
+	void *data = retro.retro_get_memory_data(RETRO_MEMORY_SAVE_RAM);
+	size_t size = retro.retro_get_memory_size(RETRO_MEMORY_SAVE_RAM);
+	if (!data || !size)return;
+	// next to what the core itself saves through GET_SAVE_DIRECTORY
+	TCHAR path[MAX_PATH] = { 0 };
+	TCHAR name[MAX_PATH] = { 0 };
+	lstrcpy(name, content);
+	PathStripPath(name);
+	PathRenameExtension(name, L".srm");
+	GetCurrentDirectory(MAX_PATH, path);
+	PathAppend(path, L"system");
+	CreateDirectory(path, NULL);
+	PathAppend(path, name);
+	sram = autosave_new(data, size, utf8_from_utf16(path).c_str());
+}
+
+void CLibretro::sram_close()
+{
+	if (!sram)return;
+	if (!autosave_flush(sram))
+		printf("Can't write the battery save\n");
+	autosave_free(sram);
+	sram = NULL;
+}
+
+#define EXPORT_VIDEO_SLOTS 8
+#define EXPORT_AUDIO_SLOTS 16
+
+void CLibretro::export_open(const struct retro_system_av_info &av)
+{
+	export_close();
+	// slots sized for the largest frame the core may send
+	size_t frame_size = (size_t)av.geometry.max_width * av.geometry.max_height * 4;
+	shm = shm_export_new(export_name.c_str(), frame_size, EXPORT_VIDEO_SLOTS,
+		SAMPLE_COUNT * sizeof(int16_t), EXPORT_AUDIO_SLOTS);
+	if (!shm)
+		printf("Can't create shared memory %s\n", export_name.c_str());
+	shm_rate = (unsigned)av.timing.sample_rate;
+}
+
+void CLibretro::export_close()
+{
+	shm_export_free(shm);
+	shm = NULL;
+}
+
+// Once a frame: both audio callbacks collect into _samples, so single
+// sample cores publish one batch a frame too.
+void CLibretro::export_audio()
+{
+	if (!shm || !_samplesCount)return;
+	TRACE_SCOPE("export_audio");
+	shm_export_audio(shm, frame_count, _samples, _samplesCount / 2, shm_rate);
+}
+
+void CLibretro::set_fastforward(bool enable)
+{
+	fastforward = enable;
+	// resume pacing from now instead of trying to catch up on skipped sleeps
+	if (!enable && !headless)_audio.sleeplil(0.0);
+}
+
 bool CLibretro::init(HWND hwnd)
 {
 	isEmulating = false;
@@ -844,10 +1215,19 @@ bool CLibretro::init(HWND hwnd)
 
 void CLibretro::kill()
 {
+	stop_thread();
+	if (!retro.initialized)return;
 	isEmulating = false;
+	// a failed loadfile leaves the core initialized but no game or audio
 	_audio.destroy();
-	video_deinit();
-	g_retro.retro_unload_game();
-	g_retro.retro_deinit();
+	if (!headless)video_deinit();
+	movie_stop();
+	// the core's SRAM goes away with the game
+	sram_close();
+	export_close();
+	if (game_loaded)retro.retro_unload_game();
+	game_loaded = false;
+	options.flush();
+	core_unload();
 }
 
@@ -6,11 +6,21 @@
 #include <chrono>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
 #include <audio/audio_resampler.h>
+#include <audio/conversion/s16_to_float.h>
 #include "io/input.h"
+#include "CCoreOptions.h"
+#include "CPerf.h"
+#include "CFrameSkip.h"
+#include "CFrameDelay.h"
+#include "CLatePoll.h"
+#include "CMovie.h"
 #include "io/audio/mini_al.h"
 #include "libretro-common-master/include/queues/fifo_queue.h"
 #include "libretro-common-master/include/rthreads/rthreads.h"
+#include "libretro-common-master/include/file/autosave.h"
+#include "libretro-common-master/include/memmap/shm_export.h"
 
 namespace std
 {
@@ -23,6 +33,11 @@ namespace std
 extern "C" {
 #endif
 
+	struct retro_system_av_info;
+	struct retro_system_info;
+	struct retro_game_info;
+	struct retro_variable;
+
 	void *resampler_sinc_init(double bandwidth_mod);
 	void resampler_sinc_process(void *re_, struct resampler_data *data);
 	void resampler_sinc_free(void *re_);
@@ -31,12 +46,20 @@ extern "C" {
 	{
 	
 	public:
-	bool init(double refreshra);
+	Audio();
+	// offline: convert and resample only, no device or fifo (headless benchmarks)
+	bool init(double refreshra, const retro_system_av_info *av, bool offline = false);
 	void destroy();
 	void reset();
-	void sleeplil();
-	void mix(const int16_t* samples, size_t sample_count);
+	// speed > 1 shortens the frame period, 0 disables pacing entirely
+	void sleeplil(double speed = 1.0);
+	// waits until usec after the last frame boundary, returns the next boundary
+	long long delay_frame(double usec);
+	// speed > 1 time-compresses the audio; without block, whatever doesn't fit is dropped
+	void mix(const int16_t* samples, size_t sample_count, double speed = 1.0, bool block = true);
 	mal_uint32 fill_buffer(uint8_t* pSamples, mal_uint32 samplecount);
+	// how full the output fifo is, 0..1
+	double fill();
 	mal_context context;
 	mal_device device;
 	unsigned client_rate;
@@ -46,6 +69,15 @@ extern "C" {
 	double skew;
 	double system_rate;
 	double resamp_original;
+	float volume;
+	bool offline;
+	// init() allocated the buffers / opened the device; destroy() undoes only what was done
+	bool initialized;
+	bool device_open;
+	// frame pacing for sleeplil/delay_frame, microseconds; per instance since
+	// headless instances pace independently
+	long long frame_limit_minimum_time;
+	long long frame_limit_last_time;
 	void* resample;
 	float *input_float;
 	float *output_float;
@@ -54,35 +86,116 @@ extern "C" {
 	std::condition_variable buffer_full;
 	};
 
+// Upper bound on cores loaded at once; each needs its own set of callback trampolines.
+#define MAX_CORE_INSTANCES 16
+
 class CLibretro
 {
 private:
 	
 	static	CLibretro* m_Instance ;
+	unsigned slot;
+	bool headless;
+	TCHAR core_copy_path[MAX_PATH];
+	void core_unload();
+	// port 0 state of the frame being run, while a movie records or plays
+	CMovie::frame input_frame;
+	int16_t live_input_state(unsigned device, unsigned index, unsigned id);
+	int16_t movie_input_state(unsigned device, unsigned index, unsigned id);
+	void capture_input();
+	void read_input();
+	// battery save, checked every frame and written in the background
+	autosave_t *sram;
+	void sram_open(const TCHAR *content);
+	void sram_close();
+	// frames and audio published for other processes, see export_name
+	shm_export_t *shm;
+	unsigned shm_rate;
+	void export_open(const struct retro_system_av_info &av);
+	void export_close();
+	void export_audio();
 	
 public:
-	struct core_vars
+	struct retro_core
 	{
-		char name[100];
-		char var[100];
-	    char description[256];
-		char usevars[256];
-	};
+		HMODULE handle;
+		bool initialized;
+
+		void(*retro_init)(void);
+		void(*retro_deinit)(void);
+		unsigned(*retro_api_version)(void);
+		void(*retro_get_system_info)(struct retro_system_info *info);
+		void(*retro_get_system_av_info)(struct retro_system_av_info *info);
+		void(*retro_set_controller_port_device)(unsigned port, unsigned device);
+		void(*retro_reset)(void);
+		void(*retro_run)(void);
+		size_t(*retro_serialize_size)(void);
+		bool(*retro_serialize)(void *data, size_t size);
+		bool(*retro_unserialize)(const void *data, size_t size);
+		bool(*retro_load_game)(const struct retro_game_info *game);
+		void(*retro_unload_game)(void);
+		void*(*retro_get_memory_data)(unsigned id);
+		size_t(*retro_get_memory_size)(unsigned id);
+	} retro;
 	TCHAR inputcfg_path[MAX_PATH];
 	TCHAR corevar_path[MAX_PATH];
-	std::vector<core_vars> variables;
-	bool variables_changed;
+	CCoreOptions options;
+	CPerf perf;
 	HANDLE thread_handle;
 	DWORD thread_id;
 	HWND emulator_hwnd;
+	std::atomic<bool> thread_quit;
 	static DWORD WINAPI libretro_thread(void* Param);
 	static CLibretro* CreateInstance(HWND hwnd ) ;
 	static	CLibretro* GetSingleton( ) ;
+	// Extra cores with no window, audio device or input; driven by start_thread().
+	static CLibretro* CreateHeadless();
+	bool start_thread();
+	void stop_thread();
 	CLibretro();
 	~CLibretro();
 	DWORD rate;
 	bool paused;
 	unsigned frame_count;
+	// headless only: CRC32 of the last software-rendered frame, when hash_frames is set
+	bool hash_frames;
+	// headless only: still do the frontend's per-frame work, copying each
+	// frame as an upload would and converting/resampling audio, for benchmarks
+	bool headless_video;
+	bool headless_audio;
+	// shared memory segment to publish every frame and its audio into,
+	// set before loadfile(); empty for none
+	std::string export_name;
+	std::vector<uint8_t> video_staging;
+	uint32_t frame_hash;
+	// CRC32 of the loaded content, 0 when the core loads it from a path
+	uint32_t content_crc;
+	unsigned pixel_format;
+	// fast-forward: ff_ratio caps the speed (0 = unlimited), only every
+	// ff_present'th frame is shown and audio is muted or time-compressed
+	bool fastforward;
+	float ff_ratio;
+	unsigned ff_present;
+	bool ff_mute;
+	// achieved speed relative to the core's nominal fps, updated twice a second
+	double speed;
+	void set_fastforward(bool enable);
+	// skips presentation when frames run over budget or audio runs low
+	CFrameSkip frameskip;
+	// runs the core late in the frame to cut input latency
+	CFrameDelay framedelay;
+	// defers the device read from input_poll to the first input_state of the
+	// frame and tracks how old the state is then, on microseconds_now()
+	CLatePoll latepoll;
+	// Both ports' joypads as the rollback session (--netplay) hands them
+	// over; replaces dinput and movies while set.
+	bool net_input_active;
+	uint16_t net_input[2];
+	// Input movies; playback replaces dinput for port 0 entirely.
+	CMovie movie;
+	bool movie_record(const TCHAR *path, bool from_power_on);
+	bool movie_play(const TCHAR *path);
+	void movie_stop();
 	bool running();
 	bool loadfile(TCHAR* filename, TCHAR* core_filename, bool gamespecificoptions);
 	void splash();
@@ -94,14 +207,22 @@ public:
 	bool savestate(TCHAR* filename, bool save = false);
 	void kill();
 	BOOL isEmulating;
+	bool core_environment(unsigned cmd, void *data);
+	void core_video_refresh(const void *data, unsigned width, unsigned height, size_t pitch);
+	void core_input_poll();
+	int16_t core_input_state(unsigned port, unsigned device, unsigned index, unsigned id);
 	void core_audio_sample(int16_t left, int16_t right);
 	size_t core_audio_sample_batch(const int16_t *data, size_t frames);
+	void core_perf_log();
 	int16_t*                        _samples;
 	size_t                          _samplesCount;
 	Audio  _audio;
+	// retro_load_game succeeded; kill() only unloads what was loaded
+	bool game_loaded;
 
 	double lastTime;
     int nbFrames;
+	bool skip_present;
 };
 
 #ifdef __cplusplus
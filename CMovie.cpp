@@ -0,0 +1,197 @@
+#include "stdafx.h"
+#include "CMovie.h"
+#include <string.h>
+
+#define MOVIE_VERSION 1
+#define MOVIE_HEADER_SIZE 16
+#define MOVIE_FLAG_SAVESTATE 1
+
+enum
+{
+	CHANGED_BUTTONS = 1 << 0,
+	CHANGED_ANALOG = 1 << 1, // four bits, one per axis
+};
+
+static void put_u16(FILE *fp, uint16_t v)
+{
+	uint8_t b[2] = { (uint8_t)v, (uint8_t)(v >> 8) };
+	fwrite(b, 1, 2, fp);
+}
+
+static void put_u32(FILE *fp, uint32_t v)
+{
+	uint8_t b[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+	fwrite(b, 1, 4, fp);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+CMovie::CMovie()
+{
+	fp = NULL;
+	recording = false;
+	playing = false;
+	frames = 0;
+	repeat = 0;
+	pos = 0;
+	memset(&prev, 0, sizeof(prev));
+}
+
+CMovie::~CMovie()
+{
+	close();
+}
+
+bool CMovie::record(const wchar_t *path, const void *anchor, size_t state_size)
+{
+	close();
+	fp = _wfopen(path, L"wb");
+	if (!fp)
+		return false;
+	fwrite("EWMV", 1, 4, fp);
+	put_u16(fp, MOVIE_VERSION);
+	put_u16(fp, anchor && state_size ? MOVIE_FLAG_SAVESTATE : 0);
+	put_u32(fp, 0); // frame count, patched by close()
+	put_u32(fp, anchor ? (uint32_t)state_size : 0);
+	if (anchor && state_size)
+		fwrite(anchor, 1, state_size, fp);
+	memset(&prev, 0, sizeof(prev));
+	frames = 0;
+	repeat = 0;
+	recording = true;
+	return true;
+}
+
+void CMovie::flush_repeat()
+{
+	if (!repeat)
+		return;
+	fputc(0, fp);
+	for (uint32_t v = repeat; ; v >>= 7)
+	{
+		if (v < 0x80)
+		{
+			fputc((int)v, fp);
+			break;
+		}
+		fputc((int)(v & 0x7f) | 0x80, fp);
+	}
+	repeat = 0;
+}
+
+void CMovie::write(const frame &f)
+{
+	if (!recording)
+		return;
+	uint8_t mask = 0;
+	if (f.buttons != prev.buttons)mask |= CHANGED_BUTTONS;
+	for (int i = 0; i < 4; i++)
+		if (f.analog[i] != prev.analog[i])mask |= CHANGED_ANALOG << i;
+	frames++;
+	if (!mask)
+	{
+		repeat++;
+		return;
+	}
+	flush_repeat();
+	fputc(mask, fp);
+	if (mask & CHANGED_BUTTONS)put_u16(fp, f.buttons);
+	for (int i = 0; i < 4; i++)
+		if (mask & (CHANGED_ANALOG << i))put_u16(fp, (uint16_t)f.analog[i]);
+	prev = f;
+}
+
+bool CMovie::play(const wchar_t *path)
+{
+	close();
+	FILE *in = _wfopen(path, L"rb");
+	if (!in)
+		return false;
+	fseek(in, 0, SEEK_END);
+	long size = ftell(in);
+	fseek(in, 0, SEEK_SET);
+	data.resize(size > 0 ? size : 0);
+	size_t got = data.empty() ? 0 : fread(&data[0], 1, data.size(), in);
+	fclose(in);
+	if (got < MOVIE_HEADER_SIZE || memcmp(&data[0], "EWMV", 4) || (data[4] | (data[5] << 8)) != MOVIE_VERSION)
+		return false;
+	frames = get_u32(&data[8]);
+	uint32_t state_size = get_u32(&data[12]);
+	if (MOVIE_HEADER_SIZE + (size_t)state_size > got)
+		return false;
+	state.assign(data.begin() + MOVIE_HEADER_SIZE, data.begin() + MOVIE_HEADER_SIZE + state_size);
+	pos = MOVIE_HEADER_SIZE + state_size;
+	memset(&prev, 0, sizeof(prev));
+	repeat = 0;
+	playing = true;
+	return true;
+}
+
+bool CMovie::read(frame &f)
+{
+	if (!playing || !frames)
+		return false;
+	frames--;
+	if (repeat)
+	{
+		repeat--;
+		f = prev;
+		return true;
+	}
+	if (pos >= data.size())
+		return false;
+	uint8_t mask = data[pos++];
+	if (!mask)
+	{
+		uint32_t v = 0;
+		for (int shift = 0; pos < data.size() && shift < 35; shift += 7)
+		{
+			uint8_t b = data[pos++];
+			v |= (uint32_t)(b & 0x7f) << shift;
+			if (!(b & 0x80))
+				break;
+		}
+		// this frame is the first of the run
+		repeat = v ? v - 1 : 0;
+		f = prev;
+		return true;
+	}
+	size_t need = 2 * ((mask & CHANGED_BUTTONS ? 1 : 0) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1) + ((mask >> 4) & 1));
+	if (pos + need > data.size())
+		return false;
+	if (mask & CHANGED_BUTTONS)
+	{
+		prev.buttons = data[pos] | (data[pos + 1] << 8);
+		pos += 2;
+	}
+	for (int i = 0; i < 4; i++)
+	{
+		if (mask & (CHANGED_ANALOG << i))
+		{
+			prev.analog[i] = (int16_t)(data[pos] | (data[pos + 1] << 8));
+			pos += 2;
+		}
+	}
+	f = prev;
+	return true;
+}
+
+void CMovie::close()
+{
+	if (recording && fp)
+	{
+		flush_repeat();
+		fseek(fp, 8, SEEK_SET);
+		put_u32(fp, frames);
+	}
+	if (fp)
+		fclose(fp);
+	fp = NULL;
+	recording = false;
+	playing = false;
+	data.clear();
+	data.shrink_to_fit();
+}
@@ -0,0 +1,49 @@
+#ifndef CMOVIE_H
+#define CMOVIE_H
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+// Input movies: one snapshot of port 0 per frame, delta-encoded so idle
+// stretches cost a couple of bytes. A movie starts either from power-on
+// (the core is reset) or from a savestate stored in the file header.
+//
+// File layout (little endian):
+//   "EWMV" u16 version u16 flags u32 frames u32 state_size state[state_size]
+//   then per frame a change mask; 0 is followed by a varint count of
+//   repeated frames, otherwise the changed fields follow in mask order.
+class CMovie
+{
+public:
+	struct frame
+	{
+		uint16_t buttons; // RETRO_DEVICE_ID_JOYPAD_* bits
+		int16_t analog[4]; // left x/y, right x/y
+	};
+
+	CMovie();
+	~CMovie();
+	bool record(const wchar_t *path, const void *state, size_t state_size);
+	bool play(const wchar_t *path);
+	void write(const frame &f);
+	// false once the movie has run out
+	bool read(frame &f);
+	void close();
+	bool recording;
+	bool playing;
+	// frames recorded so far, or left to play
+	uint32_t frames;
+	// savestate the movie starts from, empty for power-on
+	std::vector<uint8_t> state;
+
+private:
+	FILE *fp;
+	frame prev;
+	uint32_t repeat;
+	std::vector<uint8_t> data;
+	size_t pos;
+
+	void flush_repeat();
+};
+
+#endif
@@ -0,0 +1,131 @@
+#include "stdafx.h"
+#include "CPerf.h"
+#include <features/features_cpu.h>
+#include <stdio.h>
+#include <algorithm>
+
+static void RETRO_CALLCONV perf_start(struct retro_perf_counter *counter)
+{
+	counter->call_cnt++;
+	counter->start = cpu_features_get_perf_counter();
+}
+
+static void RETRO_CALLCONV perf_stop(struct retro_perf_counter *counter)
+{
+	counter->total += cpu_features_get_perf_counter() - counter->start;
+}
+
+CPerf::CPerf()
+{
+	clear();
+}
+
+void CPerf::get_callback(struct retro_perf_callback *cb,
+	retro_perf_register_t perf_register, retro_perf_log_t perf_log)
+{
+	cb->get_time_usec = cpu_features_get_time_usec;
+	cb->get_cpu_features = cpu_features_get;
+	cb->get_perf_counter = cpu_features_get_perf_counter;
+	cb->perf_register = perf_register;
+	cb->perf_start = perf_start;
+	cb->perf_stop = perf_stop;
+	cb->perf_log = perf_log;
+}
+
+void CPerf::add(struct retro_perf_counter *counter)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	if (counter->registered)
+		return;
+	stats s = { counter->ident ? counter->ident : "", counter,
+		counter->total, counter->call_cnt, 0, 0, 0, UINT64_MAX, 0, 0 };
+	counters.push_back(s);
+	counter->registered = true;
+}
+
+void CPerf::frame_end()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	frames++;
+	for (size_t i = 0; i < counters.size(); i++)
+	{
+		stats &s = counters[i];
+		uint64_t calls = s.counter->call_cnt - s.prev_calls;
+		uint64_t ticks = s.counter->total - s.prev_total;
+		s.prev_calls = s.counter->call_cnt;
+		s.prev_total = s.counter->total;
+		s.last_frame = ticks;
+		if (!calls)
+			continue;
+		s.calls += calls;
+		s.ticks += ticks;
+		s.frames++;
+		s.min_frame = std::min(s.min_frame, ticks);
+		s.max_frame = std::max(s.max_frame, ticks);
+	}
+}
+
+void CPerf::clear()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	counters.clear();
+	frames = 0;
+	start_usec = cpu_features_get_time_usec();
+	start_ticks = cpu_features_get_perf_counter();
+}
+
+bool CPerf::empty()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return counters.empty();
+}
+
+// The tick source is rdtsc or a monotonic clock depending on platform,
+// so calibrate it against wall time over the life of the session.
+double CPerf::ticks_per_usec()
+{
+	retro_time_t usec = cpu_features_get_time_usec() - start_usec;
+	retro_perf_tick_t ticks = cpu_features_get_perf_counter() - start_ticks;
+	if (usec <= 0 || !ticks)
+		return 1.0;
+	return (double)ticks / (double)usec;
+}
+
+std::string CPerf::report()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	double scale = 1.0 / ticks_per_usec();
+	std::string out;
+	char line[512];
+	snprintf(line, sizeof(line), "%-32s %10s %10s %10s %10s %10s %12s\n",
+		"counter", "calls/frm", "avg us", "min us", "max us", "last us", "total ms");
+	out += line;
+	for (size_t i = 0; i < counters.size(); i++)
+	{
+		const stats &s = counters[i];
+		uint64_t n = s.frames ? s.frames : 1;
+		snprintf(line, sizeof(line), "%-32.32s %10.2f %10.2f %10.2f %10.2f %10.2f %12.2f\n",
+			s.ident.c_str(), (double)s.calls / n,
+			s.ticks * scale / n,
+			s.frames ? s.min_frame * scale : 0.0,
+			s.max_frame * scale,
+			s.last_frame * scale,
+			s.ticks * scale / 1000.0);
+		out += line;
+	}
+	snprintf(line, sizeof(line), "%llu frames, %.1f ticks/us\n",
+		(unsigned long long)frames, 1.0 / scale);
+	out += line;
+	return out;
+}
+
+bool CPerf::dump(const wchar_t *path)
+{
+	FILE *fp = _wfopen(path, L"w");
+	if (!fp)
+		return false;
+	std::string text = report();
+	fwrite(text.c_str(), 1, text.size(), fp);
+	fclose(fp);
+	return true;
+}
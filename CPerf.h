@@ -0,0 +1,52 @@
+#ifndef CPERF_H
+#define CPERF_H
+#include <string>
+#include <vector>
+#include <mutex>
+#include <stdint.h>
+#include "libretro.h"
+
+// Frontend side of RETRO_ENVIRONMENT_GET_PERF_INTERFACE. Cores register
+// their RETRO_PERFORMANCE_* counters here; after every retro_run the
+// counters are sampled so the report shows per-frame cost, not just totals.
+class CPerf
+{
+public:
+	struct stats
+	{
+		std::string ident;
+		struct retro_perf_counter *counter;
+		uint64_t prev_total;
+		uint64_t prev_calls;
+		uint64_t ticks;
+		uint64_t calls;
+		// frames the counter was started in, and its per-frame extremes
+		uint64_t frames;
+		uint64_t min_frame;
+		uint64_t max_frame;
+		uint64_t last_frame;
+	};
+
+	CPerf();
+	// Fills the stateless entries of cb; register/log are per instance.
+	static void get_callback(struct retro_perf_callback *cb,
+		retro_perf_register_t perf_register, retro_perf_log_t perf_log);
+	void add(struct retro_perf_counter *counter);
+	void frame_end();
+	// Counters point into the core, drop them before it is unloaded.
+	void clear();
+	bool empty();
+	std::string report();
+	bool dump(const wchar_t *path);
+	uint64_t frames;
+
+private:
+	std::mutex lock;
+	std::vector<stats> counters;
+	retro_time_t start_usec;
+	retro_perf_tick_t start_ticks;
+
+	double ticks_per_usec();
+};
+
+#endif
@@ -0,0 +1,357 @@
+#include "stdafx.h"
+#include "CRomFile.h"
+#include "CInflate.h"
+#include "gui/utf8conv.h"
+#include <encodings/crc32.h>
+#include <string.h>
+#include <stdlib.h>
+#include <wctype.h>
+#include <vector>
+#ifdef HAVE_7ZIP
+#include <file/archive_file.h>
+#include <lists/string_list.h>
+#endif
+
+using namespace std;
+using namespace utf8util;
+
+// big enough to keep the disk busy, small enough to stay in L2 for the CRC
+#define CHUNK_SIZE (256 * 1024)
+
+#define ZIP_LOCAL_HEADER 0x04034b50
+#define ZIP_CENTRAL_HEADER 0x02014b50
+#define ZIP_END_OF_DIRECTORY 0x06054b50
+
+static uint32_t le16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+static uint32_t le32(const uint8_t *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+
+// CInflate's window refill
+static size_t read_file(void *fp, uint8_t *buf, size_t len) { return fread(buf, 1, len, (FILE*)fp); }
+
+static bool has_ext(const wchar_t *path, const wchar_t *ext)
+{
+	const wchar_t *dot = wcsrchr(path, L'.');
+	if (!dot)return false;
+	for (dot++; *dot && *ext; dot++, ext++)
+		if (towlower(*dot) != *ext)return false;
+	return !*dot && !*ext;
+}
+
+// "a.zip#b/c.sfc" -> "a.zip", "b/c.sfc"; the '#' must follow an archive extension
+static bool split_archive_path(const wchar_t *path, wstring &archive, string &name)
+{
+	const wchar_t *hash = NULL;
+	for (const wchar_t *p = path; *p; p++)
+	{
+		if (*p != L'#')continue;
+		wstring head(path, p - path);
+		if (has_ext(head.c_str(), L"zip") || has_ext(head.c_str(), L"7z"))
+		{
+			hash = p;
+			break;
+		}
+	}
+	if (!hash)
+	{
+		archive = path;
+		name.clear();
+	}
+	else
+	{
+		archive.assign(path, hash - path);
+		name = utf8_from_utf16(hash + 1);
+	}
+	return has_ext(archive.c_str(), L"zip") || has_ext(archive.c_str(), L"7z");
+}
+
+static bool ext_matches(const string &name, const char *valid_exts)
+{
+	if (!name.empty() && (name.back() == '/' || name.back() == '\\'))return false;
+	if (!valid_exts || !*valid_exts)return true;
+	size_t dot = name.rfind('.');
+	if (dot == string::npos)return false;
+	string ext = name.substr(dot + 1);
+	for (const char *p = valid_exts; *p;)
+	{
+		const char *end = strchr(p, '|');
+		size_t len = end ? (size_t)(end - p) : strlen(p);
+		if (len == ext.size() && !_strnicmp(p, ext.c_str(), len))return true;
+		if (!end)break;
+		p = end + 1;
+	}
+	return false;
+}
+
+CRomFile::CRomFile()
+{
+	data = NULL;
+	size = 0;
+	crc = 0;
+}
+
+CRomFile::~CRomFile()
+{
+	close();
+}
+
+void CRomFile::close()
+{
+	free(data);
+	data = NULL;
+	size = 0;
+	crc = 0;
+	entry.clear();
+}
+
+bool CRomFile::is_archive(const wchar_t *path)
+{
+	wstring archive;
+	string name;
+	return split_archive_path(path, archive, name);
+}
+
+bool CRomFile::load(const wchar_t *path, const char *valid_exts)
+{
+	close();
+	error.clear();
+	wstring archive;
+	string name;
+	bool is_arc = split_archive_path(path, archive, name);
+	if (is_arc && has_ext(archive.c_str(), L"7z"))
+		return load_7z(archive, name, valid_exts);
+
+	FILE *fp = _wfopen(archive.c_str(), L"rb");
+	if (!fp)
+	{
+		error = "can't open " + utf8_from_utf16(archive.c_str());
+		return false;
+	}
+	bool ok;
+	if (is_arc)
+		ok = load_zip(fp, name, valid_exts);
+	else
+	{
+		fseek(fp, 0, SEEK_END);
+		long len = ftell(fp);
+		fseek(fp, 0, SEEK_SET);
+		ok = len >= 0 && read_into(fp, (size_t)len);
+		if (!ok && error.empty())error = "read error";
+	}
+	fclose(fp);
+	if (!ok)
+	{
+		string keep = error;
+		close();
+		error = keep;
+	}
+	return ok;
+}
+
+// Reads len bytes at the current position into a new data buffer.
+bool CRomFile::read_into(FILE *fp, size_t len)
+{
+	data = (uint8_t*)malloc(len ? len : 1);
+	if (!data)
+	{
+		error = "out of memory";
+		return false;
+	}
+	size = len;
+	crc = 0;
+	for (size_t pos = 0; pos < len;)
+	{
+		size_t want = len - pos < CHUNK_SIZE ? len - pos : CHUNK_SIZE;
+		size_t got = fread(data + pos, 1, want, fp);
+		if (got != want)
+		{
+			error = "short read";
+			return false;
+		}
+		crc = encoding_crc32(crc, data + pos, got);
+		pos += got;
+	}
+	return true;
+}
+
+bool CRomFile::load_zip(FILE *fp, const string &name, const char *valid_exts)
+{
+	// the end of central directory record sits in the last 64k + 22 bytes
+	fseek(fp, 0, SEEK_END);
+	long file_size = ftell(fp);
+	long tail_size = file_size < 0x10000 + 22 ? file_size : 0x10000 + 22;
+	if (tail_size < 22)
+	{
+		error = "not a zip archive";
+		return false;
+	}
+	vector<uint8_t> tail(tail_size);
+	fseek(fp, file_size - tail_size, SEEK_SET);
+	if (fread(&tail[0], 1, tail_size, fp) != (size_t)tail_size)
+	{
+		error = "short read";
+		return false;
+	}
+	long eocd = -1;
+	for (long i = tail_size - 22; i >= 0; i--)
+	{
+		if (le32(&tail[i]) == ZIP_END_OF_DIRECTORY && i + 22 + (long)le16(&tail[i + 20]) == tail_size)
+		{
+			eocd = i;
+			break;
+		}
+	}
+	if (eocd < 0)
+	{
+		error = "no zip directory";
+		return false;
+	}
+	uint32_t dir_size = le32(&tail[eocd + 12]);
+	uint32_t dir_offset = le32(&tail[eocd + 16]);
+	// fseek takes a long, 32 bits on Win32: compare in 64 bits before seeking
+	if ((uint64_t)dir_offset + dir_size > (uint64_t)file_size)
+	{
+		error = "zip directory out of range (zip64 is not supported)";
+		return false;
+	}
+
+	// only the directory is read up front; entry data is read once, into place
+	vector<uint8_t> dir(dir_size + 1);
+	fseek(fp, dir_offset, SEEK_SET);
+	if (fread(&dir[0], 1, dir_size, fp) != dir_size)
+	{
+		error = "short read";
+		return false;
+	}
+	const uint8_t *found = NULL;
+	for (uint32_t pos = 0; pos + 46 <= dir_size && le32(&dir[pos]) == ZIP_CENTRAL_HEADER;)
+	{
+		const uint8_t *h = &dir[pos];
+		uint32_t name_len = le16(h + 28);
+		if (pos + 46 + name_len > dir_size)break;
+		string entry_name((const char*)h + 46, name_len);
+		if (name.empty() ? ext_matches(entry_name, valid_exts) : entry_name == name)
+		{
+			found = h;
+			entry = entry_name;
+			break;
+		}
+		pos += 46 + name_len + le16(h + 30) + le16(h + 32);
+	}
+	if (!found)
+	{
+		error = name.empty() ? "no usable file in archive" : "\"" + name + "\" is not in the archive";
+		return false;
+	}
+
+	unsigned flags = le16(found + 8);
+	unsigned method = le16(found + 10);
+	uint32_t expect_crc = le32(found + 16);
+	uint32_t csize = le32(found + 20);
+	uint32_t usize = le32(found + 24);
+	uint32_t local = le32(found + 42);
+	if (flags & 1)
+	{
+		error = "encrypted zip entries are not supported";
+		return false;
+	}
+	uint8_t lh[30];
+	if ((uint64_t)local + 30 > (uint64_t)file_size)
+	{
+		error = "zip entry out of range";
+		return false;
+	}
+	fseek(fp, (long)local, SEEK_SET);
+	if (fread(lh, 1, 30, fp) != 30 || le32(lh) != ZIP_LOCAL_HEADER)
+	{
+		error = "bad zip local header";
+		return false;
+	}
+	uint64_t start = (uint64_t)local + 30 + le16(lh + 26) + le16(lh + 28);
+	if (start + csize > (uint64_t)file_size)
+	{
+		error = "zip entry out of range";
+		return false;
+	}
+	fseek(fp, (long)start, SEEK_SET);
+
+	if (method == 0)
+	{
+		if (!read_into(fp, usize))return false;
+	}
+	else if (method == 8)
+	{
+		// the compressed entry streams through CInflate's 64 KB window and
+		// inflates straight into data
+		data = (uint8_t*)malloc(usize ? usize : 1);
+		if (!data)
+		{
+			error = "out of memory";
+			return false;
+		}
+		size = usize;
+		crc = 0;
+		CInflate inflater(read_file, fp, csize, data, usize);
+		int ret;
+		do
+		{
+			size_t from = inflater.out_pos;
+			ret = inflater.block();
+			// checksum what just landed while it is still in cache
+			if (ret >= 0)crc = encoding_crc32(crc, data + from, inflater.out_pos - from);
+		} while (ret > 0);
+		if (ret < 0 || inflater.out_pos != usize)
+		{
+			error = "corrupt deflate stream";
+			return false;
+		}
+	}
+	else
+	{
+		error = "unsupported zip compression method";
+		return false;
+	}
+	if (crc != expect_crc)
+	{
+		error = "CRC mismatch in " + entry;
+		return false;
+	}
+	return true;
+}
+
+bool CRomFile::load_7z(const wstring &archive, const string &name, const char *valid_exts)
+{
+#ifdef HAVE_7ZIP
+	// the 7z SDK decodes whole solid blocks into its own cache, so this path
+	// can't avoid one copy; it still skips the temp file
+	string path = utf8_from_utf16(archive.c_str());
+	string want = name;
+	if (want.empty())
+	{
+		struct string_list *list = file_archive_get_file_list(path.c_str(), valid_exts);
+		if (list && list->size)want = list->elems[0].data;
+		if (list)string_list_free(list);
+	}
+	if (want.empty())
+	{
+		error = "no usable file in archive";
+		return false;
+	}
+	string full = path + "#" + want;
+	void *buf = NULL;
+	ssize_t len = 0;
+	if (!file_archive_compressed_read(full.c_str(), &buf, NULL, &len) || len < 0 || !buf)
+	{
+		free(buf);
+		error = "can't extract \"" + want + "\"";
+		return false;
+	}
+	data = (uint8_t*)buf;
+	size = (size_t)len;
+	crc = encoding_crc32(0, data, size);
+	entry = want;
+	return true;
+#else
+	error = "7z archives need a build with HAVE_7ZIP";
+	return false;
+#endif
+}
@@ -0,0 +1,39 @@
+#ifndef CROMFILE_H
+#define CROMFILE_H
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+
+// Game content for retro_load_game: a plain file, or one entry of a ZIP
+// archive named "archive.zip#path/in/archive" (without a name, the first
+// entry with one of the core's extensions). Plain files and stored ZIP
+// entries are read straight into the buffer handed to the core, deflated
+// ones are inflated into it by CInflate, reading the compressed entry in
+// 64 KB windows, with the CRC32 computed on each chunk as it lands: no
+// temp files and no second full-size buffer. 7z archives need a build
+// with HAVE_7ZIP and the 7z SDK (the switch libretro-common's archive_file
+// uses), which the shipped project doesn't enable.
+class CRomFile
+{
+public:
+	CRomFile();
+	~CRomFile();
+	// valid_exts is the core's "ext|ext" list and may be NULL
+	bool load(const wchar_t *path, const char *valid_exts);
+	void close();
+	static bool is_archive(const wchar_t *path);
+
+	uint8_t *data;
+	size_t size;
+	uint32_t crc;
+	// the entry that was loaded, empty for plain files
+	std::string entry;
+	std::string error;
+
+private:
+	bool read_into(FILE *fp, size_t len);
+	bool load_zip(FILE *fp, const std::string &name, const char *valid_exts);
+	bool load_7z(const std::wstring &archive, const std::string &name, const char *valid_exts);
+};
+
+#endif
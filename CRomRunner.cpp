@@ -0,0 +1,882 @@
+#include "stdafx.h"
+#include <windows.h>
+#include <psapi.h>
+#include "CRomRunner.h"
+#include "CLibretro.h"
+#include "cmdline.h"
+#include "CTrace.h"
+#include "gui/utf8conv.h"
+#include <dynamic/core_info_cache.h>
+#include <memmap/ram_search.h>
+#include <net/net_rollback.h>
+#include <encodings/crc32.h>
+#include <lists/dir_list.h>
+#include <lists/string_list.h>
+#include <Shlwapi.h>
+#include <algorithm>
+#include <sstream>
+#include <thread>
+#pragma comment(lib, "psapi.lib")
+#pragma comment(lib, "shlwapi.lib")
+#pragma comment(lib, "ws2_32.lib")
+using namespace std;
+using namespace utf8util;
+
+long long microseconds_now();
+
+CRomRunner::CRomRunner()
+{
+	frames = 600;
+	until_hash = 0;
+	timeout_ms = 120 * 1000;
+}
+
+bool CRomRunner::add_dir(const char *dir, const char *exts)
+{
+	struct string_list *list = dir_list_new(dir, (exts && *exts) ? exts : NULL,
+		false, false, false, true);
+	if (!list)return false;
+	for (size_t i = 0; i < list->size; i++)
+	{
+		job j;
+		j.rom = list->elems[i].data;
+		pending.push_back(j);
+	}
+	dir_list_free(list);
+	return true;
+}
+
+bool CRomRunner::add_manifest(const char *path)
+{
+	FILE *fp = fopen(path, "r");
+	if (!fp)return false;
+	char line[4096];
+	while (fgets(line, sizeof(line), fp))
+	{
+		size_t len = strlen(line);
+		while (len && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+			line[--len] = 0;
+		if (!len || line[0] == '#')continue;
+		job j;
+		j.rom = line;
+		pending.push_back(j);
+	}
+	fclose(fp);
+	return true;
+}
+
+bool CRomRunner::pop(unsigned worker, job &out)
+{
+	{
+		worker_queue *own = queues[worker];
+		lock_guard<mutex> lg(own->lock);
+		if (!own->jobs.empty())
+		{
+			out = own->jobs.front();
+			own->jobs.pop_front();
+			return true;
+		}
+	}
+	// Own queue ran dry: take from the far end of another worker's queue, so
+	// a worker stuck on a slow ROM doesn't hold back the ones queued behind it.
+	for (unsigned i = 1; i < queues.size(); i++)
+	{
+		worker_queue *victim = queues[(worker + i) % queues.size()];
+		lock_guard<mutex> lg(victim->lock);
+		if (!victim->jobs.empty())
+		{
+			out = victim->jobs.back();
+			victim->jobs.pop_back();
+			return true;
+		}
+	}
+	return false;
+}
+
+CRomRunner::result CRomRunner::run_child(const job &j, unsigned worker_index)
+{
+	result r = result();
+	r.rom = j.rom;
+
+	TCHAR exe[MAX_PATH] = { 0 };
+	GetModuleFileName(NULL, exe, MAX_PATH);
+	TCHAR result_path[MAX_PATH] = { 0 };
+	GetTempPath(MAX_PATH, result_path);
+	TCHAR result_name[64] = { 0 };
+	swprintf(result_name, 64, L"einweggerat_job_%lu_%u.txt", GetCurrentProcessId(), worker_index);
+	PathAppend(result_path, result_name);
+	DeleteFile(result_path);
+
+	wostringstream cmd;
+	cmd << L"\"" << exe << L"\" --run-job --core \"" << utf16_from_utf8(core)
+		<< L"\" --rom \"" << utf16_from_utf8(j.rom) << L"\" --frames " << frames
+		<< L" --until-hash " << until_hash << L" --result \"" << result_path << L"\"";
+	wstring command = cmd.str();
+
+	// cores log to stdout; keep several of them from interleaving with the report
+	SECURITY_ATTRIBUTES sa = { sizeof(sa), NULL, TRUE };
+	HANDLE nul = CreateFile(L"NUL", GENERIC_WRITE, FILE_SHARE_WRITE, &sa, OPEN_EXISTING, 0, NULL);
+	STARTUPINFO si = { 0 };
+	si.cb = sizeof(si);
+	si.dwFlags = STARTF_USESTDHANDLES;
+	si.hStdOutput = nul;
+	si.hStdError = nul;
+	PROCESS_INFORMATION pi = { 0 };
+	if (!CreateProcess(NULL, &command[0], NULL, NULL, TRUE, CREATE_NO_WINDOW, NULL, NULL, &si, &pi))
+	{
+		CloseHandle(nul);
+		r.crashed = true;
+		return r;
+	}
+	CloseHandle(nul);
+
+	if (WaitForSingleObject(pi.hProcess, timeout_ms) == WAIT_TIMEOUT)
+	{
+		TerminateProcess(pi.hProcess, ERROR_TIMEOUT);
+		WaitForSingleObject(pi.hProcess, INFINITE);
+		r.timed_out = true;
+	}
+	GetExitCodeProcess(pi.hProcess, &r.exit_code);
+	PROCESS_MEMORY_COUNTERS pmc = { 0 };
+	pmc.cb = sizeof(pmc);
+	if (GetProcessMemoryInfo(pi.hProcess, &pmc, sizeof(pmc)))
+		r.peak_rss = pmc.PeakWorkingSetSize;
+	CloseHandle(pi.hThread);
+	CloseHandle(pi.hProcess);
+
+	// the child only writes its result once it got through every frame
+	FILE *fp = _wfopen(result_path, L"r");
+	if (fp)
+	{
+		int loaded = 0;
+		if (fscanf(fp, "%d %lf %u %lf %u", &loaded, &r.load_ms, &r.frames, &r.fps, &r.frame_hash) == 5)
+			r.loaded = loaded != 0;
+		fclose(fp);
+		DeleteFile(result_path);
+		r.crashed = !r.timed_out && r.loaded && r.exit_code != 0;
+	}
+	else
+		r.crashed = !r.timed_out;
+	return r;
+}
+
+void CRomRunner::worker(unsigned index)
+{
+	job j;
+	while (pop(index, j))
+	{
+		result r = run_child(j, index);
+		lock_guard<mutex> lg(results_lock);
+		results.push_back(r);
+		printf("[%u/%u] %s: %s, %.1f fps\n", (unsigned)results.size(), (unsigned)pending.size(),
+			r.rom.c_str(), r.timed_out ? "timeout" : r.crashed ? "crashed" : r.loaded ? "ok" : "load failed", r.fps);
+	}
+}
+
+void CRomRunner::run(unsigned workers)
+{
+	if (!workers)workers = 1;
+	results.clear();
+	queues.clear();
+	for (unsigned i = 0; i < workers; i++)
+		queues.push_back(new worker_queue);
+	for (size_t i = 0; i < pending.size(); i++)
+		queues[i % workers]->jobs.push_back(pending[i]);
+
+	vector<thread> threads;
+	for (unsigned i = 0; i < workers; i++)
+		threads.push_back(thread(&CRomRunner::worker, this, i));
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+
+	for (size_t i = 0; i < queues.size(); i++)
+		delete queues[i];
+	queues.clear();
+	sort(results.begin(), results.end(), [](const result &a, const result &b) { return a.rom < b.rom; });
+}
+
+bool CRomRunner::write_report(const char *path)
+{
+	FILE *fp = fopen(path, "w");
+	if (!fp)return false;
+	fprintf(fp, "rom,status,load_ms,frames,fps,peak_rss_kb,frame_hash\n");
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const result &r = results[i];
+		fprintf(fp, "\"%s\",%s,%.2f,%u,%.2f,%llu,%08x\n", r.rom.c_str(),
+			r.timed_out ? "timeout" : r.crashed ? "crashed" : r.loaded ? "ok" : "load_failed",
+			r.load_ms, r.frames, r.fps, (unsigned long long)(r.peak_rss / 1024), r.frame_hash);
+	}
+	fclose(fp);
+	return true;
+}
+
+static void set_core_directory()
+{
+	TCHAR core_dir[MAX_PATH] = { 0 };
+	GetCurrentDirectory(MAX_PATH, core_dir);
+	PathAppend(core_dir, L"cores");
+	SetDllDirectory(core_dir);
+}
+
+int rom_runner_main(int argc, char **argv)
+{
+	cmdline::parser a;
+	a.add("batch", 0, "run every ROM of --dir or --manifest headless");
+	a.add<string>("core", 'c', "core filename", true, "");
+	a.add<string>("dir", 'd', "ROM directory, searched recursively", false, "");
+	a.add<string>("ext", 'e', "ROM extensions to pick up from --dir, '|' separated", false, "");
+	a.add<string>("manifest", 'm', "text file with one ROM path per line", false, "");
+	a.add<unsigned>("frames", 'n', "frames to run per ROM", false, 600);
+	a.add<string>("until-hash", 0, "stop a ROM early once its frame CRC32 matches", false, "0");
+	a.add<unsigned>("jobs", 'j', "worker processes, 0 for one per CPU", false, 0);
+	a.add<unsigned>("timeout", 't', "seconds before a ROM counts as hung", false, 120);
+	a.add<string>("out", 'o', "CSV report", false, "rom_report.csv");
+	a.parse_check(argc, argv);
+
+	CRomRunner runner;
+	TCHAR core_path[MAX_PATH] = { 0 };
+	set_core_directory();
+	// children may run from elsewhere, so pin down a core given relative to here;
+	// bare names are left for the cores directory lookup
+	wstring core = utf16_from_utf8(a.get<string>("core"));
+	if (PathFileExists(core.c_str()))
+		GetFullPathName(core.c_str(), MAX_PATH, core_path, NULL);
+	else
+		lstrcpy(core_path, core.c_str());
+	runner.core = utf8_from_utf16(core_path);
+	runner.frames = a.get<unsigned>("frames");
+	runner.until_hash = strtoul(a.get<string>("until-hash").c_str(), NULL, 0);
+	runner.timeout_ms = a.get<unsigned>("timeout") * 1000;
+
+	if (a.exist("dir") && !runner.add_dir(a.get<string>("dir").c_str(), a.get<string>("ext").c_str()))
+	{
+		printf("Can't read ROM directory %s\n", a.get<string>("dir").c_str());
+		return 2;
+	}
+	if (a.exist("manifest") && !runner.add_manifest(a.get<string>("manifest").c_str()))
+	{
+		printf("Can't read manifest %s\n", a.get<string>("manifest").c_str());
+		return 2;
+	}
+
+	unsigned jobs = a.get<unsigned>("jobs");
+	if (!jobs)jobs = max(1u, thread::hardware_concurrency());
+	runner.run(jobs);
+	if (!runner.write_report(a.get<string>("out").c_str()))
+		printf("Can't write report %s\n", a.get<string>("out").c_str());
+
+	unsigned failed = 0;
+	for (size_t i = 0; i < runner.results.size(); i++)
+		if (runner.results[i].crashed || runner.results[i].timed_out)failed++;
+	printf("%u ROMs, %u crashed or hung\n", (unsigned)runner.results.size(), failed);
+	return failed ? 1 : 0;
+}
+
+int core_list_main(int argc, char **argv)
+{
+	cmdline::parser a;
+	a.add("list-cores", 0, "list the cores of a directory and the content they take");
+	a.add<string>("dir", 'd', "core directory", false, "cores");
+	a.add<string>("cache", 0, "core info cache, kept in the core directory by default", false, "");
+	a.add<unsigned>("jobs", 'j', "cores probed at once, 0 for one per CPU", false, 0);
+	a.add<unsigned>("timeout", 't', "seconds before a core probe counts as hung", false, 10);
+	a.parse_check(argc, argv);
+
+	string dir = a.get<string>("dir");
+	string cache_path = a.get<string>("cache");
+	if (cache_path.empty())
+		cache_path = dir + "\\core_info.cache";
+
+	long long start = microseconds_now();
+	core_info_cache_stats_t stats;
+	core_info_cache_t *cache = core_info_cache_load(cache_path.c_str());
+	if (!cache || !core_info_cache_refresh(cache, dir.c_str(), NULL, a.get<unsigned>("jobs"),
+		a.get<unsigned>("timeout") * 1000, &stats))
+	{
+		printf("Can't read core directory %s\n", dir.c_str());
+		core_info_cache_free(cache);
+		return 2;
+	}
+	if ((stats.probed || stats.removed) && !core_info_cache_save(cache, cache_path.c_str()))
+		printf("Can't write core info cache %s\n", cache_path.c_str());
+	double elapsed_ms = (microseconds_now() - start) / 1000.0;
+
+	for (size_t i = 0; i < core_info_cache_count(cache); i++)
+	{
+		const core_info_cache_entry_t *e = core_info_cache_get(cache, i);
+		const char *path = core_info_cache_string(cache, e->path);
+		if (!(e->flags & CORE_INFO_CACHE_VALID))
+		{
+			printf("%s: not a working libretro core\n", path);
+			continue;
+		}
+		printf("%s: %s %s [%s]%s%s\n", path, core_info_cache_string(cache, e->library_name),
+			core_info_cache_string(cache, e->library_version),
+			core_info_cache_string(cache, e->valid_extensions),
+			e->flags & CORE_INFO_CACHE_NEED_FULLPATH ? " need_fullpath" : "",
+			e->flags & CORE_INFO_CACHE_BLOCK_EXTRACT ? " block_extract" : "");
+	}
+	printf("%u cores, %u probed (%u failed), %u from cache, %.1f ms\n",
+		stats.cores, stats.probed, stats.failed, stats.reused, elapsed_ms);
+	core_info_cache_free(cache);
+	return 0;
+}
+
+int rom_runner_job(int argc, char **argv)
+{
+	cmdline::parser a;
+	a.add("run-job", 0, "run one ROM for the batch runner");
+	a.add<string>("core", 0, "core filename", true, "");
+	a.add<string>("rom", 0, "rom filename", true, "");
+	a.add<unsigned>("frames", 0, "frames to run", false, 600);
+	a.add<unsigned>("until-hash", 0, "stop once the frame CRC32 matches", false, 0);
+	a.add<string>("result", 0, "result file", true, "");
+	a.add<string>("perf", 0, "write the core's performance counters to this file", false, "");
+	a.add<string>("trace", 0, "write a frame trace to this file (.json or .pftrace)", false, "");
+	a.add<string>("movie", 0, "feed input from this movie", false, "");
+	if (!a.parse(argc, argv))return 2;
+	string trace = a.get<string>("trace");
+	if (!trace.empty())CTrace::start();
+
+	// a crashing core should end this process, not wait on an error dialog
+	SetErrorMode(SEM_FAILCRITICALERRORS | SEM_NOGPFAULTERRORBOX | SEM_NOOPENFILEERRORBOX);
+	set_core_directory();
+
+	unsigned frames = a.get<unsigned>("frames");
+	uint32_t until_hash = a.get<unsigned>("until-hash");
+	wstring rom = utf16_from_utf8(a.get<string>("rom"));
+	wstring core = utf16_from_utf8(a.get<string>("core"));
+	CLibretro *emulator = CLibretro::CreateHeadless();
+	emulator->hash_frames = until_hash != 0;
+
+	long long start = microseconds_now();
+	bool loaded = emulator->loadfile((TCHAR*)rom.c_str(), (TCHAR*)core.c_str(), false);
+	double load_ms = (microseconds_now() - start) / 1000.0;
+	if (loaded && !a.get<string>("movie").empty() &&
+		!emulator->movie_play(utf16_from_utf8(a.get<string>("movie")).c_str()))
+		loaded = false;
+
+	unsigned done = 0;
+	start = microseconds_now();
+	while (loaded && done < frames)
+	{
+		if (done == frames - 1)emulator->hash_frames = true;
+		emulator->run();
+		done++;
+		if (until_hash && emulator->frame_hash == until_hash)break;
+	}
+	double elapsed = (microseconds_now() - start) / 1000000.0;
+
+	FILE *fp = _wfopen(utf16_from_utf8(a.get<string>("result")).c_str(), L"w");
+	if (fp)
+	{
+		fprintf(fp, "%d %f %u %f %u\n", loaded ? 1 : 0, load_ms, done,
+			elapsed > 0 ? done / elapsed : 0.0, emulator->frame_hash);
+		fclose(fp);
+	}
+	if (loaded && !a.get<string>("perf").empty())
+		emulator->perf.dump(utf16_from_utf8(a.get<string>("perf")).c_str());
+	if (!trace.empty())
+	{
+		CTrace::stop();
+		CTrace::save(trace.c_str());
+	}
+	delete emulator;
+	return loaded ? 0 : 1;
+}
+
+static string json_escape(const string &s)
+{
+	string out;
+	for (size_t i = 0; i < s.size(); i++)
+	{
+		char c = s[i];
+		if (c == '"' || c == '\\')out += '\\';
+		if ((unsigned char)c >= 0x20)out += c;
+	}
+	return out;
+}
+
+// "addr[:8|:16|:32][s],..." with addresses in decimal or 0x hex, 8 bits
+// unsigned unless told otherwise.
+static ram_watch_t *parse_watch(const string &spec, size_t frames, vector<string> &names)
+{
+	ram_watch_t *watch = ram_watch_new(frames);
+	if (!watch)
+		return NULL;
+	stringstream ss(spec);
+	string item;
+	while (getline(ss, item, ','))
+	{
+		char *end = NULL;
+		unsigned long addr = strtoul(item.c_str(), &end, 0);
+		unsigned bits = 8;
+		if (*end == ':')
+			bits = strtoul(end + 1, &end, 10);
+		unsigned flags = 0;
+		if (*end == 's')
+		{
+			flags = RAM_SEARCH_SIGNED;
+			end++;
+		}
+		if (end == item.c_str() || *end || ram_watch_add(watch, addr, bits / 8, flags) < 0)
+		{
+			fprintf(stderr, "Bad watch %s\n", item.c_str());
+			ram_watch_free(watch);
+			return NULL;
+		}
+		names.push_back(item);
+	}
+	return watch;
+}
+
+static bool save_watch(const char *path, const ram_watch_t *watch, const vector<string> &names)
+{
+	FILE *fp = fopen(path, "w");
+	if (!fp)
+		return false;
+	fputs("frame", fp);
+	for (size_t i = 0; i < names.size(); i++)
+		fprintf(fp, ",%s", names[i].c_str());
+	fputs("\n", fp);
+	for (size_t f = 0; f < ram_watch_frames(watch); f++)
+	{
+		fprintf(fp, "%u", (unsigned)f);
+		for (unsigned i = 0; i < ram_watch_count(watch); i++)
+		{
+			uint32_t v = ram_watch_get(watch, i, f);
+			if (names[i][names[i].size() - 1] == 's')
+				fprintf(fp, ",%d", (int)v);
+			else
+				fprintf(fp, ",%u", (unsigned)v);
+		}
+		fputs("\n", fp);
+	}
+	fclose(fp);
+	return true;
+}
+
+// --benchmark --instances N: the same ROM in 1, 2, 4 .. N headless cores at once,
+// each free-running on its own thread, to see how throughput scales with cores
+static int benchmark_instances(cmdline::parser &a)
+{
+	unsigned count = min<unsigned>(a.get<unsigned>("instances"), MAX_CORE_INSTANCES);
+	unsigned warmup = a.get<unsigned>("warmup");
+	unsigned seconds = max(1u, a.get<unsigned>("seconds"));
+	wstring rom = utf16_from_utf8(a.get<string>("rom"));
+	wstring core = utf16_from_utf8(a.get<string>("core"));
+
+	ostringstream json;
+	json << "{\n\"core\": \"" << json_escape(a.get<string>("core")) << "\",\n"
+		<< "\"rom\": \"" << json_escape(a.get<string>("rom")) << "\",\n"
+		<< "\"seconds\": " << seconds << ", \"warmup\": " << warmup << ",\n"
+		<< "\"video\": " << (a.exist("no-video") ? "false" : "true")
+		<< ", \"audio\": " << (a.exist("no-audio") ? "false" : "true") << ",\n"
+		<< "\"instances\": [";
+	vector<unsigned> steps;
+	for (unsigned n = 1; n < count; n *= 2)steps.push_back(n);
+	steps.push_back(count);
+	bool ok = true;
+	string error;
+	for (size_t step = 0; step < steps.size() && ok; step++)
+	{
+		unsigned n = steps[step];
+		vector<CLibretro*> cores;
+		for (unsigned i = 0; i < n && ok; i++)
+		{
+			CLibretro *emulator = CLibretro::CreateHeadless();
+			if (!emulator)
+			{
+				fprintf(stderr, "Out of core slots at %u instances\n", i);
+				error = "no free core slot";
+				ok = false;
+				break;
+			}
+			cores.push_back(emulator);
+			emulator->headless_video = !a.exist("no-video");
+			emulator->headless_audio = !a.exist("no-audio");
+			if (!emulator->loadfile((TCHAR*)rom.c_str(), (TCHAR*)core.c_str(), false))
+			{
+				fprintf(stderr, "Can't load %s with %s\n", a.get<string>("rom").c_str(), a.get<string>("core").c_str());
+				error = "can't load the ROM with this core";
+				ok = false;
+				break;
+			}
+			for (unsigned f = 0; f < warmup; f++)
+				emulator->run();
+		}
+		if (ok)
+		{
+			vector<unsigned> before(n);
+			for (unsigned i = 0; i < n; i++)before[i] = cores[i]->frame_count;
+			long long start = microseconds_now();
+			for (unsigned i = 0; i < n; i++)cores[i]->start_thread();
+			Sleep(seconds * 1000);
+			for (unsigned i = 0; i < n; i++)cores[i]->stop_thread();
+			double elapsed = (microseconds_now() - start) / 1000000.0;
+			// the threads are joined, so frame_count is safe to read
+			unsigned long long frames = 0;
+			unsigned slowest = ~0u;
+			for (unsigned i = 0; i < n; i++)
+			{
+				unsigned ran = cores[i]->frame_count - before[i];
+				frames += ran;
+				slowest = min(slowest, ran);
+			}
+			double fps = elapsed > 0 ? frames / elapsed : 0.0;
+			char buf[256];
+			snprintf(buf, sizeof(buf), "%s\n{\"count\": %u, \"frames\": %llu, \"fps\": %.2f, \"fps_per_instance\": %.2f, \"slowest_fps\": %.2f}",
+				step ? "," : "", n, frames, fps, fps / n, elapsed > 0 ? slowest / elapsed : 0.0);
+			json << buf;
+		}
+		for (size_t i = 0; i < cores.size(); i++)delete cores[i];
+	}
+	json << "\n]";
+	if (!error.empty())json << ",\n\"error\": \"" << json_escape(error) << "\"";
+	json << "\n}\n";
+
+	string out = a.get<string>("out");
+	FILE *fp = out.empty() ? stdout : fopen(out.c_str(), "w");
+	if (!fp)
+	{
+		fprintf(stderr, "Can't write report %s\n", out.c_str());
+		return 2;
+	}
+	fputs(json.str().c_str(), fp);
+	if (fp != stdout)fclose(fp);
+	return ok ? 0 : 1;
+}
+
+int rom_runner_benchmark(int argc, char **argv)
+{
+	cmdline::parser a;
+	a.add("benchmark", 0, "time one ROM headless and report as JSON");
+	a.add<string>("core", 'c', "core filename", true, "");
+	a.add<string>("rom", 'r', "rom filename", true, "");
+	a.add<unsigned>("frames", 'n', "frames to time per run", false, 3000);
+	a.add<unsigned>("warmup", 'w', "frames to run before timing", false, 300);
+	a.add<unsigned>("repeat", 'k', "how many times to load and time the ROM", false, 1);
+	a.add("no-video", 0, "skip the per-frame video copy");
+	a.add("no-audio", 0, "skip audio conversion and resampling");
+	a.add<string>("movie", 0, "feed input from this movie", false, "");
+	a.add<string>("out", 'o', "JSON report, stdout if not given", false, "");
+	a.add<string>("watch", 0, "system RAM values to sample every timed frame: addr[:8|:16|:32][s],...", false, "");
+	a.add<string>("watch-out", 0, "CSV of the watched values over the last run", false, "watch.csv");
+	a.add<string>("export", 0, "publish frames and audio into shared memory under this name", false, "");
+	a.add<unsigned>("instances", 0, "run 1, 2, 4 .. N copies on their own threads and report the summed fps", false, 0);
+	a.add<unsigned>("seconds", 0, "how long each --instances step runs", false, 5);
+	a.parse_check(argc, argv);
+
+	SetErrorMode(SEM_FAILCRITICALERRORS | SEM_NOGPFAULTERRORBOX | SEM_NOOPENFILEERRORBOX);
+	set_core_directory();
+	if (a.get<unsigned>("instances"))
+		return benchmark_instances(a);
+	unsigned frames = max(1u, a.get<unsigned>("frames"));
+	unsigned warmup = a.get<unsigned>("warmup");
+	unsigned repeat = max(1u, a.get<unsigned>("repeat"));
+	wstring rom = utf16_from_utf8(a.get<string>("rom"));
+	wstring core = utf16_from_utf8(a.get<string>("core"));
+	wstring movie = utf16_from_utf8(a.get<string>("movie"));
+
+	ostringstream json;
+	json << "{\n\"core\": \"" << json_escape(a.get<string>("core")) << "\",\n"
+		<< "\"rom\": \"" << json_escape(a.get<string>("rom")) << "\",\n"
+		<< "\"frames\": " << frames << ", \"warmup\": " << warmup << ",\n"
+		<< "\"video\": " << (a.exist("no-video") ? "false" : "true")
+		<< ", \"audio\": " << (a.exist("no-audio") ? "false" : "true") << ",\n"
+		<< "\"movie\": \"" << json_escape(a.get<string>("movie")) << "\",\n"
+		<< "\"runs\": [";
+	vector<double> run_fps;
+	bool ok = true;
+	vector<string> watch_names;
+	ram_watch_t *watch = NULL;
+	if (!a.get<string>("watch").empty() &&
+		!(watch = parse_watch(a.get<string>("watch"), frames, watch_names)))
+		return 2;
+	string error;
+	for (unsigned k = 0; k < repeat && ok; k++)
+	{
+		CLibretro *emulator = CLibretro::CreateHeadless();
+		if (!emulator)
+		{
+			error = "no free core slot";
+			ok = false;
+			break;
+		}
+		emulator->headless_video = !a.exist("no-video");
+		emulator->headless_audio = !a.exist("no-audio");
+		emulator->export_name = a.get<string>("export");
+		long long start = microseconds_now();
+		ok = emulator->loadfile((TCHAR*)rom.c_str(), (TCHAR*)core.c_str(), false);
+		double load_ms = (microseconds_now() - start) / 1000.0;
+		if (!ok)error = "can't load the ROM with this core";
+		else if (!movie.empty() && !(ok = emulator->movie_play(movie.c_str())))
+			error = "can't play the movie";
+		if (!ok)
+		{
+			// a bad ROM leaves the core loaded without a game; delete tears down only that
+			fprintf(stderr, "Can't load %s with %s\n", a.get<string>("rom").c_str(), a.get<string>("core").c_str());
+			delete emulator;
+			break;
+		}
+		for (unsigned i = 0; i < warmup; i++)
+			emulator->run();
+
+		vector<double> frame_us(frames);
+		CTrace::reset();
+		CTrace::start();
+		void *ram = emulator->retro.retro_get_memory_data(RETRO_MEMORY_SYSTEM_RAM);
+		size_t ram_size = emulator->retro.retro_get_memory_size(RETRO_MEMORY_SYSTEM_RAM);
+		start = microseconds_now();
+		for (unsigned i = 0; i < frames; i++)
+		{
+			long long t = microseconds_now();
+			emulator->run();
+			frame_us[i] = (double)(microseconds_now() - t);
+			// outside the frame time, the ring holds the last run
+			if (watch && ram)ram_watch_sample(watch, ram, ram_size);
+		}
+		double elapsed = (microseconds_now() - start) / 1000000.0;
+		CTrace::stop();
+		vector<CTrace::phase> phases = CTrace::phases();
+		uint32_t content_crc = emulator->content_crc;
+		delete emulator;
+
+		double sum = 0;
+		for (unsigned i = 0; i < frames; i++)sum += frame_us[i];
+		sort(frame_us.begin(), frame_us.end());
+		double fps = elapsed > 0 ? frames / elapsed : 0.0;
+		run_fps.push_back(fps);
+		PROCESS_MEMORY_COUNTERS pmc = { 0 };
+		pmc.cb = sizeof(pmc);
+		GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc));
+
+		char buf[512];
+		snprintf(buf, sizeof(buf), "%s\n{\"load_ms\": %.3f, \"content_crc\": \"%08x\", \"fps\": %.2f, \"peak_rss_kb\": %llu,\n"
+			" \"frame_ms\": {\"min\": %.4f, \"mean\": %.4f, \"p99\": %.4f, \"max\": %.4f},\n \"phases\": {",
+			k ? "," : "", load_ms, content_crc, fps, (unsigned long long)(pmc.PeakWorkingSetSize / 1024),
+			frame_us.front() / 1000.0, sum / frames / 1000.0,
+			frame_us[min<size_t>(frames - 1, (size_t)(frames * 0.99))] / 1000.0, frame_us.back() / 1000.0);
+		json << buf;
+		for (size_t i = 0; i < phases.size(); i++)
+		{
+			snprintf(buf, sizeof(buf), "%s\"%s\": {\"calls_per_frame\": %.3f, \"us_per_frame\": %.3f}",
+				i ? ", " : "", json_escape(phases[i].name).c_str(),
+				(double)phases[i].count / frames, phases[i].total_usec / frames);
+			json << buf;
+		}
+		json << "}}";
+	}
+	json << "\n]";
+	if (!error.empty())json << ",\n\"error\": \"" << json_escape(error) << "\"";
+	if (!run_fps.empty())
+	{
+		double mean = 0;
+		for (size_t i = 0; i < run_fps.size(); i++)mean += run_fps[i];
+		mean /= run_fps.size();
+		char buf[256];
+		snprintf(buf, sizeof(buf), ",\n\"fps\": {\"min\": %.2f, \"mean\": %.2f, \"max\": %.2f}",
+			*min_element(run_fps.begin(), run_fps.end()), mean, *max_element(run_fps.begin(), run_fps.end()));
+		json << buf;
+	}
+	json << "\n}\n";
+
+	string out = a.get<string>("out");
+	FILE *fp = out.empty() ? stdout : fopen(out.c_str(), "w");
+	if (!fp)
+	{
+		fprintf(stderr, "Can't write report %s\n", out.c_str());
+		ram_watch_free(watch);
+		return 2;
+	}
+	fputs(json.str().c_str(), fp);
+	if (fp != stdout)fclose(fp);
+	if (watch)
+	{
+		if (ok && !save_watch(a.get<string>("watch-out").c_str(), watch, watch_names))
+			fprintf(stderr, "Can't write %s\n", a.get<string>("watch-out").c_str());
+		ram_watch_free(watch);
+	}
+	return ok ? 0 : 1;
+}
+
+static size_t netplay_serialize_size(void *data)
+{
+	return ((CLibretro*)data)->retro.retro_serialize_size();
+}
+
+static bool netplay_serialize(void *data, void *buf, size_t size)
+{
+	return ((CLibretro*)data)->retro.retro_serialize(buf, size);
+}
+
+static bool netplay_unserialize(void *data, const void *buf, size_t size)
+{
+	return ((CLibretro*)data)->retro.retro_unserialize(buf, size);
+}
+
+static void netplay_run(void *data, const uint16_t input[2], bool replay)
+{
+	CLibretro *emulator = (CLibretro*)data;
+	emulator->net_input[0] = input[0];
+	emulator->net_input[1] = input[1];
+	emulator->run();
+}
+
+int netplay_main(int argc, char **argv)
+{
+	cmdline::parser a;
+	a.add("netplay", 0, "one side of a headless two-player rollback session");
+	a.add<string>("core", 'c', "core filename", true, "");
+	a.add<string>("rom", 'r', "rom filename", true, "");
+	a.add<unsigned>("player", 'p', "0 or 1, the other side takes the other", false, 0);
+	a.add<unsigned>("port", 0, "local UDP port", false, 7100);
+	a.add<string>("peer", 0, "host:port of the other side", false, "127.0.0.1:7101");
+	a.add<unsigned>("frames", 'n', "frames to run", false, 600);
+	a.add<unsigned>("window", 0, "rollback window in frames", false, 8);
+	a.add<unsigned>("delay", 0, "input delay in frames, same on both sides", false, 2);
+	a.add<unsigned>("latency", 0, "injected one-way latency in ms", false, 0);
+	a.add<unsigned>("jitter", 0, "injected latency jitter in ms", false, 0);
+	a.add<float>("loss", 0, "injected packet loss, 0..1", false, 0.0f);
+	a.add<string>("movie", 0, "local input from this movie, random if not given", false, "");
+	a.add<unsigned>("seed", 0, "seed of the random local input", false, 1);
+	a.add<string>("out", 'o', "JSON report, stdout if not given", false, "");
+	a.parse_check(argc, argv);
+
+	SetErrorMode(SEM_FAILCRITICALERRORS | SEM_NOGPFAULTERRORBOX | SEM_NOOPENFILEERRORBOX);
+	set_core_directory();
+	unsigned frames = a.get<unsigned>("frames");
+	string peer = a.get<string>("peer");
+	size_t colon = peer.rfind(':');
+	if (colon == string::npos)
+	{
+		fprintf(stderr, "Bad peer %s, want host:port\n", peer.c_str());
+		return 2;
+	}
+	string peer_host = peer.substr(0, colon);
+
+	wstring rom = utf16_from_utf8(a.get<string>("rom"));
+	wstring core = utf16_from_utf8(a.get<string>("core"));
+	CLibretro *emulator = CLibretro::CreateHeadless();
+	if (!emulator->loadfile((TCHAR*)rom.c_str(), (TCHAR*)core.c_str(), false))
+	{
+		fprintf(stderr, "Can't load %s with %s\n", a.get<string>("rom").c_str(), a.get<string>("core").c_str());
+		delete emulator;
+		return 1;
+	}
+	emulator->net_input_active = true;
+	CMovie movie;
+	if (!a.get<string>("movie").empty() && !movie.play(utf16_from_utf8(a.get<string>("movie")).c_str()))
+	{
+		fprintf(stderr, "Can't play %s\n", a.get<string>("movie").c_str());
+		delete emulator;
+		return 1;
+	}
+	retro_system_av_info av = { 0 };
+	emulator->retro.retro_get_system_av_info(&av);
+	long long frame_us = (long long)(1000000.0 / (av.timing.fps > 0 ? av.timing.fps : 60.0));
+
+	rollback_callbacks cb;
+	cb.data = emulator;
+	cb.serialize_size = netplay_serialize_size;
+	cb.serialize = netplay_serialize;
+	cb.unserialize = netplay_unserialize;
+	cb.run = netplay_run;
+	rollback_config config = { 0 };
+	config.player = a.get<unsigned>("player");
+	config.local_port = (uint16_t)a.get<unsigned>("port");
+	config.remote_host = peer_host.c_str();
+	config.remote_port = (uint16_t)atoi(peer.c_str() + colon + 1);
+	config.window = a.get<unsigned>("window");
+	config.input_delay = a.get<unsigned>("delay");
+	config.sync_interval = 60;
+	config.latency_ms = a.get<unsigned>("latency");
+	config.jitter_ms = a.get<unsigned>("jitter");
+	config.loss = a.get<float>("loss");
+	config.seed = a.get<unsigned>("seed") + config.player;
+	rollback_t *rb = rollback_new(&config, &cb);
+	if (!rb)
+	{
+		fprintf(stderr, "Can't start the session on port %u\n", config.local_port);
+		delete emulator;
+		return 1;
+	}
+
+	// random input holds buttons for a while, as players do
+	uint32_t rng = config.seed * 2654435761u + 1;
+	uint16_t held = 0;
+	auto next_input = [&]() -> uint16_t {
+		CMovie::frame f;
+		if (movie.playing)
+			return movie.read(f) ? f.buttons : 0;
+		rng ^= rng << 13;
+		rng ^= rng >> 17;
+		rng ^= rng << 5;
+		if (rng % 12 == 0)held = (uint16_t)(rng >> 8) & 0x0fff;
+		return held;
+	};
+
+	uint16_t input = next_input();
+	long long start = microseconds_now();
+	for (unsigned tick = 1; rollback_current_frame(rb) < frames; tick++)
+	{
+		// a stalled frame keeps its input for the next try
+		if (rollback_frame(rb, input))input = next_input();
+		long long wait = start + tick * frame_us - microseconds_now();
+		if (wait > 0)this_thread::sleep_for(chrono::microseconds(wait));
+	}
+	// until every frame ran on both real inputs, then a little longer so
+	// the other side gets ours too
+	rollback_stats stats;
+	long long deadline = microseconds_now() + 5000000;
+	do
+	{
+		rollback_poll(rb);
+		rollback_get_stats(rb, &stats);
+		if (stats.confirmed >= frames)break;
+		this_thread::sleep_for(chrono::milliseconds(1));
+	} while (microseconds_now() < deadline);
+	bool confirmed = stats.confirmed >= frames;
+	deadline = microseconds_now() + 300000 + config.latency_ms * 2000;
+	while (microseconds_now() < deadline)
+	{
+		rollback_poll(rb);
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+	rollback_get_stats(rb, &stats);
+
+	// both sides should end on the same state
+	vector<uint8_t> state(emulator->retro.retro_serialize_size());
+	uint32_t state_crc = 0;
+	if (!state.empty() && emulator->retro.retro_serialize(&state[0], state.size()))
+		state_crc = encoding_crc32(0, &state[0], state.size());
+	rollback_free(rb);
+	delete emulator;
+
+	char buf[1024];
+	snprintf(buf, sizeof(buf), "{\"player\": %u, \"frames\": %u, \"confirmed\": %s, \"state_crc\": \"%08x\",\n"
+		" \"stalls\": %llu, \"predicted\": %llu, \"rollbacks\": %llu, \"resimulated\": %llu, \"max_depth\": %u,\n"
+		" \"serialize_us\": %.2f, \"unserialize_us\": %.2f, \"resimulate_ms\": %.3f,\n"
+		" \"packets_sent\": %llu, \"packets_dropped\": %llu, \"packets_received\": %llu, \"packets_rejected\": %llu,"
+		" \"syncs_checked\": %llu, \"desyncs\": %llu}\n",
+		config.player, frames, confirmed ? "true" : "false", state_crc,
+		(unsigned long long)stats.stalls, (unsigned long long)stats.predicted,
+		(unsigned long long)stats.rollbacks, (unsigned long long)stats.resimulated, stats.max_depth,
+		stats.serializes ? stats.serialize_usec / stats.serializes : 0.0,
+		stats.unserializes ? stats.unserialize_usec / stats.unserializes : 0.0,
+		stats.resimulate_usec / 1000.0,
+		(unsigned long long)stats.packets_sent, (unsigned long long)stats.packets_dropped,
+		(unsigned long long)stats.packets_received, (unsigned long long)stats.packets_rejected,
+		(unsigned long long)stats.syncs_checked, (unsigned long long)stats.desyncs);
+	string out = a.get<string>("out");
+	FILE *fp = out.empty() ? stdout : fopen(out.c_str(), "w");
+	if (!fp)
+	{
+		fprintf(stderr, "Can't write report %s\n", out.c_str());
+		return 2;
+	}
+	fputs(buf, fp);
+	if (fp != stdout)fclose(fp);
+	return confirmed && !stats.desyncs ? 0 : 1;
+}
@@ -0,0 +1,75 @@
+#ifndef CROMRUNNER_H
+#define CROMRUNNER_H
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <stdint.h>
+
+// Headless batch runner: every ROM of a directory or manifest is run for a
+// number of frames in its own child process, so a crashing core only costs
+// that one ROM. Child processes are driven by a pool of worker threads which
+// each own a deque of jobs and steal from the others once theirs runs dry.
+class CRomRunner
+{
+public:
+	struct job
+	{
+		std::string rom;
+	};
+
+	struct result
+	{
+		std::string rom;
+		bool loaded;
+		bool crashed;
+		bool timed_out;
+		double load_ms;
+		double fps;
+		unsigned frames;
+		uint64_t peak_rss;
+		uint32_t frame_hash;
+		unsigned long exit_code;
+	};
+
+	std::string core;
+	unsigned frames;
+	// stop a ROM early once its frame hash reaches this value (0 = never)
+	uint32_t until_hash;
+	unsigned timeout_ms;
+
+	CRomRunner();
+	bool add_dir(const char *dir, const char *exts);
+	bool add_manifest(const char *path);
+	// Runs every queued job with the given amount of workers, blocking until done.
+	void run(unsigned workers);
+	bool write_report(const char *path);
+	std::vector<result> results;
+
+private:
+	struct worker_queue
+	{
+		std::mutex lock;
+		std::deque<job> jobs;
+	};
+	std::vector<job> pending;
+	std::vector<worker_queue*> queues;
+	std::mutex results_lock;
+
+	bool pop(unsigned worker, job &out);
+	void worker(unsigned index);
+	result run_child(const job &j, unsigned worker_index);
+};
+
+// Entry points for --batch (the scheduler) and --run-job (one ROM, child side).
+int rom_runner_main(int argc, char **argv);
+int rom_runner_job(int argc, char **argv);
+// --benchmark: times one ROM in this process and prints a JSON report; with
+// --instances, runs several copies on their own threads and reports the summed fps.
+int rom_runner_benchmark(int argc, char **argv);
+// --list-cores: what every core in a directory takes, from the core info cache.
+int core_list_main(int argc, char **argv);
+// --netplay: one side of a headless two-player rollback session over UDP.
+int netplay_main(int argc, char **argv);
+
+#endif
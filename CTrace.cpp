@@ -0,0 +1,295 @@
+#include "stdafx.h"
+#include "CTrace.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+
+// 64k events per thread, about 1.5MB; older events are overwritten
+#define TRACE_RING_SIZE (1 << 16)
+
+namespace {
+	struct ring
+	{
+		std::atomic<uint64_t> head;
+		uint32_t tid;
+		char thread_name[64];
+		CTrace::event events[TRACE_RING_SIZE];
+	};
+
+	std::mutex rings_lock;
+	std::vector<ring*> rings;
+	thread_local ring *local_ring = NULL;
+	thread_local char local_name[64];
+	retro_time_t start_usec;
+	retro_perf_tick_t start_ticks;
+	double ticks_per_usec = 1.0;
+
+	ring* thread_ring()
+	{
+		if (!local_ring)
+		{
+			ring *r = new ring;
+			r->head = 0;
+			std::lock_guard<std::mutex> guard(rings_lock);
+			r->tid = (uint32_t)rings.size() + 1;
+			if (local_name[0])
+				strcpy(r->thread_name, local_name);
+			else
+				snprintf(r->thread_name, sizeof(r->thread_name), "thread %u", r->tid);
+			rings.push_back(r);
+			local_ring = r;
+		}
+		return local_ring;
+	}
+
+	// Snapshot of one ring in recording order, oldest first.
+	std::vector<CTrace::event> ring_events(ring *r)
+	{
+		uint64_t head = r->head.load(std::memory_order_acquire);
+		uint64_t count = std::min<uint64_t>(head, TRACE_RING_SIZE);
+		std::vector<CTrace::event> out;
+		out.reserve((size_t)count);
+		for (uint64_t i = head - count; i < head; i++)
+			out.push_back(r->events[i & (TRACE_RING_SIZE - 1)]);
+		return out;
+	}
+
+	double to_usec(retro_perf_tick_t ticks)
+	{
+		return ticks < start_ticks ? 0.0 : (ticks - start_ticks) / ticks_per_usec;
+	}
+
+	void calibrate()
+	{
+		retro_time_t usec = cpu_features_get_time_usec() - start_usec;
+		retro_perf_tick_t ticks = CTrace::now() - start_ticks;
+		if (usec > 0 && ticks)
+			ticks_per_usec = (double)ticks / (double)usec;
+	}
+
+	void json_string(std::string &out, const char *s)
+	{
+		out += '"';
+		for (; *s; s++)
+		{
+			if (*s == '"' || *s == '\\')out += '\\';
+			if ((unsigned char)*s >= 0x20)out += *s;
+		}
+		out += '"';
+	}
+
+	// minimal protobuf writer, just what the Perfetto TracePacket needs
+	void pb_varint(std::string &out, uint64_t v)
+	{
+		while (v >= 0x80)
+		{
+			out += (char)(v | 0x80);
+			v >>= 7;
+		}
+		out += (char)v;
+	}
+
+	void pb_uint(std::string &out, unsigned field, uint64_t v)
+	{
+		pb_varint(out, field << 3);
+		pb_varint(out, v);
+	}
+
+	void pb_bytes(std::string &out, unsigned field, const std::string &v)
+	{
+		pb_varint(out, (field << 3) | 2);
+		pb_varint(out, v.size());
+		out += v;
+	}
+}
+
+std::atomic<bool> CTrace::enabled(false);
+
+void CTrace::start()
+{
+	start_usec = cpu_features_get_time_usec();
+	start_ticks = now();
+	enabled = true;
+}
+
+void CTrace::stop()
+{
+	enabled = false;
+}
+
+// the ring itself is only allocated once the thread records something
+void CTrace::set_thread_name(const char *name)
+{
+	strncpy(local_name, name, sizeof(local_name) - 1);
+	if (local_ring)
+		strcpy(local_ring->thread_name, local_name);
+}
+
+void CTrace::record(const char *name, retro_perf_tick_t start, retro_perf_tick_t end)
+{
+	ring *r = local_ring ? local_ring : thread_ring();
+	uint64_t head = r->head.load(std::memory_order_relaxed);
+	event &e = r->events[head & (TRACE_RING_SIZE - 1)];
+	e.name = name;
+	e.start = start;
+	e.end = end;
+	r->head.store(head + 1, std::memory_order_release);
+}
+
+std::vector<CTrace::phase> CTrace::phases()
+{
+	calibrate();
+	std::lock_guard<std::mutex> guard(rings_lock);
+	std::vector<phase> out;
+	for (size_t i = 0; i < rings.size(); i++)
+	{
+		std::vector<event> events = ring_events(rings[i]);
+		for (size_t j = 0; j < events.size(); j++)
+		{
+			size_t k = 0;
+			while (k < out.size() && strcmp(out[k].name, events[j].name))
+				k++;
+			if (k == out.size())
+			{
+				phase p = { events[j].name, 0, 0.0 };
+				out.push_back(p);
+			}
+			out[k].count++;
+			out[k].total_usec += to_usec(events[j].end) - to_usec(events[j].start);
+		}
+	}
+	return out;
+}
+
+void CTrace::reset()
+{
+	std::lock_guard<std::mutex> guard(rings_lock);
+	for (size_t i = 0; i < rings.size(); i++)
+		rings[i]->head = 0;
+}
+
+bool CTrace::save(const char *path)
+{
+	const char *ext = strrchr(path, '.');
+	if (ext && (!strcmp(ext, ".pftrace") || !strcmp(ext, ".perfetto-trace")))
+		return save_perfetto(path);
+	return save_json(path);
+}
+
+bool CTrace::save_json(const char *path)
+{
+	FILE *fp = fopen(path, "wb");
+	if (!fp)
+		return false;
+	calibrate();
+	std::lock_guard<std::mutex> guard(rings_lock);
+	std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	char buf[128];
+	bool first = true;
+	for (size_t i = 0; i < rings.size(); i++)
+	{
+		snprintf(buf, sizeof(buf), "{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":", rings[i]->tid);
+		if (!first)out += ",\n";
+		first = false;
+		out += buf;
+		json_string(out, rings[i]->thread_name);
+		out += "}}";
+		std::vector<event> events = ring_events(rings[i]);
+		for (size_t j = 0; j < events.size(); j++)
+		{
+			out += ",\n{\"ph\":\"X\",\"pid\":1,\"name\":";
+			json_string(out, events[j].name);
+			snprintf(buf, sizeof(buf), ",\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", rings[i]->tid,
+				to_usec(events[j].start), to_usec(events[j].end) - to_usec(events[j].start));
+			out += buf;
+		}
+		if (out.size() > (1 << 20))
+		{
+			fwrite(out.c_str(), 1, out.size(), fp);
+			out.clear();
+		}
+	}
+	out += "\n]}\n";
+	fwrite(out.c_str(), 1, out.size(), fp);
+	fclose(fp);
+	return true;
+}
+
+static bool trace_event_order(const CTrace::event &a, const CTrace::event &b)
+{
+	// parents before their children when they start on the same tick
+	if (a.start != b.start)return a.start < b.start;
+	return a.end > b.end;
+}
+
+bool CTrace::save_perfetto(const char *path)
+{
+	// Trace.packet = 1; TracePacket: timestamp = 8, trusted_packet_sequence_id = 10,
+	// track_event = 11, track_descriptor = 60. TrackEvent: type = 9, track_uuid = 11,
+	// name = 23. TrackDescriptor: uuid = 1, thread = 4 (pid = 1, tid = 2, thread_name = 5).
+	enum { SLICE_BEGIN = 1, SLICE_END = 2 };
+	FILE *fp = fopen(path, "wb");
+	if (!fp)
+		return false;
+	calibrate();
+	std::lock_guard<std::mutex> guard(rings_lock);
+	std::string out, packet, msg, sub;
+	for (size_t i = 0; i < rings.size(); i++)
+	{
+		uint64_t uuid = rings[i]->tid;
+		sub.clear();
+		pb_uint(sub, 1, 1);
+		pb_uint(sub, 2, rings[i]->tid);
+		pb_bytes(sub, 5, rings[i]->thread_name);
+		msg.clear();
+		pb_uint(msg, 1, uuid);
+		pb_bytes(msg, 4, sub);
+		packet.clear();
+		pb_uint(packet, 10, 1);
+		pb_bytes(packet, 60, msg);
+		pb_bytes(out, 1, packet);
+
+		// events sit in the ring in order of completion; re-nest them
+		std::vector<event> events = ring_events(rings[i]);
+		std::sort(events.begin(), events.end(), trace_event_order);
+		std::vector<retro_perf_tick_t> open;
+		for (size_t j = 0; j <= events.size(); j++)
+		{
+			while (!open.empty() && (j == events.size() || open.back() <= events[j].start))
+			{
+				msg.clear();
+				pb_uint(msg, 9, SLICE_END);
+				pb_uint(msg, 11, uuid);
+				packet.clear();
+				pb_uint(packet, 8, (uint64_t)(to_usec(open.back()) * 1000.0));
+				pb_uint(packet, 10, 1);
+				pb_bytes(packet, 11, msg);
+				pb_bytes(out, 1, packet);
+				open.pop_back();
+			}
+			if (j == events.size())
+				break;
+			msg.clear();
+			pb_uint(msg, 9, SLICE_BEGIN);
+			pb_uint(msg, 11, uuid);
+			pb_bytes(msg, 23, events[j].name);
+			packet.clear();
+			pb_uint(packet, 8, (uint64_t)(to_usec(events[j].start) * 1000.0));
+			pb_uint(packet, 10, 1);
+			pb_bytes(packet, 11, msg);
+			pb_bytes(out, 1, packet);
+			// a child can't outlive its parent, clip overwritten-ring leftovers
+			retro_perf_tick_t end = events[j].end;
+			if (!open.empty() && end > open.back())
+				end = open.back();
+			open.push_back(end);
+		}
+		fwrite(out.data(), 1, out.size(), fp);
+		out.clear();
+	}
+	fclose(fp);
+	return true;
+}
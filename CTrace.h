@@ -0,0 +1,77 @@
+#ifndef CTRACE_H
+#define CTRACE_H
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+#include <features/features_cpu.h>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
+
+// Phase-level frame profiler. TRACE_SCOPE records one complete event into
+// a ring owned by the calling thread (no locks, no allocation once the ring
+// exists); save() exports every ring as Chrome trace JSON or, for paths
+// ending in .pftrace/.perfetto-trace, as a Perfetto protobuf trace.
+// Scope names must be string literals, only the pointer is stored.
+class CTrace
+{
+public:
+	struct event
+	{
+		const char *name;
+		retro_perf_tick_t start;
+		retro_perf_tick_t end;
+	};
+
+	// Raw timestamp; save() calibrates it against cpu_features_get_time_usec.
+	static inline retro_perf_tick_t now()
+	{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return cpu_features_get_perf_counter();
+#endif
+	}
+
+	class scope
+	{
+	public:
+		scope(const char *name) : name(name),
+			start(enabled.load(std::memory_order_relaxed) ? now() : 0) {}
+		~scope() { if (start) record(name, start, now()); }
+	private:
+		const char *name;
+		retro_perf_tick_t start;
+	};
+
+	static std::atomic<bool> enabled;
+	static void start();
+	static void stop();
+	// Names the calling thread in the exported trace.
+	static void set_thread_name(const char *name);
+	// Call with tracing stopped or the traced threads idle; rings are read
+	// without synchronising against their writers.
+	static bool save(const char *path);
+	static bool save_json(const char *path);
+	static bool save_perfetto(const char *path);
+	static void record(const char *name, retro_perf_tick_t start, retro_perf_tick_t end);
+
+	// Per-name totals over everything still in the rings, same caveat as save().
+	struct phase
+	{
+		const char *name;
+		uint64_t count;
+		double total_usec;
+	};
+	static std::vector<phase> phases();
+	// Drops all recorded events; only while tracing is stopped.
+	static void reset();
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(name) CTrace::scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+
+#endif
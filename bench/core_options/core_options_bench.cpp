@@ -0,0 +1,126 @@
+// GET_VARIABLE cost with a large option set: the hashed CCoreOptions lookup
+// against the linear strcmp scan over fixed-size entries it replaced, plus
+// the per-frame GET_VARIABLE_UPDATE poll.
+//
+// usage: core_options_bench [options] [lookups]
+#include "stdafx.h"
+#include "CCoreOptions.h"
+#define INI_IMPLEMENTATION
+#include "ini.h"
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// the old layout: one fixed record per option, found by strcmp
+struct core_vars
+{
+	char name[100];
+	char var[100];
+	char description[256];
+	char usevars[256];
+};
+
+static const char *linear_get(const std::vector<core_vars> &vars, const char *key)
+{
+	for (size_t i = 0; i < vars.size(); i++)
+		if (!strcmp(vars[i].name, key))
+			return vars[i].var;
+	return NULL;
+}
+
+static double now_ns()
+{
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static volatile size_t sink;
+
+int main(int argc, char *argv[])
+{
+	unsigned count = argc > 1 ? (unsigned)atoi(argv[1]) : 256;
+	unsigned lookups = argc > 2 ? (unsigned)atoi(argv[2]) : 2000000;
+	if (count < 1)count = 1;
+
+	// keys share a long core prefix like real ones ("mupen64plus-rdp-...")
+	std::vector<std::string> keys, values;
+	for (unsigned i = 0; i < count; i++)
+	{
+		char key[64], value[128];
+		snprintf(key, sizeof(key), "examplecore-video-option-%05u", i);
+		snprintf(value, sizeof(value), "Option %u; enabled|disabled|auto", i);
+		keys.push_back(key);
+		values.push_back(value);
+	}
+	std::vector<retro_variable> defs(count + 1);
+	for (unsigned i = 0; i < count; i++)
+	{
+		defs[i].key = keys[i].c_str();
+		defs[i].value = values[i].c_str();
+	}
+	defs[count].key = NULL;
+	defs[count].value = NULL;
+
+	CCoreOptions options;
+	options.init(&defs[0], NULL);
+
+	std::vector<core_vars> linear(count);
+	for (unsigned i = 0; i < count; i++)
+	{
+		snprintf(linear[i].name, sizeof(linear[i].name), "%s", keys[i].c_str());
+		snprintf(linear[i].var, sizeof(linear[i].var), "enabled");
+	}
+
+	// a core reads its options in no particular order
+	std::vector<const char*> order(lookups < 65536 ? lookups : 65536);
+	uint32_t x = 2463534242u;
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		order[i] = keys[x % count].c_str();
+	}
+
+	double t0 = now_ns();
+	for (unsigned i = 0; i < lookups; i++)
+		sink += (size_t)linear_get(linear, order[i % order.size()]);
+	double t1 = now_ns();
+	for (unsigned i = 0; i < lookups; i++)
+		sink += (size_t)options.read(order[i % order.size()]);
+	double t2 = now_ns();
+	for (unsigned i = 0; i < lookups; i++)
+		sink += options.poll_update();
+	double t3 = now_ns();
+
+	// correctness: every key resolves, GET_VARIABLE_UPDATE only fires for read options
+	for (unsigned i = 0; i < count; i++)
+	{
+		const char *v = options.get(keys[i].c_str());
+		if (!v || strcmp(v, "enabled"))
+		{
+			printf("lookup of %s failed\n", keys[i].c_str());
+			return 1;
+		}
+	}
+	CCoreOptions fresh;
+	fresh.init(&defs[0], NULL);
+	fresh.read(keys[0].c_str());
+	fresh.set(keys[count - 1].c_str(), "disabled");
+	bool unread = count > 1 && fresh.poll_update();
+	fresh.set(keys[0].c_str(), "auto");
+	bool read = fresh.poll_update();
+	bool again = fresh.poll_update();
+	if (unread || !read || again || fresh.changed_since(1).size() != (count > 1 ? 2u : 1u))
+	{
+		printf("update tracking is wrong\n");
+		return 1;
+	}
+
+	printf("%u options, %u lookups\n", count, lookups);
+	printf("linear strcmp  %8.1f ns/lookup\n", (t1 - t0) / lookups);
+	printf("hashed         %8.1f ns/lookup\n", (t2 - t1) / lookups);
+	printf("poll_update    %8.1f ns/call (no change)\n", (t3 - t2) / lookups);
+	return 0;
+}
@@ -0,0 +1,13 @@
+#pragma once
+// Stands in for the frontend's Win32 stdafx.h so CCoreOptions builds on Linux.
+#include <stdio.h>
+#include <stdlib.h>
+#include <wchar.h>
+
+static inline FILE *_wfopen(const wchar_t *path, const wchar_t *mode)
+{
+	char p[4096], m[8];
+	if (wcstombs(p, path, sizeof(p)) == (size_t)-1 || wcstombs(m, mode, sizeof(m)) == (size_t)-1)
+		return NULL;
+	return fopen(p, m);
+}
@@ -0,0 +1,243 @@
+// event_ring behaviour when full, checked against what the input code
+// relies on: key and button edges survive any amount of axis noise, the
+// latest value of every axis is kept, order is preserved. Then the
+// per-poll cost of the ring against the std::vector read() it replaced,
+// with operator new counted.
+//
+// usage: event_ring_test [polls]
+#include "event_ring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <chrono>
+#include <new>
+#include <vector>
+
+static uint64_t allocations;
+
+void *operator new(size_t size)
+{
+	++allocations;
+	void *p = malloc(size ? size : 1);
+	if (!p)throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+// shaped like dinput::di_event: keys are edges, axes are levels
+struct event
+{
+	enum { key_down, key_up, axis } type;
+	unsigned which;
+	int value;
+};
+
+struct event_levels
+{
+	static bool is_level(const event &e) { return e.type == event::axis; }
+	static bool same_control(const event &a, const event &b)
+	{
+		return a.type == event::axis && b.type == event::axis && a.which == b.which;
+	}
+};
+
+typedef event_ring< event, 256, event_levels > ring;
+
+static event key(bool down, unsigned which)
+{
+	event e = { down ? event::key_down : event::key_up, which, 0 };
+	return e;
+}
+
+static event axis(unsigned which, int value)
+{
+	event e = { event::axis, which, value };
+	return e;
+}
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { printf("  FAILED: %s (line %d)\n", #cond, __LINE__); ++failures; } } while (0)
+
+static unsigned count_keys(const ring &r, unsigned which)
+{
+	unsigned n = 0;
+	for (unsigned i = 0; i < r.size(); i++)
+		if (r[i].type != event::axis && r[i].which == which)n++;
+	return n;
+}
+
+// latest value of an axis in the ring, or -1
+static int axis_value(const ring &r, unsigned which)
+{
+	int v = -1;
+	for (unsigned i = 0; i < r.size(); i++)
+		if (r[i].type == event::axis && r[i].which == which)v = r[i].value;
+	return v;
+}
+
+static void test_order()
+{
+	printf("in order below capacity\n");
+	ring r;
+	for (unsigned i = 0; i < 200; i++)
+		r.push(i % 3 ? axis(i, (int)i) : key(true, i));
+	CHECK(r.size() == 200);
+	CHECK(r.dropped == 0 && r.overflows == 0 && r.coalesced == 0);
+	bool ordered = true;
+	for (unsigned i = 0; i < r.size(); i++)
+		if (r[i].which != i)ordered = false;
+	CHECK(ordered);
+	event e;
+	CHECK(r.pop(e) && e.which == 0 && r.size() == 199);
+}
+
+static void test_noisy_axes()
+{
+	printf("key down, 1000 events on two axes, key up\n");
+	ring r;
+	r.push(key(true, 5));
+	for (int i = 0; i < 1000; i++)
+		r.push(axis(i & 1, i));
+	r.push(key(false, 5));
+	CHECK(count_keys(r, 5) == 2);
+	CHECK(r[0].type == event::key_down);
+	CHECK(r[r.size() - 1].type == event::key_up);
+	CHECK(axis_value(r, 0) == 998);
+	CHECK(axis_value(r, 1) == 999);
+	CHECK(r.overflows == 1);
+	CHECK(r.coalesced > 0);
+	printf("  size %u dropped %llu coalesced %llu\n", r.size(),
+		(unsigned long long)r.dropped, (unsigned long long)r.coalesced);
+}
+
+static void test_edges_only()
+{
+	printf("300 edges\n");
+	ring r;
+	for (unsigned i = 0; i < 300; i++)
+		r.push(key(true, i));
+	CHECK(r.size() == 256);
+	CHECK(r.dropped == 44);
+	CHECK(r[0].which == 44 && r[255].which == 299);
+}
+
+static void test_edges_and_fresh_levels()
+{
+	// nothing supersedes any level here: an incoming edge has to cost a
+	// level its value rather than evict an older edge
+	printf("edges into a ring of edges and distinct axes\n");
+	ring r;
+	for (unsigned i = 0; i < 200; i++)
+		r.push(key(true, i));
+	for (unsigned i = 0; i < 56; i++)
+		r.push(axis(i, (int)i));
+	for (unsigned i = 0; i < 56; i++)
+		CHECK(r.push(key(false, i)));
+	CHECK(r.size() == 256);
+	unsigned downs = 0, ups = 0, axes = 0;
+	for (unsigned i = 0; i < r.size(); i++)
+	{
+		if (r[i].type == event::key_down)downs++;
+		else if (r[i].type == event::key_up)ups++;
+		else axes++;
+	}
+	CHECK(downs == 200 && ups == 56 && axes == 0);
+	CHECK(r.dropped == 56);
+	// one more edge with only edges left: now the oldest edge goes
+	CHECK(!r.push(key(false, 999)));
+	CHECK(r[0].which == 1 && r[255].which == 999);
+}
+
+static void test_levels_into_full_ring()
+{
+	printf("axes into a full ring\n");
+	ring r;
+	for (unsigned i = 0; i < 256; i++)
+		r.push(axis(i, 0));
+	// a control already held: merged into its newest event
+	CHECK(r.push(axis(7, 42)));
+	CHECK(axis_value(r, 7) == 42);
+	CHECK(r.coalesced == 1 && r.dropped == 0);
+	// a control not held and nothing superseded: dropped, the ring is unchanged
+	CHECK(!r.push(axis(1000, 1)));
+	CHECK(axis_value(r, 1000) == -1);
+	CHECK(r.dropped == 1);
+	for (unsigned i = 0; i < 256; i++)
+		CHECK(axis_value(r, i) == (i == 7 ? 42 : 0));
+}
+
+// what a device hands over in one poll
+static event device[512];
+
+// the read() shape event_ring replaced: a vector built and returned per poll
+static std::vector<event> old_read(unsigned n, unsigned seed)
+{
+	std::vector<event> v;
+	for (unsigned i = 0; i < n; i++)
+		v.push_back(device[(seed + i) & 511]);
+	return v;
+}
+
+static volatile unsigned sink;
+
+static double now_ns()
+{
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void bench(unsigned per_poll, unsigned polls)
+{
+	uint64_t a0 = allocations;
+	double t0 = now_ns();
+	for (unsigned p = 0; p < polls; p++)
+	{
+		std::vector<event> events = old_read(per_poll, p);
+		for (size_t i = 0; i < events.size(); i++)sink += events[i].which;
+	}
+	double old_ns = (now_ns() - t0) / polls;
+	double old_allocs = (double)(allocations - a0) / polls;
+
+	ring r;
+	a0 = allocations;
+	t0 = now_ns();
+	for (unsigned p = 0; p < polls; p++)
+	{
+		for (unsigned i = 0; i < per_poll; i++)
+			r.push(device[(p + i) & 511]);
+		for (unsigned i = 0; i < r.size(); i++)sink += r[i].which;
+		r.clear();
+	}
+	double ring_ns = (now_ns() - t0) / polls;
+	uint64_t ring_allocs = allocations - a0;
+
+	printf("  %3u events/poll: vector %.1f allocs %6.0f ns, ring %llu allocs %6.0f ns, %llu dropped\n",
+		per_poll, old_allocs, old_ns, (unsigned long long)ring_allocs, ring_ns,
+		(unsigned long long)r.dropped / polls);
+	CHECK(ring_allocs == 0);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned polls = argc > 1 ? (unsigned)atoi(argv[1]) : 200000;
+	if (polls < 1)polls = 1;
+
+	test_order();
+	test_noisy_axes();
+	test_edges_only();
+	test_edges_and_fresh_levels();
+	test_levels_into_full_ring();
+
+	for (unsigned i = 0; i < 512; i++)
+		device[i] = key((i & 1) != 0, i & 255);
+	printf("per poll, %u polls\n", polls);
+	bench(4, polls);
+	bench(32, polls);
+	bench(300, polls);
+
+	printf(failures ? "%d checks FAILED\n" : "all checks passed\n", failures);
+	return failures ? 1 : 0;
+}
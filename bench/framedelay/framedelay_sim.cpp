@@ -0,0 +1,151 @@
+// CFrameDelay's adaptive delay, then 60 fps against a virtual vsync with a
+// stub core: uniform per-frame cost plus random 6 ms spikes. Each frame
+// waits delay() after the boundary, runs, and is shown at the next boundary
+// it makes (one later when it misses). With the delay on, input must be
+// polled closer to its present while deadlines are still met.
+//
+// usage: framedelay_sim [frames]
+#include "stdafx.h"
+#include "CFrameDelay.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { printf("  FAILED: %s (line %d)\n", #cond, __LINE__); ++failures; } } while (0)
+
+static const double FRAME = 1000000.0 / 60.0;
+
+static void run_steady(CFrameDelay &fd, double cost, unsigned n)
+{
+	for (unsigned i = 0; i < n; i++)
+		fd.update(cost, false);
+}
+
+static void test_adapt()
+{
+	printf("adaptive delay\n");
+	CFrameDelay fd;
+	fd.reset(FRAME);
+	run_steady(fd, 4000.0, 200);
+	// off: no delay, whatever it has learned
+	CHECK(fd.delay() == 0.0);
+
+	fd.enabled = true;
+	fd.reset(FRAME);
+	// grows an eighth of the way per frame, towards budget - cost - margin
+	fd.update(4000.0, false);
+	double target = FRAME - 4000.0 - fd.margin_usec;
+	CHECK(fd.delay() > 0.0 && fd.delay() < target * 0.2);
+	run_steady(fd, 4000.0, 200);
+	CHECK(fd.delay() > target - 10.0 && fd.delay() <= target);
+
+	// dearer frames shrink it at once
+	fd.update(8000.0, false);
+	CHECK(fd.delay() <= FRAME - 8000.0 - fd.margin_usec);
+
+	// the worst of the last 32 frames counts: one spike holds it down
+	fd.reset(FRAME);
+	run_steady(fd, 4000.0, 200);
+	fd.update(10000.0, false);
+	run_steady(fd, 4000.0, 30);
+	CHECK(fd.delay() <= FRAME - 10000.0 - fd.margin_usec);
+	run_steady(fd, 4000.0, 60);
+	CHECK(fd.delay() > FRAME - 10000.0 - fd.margin_usec);
+
+	// a miss drops it to zero and holds it there for a quarter of the window
+	fd.reset(FRAME);
+	run_steady(fd, 4000.0, 200);
+	fd.update(4000.0, true);
+	CHECK(fd.delay() == 0.0);
+	CHECK(fd.misses == 1);
+	run_steady(fd, 4000.0, 8);
+	CHECK(fd.delay() == 0.0);
+	fd.update(4000.0, false);
+	CHECK(fd.delay() > 0.0);
+
+	// never more than 80% of the frame, never negative
+	fd.reset(FRAME);
+	run_steady(fd, 100.0, 200);
+	CHECK(fd.delay() <= FRAME * 0.8 + 0.001 && fd.delay() > FRAME * 0.79);
+	fd.reset(FRAME);
+	run_steady(fd, FRAME * 2, 50);
+	CHECK(fd.delay() == 0.0);
+}
+
+struct rng
+{
+	uint32_t s;
+	rng() : s(12345) {}
+	double next() { s = s * 1664525 + 1013904223; return (s >> 8) / 16777216.0; }
+};
+
+struct result
+{
+	// mean time from retro_run (input poll) to present, milliseconds
+	double latency_ms;
+	double miss_rate;
+};
+
+static result simulate(unsigned frames, double cost_lo, double cost_hi, double spike_chance, bool delay)
+{
+	CFrameDelay fd;
+	fd.enabled = delay;
+	fd.reset(FRAME);
+	rng r;
+	double boundary = 0.0, latency = 0.0;
+	unsigned misses = 0;
+	for (unsigned f = 0; f < frames; f++)
+	{
+		double start = boundary + fd.delay();
+		double cost = cost_lo + (cost_hi - cost_lo) * r.next();
+		if (r.next() < spike_chance)cost += 6000.0;
+		double present = boundary + FRAME;
+		bool missed = start + cost > present;
+		if (missed)
+		{
+			misses++;
+			present += FRAME;
+		}
+		latency += present - start;
+		fd.update(cost, missed);
+		boundary = present;
+	}
+	result res = { latency / frames / 1000.0, (double)misses / frames };
+	return res;
+}
+
+static void test_latency(unsigned frames)
+{
+	printf("%u frames at 60 fps, 6 ms spikes\n", frames);
+	printf("  core cost  spikes  poll->present off   on        misses off   on\n");
+	static const double cases[][3] = { { 2000, 4000, 0.01 }, { 4000, 8000, 0.02 }, { 8000, 12000, 0.02 } };
+	for (unsigned i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+	{
+		result off = simulate(frames, cases[i][0], cases[i][1], cases[i][2], false);
+		result on = simulate(frames, cases[i][0], cases[i][1], cases[i][2], true);
+		printf("  %2.0f-%2.0f ms  %3.0f%%    %6.2f ms  %6.2f ms     %5.2f%%  %5.2f%%\n",
+			cases[i][0] / 1000, cases[i][1] / 1000, cases[i][2] * 100,
+			off.latency_ms, on.latency_ms, off.miss_rate * 100, on.miss_rate * 100);
+		CHECK(on.latency_ms < off.latency_ms);
+		// the margin and the worst-frame window keep misses rare
+		CHECK(on.miss_rate < 0.02);
+		CHECK(on.miss_rate - off.miss_rate < 0.01);
+	}
+	// a cheap core gets most of the frame back
+	result cheap = simulate(frames, 2000, 4000, 0.01, true);
+	CHECK(cheap.latency_ms < 10.0);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned frames = argc > 1 ? (unsigned)atoi(argv[1]) : 36000;
+	if (frames < 600)frames = 600;
+
+	test_adapt();
+	test_latency(frames);
+
+	printf(failures ? "%d checks FAILED\n" : "all checks passed\n", failures);
+	return failures ? 1 : 0;
+}
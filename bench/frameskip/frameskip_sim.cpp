@@ -0,0 +1,192 @@
+// CFrameSkip decisions, then the frame loop of CLibretro::run() in virtual
+// time with a stub core: per-frame cost plus random load bursts, 5 ms to
+// present a frame, a 35 ms audio fifo drained by the device in real time and
+// filled by a blocking mix(), sleeplil()'s millisecond pacing. The same runs
+// go with the frameskip off and on; with it on the audio must go silent for
+// less time, and hardly at all when only the bursts overrun.
+//
+// usage: frameskip_sim [frames]
+#include "stdafx.h"
+#include "CFrameSkip.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { printf("  FAILED: %s (line %d)\n", #cond, __LINE__); ++failures; } } while (0)
+
+static const double FRAME = 1000000.0 / 60.0;
+
+static void test_decisions()
+{
+	printf("decisions\n");
+	CFrameSkip fs;
+	fs.reset(FRAME);
+	// off: never skips, however far behind
+	for (int i = 0; i < 10; i++)
+		CHECK(!fs.update(FRAME * 2, 0.0));
+
+	fs.enabled = true;
+	fs.reset(FRAME);
+	CHECK(!fs.update(FRAME, 1.0));
+	// within a quarter frame of real time: keep presenting
+	CHECK(!fs.update(FRAME * 1.2, 1.0));
+	// the debt passes a quarter frame
+	CHECK(fs.update(FRAME * 1.1, 1.0));
+	CHECK(fs.skipping);
+	// paid back: present again
+	CHECK(!fs.update(FRAME * 0.5, 1.0));
+
+	// spare time doesn't bank credit for a later overrun
+	fs.reset(FRAME);
+	for (int i = 0; i < 100; i++)
+		fs.update(FRAME * 0.2, 1.0);
+	CHECK(fs.update(FRAME * 1.3, 1.0));
+
+	// a low fifo skips without any overrun
+	fs.reset(FRAME);
+	CHECK(fs.update(FRAME * 0.9, 0.2));
+	CHECK(!fs.update(FRAME * 0.9, 0.5));
+
+	// at most max_skip in a row, then one frame is shown
+	fs.reset(FRAME);
+	unsigned run = 0, longest = 0;
+	for (int i = 0; i < 40; i++)
+	{
+		run = fs.update(FRAME * 3, 0.0) ? run + 1 : 0;
+		if (run > longest)longest = run;
+	}
+	CHECK(longest == fs.max_skip);
+
+	// a stall of over a second is a hitch, not load to catch up on
+	fs.reset(FRAME);
+	CHECK(!fs.update(2000000.0, 1.0));
+	CHECK(!fs.update(FRAME, 1.0));
+
+	// skipped counts the frames that ran skipping
+	fs.reset(FRAME);
+	fs.update(FRAME * 2, 1.0);
+	fs.update(FRAME * 0.2, 1.0);
+	fs.update(FRAME, 1.0);
+	CHECK(fs.frames == 3 && fs.skipped == 1);
+}
+
+struct rng
+{
+	uint32_t s;
+	rng() : s(12345) {}
+	double next() { s = s * 1664525 + 1013904223; return (s >> 8) / 16777216.0; }
+};
+
+struct result
+{
+	double silent_sec;
+	double skip_rate;
+};
+
+// One run of the stub core. Costs are microseconds of virtual time.
+static result simulate(unsigned frames, double cost_lo, double cost_hi, bool frameskip)
+{
+	const double present = 5000.0, fifo = 35000.0;
+	const double burst = 6000.0, burst_chance = 0.02;
+	const unsigned burst_frames = 30;
+	CFrameSkip fs;
+	fs.enabled = frameskip;
+	fs.reset(FRAME);
+	rng r;
+	double t = 0.0, last_time = 0.0, level = fifo * 0.5, played_to = 0.0, silent = 0.0;
+	unsigned bursting = 0;
+	for (unsigned f = 0; f < frames; f++)
+	{
+		if (!bursting && r.next() < burst_chance)bursting = burst_frames;
+		double cost = cost_lo + (cost_hi - cost_lo) * r.next();
+		if (bursting)
+		{
+			cost += burst;
+			bursting--;
+		}
+		if (!fs.skipping)cost += present;
+		t += cost;
+		double spent = cost;
+
+		// the device plays what's there, silence once it runs dry
+		level -= t - played_to;
+		played_to = t;
+		if (level < 0.0)
+		{
+			silent += -level;
+			level = 0.0;
+		}
+		// mix() blocks until the frame's audio fits
+		level += FRAME;
+		if (level > fifo)
+		{
+			t += level - fifo;
+			played_to = t;
+			level = fifo;
+		}
+
+		// sleeplil(): whole milliseconds up to the frame deadline, nothing while skipping
+		if (fs.skipping)last_time = t;
+		else
+		{
+			long long to_sleep_ms = (long long)((last_time + FRAME - t) / 1000.0);
+			if (to_sleep_ms > 0)
+			{
+				last_time += FRAME;
+				t += to_sleep_ms * 1000.0;
+			}
+			else last_time = t;
+		}
+		level -= t - played_to;
+		played_to = t;
+		if (level < 0.0)
+		{
+			silent += -level;
+			level = 0.0;
+		}
+		fs.update(spent, level / fifo);
+	}
+	result res = { silent / 1000000.0, fs.skip_rate() };
+	return res;
+}
+
+static void test_load(unsigned frames)
+{
+	printf("%u frames at 60 fps, 35 ms fifo, 5 ms present, 6 ms bursts\n", frames);
+	printf("  core cost   without        with           skip rate\n");
+	static const double costs[][2] = { { 2000, 5000 }, { 6000, 10000 }, { 9000, 13000 }, { 11000, 15000 } };
+	for (unsigned i = 0; i < sizeof(costs) / sizeof(costs[0]); i++)
+	{
+		result off = simulate(frames, costs[i][0], costs[i][1], false);
+		result on = simulate(frames, costs[i][0], costs[i][1], true);
+		printf("  %2.0f-%2.0f ms    %6.2f s silent  %6.2f s silent  %5.1f%%\n", costs[i][0] / 1000, costs[i][1] / 1000,
+			off.silent_sec, on.silent_sec, on.skip_rate * 100.0);
+		CHECK(off.skip_rate == 0.0);
+		if (i == 0)
+		{
+			// even bursts fit the frame: nothing to catch up on
+			CHECK(off.silent_sec == 0.0);
+			CHECK(on.silent_sec == 0.0);
+			CHECK(on.skip_rate < 0.01);
+			continue;
+		}
+		CHECK(on.skip_rate > 0.0);
+		CHECK(on.silent_sec < off.silent_sec);
+		// only the bursts overrun: skipping covers them
+		if (i == 1)CHECK(on.silent_sec < off.silent_sec * 0.05);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned frames = argc > 1 ? (unsigned)atoi(argv[1]) : 36000;
+	if (frames < 600)frames = 600;
+
+	test_decisions();
+	test_load(frames);
+
+	printf(failures ? "%d checks FAILED\n" : "all checks passed\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,254 @@
+// input_sampler against a fake device backend: events come out in the
+// order they were read, key edges survive a queue that nobody drains
+// (the emulator paused) while an axis keeps reporting, the latest axis
+// values arrive once draining resumes, and posted requests run on the
+// sampling thread between reads.
+//
+// usage: input_sampler_test
+#include "input_sampler.h"
+#include <stdio.h>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef dinput::di_event di_event;
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { printf("  FAILED: %s (line %d)\n", #cond, __LINE__); ++failures; } } while (0)
+
+static di_event key(bool down, unsigned which)
+{
+	di_event e = {};
+	e.type = di_event::ev_key;
+	e.key.type = down ? di_event::key_down : di_event::key_up;
+	e.key.which = which;
+	return e;
+}
+
+static di_event axis(unsigned which, unsigned value)
+{
+	di_event e = {};
+	e.type = di_event::ev_joy;
+	e.joy.type = di_event::joy_axis;
+	e.joy.which = which;
+	e.joy.axis = di_event::axis_positive;
+	e.joy.value = value;
+	return e;
+}
+
+static bool is_axis(const di_event &e) { return e.type == di_event::ev_joy && e.joy.type == di_event::joy_axis; }
+
+// What the sampler reads: scripted events, at most per_pass of them a
+// pass, and when noise is on every axis moves that many times a pass.
+struct fake_device
+{
+	std::mutex lock;
+	std::deque< di_event > script;
+	unsigned per_pass;
+	unsigned noise_axes;
+	unsigned noise;
+	unsigned value;
+	std::vector< unsigned > last;
+	std::thread::id reader;
+	bool reading;
+
+	fake_device() : per_pass(256), noise_axes(0), noise(1), value(0), last(8, 0), reading(false) {}
+
+	void add(const di_event &e)
+	{
+		std::lock_guard< std::mutex > lg(lock);
+		script.push_back(e);
+	}
+
+	bool idle()
+	{
+		std::lock_guard< std::mutex > lg(lock);
+		return script.empty();
+	}
+
+	void read(dinput::event_buffer &events)
+	{
+		std::lock_guard< std::mutex > lg(lock);
+		reader = std::this_thread::get_id();
+		reading = true;
+		for (unsigned n = 0; n < noise; n++)
+			for (unsigned i = 0; i < noise_axes; i++)
+			{
+				last[i] = ++value;
+				events.push(axis(i, value));
+			}
+		for (unsigned i = 0; i < per_pass && !script.empty(); i++)
+		{
+			events.push(script.front());
+			script.pop_front();
+		}
+		reading = false;
+	}
+
+	input_sampler::source source() { return [this](dinput::event_buffer &e) { read(e); }; }
+};
+
+// waits for n more sampling passes, false after a few seconds without them
+static bool wait_passes(input_sampler &s, uint64_t n)
+{
+	uint64_t want = s.samples.load() + n;
+	for (int i = 0; i < 5000 && s.samples.load() < want; i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	return s.samples.load() >= want;
+}
+
+static void test_order()
+{
+	printf("order, 4000 keys 16 a pass\n");
+	fake_device dev;
+	dev.per_pass = 16;
+	for (unsigned i = 0; i < 4000; i++)
+		dev.add(key((i & 1) == 0, i));
+
+	input_sampler s;
+	CHECK(s.start(dev.source(), 2000));
+	std::vector< unsigned > seen;
+	int64_t last_usec = 0;
+	bool monotonic = true;
+	for (int spins = 0; spins < 20000 && seen.size() < 4000; spins++)
+	{
+		input_sampler::timed_event te;
+		while (s.queue.pop(te))
+		{
+			seen.push_back(te.e.key.which);
+			if (te.usec < last_usec)monotonic = false;
+			last_usec = te.usec;
+		}
+		std::this_thread::sleep_for(std::chrono::microseconds(200));
+	}
+	s.stop();
+
+	CHECK(seen.size() == 4000);
+	bool ordered = true;
+	for (unsigned i = 0; i < seen.size(); i++)
+		if (seen[i] != i)ordered = false;
+	CHECK(ordered);
+	CHECK(monotonic);
+	CHECK(s.lost.load() == 0);
+}
+
+// Nothing drains, as while paused: 4 axes x 60 a pass fill the queue in
+// five passes. The key goes down and up behind that; both edges have to
+// come out, in order, and so do the axes' latest values.
+static void test_paused_overflow()
+{
+	printf("paused, noisy axes, key down/up behind a full queue\n");
+	fake_device dev;
+	dev.noise_axes = 4;
+	dev.noise = 60;
+	dev.per_pass = 1;
+
+	input_sampler s;
+	CHECK(s.start(dev.source(), 2000));
+	CHECK(wait_passes(s, 20));
+	dev.add(key(true, 7));
+	CHECK(wait_passes(s, 50));
+	dev.add(key(false, 7));
+	CHECK(wait_passes(s, 50));
+	CHECK(dev.idle());
+	CHECK(s.queue.size() == 1024);
+	CHECK(s.queue.dropped.load() > 0);
+
+	// resume: drain like the emulation thread does until the key is up,
+	// then the axes go quiet and whatever is left comes out
+	dinput::event_buffer events;
+	std::vector< di_event > seen;
+	bool released = false;
+	for (int spins = 0; spins < 20000 && !released; spins++)
+	{
+		events.clear();
+		s.drain(events);
+		for (unsigned i = 0; i < events.size(); i++)
+		{
+			seen.push_back(events[i]);
+			if (events[i].type == di_event::ev_key && events[i].key.type == di_event::key_up)released = true;
+		}
+		std::this_thread::sleep_for(std::chrono::microseconds(200));
+	}
+	{
+		std::lock_guard< std::mutex > lg(dev.lock);
+		dev.noise_axes = 0;
+	}
+	for (int i = 0; i < 8; i++)
+	{
+		CHECK(wait_passes(s, 2));
+		events.clear();
+		s.drain(events);
+		for (unsigned j = 0; j < events.size(); j++)
+			seen.push_back(events[j]);
+	}
+	uint64_t coalesced = s.coalesced.load(), lost = s.lost.load();
+	s.stop();
+
+	int down = -1, up = -1;
+	std::vector< unsigned > latest(4, 0);
+	for (unsigned i = 0; i < seen.size(); i++)
+	{
+		const di_event &e = seen[i];
+		if (e.type == di_event::ev_key && e.key.which == 7)
+		{
+			if (e.key.type == di_event::key_down && down < 0)down = i;
+			if (e.key.type == di_event::key_up && up < 0)up = i;
+		}
+		if (is_axis(e) && e.joy.which < 4)latest[e.joy.which] = e.joy.value;
+	}
+	printf("  %u events drained, %llu coalesced, %llu lost\n", (unsigned)seen.size(),
+		(unsigned long long)coalesced, (unsigned long long)lost);
+	CHECK(down >= 0);
+	CHECK(up > down);
+	for (unsigned i = 0; i < 4; i++)
+		CHECK(latest[i] == dev.last[i]);
+	CHECK(coalesced > 0);
+	CHECK(lost == 0);
+	CHECK(s.age_count >= seen.size());
+}
+
+// Requests posted while running happen on the sampling thread, never
+// during a read, and ahead of the next one.
+static void test_post()
+{
+	printf("post while running\n");
+	fake_device dev;
+	dev.noise_axes = 1;
+	input_sampler s;
+	CHECK(s.start(dev.source(), 2000));
+	CHECK(wait_passes(s, 2));
+
+	std::thread::id ran_on;
+	bool overlapped = true;
+	bool ran = false;
+	s.post([&]() {
+		// the sampling thread holds no device lock between reads
+		std::lock_guard< std::mutex > lg(dev.lock);
+		ran_on = std::this_thread::get_id();
+		overlapped = dev.reading;
+		ran = true;
+	});
+	CHECK(wait_passes(s, 2));
+	s.stop();
+	CHECK(ran);
+	CHECK(!overlapped);
+	CHECK(ran_on == dev.reader);
+
+	bool inline_ran = false;
+	s.post([&]() { inline_ran = true; });
+	CHECK(inline_ran);
+}
+
+int main()
+{
+	test_order();
+	test_paused_overflow();
+	test_post();
+
+	printf(failures ? "%d checks FAILED\n" : "all checks passed\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,7 @@
+// just enough of <tchar.h> for dinput.h on Linux
+#ifndef _tchar_h_
+#define _tchar_h_
+
+typedef char TCHAR;
+
+#endif
@@ -0,0 +1,244 @@
+// CLatePoll driven the way CLibretro's input callbacks drive it, headless
+// and in virtual time: a stub input source whose button goes down at a set
+// time, and stub cores that poll at the start of retro_run and read input
+// later, read on another port first, or never read at all. Checks where the
+// device read lands, what the core sees, and the input-age accounting.
+//
+// usage: late_poll_test
+#include "stdafx.h"
+#include "CLatePoll.h"
+#include <stdio.h>
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { printf("  FAILED: %s (line %d)\n", #cond, __LINE__); ++failures; } } while (0)
+
+// the virtual clock, microseconds
+static long long now;
+
+// What input::poll() reads: one button, pressed from press_at on. A read
+// takes read_cost of the clock, like a dinput poll.
+struct stub_input
+{
+	long long press_at;
+	long long read_cost;
+	unsigned reads;
+	long long last_read;
+	bool pressed;
+
+	stub_input() : press_at(-1), read_cost(0), reads(0), last_read(-1), pressed(false) {}
+
+	void poll()
+	{
+		reads++;
+		last_read = now;
+		pressed = press_at >= 0 && now >= press_at;
+		now += read_cost;
+	}
+};
+
+// CLibretro's core_input_poll, read_input, core_input_state and the
+// end-of-frame drain in run(), minus movies and netplay.
+struct frontend
+{
+	CLatePoll latepoll;
+	stub_input device;
+
+	void core_input_poll()
+	{
+		if (!latepoll.poll(now))return;
+		read_input();
+	}
+
+	void read_input()
+	{
+		latepoll.read(now);
+		device.poll();
+	}
+
+	int16_t core_input_state(unsigned port)
+	{
+		if (latepoll.pending)read_input();
+		latepoll.state(now);
+		if (port != 0)return 0;
+		return device.pressed;
+	}
+
+	void end_frame()
+	{
+		if (latepoll.pending)read_input();
+	}
+};
+
+// polls, emulates for before_read, reads port 0 a few times
+static int16_t run_frame(frontend &fe, long long before_read)
+{
+	fe.core_input_poll();
+	now += before_read;
+	int16_t seen = fe.core_input_state(0);
+	now += 100;
+	fe.core_input_state(0);
+	fe.core_input_state(0);
+	now += 1000;
+	fe.end_frame();
+	return seen;
+}
+
+static void test_early()
+{
+	printf("late polling off\n");
+	frontend fe;
+	now = 1000;
+	fe.core_input_poll();
+	// read right at the poll
+	CHECK(fe.device.reads == 1 && fe.device.last_read == 1000);
+	CHECK(!fe.latepoll.pending);
+	CHECK(fe.latepoll.poll_time == 1000);
+	now += 8000;
+	fe.core_input_state(0);
+	fe.core_input_state(0);
+	fe.end_frame();
+	CHECK(fe.device.reads == 1);
+	// the core saw state 8 ms old, counted once
+	CHECK(fe.latepoll.age_count == 1);
+	CHECK(fe.latepoll.age_total == 8000.0);
+	CHECK(fe.latepoll.age() == 8000.0);
+}
+
+static void test_late()
+{
+	printf("late polling on\n");
+	frontend fe;
+	fe.latepoll.enabled = true;
+	now = 1000;
+	fe.core_input_poll();
+	CHECK(fe.device.reads == 0);
+	CHECK(fe.latepoll.pending);
+	CHECK(fe.latepoll.poll_time == 1000);
+	now += 8000;
+	fe.core_input_state(0);
+	// deferred to the first input_state
+	CHECK(fe.device.reads == 1 && fe.device.last_read == 9000);
+	CHECK(!fe.latepoll.pending);
+	now += 100;
+	fe.core_input_state(0);
+	fe.end_frame();
+	// once a frame, whatever the core asks afterwards
+	CHECK(fe.device.reads == 1);
+	CHECK(fe.latepoll.age_count == 1);
+	CHECK(fe.latepoll.age_total == 0.0);
+}
+
+// the button goes down 5 ms into the frame, before the core reads it at 8 ms
+static void test_fresh_state()
+{
+	printf("press between poll and read\n");
+	for (int late = 0; late < 2; late++)
+	{
+		frontend fe;
+		fe.latepoll.enabled = late != 0;
+		now = 1000;
+		fe.device.press_at = 6000;
+		int16_t seen = run_frame(fe, 8000);
+		CHECK(seen == (late ? 1 : 0));
+		// the next frame sees it either way
+		CHECK(run_frame(fe, 8000) == 1);
+	}
+}
+
+// age is measured to the first input_state after a read, read cost included
+static void test_age_accounting()
+{
+	printf("age accounting\n");
+	frontend early, late;
+	late.latepoll.enabled = true;
+	early.device.read_cost = late.device.read_cost = 50;
+	const long long before[] = { 2000, 8000, 14000, 4000 };
+	// read_time 0 means no read yet; the frontend's clock never reads 0
+	now = 1000;
+	for (unsigned i = 0; i < 4; i++)
+		run_frame(early, before[i]);
+	now = 1000;
+	for (unsigned i = 0; i < 4; i++)
+		run_frame(late, before[i]);
+	CHECK(early.latepoll.age_count == 4);
+	CHECK(early.latepoll.age_total == 2000 + 8000 + 14000 + 4000 + 4 * 50);
+	CHECK(early.latepoll.age_max == 14050);
+	CHECK(early.latepoll.age() == 7050.0);
+	CHECK(late.latepoll.age_count == 4);
+	CHECK(late.latepoll.age_total == 4 * 50);
+	CHECK(late.latepoll.age_max == 50);
+
+	late.latepoll.reset_stats();
+	CHECK(late.latepoll.age_count == 0 && late.latepoll.age() == 0.0);
+	run_frame(late, 3000);
+	CHECK(late.latepoll.age_count == 1 && late.latepoll.age_total == 50);
+}
+
+static void test_other_port_first()
+{
+	printf("first input_state on port 1\n");
+	frontend fe;
+	fe.latepoll.enabled = true;
+	now = 1000;
+	fe.core_input_poll();
+	now += 3000;
+	fe.core_input_state(1);
+	CHECK(fe.device.reads == 1 && fe.device.last_read == 4000);
+	CHECK(fe.latepoll.age_count == 1);
+	now += 3000;
+	fe.core_input_state(0);
+	CHECK(fe.device.reads == 1);
+	CHECK(fe.latepoll.age_count == 1);
+}
+
+static void test_poll_without_state()
+{
+	printf("core polls but never reads\n");
+	frontend fe;
+	fe.latepoll.enabled = true;
+	now = 1000;
+	for (unsigned f = 0; f < 3; f++)
+	{
+		fe.core_input_poll();
+		now += 16000;
+		fe.end_frame();
+		now += 667;
+	}
+	// drained at the end of every frame, nothing counted
+	CHECK(fe.device.reads == 3);
+	CHECK(!fe.latepoll.pending);
+	CHECK(fe.latepoll.age_count == 0);
+
+	// a core that reads without polling sees the last read, counted once
+	now += 1000;
+	fe.core_input_state(0);
+	fe.core_input_state(0);
+	CHECK(fe.device.reads == 3);
+	CHECK(fe.latepoll.age_count == 1);
+	CHECK(fe.latepoll.age_total == 1000 + 667);
+}
+
+static void test_before_any_read()
+{
+	printf("input_state before any read\n");
+	frontend fe;
+	now = 500;
+	fe.core_input_state(0);
+	CHECK(fe.device.reads == 0);
+	CHECK(fe.latepoll.age_count == 0);
+}
+
+int main()
+{
+	test_early();
+	test_late();
+	test_fresh_state();
+	test_age_accounting();
+	test_other_port_first();
+	test_poll_without_state();
+	test_before_any_read();
+
+	printf(failures ? "%d checks FAILED\n" : "all checks passed\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,2 @@
+#pragma once
+// Stands in for the frontend's Win32 stdafx.h so CLatePoll builds on Linux.
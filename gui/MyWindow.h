@@ -67,6 +67,9 @@ public:
 	END_MSG_MAP()
 	CPropertyGridCtrl m_grid;
 	CLibretro *retro;
+	// option values when the dialog opened, restored on Cancel
+	unsigned opened_generation;
+	vector<string> opened_values;
 
 	LRESULT OnAddItem(int idCtrl, LPNMHDR /*pnmh*/, BOOL& /*bHandled*/)
 	{
@@ -100,36 +103,17 @@ public:
 			ATLTRACE(_T("OnItemChanged - Ctrl: %d, Name: '%s', DispValue: '%s', Value: '%ls'\n"),
 				idCtrl, pnpi->prop->GetName(), szValue, vValue.bstrVal); idCtrl;
 
-			for (int i = 0; i < retro->variables.size(); i++)
-			{
-				wstring str = s2ws(retro->variables[i].name);
-				if (lstrcmpW(str.c_str(), (LPCTSTR)name) == 0)
-				{
-					wstring var = szValue;
-					string var2 =ws2s(var);
-					strcpy(retro->variables[i].var, var2.c_str());
-				}
-
-			}
+			wstring var = szValue;
+			retro->options.set(ws2s((LPCTSTR)name).c_str(), ws2s(var).c_str());
 		}
 		if (type == 6)
 		{
 			CComVariant vValue;
 			pnpi->prop->GetValue(&vValue);
 			vValue.ChangeType(VT_BOOL);
-			for (int i = 0; i < retro->variables.size(); i++)
-			{
-				wstring str = s2ws(retro->variables[i].name);
-				wstring str2 = (LPCTSTR)name;
-				if (lstrcmp(str.c_str(), str2.c_str()) == 0)
-				{
-					const char* check = vValue.boolVal ? "enabled" : "disabled";
-					strcpy(retro->variables[i].var,check) ;
-				}
-
-			}
+			const char* check = vValue.boolVal ? "enabled" : "disabled";
+			retro->options.set(ws2s((LPCTSTR)name).c_str(), check);
 		}
-		retro->variables_changed = true;
 		return 0;
 	}
 
@@ -137,18 +121,22 @@ public:
 	LRESULT OnInitDialogView1(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam*/, BOOL& /*bHandled*/)
 	{
 		retro = CLibretro::GetSingleton();
+		opened_generation = retro->options.generation;
+		opened_values.clear();
+		for (size_t i = 0; i < retro->options.size(); i++)
+			opened_values.push_back(retro->options[i].value);
 		m_grid.SubclassWindow(GetDlgItem(IDC_LIST_VARIABLES));
 		m_grid.InsertColumn(0, _T("Option"), LVCFMT_LEFT, 200, 0);
 		m_grid.InsertColumn(1, _T("Setting"), LVCFMT_LEFT, 80, 0);
 		m_grid.SetExtendedGridStyle(PGS_EX_SINGLECLICKEDIT);
 
-		for (int i = 0; i < retro->variables.size(); i++)
+		for (int i = 0; i < retro->options.size(); i++)
 		{
-			string str = retro->variables[i].description;
-			wstring st2 = s2ws(str);
-			string usedv = retro->variables[i].usevars;
-			string var = retro->variables[i].var;
-			wstring varname = s2ws(retro->variables[i].name);
+			const CCoreOptions::option &opt = retro->options[i];
+			wstring st2 = s2ws(opt.description);
+			string usedv = opt.usevars;
+			string var = opt.value;
+			wstring varname = s2ws(opt.name);
 			m_grid.InsertItem(i, PropCreateReadOnlyItem(_T(""), st2.c_str()));
 			if (strcmp(usedv.c_str(), "enabled|disabled") == 0 || strcmp(usedv.c_str(),"disabled|enabled") == 0)
 			{
@@ -159,27 +147,8 @@ public:
 			{
 				
 				vector <wstring> colour;
-				colour.clear();
-				char *pch = (char*)retro->variables[i].usevars;
-				while (pch != NULL)
-				{
-					char val[255] = { 0 };
-					char* str2 = strstr(pch, (char*)"|");
-					if (!str2)
-					{
-						strcpy(val, pch);
-						break;
-					}
-					strncpy(val, pch, str2 - pch);
-					std::wostringstream temp;
-					temp << val;
-					colour.push_back(temp.str());
-					pch += str2 - pch++;
-
-				}
-				std::wostringstream temp;
-				temp << pch;
-				colour.push_back(temp.str());
+				for (size_t j = 0; j < opt.values.size(); j++)
+					colour.push_back(s2ws(opt.values[j]));
 				
 				LPWSTR **wszArray = new LPWSTR*[colour.size() + 1];
 				int j = 0;
@@ -195,7 +164,7 @@ public:
 				HPROPERTY hDisabled = m_grid.GetProperty(i, 1);
 				TCHAR szValue[100] = { 0 };
 				hDisabled->GetDisplayValue(szValue, sizeof(szValue) / sizeof(TCHAR));
-				wstring variant = s2ws(retro->variables[i].var);
+				wstring variant = s2ws(opt.value);
 				CComVariant vValue(variant.c_str());
 				vValue.ChangeType(VT_BSTR);
 				m_grid.SetItemValue(hDisabled, &vValue);
@@ -210,27 +179,9 @@ public:
 		return TRUE;
 	}
 
-	void save()
-	{
-		FILE *fp = NULL;
-		ini_t* ini = ini_create(NULL);
-		for (int i = 0; i < retro->variables.size(); i++){
-			ini_property_add(ini, INI_GLOBAL_SECTION, retro->variables[i].name,strlen(retro->variables[i].name), retro->variables[i].var, 
-			strlen(retro->variables[i].var));
-		}
-		int size = ini_save(ini, NULL, 0); // Find the size needed
-		char* data = (char*)malloc(size);
-		size = ini_save(ini, data, size); // Actually save the file	
-		ini_destroy(ini);
-		fp = _wfopen(retro->corevar_path, L"w");
-		fwrite(data, 1, size, fp);
-		fclose(fp);
-		free(data);	
-	}
-
 	LRESULT OnOK(WORD /*wNotifyCode*/, WORD wID, HWND /*hWndCtl*/, BOOL& /*bHandled*/)
 	{
-		save();
+		retro->options.flush();
 		// TODO: Add validation code
 		EndDialog(wID);
 		return 0;
@@ -238,6 +189,14 @@ public:
 
 	LRESULT OnCancel(WORD /*wNotifyCode*/, WORD wID, HWND /*hWndCtl*/, BOOL& /*bHandled*/)
 	{
+		// edits apply live; undo the ones made while the dialog was open
+		vector<const CCoreOptions::option*> changed = retro->options.changed_since(opened_generation);
+		for (size_t i = 0; i < changed.size(); i++)
+		{
+			size_t index = changed[i] - &retro->options[0];
+			if (index < opened_values.size())
+				retro->options.set(changed[i]->name.c_str(), opened_values[index].c_str());
+		}
 		EndDialog(wID);
 		return 0;
 	}
@@ -257,6 +216,7 @@ public:
 	bool					 notify_d;
 	bool                     have_event;
 	dinput::di_event         last_event;
+	dinput::event_buffer     events;
 	std::vector< HTREEITEM > tree_items;
 	guid_container         * guids;
 	// returned to list view control
@@ -311,7 +271,7 @@ public:
 
 	LRESULT NotifyHandler(int idCtrl, LPNMHDR pnmh, BOOL&/*bHandled*/) {
 	//	KillTimer(0x1337);
-		while (!process_events(di->read()))Sleep(10);
+		while (!process_events())Sleep(10);
 		std::tostringstream event_text;
 		format_event(last_event, event_text);
 		int n = ListView_GetSelectionMark(assign);
@@ -393,7 +353,7 @@ public:
 		if (wParam == 0x1337)
 		{
 
-			if (process_events(di->read()))
+			if (process_events())
 			{
 				std::tostringstream event_text;
 				format_event(last_event, event_text);
@@ -479,95 +439,42 @@ private:
 		}
 	}
 
-	bool process_events(std::vector< dinput::di_event > events)
+	// Picks the newest event that presses something, ignoring releases and
+	// sticks returning to center.
+	bool process_events()
 	{
-		std::vector< dinput::di_event >::iterator it;
-		bool     again;
-		unsigned last = 0;
-		do
-		{
-			again = false;
-			for (it = events.begin() + last; it < events.end(); ++it)
+		events.clear();
+		di->read(events);
+		for (unsigned n = events.size(); n-- > 0;)
+		{
+			const dinput::di_event &e = events[n];
+			bool release = false;
+			if (e.type == dinput::di_event::ev_key)
+				release = e.key.type == dinput::di_event::key_up;
+			else if (e.type == dinput::di_event::ev_joy)
 			{
-				if (it->type == dinput::di_event::ev_key)
-				{
-					if (it->key.type == dinput::di_event::key_up)
-					{
-						again = true;
-						last = it - events.begin();
-						events.erase(it);
-						break;
-					}
-				}
-				else if (it->type == dinput::di_event::ev_joy)
-				{
-					if (it->joy.type == dinput::di_event::joy_axis)
-					{
-						if (it->joy.axis == dinput::di_event::axis_center)
-						{
-							again = true;
-							last = it - events.begin();
-							events.erase(it);
-							break;
-						}
-					}
-					else if (it->joy.type == dinput::di_event::joy_button)
-					{
-						if (it->joy.button == dinput::di_event::button_up)
-						{
-							again = true;
-							last = it - events.begin();
-							events.erase(it);
-							break;
-						}
-					}
-					else if (it->joy.type == dinput::di_event::joy_pov)
-					{
-						if (it->joy.pov_angle == ~0)
-						{
-							again = true;
-							last = it - events.begin();
-							events.erase(it);
-							break;
-						}
-					}
-				}
-				else if (it->type == dinput::di_event::ev_xinput)
-				{
-					if (it->xinput.type == dinput::di_event::xinput_axis)
-					{
-						if (it->xinput.axis == dinput::di_event::axis_center)
-						{
-							again = true;
-							last = it - events.begin();
-							events.erase(it);
-							break;
-						}
-					}
-					else if (it->xinput.type == dinput::di_event::xinput_trigger ||
-						it->xinput.type == dinput::di_event::xinput_button)
-					{
-						if (it->xinput.button == dinput::di_event::button_up)
-						{
-							again = true;
-							last = it - events.begin();
-							events.erase(it);
-							break;
-						}
-					}
-				}
+				if (e.joy.type == dinput::di_event::joy_axis)
+					release = e.joy.axis == dinput::di_event::axis_center;
+				else if (e.joy.type == dinput::di_event::joy_button)
+					release = e.joy.button == dinput::di_event::button_up;
+				else if (e.joy.type == dinput::di_event::joy_pov)
+					release = e.joy.pov_angle == ~0;
+			}
+			else if (e.type == dinput::di_event::ev_xinput)
+			{
+				if (e.xinput.type == dinput::di_event::xinput_axis)
+					release = e.xinput.axis == dinput::di_event::axis_center;
+				else if (e.xinput.type == dinput::di_event::xinput_trigger ||
+					e.xinput.type == dinput::di_event::xinput_button)
+					release = e.xinput.button == dinput::di_event::button_up;
+			}
+			if (!release)
+			{
+				have_event = true;
+				last_event = e;
+				return true;
 			}
-		} while (again);
-
-		it = events.end();
-		if (it > events.begin())
-		{
-			--it;
-			have_event = true;
-			last_event = *it;
-			return true;
 		}
-
 		return false;
 	}
 
@@ -652,13 +559,29 @@ public:
 		greetz += "F1 : Load Savestate\r\n";
 		greetz += "F2 : Save Savestate\r\n";
 		greetz += "F3 : Reset\r\n";
+		greetz += "Tab : Fast-forward on/off\r\n";
 		greetz += "-----------\r\n";
 		greetz += "Commandline variables:\r\n";
 		greetz += "-r (game filename)\r\n";
 		greetz += "-c (core filename)\r\n";
 		greetz += "-q : Per-game configuration\r\n";
+		greetz += "--ff-ratio (speed cap, 0 = unlimited) --ff-present (show every Nth frame) --ff-mute\r\n";
+		greetz += "--frameskip : skip frames when emulation falls behind\r\n";
+		greetz += "--frame-delay : run the core late in the frame to cut input lag (--frame-delay-margin ms)\r\n";
+		greetz += "--late-poll : read input devices when the core first asks for input, not when it polls\r\n";
+		greetz += "--input-rate (Hz) : sample input on a separate thread, e.g. 1000\r\n";
+		greetz += "--record (movie) [--power-on] / --play (movie) : input movies\r\n";
+		greetz += "--export (name) : publish frames and audio into shared memory for other tools\r\n";
 		greetz += "\n";
 		greetz += "Example: einweggerat.exe -r somerom.sfc  -c snes9x_libretro.dll\r\n";
+		greetz += "\n";
+		greetz += "Batch mode: --batch -c (core) -d (rom dir) or -m (manifest)\r\n";
+		greetz += "Example: einweggerat.exe --batch -c snes9x_libretro.dll -d roms -n 600 -o report.csv\r\n";
+		greetz += "Benchmark: --benchmark -c (core) -r (rom) [--frames --warmup --repeat --movie --no-video --no-audio -o report.json]\r\n";
+		greetz += "RAM watch: --benchmark ... --watch 0x1f00:16,0x20:8s [--watch-out watch.csv]\r\n";
+		greetz += "Scaling: --benchmark -c (core) -r (rom) --instances N [--seconds --warmup --no-video --no-audio -o report.json]\r\n";
+		greetz += "Core list: --list-cores [-d (core dir) -j (jobs) -t (probe timeout)], cached in core_info.cache\r\n";
+		greetz += "Netplay test: --netplay -c (core) -r (rom) -p (0|1) [--port --peer host:port --window --delay --latency --jitter --loss -o report.json]\r\n";
 		greetz += "-----------\r\n";
 		greetz += "Greetz:\r\n";
 		greetz += "Higor Eurpedes\r\n";
@@ -688,12 +611,17 @@ public:
 		MESSAGE_HANDLER(WM_SIZE,OnSize)
 		COMMAND_ID_HANDLER(ID_PREFERENCES_INPUTCONFIG, OnInput)
 		COMMAND_ID_HANDLER(ID_PREFERENCES_COREVARIABLES, OnVariables)
+		COMMAND_ID_HANDLER(ID_PREFERENCES_PERFCOUNTERS, OnPerfCounters)
 		COMMAND_ID_HANDLER_EX(IDC_EXIT, OnFileExit)
 		COMMAND_ID_HANDLER(ID_FILE_OPEN, OnFileOpen)
 		COMMAND_ID_HANDLER(ID_ABOUT, OnAbout)
 		COMMAND_ID_HANDLER(ID_LOADSTATEFILE,OnLoadState)
 		COMMAND_ID_HANDLER(ID_SAVESTATEFILE, OnSaveState)
 		COMMAND_ID_HANDLER(ID_RESET, OnReset)
+		COMMAND_ID_HANDLER(ID_FASTFORWARD, OnFastForward)
+		COMMAND_ID_HANDLER(ID_FRAMESKIP, OnFrameSkip)
+		COMMAND_ID_HANDLER(ID_FRAMEDELAY, OnFrameDelay)
+		COMMAND_ID_HANDLER(ID_LATEPOLL, OnLatePoll)
 		CHAIN_MSG_MAP(CFrameWindowImpl<CMyWindow>)
 		CHAIN_MSG_MAP(CDropFileTarget<CMyWindow>)
 		END_MSG_MAP()
@@ -725,6 +653,34 @@ public:
 			return 0;
 		}
 
+		LRESULT OnFastForward(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/)
+		{
+			emulator->set_fastforward(!emulator->fastforward);
+			::CheckMenuItem(GetMenu(), ID_FASTFORWARD, emulator->fastforward ? MF_CHECKED : MF_UNCHECKED);
+			return 0;
+		}
+
+		LRESULT OnFrameSkip(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/)
+		{
+			emulator->frameskip.enabled = !emulator->frameskip.enabled;
+			::CheckMenuItem(GetMenu(), ID_FRAMESKIP, emulator->frameskip.enabled ? MF_CHECKED : MF_UNCHECKED);
+			return 0;
+		}
+
+		LRESULT OnFrameDelay(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/)
+		{
+			emulator->framedelay.enabled = !emulator->framedelay.enabled;
+			::CheckMenuItem(GetMenu(), ID_FRAMEDELAY, emulator->framedelay.enabled ? MF_CHECKED : MF_UNCHECKED);
+			return 0;
+		}
+
+		LRESULT OnLatePoll(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/)
+		{
+			emulator->latepoll.enabled = !emulator->latepoll.enabled;
+			::CheckMenuItem(GetMenu(), ID_LATEPOLL, emulator->latepoll.enabled ? MF_CHECKED : MF_UNCHECKED);
+			return 0;
+		}
+
 		LRESULT OnSaveState(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/)
 		{
 			CHAR szFileName[MAX_PATH];
@@ -858,6 +814,27 @@ public:
 			return 0;
 		}
 
+		LRESULT OnPerfCounters(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/)
+		{
+			if (emulator->perf.empty())
+			{
+				MessageBox(L"The running core has not registered any performance counters.", L"Performance counters", MB_ICONINFORMATION);
+				return 0;
+			}
+			wstring text = s2ws(emulator->perf.report());
+			text += L"\r\nSave this report to a file?";
+			if (MessageBox(text.c_str(), L"Performance counters", MB_YESNO) == IDYES)
+			{
+				LPCTSTR sFiles =
+					L"Text files (*.txt)\0*.txt\0"
+					L"All Files (*.*)\0*.*\0\0";
+				CFileDialog dlg(FALSE, L"*.txt", NULL, OFN_HIDEREADONLY | OFN_OVERWRITEPROMPT, sFiles);
+				if (dlg.DoModal() == IDOK)
+					emulator->perf.dump(dlg.m_szFileName);
+			}
+			return 0;
+		}
+
 		void OnFileExit(UINT uCode, int nID, HWND hwndCtrl)
 		{
 			DestroyWindow();
@@ -869,6 +846,7 @@ public:
 			CHAR szFileName[MAX_PATH];
 			LPCTSTR sFiles =
 				L"GB ROMs (*.dmg,*.gb)\0*.dmg;*.gb\0"
+				L"ZIP archives (*.zip)\0*.zip\0"
 				L"All Files (*.*)\0*.*\0\0";
 			CFileDialog dlg( TRUE, NULL, NULL, OFN_HIDEREADONLY | OFN_OVERWRITEPROMPT, sFiles);
 			if (dlg.DoModal() == IDOK)
@@ -8,6 +8,9 @@
 #include <fcntl.h>
 #include <io.h>
 #include "../cmdline.h"
+#include "../CRomRunner.h"
+#include "../CTrace.h"
+#include <dynamic/core_info_cache.h>
 #include <iostream>
 #include <string>
 #include <sstream>
@@ -111,6 +114,40 @@ LPSTR* CommandLineToArgvA(LPSTR lpCmdLine, INT *pNumArgs)
 
 int Run(LPTSTR cmdline = NULL, int nCmdShow = SW_SHOWDEFAULT)
 {
+	int argc = 1;
+	char** cmdargptr = CommandLineToArgvA(GetCommandLineA(), &argc);
+
+	// a core probe for --list-cores: load one core, report, and get out
+	if (argc > 2 && !strcmp(cmdargptr[1], CORE_INFO_PROBE_ARG))
+		ExitProcess(core_info_probe_main(cmdargptr[2]));
+
+	// batch modes run headless and never open the main window
+	if (argc > 1 && (!strcmp(cmdargptr[1], "--batch") || !strcmp(cmdargptr[1], "--run-job") ||
+		!strcmp(cmdargptr[1], "--benchmark") || !strcmp(cmdargptr[1], "--list-cores") ||
+		!strcmp(cmdargptr[1], "--netplay")))
+	{
+		int ret;
+		if (!strcmp(cmdargptr[1], "--run-job"))
+			ret = rom_runner_job(argc, cmdargptr);
+		else
+		{
+			if (!AttachConsole(ATTACH_PARENT_PROCESS))AllocConsole();
+			freopen("CONOUT$", "w", stdout);
+			freopen("CONOUT$", "w", stderr);
+			if (!strcmp(cmdargptr[1], "--benchmark"))
+				ret = rom_runner_benchmark(argc, cmdargptr);
+			else if (!strcmp(cmdargptr[1], "--list-cores"))
+				ret = core_list_main(argc, cmdargptr);
+			else if (!strcmp(cmdargptr[1], "--netplay"))
+				ret = netplay_main(argc, cmdargptr);
+			else
+				ret = rom_runner_main(argc, cmdargptr);
+		}
+		LocalFree(cmdargptr);
+		ExitProcess(ret);
+		return ret;
+	}
+
 	CEmuMessageLoop theLoop;
 	_Module.AddMessageLoop(&theLoop);
 	CMyWindow dlgMain;
@@ -136,9 +173,6 @@ int Run(LPTSTR cmdline = NULL, int nCmdShow = SW_SHOWDEFAULT)
 	menu.DestroyMenu();
 
 
-	int argc = 1;
-	char** cmdargptr = CommandLineToArgvA(GetCommandLineA(), &argc);
-
 	if (argc < 2)
 	{
 		if (!AttachConsole(ATTACH_PARENT_PROCESS))
@@ -157,6 +191,7 @@ int Run(LPTSTR cmdline = NULL, int nCmdShow = SW_SHOWDEFAULT)
 			a.add<string>("core_name", 'c', "core filename", true, "");
 			a.add<string>("rom_name", 'r', "rom filename", true, "");
 			a.add("pergame", 'g', "per-game configuration");
+			a.add<string>("trace", 't', "write a frame trace on exit (.json, or .pftrace for Perfetto)", false, "");
 			a.parse_check(argc, cmdargptr);
 			printf("\nPress any key to continue....\n");
 			_Module.RemoveMessageLoop();
@@ -181,14 +216,55 @@ int Run(LPTSTR cmdline = NULL, int nCmdShow = SW_SHOWDEFAULT)
 	a.add<string>("core_name", 'c', "core filename", true, "");
 	a.add<string>("rom_name", 'r', "rom filename", true, "");
 	a.add("pergame", 'g', "per-game configuration");
+	a.add<string>("trace", 't', "write a frame trace on exit (.json, or .pftrace for Perfetto)", false, "");
+	a.add<float>("ff-ratio", 0, "fast-forward speed cap, 0 for unlimited", false, 0.0f);
+	a.add<unsigned>("ff-present", 0, "show every Nth frame while fast-forwarding", false, 4);
+	a.add("ff-mute", 0, "mute audio while fast-forwarding");
+	a.add("frameskip", 0, "skip frames when emulation falls behind");
+	a.add("frame-delay", 0, "run the core as late as possible before each present");
+	a.add<float>("frame-delay-margin", 0, "frame delay safety margin in milliseconds", false, 2.0f);
+	a.add("late-poll", 0, "read input devices on the core's first input query of a frame");
+	a.add<unsigned>("input-rate", 0, "sample input devices on their own thread at this rate in Hz, 0 to sample on poll", false, 0);
+	a.add<string>("record", 0, "record an input movie from the current state", false, "");
+	a.add<string>("play", 0, "play back an input movie", false, "");
+	a.add("power-on", 0, "anchor --record at power-on instead of a savestate");
+	a.add<string>("export", 0, "publish frames and audio into shared memory under this name", false, "");
 	a.parse_check(argc, cmdargptr);
 
 	wstring rom = s2ws(a.get<string>("rom_name"));
 	wstring core = s2ws(a.get<string>("core_name"));
 	bool percore = a.exist("pergame");
+	string trace = a.get<string>("trace");
+	if (!trace.empty())
+	{
+		CTrace::set_thread_name("main");
+		CTrace::start();
+	}
+	dlgMain.emulator->ff_ratio = a.get<float>("ff-ratio");
+	dlgMain.emulator->ff_present = a.get<unsigned>("ff-present");
+	dlgMain.emulator->ff_mute = a.exist("ff-mute");
+	dlgMain.emulator->frameskip.enabled = a.exist("frameskip");
+	if (a.exist("frameskip"))::CheckMenuItem(dlgMain.GetMenu(), ID_FRAMESKIP, MF_CHECKED);
+	dlgMain.emulator->framedelay.enabled = a.exist("frame-delay");
+	dlgMain.emulator->framedelay.margin_usec = a.get<float>("frame-delay-margin") * 1000.0;
+	if (a.exist("frame-delay"))::CheckMenuItem(dlgMain.GetMenu(), ID_FRAMEDELAY, MF_CHECKED);
+	dlgMain.emulator->latepoll.enabled = a.exist("late-poll");
+	if (a.exist("late-poll"))::CheckMenuItem(dlgMain.GetMenu(), ID_LATEPOLL, MF_CHECKED);
+	if (a.get<unsigned>("input-rate") && dlgMain.input_device)
+		dlgMain.input_device->start_sampling(a.get<unsigned>("input-rate"));
+	dlgMain.emulator->export_name = a.get<string>("export");
 	dlgMain.ShowWindow(nCmdShow);
 	dlgMain.start((TCHAR*)rom.c_str(), (TCHAR*)core.c_str(), percore);
+	if (!a.get<string>("play").empty())
+		dlgMain.emulator->movie_play(s2ws(a.get<string>("play")).c_str());
+	else if (!a.get<string>("record").empty())
+		dlgMain.emulator->movie_record(s2ws(a.get<string>("record")).c_str(), a.exist("power-on"));
 	int nRet = theLoop.Run(dlgMain);
+	if (!trace.empty())
+	{
+		CTrace::stop();
+		CTrace::save(trace.c_str());
+	}
 	_Module.RemoveMessageLoop();
 	LocalFree(cmdargptr);
 	ExitProcess(0);
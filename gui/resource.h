@@ -89,13 +89,18 @@
 #define ID_SAVESTATEFILE                40039
 #define ID_LOADSTATEFILE                40045
 #define ID_RESET                        40048
+#define ID_PREFERENCES_PERFCOUNTERS     40056
+#define ID_FASTFORWARD                  40057
+#define ID_FRAMESKIP                    40058
+#define ID_FRAMEDELAY                   40059
+#define ID_LATEPOLL                     40060
 
 // Next default values for new objects
 // 
 #ifdef APSTUDIO_INVOKED
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        139
-#define _APS_NEXT_COMMAND_VALUE         40056
+#define _APS_NEXT_COMMAND_VALUE         40061
 #define _APS_NEXT_CONTROL_VALUE         1193
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
@@ -370,12 +370,12 @@ public:
 		return err;
 	}
 
-	virtual void process( std::vector< dinput::di_event > & events )
+	virtual void process( const dinput::event_buffer & events )
 	{
 		lock();
-			std::vector< dinput::di_event >::iterator it;
-			for ( it = events.begin(); it < events.end(); ++it )
+			for ( unsigned n = 0; n < events.size(); ++n )
 			{
+				const dinput::di_event * it = & events[ n ];
 				std::vector< bind >::iterator itb;
 				if ( it->type == dinput::di_event::ev_key ||
 					( it->type == dinput::di_event::ev_joy &&
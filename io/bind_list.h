@@ -59,7 +59,7 @@ public:
 	virtual const char * save( Data_Writer & ) = 0;
 
 	// input handling
-	virtual void process( std::vector< dinput::di_event > & ) = 0;
+	virtual void process( const dinput::event_buffer & ) = 0;
 	
 	virtual unsigned read( ) = 0;
 
@@ -14,6 +14,7 @@
 
 #include <wbemidl.h>
 
+#include <atomic>
 #include <string>
 
 #include <assert.h>
@@ -53,7 +54,8 @@ class dinput_i : public dinput
 
 	std::vector< joy >       joysticks;
 
-	bool                     focused;
+	// read by every read(), which may run on the input sampler thread
+	std::atomic< bool >      focused;
 
 	// only needed by enum callbacks
 	LPDIRECTINPUT8           lpDI;
@@ -367,9 +369,8 @@ public:
 		return 0;
 	}
 
-	virtual std::vector< di_event > read()
+	virtual void read( event_buffer & events )
 	{
-		std::vector< di_event > events;
 		di_event e;
 
 		HRESULT hr;
@@ -402,7 +403,7 @@ public:
 					if ( od.dwData & 0x80 ) e.key.type = di_event::key_down;
 					else e.key.type = di_event::key_up;
 
-					events.push_back( e );
+					events.push( e );
 				}
 			}
 		}
@@ -455,7 +456,7 @@ public:
 							//e.joy.value = 0;
 						}
 						
-						events.push_back( e );
+						events.push( e );
 					}
 					else if ( od.dwOfs >= DIJOFS_POV( 0 ) && od.dwOfs <= DIJOFS_POV( 3 ) )
 					{
@@ -464,7 +465,7 @@ public:
 						e.joy.pov_angle = od.dwData;
 						if ( e.joy.pov_angle != ~0 ) e.joy.pov_angle /= DI_DEGREES;
 
-						events.push_back( e );
+						events.push( e );
 					}
 					else if ( od.dwOfs >= DIJOFS_BUTTON( 0 ) && od.dwOfs <= DIJOFS_BUTTON( 31 ) )
 					{
@@ -474,7 +475,7 @@ public:
 						if ( od.dwData & 0x80 ) e.joy.button = di_event::button_down;
 						else e.joy.button = di_event::button_up;
 
-						events.push_back( e );
+						events.push( e );
 					}
 				}
 			}
@@ -496,7 +497,7 @@ public:
 #define XINPUT_PUSH_AXIS(n, stick, v) \
 				e.xinput.which = n; \
 				e.xinput.value = ((xinput_##stick##_stick_deadzone(state.Gamepad.##v))); \
-				if ( xinput_##stick##_stick_motion( xinput_last_state[ i ].Gamepad.##v, state.Gamepad.##v, &e.xinput.axis ) ) events.push_back( e )
+				if ( xinput_##stick##_stick_motion( xinput_last_state[ i ].Gamepad.##v, state.Gamepad.##v, &e.xinput.axis ) ) events.push( e )
 
 				XINPUT_PUSH_AXIS( 0, left, sThumbLX );
 				XINPUT_PUSH_AXIS( 1, left, sThumbLY );
@@ -510,7 +511,7 @@ public:
 #define XINPUT_PUSH_TRIGGER(n, v) \
 				e.xinput.which = n; \
 				e.xinput.value = xinput_trigger_deadzone( state.Gamepad.##v ); \
-				if ( xinput_trigger_motion( xinput_last_state[ i ].Gamepad.##v, state.Gamepad.##v, &e.xinput.button ) ) events.push_back( e )
+				if ( xinput_trigger_motion( xinput_last_state[ i ].Gamepad.##v, state.Gamepad.##v, &e.xinput.button ) ) events.push( e )
 
 				XINPUT_PUSH_TRIGGER( 0, bLeftTrigger );
 				XINPUT_PUSH_TRIGGER( 1, bRightTrigger );
@@ -528,15 +529,13 @@ public:
 						e.xinput.which = button;
 						if ( state.Gamepad.wButtons & mask ) e.xinput.button = di_event::button_down;
 						else e.xinput.button = di_event::button_up;
-						events.push_back( e );
+						events.push( e );
 					}
 				}
 
 				xinput_last_state[ i ] = state;
 			}
 		}
-
-		return events;
 	}
 
 	virtual void set_focus( bool is_focused )
@@ -552,6 +551,9 @@ public:
 
 	virtual void refocus( void * hwnd )
 	{
+		// SetCooperativeLevel fails with DIERR_ACQUIRED on an acquired device,
+		// read() acquires it again once focused
+		lpdKeyboard->Unacquire();
 		if ( lpdKeyboard->SetCooperativeLevel( ( HWND ) hwnd, DISCL_NONEXCLUSIVE | DISCL_FOREGROUND ) == DI_OK )
 			set_focus( true );
 	}
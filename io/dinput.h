@@ -5,6 +5,8 @@
 
 #include <tchar.h>
 
+#include "event_ring.h"
+
 class guid_container;
 
 class dinput
@@ -105,11 +107,34 @@ public:
 		};
 	};
 
+	// axes, triggers and the pov hat report levels, keys and buttons edges
+	struct di_event_levels
+	{
+		static bool is_level( const di_event & e )
+		{
+			if ( e.type == di_event::ev_joy ) return e.joy.type != di_event::joy_button;
+			if ( e.type == di_event::ev_xinput ) return e.xinput.type != di_event::xinput_button;
+			return false;
+		}
+
+		static bool same_control( const di_event & a, const di_event & b )
+		{
+			if ( a.type != b.type || ! is_level( a ) || ! is_level( b ) ) return false;
+			if ( a.type == di_event::ev_joy )
+				return a.joy.serial == b.joy.serial && a.joy.type == b.joy.type && a.joy.which == b.joy.which;
+			return a.xinput.index == b.xinput.index && a.xinput.type == b.xinput.type && a.xinput.which == b.xinput.which;
+		}
+	};
+
+	// what one poll can hold; a poll normally sees a handful of events
+	typedef event_ring< di_event, 256, di_event_levels > event_buffer;
+
 	virtual ~dinput() {}
 
 	virtual const char* open( void * di8, void * hwnd, guid_container * ) = 0;
 
-	virtual std::vector< di_event > read() = 0;
+	// appends everything the devices buffered since the last call
+	virtual void read( event_buffer & ) = 0;
 
 	virtual void set_focus( bool ) = 0;
 
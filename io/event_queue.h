@@ -0,0 +1,60 @@
+#ifndef _event_queue_h_
+#define _event_queue_h_
+
+#include <atomic>
+#include <stdint.h>
+
+// Bounded single-producer single-consumer queue. One thread pushes, one
+// other thread pops; neither ever blocks or allocates. N must be a power
+// of two. A push into a full queue fails and is counted in dropped, so the
+// producer never overwrites what the consumer may be reading; keeping the
+// refused event is up to the producer.
+template < typename T, unsigned N >
+class event_queue
+{
+	static_assert( ( N & ( N - 1 ) ) == 0, "event_queue size must be a power of two" );
+
+	T items[ N ];
+	// free-running; head is only written by the consumer, tail by the producer
+	alignas( 64 ) std::atomic< uint32_t > head;
+	alignas( 64 ) std::atomic< uint32_t > tail;
+
+public:
+	enum { capacity = N };
+
+	std::atomic< uint64_t > dropped;
+
+	event_queue() : head( 0 ), tail( 0 ), dropped( 0 ) {}
+
+	// producer side
+	bool push( const T & e )
+	{
+		uint32_t t = tail.load( std::memory_order_relaxed );
+		if ( t - head.load( std::memory_order_acquire ) == N )
+		{
+			dropped.fetch_add( 1, std::memory_order_relaxed );
+			return false;
+		}
+		items[ t & ( N - 1 ) ] = e;
+		tail.store( t + 1, std::memory_order_release );
+		return true;
+	}
+
+	// consumer side
+	bool pop( T & e )
+	{
+		uint32_t h = head.load( std::memory_order_relaxed );
+		if ( h == tail.load( std::memory_order_acquire ) ) return false;
+		e = items[ h & ( N - 1 ) ];
+		head.store( h + 1, std::memory_order_release );
+		return true;
+	}
+
+	// approximate unless called from one of the two threads while the other is idle
+	unsigned size() const
+	{
+		return tail.load( std::memory_order_acquire ) - head.load( std::memory_order_acquire );
+	}
+};
+
+#endif
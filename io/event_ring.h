@@ -0,0 +1,158 @@
+#ifndef _event_ring_h_
+#define _event_ring_h_
+
+#include <stdint.h>
+
+// Tells the ring which events are levels (axes and the like, where only the
+// latest value of a control matters) and which are edges (key and button
+// transitions, every one of which has to arrive).
+struct event_no_levels
+{
+	template < typename T > static bool is_level( const T & ) { return false; }
+	template < typename T > static bool same_control( const T &, const T & ) { return false; }
+};
+
+// Fixed-capacity FIFO of input events. The input subsystem owns one and
+// reuses it every poll: devices push into it in place, bind_list walks it
+// in place, then it is cleared. Nothing here allocates.
+// When full, a level event replaces the newest held event of the same
+// control, or else an older level event a later one supersedes makes room;
+// failing both it is dropped, since the value before it stays in effect.
+// An edge takes the place of a superseded level if there is one, else of
+// the oldest level. Edges are never evicted for a level, and only a ring
+// holding nothing but edges loses its oldest edge (a lost key_up leaves the
+// button held).
+template < typename T, unsigned N, typename Levels = event_no_levels >
+class event_ring
+{
+	T        items[ N ];
+	unsigned head;
+	unsigned count;
+	// level events held, so a ring of edges skips the searches for one
+	unsigned levels;
+	bool     overflowing;
+
+public:
+	enum { capacity = N };
+
+	// events lost while full, and how many times the ring filled up
+	// (a burst that loses several events counts once)
+	uint64_t dropped;
+	uint64_t overflows;
+	// level events merged into an older one of the same control while full
+	uint64_t coalesced;
+	// most events held at once
+	unsigned peak;
+
+	event_ring() : head( 0 ), count( 0 ), levels( 0 ), overflowing( false ), dropped( 0 ), overflows( 0 ), coalesced( 0 ), peak( 0 ) {}
+
+	void clear() { head = 0; count = 0; levels = 0; overflowing = false; }
+
+	unsigned size() const { return count; }
+
+	bool empty() const { return count == 0; }
+
+	bool push( const T & e )
+	{
+		if ( count == N ) return push_full( e );
+		append( e );
+		if ( count > peak ) peak = count;
+		return true;
+	}
+
+	bool pop( T & e )
+	{
+		if ( ! count ) return false;
+		e = items[ head ];
+		head = ( head + 1 ) % N;
+		--count;
+		if ( Levels::is_level( e ) ) --levels;
+		overflowing = false;
+		return true;
+	}
+
+	// i-th oldest event still held
+	T & operator[]( unsigned i ) { return items[ ( head + i ) % N ]; }
+
+	const T & operator[]( unsigned i ) const { return items[ ( head + i ) % N ]; }
+
+private:
+	// kept out of push() so the common case stays small enough to inline
+	bool push_full( const T & e )
+	{
+		if ( ! overflowing ) ++overflows;
+		overflowing = true;
+		int victim = -1;
+		if ( Levels::is_level( e ) ) victim = newest_of( e );
+		if ( victim < 0 ) victim = oldest_superseded();
+		if ( victim >= 0 )
+		{
+			erase( ( unsigned ) victim );
+			append( e );
+			++coalesced;
+			return true;
+		}
+		++dropped;
+		// the previous value of this control stays in effect
+		if ( Levels::is_level( e ) ) return false;
+		// an edge costs a level its latest value before it costs another edge
+		victim = oldest_level();
+		if ( victim >= 0 )
+		{
+			erase( ( unsigned ) victim );
+			append( e );
+			return true;
+		}
+		// only edges held: the one overwritten is an edge as well
+		items[ head ] = e;
+		head = ( head + 1 ) % N;
+		return false;
+	}
+
+	// newest held event of the same control as e, or -1
+	int newest_of( const T & e ) const
+	{
+		for ( unsigned i = count; i-- > 0; )
+			if ( Levels::same_control( ( *this )[ i ], e ) ) return ( int ) i;
+		return -1;
+	}
+
+	// oldest level event with a newer one of the same control behind it, or -1
+	int oldest_superseded() const
+	{
+		if ( ! levels ) return -1;
+		for ( unsigned i = 0; i < count; ++i )
+		{
+			if ( ! Levels::is_level( ( *this )[ i ] ) ) continue;
+			for ( unsigned j = i + 1; j < count; ++j )
+				if ( Levels::same_control( ( *this )[ j ], ( *this )[ i ] ) ) return ( int ) i;
+		}
+		return -1;
+	}
+
+	// oldest level event, or -1
+	int oldest_level() const
+	{
+		if ( ! levels ) return -1;
+		for ( unsigned i = 0; i < count; ++i )
+			if ( Levels::is_level( ( *this )[ i ] ) ) return ( int ) i;
+		return -1;
+	}
+
+	void append( const T & e )
+	{
+		items[ ( head + count ) % N ] = e;
+		++count;
+		if ( Levels::is_level( e ) ) ++levels;
+	}
+
+	void erase( unsigned i )
+	{
+		if ( Levels::is_level( ( *this )[ i ] ) ) --levels;
+		for ( ; i + 1 < count; ++i )
+			( *this )[ i ] = ( *this )[ i + 1 ];
+		--count;
+	}
+};
+
+#endif
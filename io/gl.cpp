@@ -2,6 +2,7 @@
 #include "../libretro.h"
 #include "glad.h"
 #include "gl_render.h"
+#include "../CTrace.h"
 
 video g_video;
 
@@ -588,10 +589,13 @@ void video_refresh(const void *data, unsigned width, unsigned height, unsigned p
 	}
 
 	if (data && data != RETRO_HW_FRAME_BUFFER_VALID) {
+		TRACE_SCOPE("upload");
 		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
 			g_video.pixtype, g_video.pixfmt, data);
 	}
 
+	{
+	TRACE_SCOPE("draw");
 	glClear(GL_COLOR_BUFFER_BIT);
 
 	glUseProgram(g_shader.program);
@@ -606,8 +610,9 @@ void video_refresh(const void *data, unsigned width, unsigned height, unsigned p
 
 	glUseProgram(0);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
 
-
+	TRACE_SCOPE("present");
 	wglDXUnlockObjectsNV(g_video.D3D_sharehandle, 1, &g_video.GL_htexture);
 	g_video.D3D_device->StretchRect(g_video.D3D_GLtarget, NULL, g_video.D3D_backbuf, NULL, D3DTEXF_NONE);
 	HRESULT res = g_video.D3D_device->PresentEx(NULL, NULL, NULL, NULL, D3DPRESENT_FORCEIMMEDIATE);
@@ -24,6 +24,8 @@ input* input::GetSingleton()
 
 void input::close()
 {
+	sampler.stop();
+
 	if (bl)
 	{
 		delete bl;
@@ -125,7 +127,23 @@ input::~input()
 
 	void input::poll()
 	{
-		if(bl)bl->process( di->read() );
+		if ( ! bl ) return;
+		events.clear();
+		if ( sampler.running() ) sampler.drain( events );
+		else di->read( events );
+		bl->process( events );
+	}
+
+	bool input::start_sampling( unsigned hz )
+	{
+		if ( ! di ) return false;
+		dinput * source = di;
+		return sampler.start( [ source ]( dinput::event_buffer & out ) { source->read( out ); }, hz );
+	}
+
+	void input::stop_sampling()
+	{
+		sampler.stop();
 	}
 
 	bool input::getbutton(int which, int16_t & value, int & retro_id, bool & isanalog)
@@ -170,12 +188,16 @@ input::~input()
 		bl->set_paused( paused );
 	}
 
+	// The sampler thread reads (and re-acquires) the devices, so focus
+	// changes are applied on that thread between two reads.
 	void input::set_focus( bool is_focused )
 	{
-		di->set_focus( is_focused );
+		dinput * target = di;
+		sampler.post( [ target, is_focused ]() { target->set_focus( is_focused ); } );
 	}
 
 	void input::refocus( void * hwnd )
 	{
-		di->refocus( hwnd );
+		dinput * target = di;
+		sampler.post( [ target, hwnd ]() { target->refocus( hwnd ); } );
 	}
\ No newline at end of file
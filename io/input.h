@@ -9,6 +9,7 @@
 #include "guid_container.h"
 #include "dinput.h"
 #include "bind_list.h"
+#include "input_sampler.h"
 #include "abstract_file.h"
 
 class Data_Reader;
@@ -30,6 +31,12 @@ public:
 	guid_container        * guids;
 	dinput                * di;
 	bind_list             * bl;
+	// filled and consumed by poll(), reused every frame
+	dinput::event_buffer    events;
+	// optional high-rate device sampling; poll() drains it instead of reading
+	input_sampler           sampler;
+	bool start_sampling( unsigned hz );
+	void stop_sampling();
 	static	input* m_Instance;
 	static input* CreateInstance(HINSTANCE hInstance, HWND hWnd);
 	static	input* GetSingleton();
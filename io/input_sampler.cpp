@@ -0,0 +1,134 @@
+#include "input_sampler.h"
+
+#include <chrono>
+
+input_sampler::input_sampler() : samples( 0 ), late( 0 ), coalesced( 0 ), lost( 0 ), quit( false ), period_usec( 1000 )
+{
+	reset_stats();
+}
+
+input_sampler::~input_sampler()
+{
+	stop();
+}
+
+int64_t input_sampler::now()
+{
+	return std::chrono::duration_cast< std::chrono::microseconds >(
+		std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+void input_sampler::reset_stats()
+{
+	age_total = 0.0;
+	age_max = 0.0;
+	age_count = 0;
+	last_event_usec = 0;
+}
+
+bool input_sampler::start( source read, unsigned hz )
+{
+	stop();
+	if ( ! read || ! hz ) return false;
+	this->read = read;
+	period_usec = 1000000 / hz;
+	if ( ! period_usec ) period_usec = 1;
+	backlog.clear();
+	quit = false;
+	worker = std::thread( &input_sampler::loop, this );
+	return true;
+}
+
+void input_sampler::stop()
+{
+	if ( ! worker.joinable() ) return;
+	quit = true;
+	worker.join();
+	// posted after the last pass; nobody else reads the devices now
+	run_requests();
+}
+
+void input_sampler::post( std::function< void () > request )
+{
+	if ( ! running() )
+	{
+		request();
+		return;
+	}
+	std::lock_guard< std::mutex > lock( requests_lock );
+	requests.push_back( request );
+}
+
+void input_sampler::run_requests()
+{
+	std::vector< std::function< void () > > pending;
+	{
+		std::lock_guard< std::mutex > lock( requests_lock );
+		pending.swap( requests );
+	}
+	for ( unsigned i = 0; i < pending.size(); ++i )
+		pending[ i ]();
+}
+
+// Oldest first: the backlog goes before anything newer, and while it holds
+// anything, newer events queue up behind it.
+void input_sampler::enqueue( const timed_event & te )
+{
+	if ( backlog.empty() && queue.push( te ) ) return;
+	backlog.push( te );
+}
+
+void input_sampler::loop()
+{
+	int64_t next = now();
+	while ( ! quit.load( std::memory_order_relaxed ) )
+	{
+		run_requests();
+		timed_event te;
+		while ( ! backlog.empty() && queue.push( backlog[ 0 ] ) )
+			backlog.pop( te );
+		scratch.clear();
+		read( scratch );
+		// one stamp per pass: events from the same pass happened within a period
+		int64_t stamp = now();
+		for ( unsigned i = 0; i < scratch.size(); ++i )
+		{
+			te.e = scratch[ i ];
+			te.usec = stamp;
+			enqueue( te );
+		}
+		coalesced.store( backlog.coalesced, std::memory_order_relaxed );
+		lost.store( backlog.dropped, std::memory_order_relaxed );
+		samples.fetch_add( 1, std::memory_order_relaxed );
+
+		next += period_usec;
+		int64_t t = now();
+		if ( t > next + period_usec )
+		{
+			// fell behind (the OS didn't schedule us); don't burst to catch up
+			late.fetch_add( 1, std::memory_order_relaxed );
+			next = t;
+			continue;
+		}
+		if ( next > t )
+			std::this_thread::sleep_for( std::chrono::microseconds( next - t ) );
+	}
+}
+
+unsigned input_sampler::drain( dinput::event_buffer & events )
+{
+	int64_t t = now();
+	unsigned n = 0;
+	timed_event te;
+	while ( queue.pop( te ) )
+	{
+		events.push( te.e );
+		double a = ( double ) ( t - te.usec );
+		age_total += a;
+		if ( a > age_max ) age_max = a;
+		++age_count;
+		last_event_usec = te.usec;
+		++n;
+	}
+	return n;
+}
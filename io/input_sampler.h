@@ -0,0 +1,102 @@
+#ifndef _input_sampler_h_
+#define _input_sampler_h_
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <stdint.h>
+#include <vector>
+
+#include "dinput.h"
+#include "event_queue.h"
+
+// Samples the input devices on a thread of its own, by default at 1 kHz,
+// instead of whenever the core happens to poll. Every transition is stamped
+// with the time it was sampled and queued for the emulation thread, which
+// drains the queue from its poll. Device access goes through a callback so
+// the thread and queue run the same against a fake backend.
+// Nothing drains while the emulator is paused or stalled. Once the queue is
+// full, new events wait in a backlog on the sampling thread, where axis
+// events merge per control, so key and button edges are kept and stay in
+// order; only a backlog of nothing but edges loses its oldest one.
+class input_sampler
+{
+public:
+	struct timed_event
+	{
+		dinput::di_event e;
+		// input_sampler::now() when the event was sampled
+		int64_t          usec;
+	};
+
+	typedef std::function< void ( dinput::event_buffer & ) > source;
+
+	input_sampler();
+	~input_sampler();
+
+	bool start( source read, unsigned hz = 1000 );
+
+	void stop();
+
+	bool running() const { return worker.joinable(); }
+
+	// Runs request on the sampling thread before its next read, or right
+	// away when the sampler isn't running. Anything else that touches the
+	// devices (focus changes) goes through here so it never overlaps a read.
+	void post( std::function< void () > request );
+
+	// Consumer side: moves everything queued into events (oldest first) and
+	// returns how many were moved. Ages are measured against now().
+	unsigned drain( dinput::event_buffer & events );
+
+	// Monotonic microseconds, the clock events are stamped with.
+	static int64_t now();
+
+	event_queue< timed_event, 1024 > queue;
+
+	// sampling passes done, and passes that started more than a period late
+	std::atomic< uint64_t > samples;
+	std::atomic< uint64_t > late;
+	// events the backlog merged into a newer one of the same control, and
+	// events it lost outright, as of the last pass
+	std::atomic< uint64_t > coalesced;
+	std::atomic< uint64_t > lost;
+
+	// sample-to-drain delay of every drained event, consumer side, summed until reset
+	double   age_total;
+	double   age_max;
+	uint64_t age_count;
+	// timestamp of the newest drained event, 0 before the first
+	int64_t  last_event_usec;
+
+	double age() const { return age_count ? age_total / age_count : 0.0; }
+
+	void reset_stats();
+
+private:
+	void loop();
+
+	std::thread          worker;
+	std::atomic< bool >  quit;
+	source               read;
+	unsigned             period_usec;
+
+	struct timed_levels
+	{
+		static bool is_level( const timed_event & t ) { return dinput::di_event_levels::is_level( t.e ); }
+		static bool same_control( const timed_event & a, const timed_event & b ) { return dinput::di_event_levels::same_control( a.e, b.e ); }
+	};
+
+	// only touched by the sampling thread
+	dinput::event_buffer scratch;
+	// what the full queue couldn't take yet, oldest first
+	event_ring< timed_event, 256, timed_levels > backlog;
+	std::mutex           requests_lock;
+	std::vector< std::function< void () > > requests;
+
+	void run_requests();
+	void enqueue( const timed_event & te );
+};
+
+#endif
@@ -22,12 +22,18 @@
 #include <stdint.h>
 #include <stddef.h>
 
-#if defined(__SSE2__)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FLOAT_TO_S16_SSE2
 #include <emmintrin.h>
+#if !defined(DONT_WANT_X86_OPTIMIZATIONS)
+#define FLOAT_TO_S16_AVX2
+#include <immintrin.h>
+#endif
 #elif defined(__ALTIVEC__)
 #include <altivec.h>
 #endif
 
+#include <boolean.h>
 #include <features/features_cpu.h>
 #include <audio/conversion/float_to_s16.h>
 
@@ -36,6 +42,38 @@ static bool float_to_s16_neon_enabled = false;
 void convert_float_s16_asm(int16_t *out, const float *in, size_t samples);
 #endif
 
+#if defined(FLOAT_TO_S16_AVX2)
+static bool float_to_s16_avx2_enabled = false;
+
+/* Compiled for AVX2 regardless of the global target so that
+ * baseline x86 builds still get it through runtime dispatch.
+ * Returns the amount of samples converted (a multiple of 16). */
+#if defined(__GNUC__)
+__attribute__((target("avx2")))
+#endif
+static size_t convert_float_to_s16_avx2(int16_t *out,
+      const float *in, size_t samples)
+{
+   size_t i;
+   __m256 factor = _mm256_set1_ps((float)0x8000);
+
+   for (i = 0; i + 16 <= samples; i += 16)
+   {
+      __m256 input_l = _mm256_loadu_ps(in + i + 0);
+      __m256 input_r = _mm256_loadu_ps(in + i + 8);
+      __m256i ints_l = _mm256_cvtps_epi32(_mm256_mul_ps(input_l, factor));
+      __m256i ints_r = _mm256_cvtps_epi32(_mm256_mul_ps(input_r, factor));
+      /* packs works per 128-bit lane, put the quadwords back in order. */
+      __m256i packed = _mm256_permute4x64_epi64(
+            _mm256_packs_epi32(ints_l, ints_r), 0xD8);
+
+      _mm256_storeu_si256((__m256i *)(out + i), packed);
+   }
+
+   return i;
+}
+#endif
+
 /**
  * convert_float_to_s16:
  * @out               : output buffer
@@ -51,9 +89,20 @@ void convert_float_to_s16(int16_t *out,
       const float *in, size_t samples)
 {
    size_t i      = 0;
-#if defined(__SSE2__)
+#if defined(FLOAT_TO_S16_SSE2)
    __m128 factor = _mm_set1_ps((float)0x8000);
 
+#if defined(FLOAT_TO_S16_AVX2)
+   if (float_to_s16_avx2_enabled)
+   {
+      size_t aligned_samples = convert_float_to_s16_avx2(out, in, samples);
+
+      out     = out     + aligned_samples;
+      in      = in      + aligned_samples;
+      samples = samples - aligned_samples;
+   }
+#endif
+
    for (i = 0; i + 8 <= samples; i += 8, in += 8, out += 8)
    {
       __m128 input_l = _mm_loadu_ps(in + 0);
@@ -156,5 +205,11 @@ void convert_float_to_s16_init_simd(void)
 
    if (cpu & RETRO_SIMD_NEON)
       float_to_s16_neon_enabled = true;
+#elif defined(FLOAT_TO_S16_AVX2)
+   uint64_t cpu = cpu_features_get();
+
+   /* RETRO_SIMD_AVX implies the OS saves the YMM state. */
+   if ((cpu & RETRO_SIMD_AVX) && (cpu & RETRO_SIMD_AVX2))
+      float_to_s16_avx2_enabled = true;
 #endif
 }
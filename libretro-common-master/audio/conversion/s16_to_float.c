@@ -19,8 +19,13 @@
  * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
-#if defined(__SSE2__)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define S16_TO_FLOAT_SSE2
 #include <emmintrin.h>
+#if !defined(DONT_WANT_X86_OPTIMIZATIONS)
+#define S16_TO_FLOAT_AVX2
+#include <immintrin.h>
+#endif
 #elif defined(__ALTIVEC__)
 #include <altivec.h>
 #endif
@@ -37,6 +42,36 @@ void convert_s16_float_asm(float *out, const int16_t *in,
       size_t samples, const float *gain);
 #endif
 
+#if defined(S16_TO_FLOAT_AVX2)
+static bool s16_to_float_avx2_enabled = false;
+
+/* Compiled for AVX2 regardless of the global target so that
+ * baseline x86 builds still get it through runtime dispatch.
+ * Returns the amount of samples converted (a multiple of 16). */
+#if defined(__GNUC__)
+__attribute__((target("avx2")))
+#endif
+static size_t convert_s16_to_float_avx2(float *out,
+      const int16_t *in, size_t samples, float gain)
+{
+   size_t i;
+   __m256 factor = _mm256_set1_ps(gain / 0x8000);
+
+   for (i = 0; i + 16 <= samples; i += 16)
+   {
+      __m128i input_l  = _mm_loadu_si128((const __m128i *)(in + i + 0));
+      __m128i input_r  = _mm_loadu_si128((const __m128i *)(in + i + 8));
+      __m256 output_l  = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(input_l));
+      __m256 output_r  = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(input_r));
+
+      _mm256_storeu_ps(out + i + 0, _mm256_mul_ps(output_l, factor));
+      _mm256_storeu_ps(out + i + 8, _mm256_mul_ps(output_r, factor));
+   }
+
+   return i;
+}
+#endif
+
 /**
  * convert_s16_to_float:
  * @out               : output buffer
@@ -52,10 +87,21 @@ void convert_s16_to_float(float *out,
 {
    size_t i      = 0;
 
-#if defined(__SSE2__)
+#if defined(S16_TO_FLOAT_SSE2)
    float fgain   = gain / UINT32_C(0x80000000);
    __m128 factor = _mm_set1_ps(fgain);
 
+#if defined(S16_TO_FLOAT_AVX2)
+   if (s16_to_float_avx2_enabled)
+   {
+      size_t aligned_samples = convert_s16_to_float_avx2(out, in, samples, gain);
+
+      out     = out     + aligned_samples;
+      in      = in      + aligned_samples;
+      samples = samples - aligned_samples;
+   }
+#endif
+
    for (i = 0; i + 8 <= samples; i += 8, in += 8, out += 8)
    {
       __m128i input    = _mm_loadu_si128((const __m128i *)in);
@@ -185,5 +231,11 @@ void convert_s16_to_float_init_simd(void)
 
    if (cpu & RETRO_SIMD_NEON)
       s16_to_float_neon_enabled = true;
+#elif defined(S16_TO_FLOAT_AVX2)
+   uint64_t cpu = cpu_features_get();
+
+   /* RETRO_SIMD_AVX implies the OS saves the YMM state. */
+   if ((cpu & RETRO_SIMD_AVX) && (cpu & RETRO_SIMD_AVX2))
+      s16_to_float_avx2_enabled = true;
 #endif
 }
@@ -0,0 +1,859 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (core_info_cache.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#endif
+
+#include <compat/strl.h>
+#include <dynamic/core_info_cache.h>
+#include <features/features_cpu.h>
+#include <file/file_path.h>
+#include <lists/dir_list.h>
+#include <lists/string_list.h>
+#include <retro_miscellaneous.h>
+#include <libretro.h>
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#ifdef HAVE_THREADS
+#define PROBE_LOCK(pool)   slock_lock((pool)->lock)
+#define PROBE_UNLOCK(pool) slock_unlock((pool)->lock)
+#else
+#define PROBE_LOCK(pool)   do { } while (0)
+#define PROBE_UNLOCK(pool) do { } while (0)
+#endif
+
+#if defined(_WIN32)
+#define CORE_EXT "dll"
+#elif defined(__APPLE__)
+#define CORE_EXT "dylib"
+#else
+#define CORE_EXT "so"
+#endif
+
+/* Only the tail of a probe's output is kept; the record comes last and
+ * whatever the core logged before it doesn't matter. */
+#define PROBE_OUTPUT_MAX   16384
+/* Backstop for a probe whose parent went away. */
+#define PROBE_CPU_SECONDS  30
+
+#ifndef _WIN32
+extern char **environ;
+#endif
+
+struct core_info_cache
+{
+   /* the file image: header, entries, pool */
+   void *data;
+   size_t size;
+
+   const core_info_cache_entry_t *entries;
+   const char *pool;
+   size_t count;
+};
+
+struct core_probe
+{
+   const char *path;
+   int64_t size;
+   int64_t mtime;
+   /* from the cache or the probe, pool offsets resolved */
+   const char *library_name;
+   const char *library_version;
+   const char *valid_extensions;
+   uint32_t api_version;
+   uint32_t flags;
+   /* probe output, the strings above point into it */
+   char *output;
+   bool probed;
+   bool pending;
+};
+
+struct core_probe_pool
+{
+   const char *exe;
+   struct core_probe *probes;
+   size_t count;
+   size_t next;
+   unsigned timeout_ms;
+#ifdef HAVE_THREADS
+   /* also held while starting a probe, so no other probe's
+    * process can inherit the pipe being set up */
+   slock_t *lock;
+#endif
+};
+
+/* Checks the header and every string offset, then points into the data. */
+static void core_info_cache_attach(core_info_cache_t *cache)
+{
+   const core_info_cache_header_t *header = (const core_info_cache_header_t*)cache->data;
+   size_t i;
+
+   cache->entries = NULL;
+   cache->pool    = NULL;
+   cache->count   = 0;
+
+   if (cache->size < sizeof(*header))
+      return;
+   if (header->magic != CORE_INFO_CACHE_MAGIC || header->version != CORE_INFO_CACHE_VERSION)
+      return;
+   if (header->count > (cache->size - sizeof(*header)) / sizeof(core_info_cache_entry_t))
+      return;
+   if (sizeof(*header) + header->count * sizeof(core_info_cache_entry_t)
+         + header->pool_size != cache->size)
+      return;
+
+   cache->entries = (const core_info_cache_entry_t*)(header + 1);
+   cache->pool    = (const char*)(cache->entries + header->count);
+
+   if (header->count && (!header->pool_size || cache->pool[header->pool_size - 1]))
+      return;
+   for (i = 0; i < header->count; i++)
+   {
+      const core_info_cache_entry_t *entry = &cache->entries[i];
+      if (     entry->path             >= header->pool_size
+            || entry->library_name     >= header->pool_size
+            || entry->library_version  >= header->pool_size
+            || entry->valid_extensions >= header->pool_size)
+         return;
+   }
+
+   cache->count = header->count;
+}
+
+core_info_cache_t *core_info_cache_load(const char *path)
+{
+   core_info_cache_t *cache = (core_info_cache_t*)calloc(1, sizeof(*cache));
+   FILE *fp;
+   long len;
+
+   if (!cache)
+      return NULL;
+   if (!(fp = fopen(path, "rb")))
+      return cache;
+
+   if (fseek(fp, 0, SEEK_END) == 0 && (len = ftell(fp)) > 0 && fseek(fp, 0, SEEK_SET) == 0)
+   {
+      if ((cache->data = malloc((size_t)len)))
+      {
+         if (fread(cache->data, 1, (size_t)len, fp) == (size_t)len)
+            cache->size = (size_t)len;
+         else
+         {
+            free(cache->data);
+            cache->data = NULL;
+         }
+      }
+   }
+   fclose(fp);
+
+   if (cache->data)
+      core_info_cache_attach(cache);
+   return cache;
+}
+
+void core_info_cache_free(core_info_cache_t *cache)
+{
+   if (!cache)
+      return;
+
+   free(cache->data);
+   free(cache);
+}
+
+bool core_info_cache_save(const core_info_cache_t *cache, const char *path)
+{
+   char tmp[PATH_MAX_LENGTH];
+   core_info_cache_header_t empty;
+   const void *data = cache->data;
+   size_t size      = cache->size;
+   FILE *fp;
+   bool ret;
+
+   if (!cache->count)
+   {
+      empty.magic     = CORE_INFO_CACHE_MAGIC;
+      empty.version   = CORE_INFO_CACHE_VERSION;
+      empty.count     = 0;
+      empty.pool_size = 0;
+      data            = &empty;
+      size            = sizeof(empty);
+   }
+
+   snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+   if (!(fp = fopen(tmp, "wb")))
+      return false;
+   ret = fwrite(data, 1, size, fp) == size;
+   if (fclose(fp) != 0)
+      ret = false;
+
+   if (ret)
+   {
+#ifdef _WIN32
+      /* rename() won't replace an existing file here. */
+      remove(path);
+#endif
+      ret = rename(tmp, path) == 0;
+   }
+   if (!ret)
+      remove(tmp);
+   return ret;
+}
+
+size_t core_info_cache_count(const core_info_cache_t *cache)
+{
+   return cache ? cache->count : 0;
+}
+
+const core_info_cache_entry_t *core_info_cache_get(
+      const core_info_cache_t *cache, size_t i)
+{
+   return &cache->entries[i];
+}
+
+const char *core_info_cache_string(const core_info_cache_t *cache,
+      uint32_t offset)
+{
+   return cache->pool + offset;
+}
+
+ssize_t core_info_cache_find(const core_info_cache_t *cache, const char *path)
+{
+   size_t lo = 0;
+   size_t hi = core_info_cache_count(cache);
+
+   while (lo < hi)
+   {
+      size_t mid = lo + (hi - lo) / 2;
+      int cmp    = strcmp(cache->pool + cache->entries[mid].path, path);
+
+      if (!cmp)
+         return (ssize_t)mid;
+      if (cmp < 0)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+
+   return -1;
+}
+
+/* Keeps the last PROBE_OUTPUT_MAX bytes of what the probe printed. */
+static void core_probe_append(char *out, size_t *len, const char *data, size_t size)
+{
+   if (size >= PROBE_OUTPUT_MAX)
+   {
+      data += size - PROBE_OUTPUT_MAX;
+      size  = PROBE_OUTPUT_MAX;
+   }
+   if (*len + size > PROBE_OUTPUT_MAX)
+   {
+      size_t drop = *len + size - PROBE_OUTPUT_MAX;
+      memmove(out, out + drop, *len - drop);
+      *len -= drop;
+   }
+   memcpy(out + *len, data, size);
+   *len += size;
+}
+
+/* Splits the record at the end of the output in place:
+ *   "\ncore-info <version>\n" api_version need_fullpath block_extract
+ *   library_name library_version valid_extensions "end"
+ * one per line. */
+static bool core_probe_parse(struct core_probe *probe, char *out, size_t len)
+{
+   char marker[32];
+   char *fields[7];
+   char *record = NULL;
+   char *p;
+   size_t marker_len;
+   unsigned i;
+
+   snprintf(marker, sizeof(marker), "\ncore-info %u\n", CORE_INFO_CACHE_VERSION);
+   marker_len = strlen(marker);
+   out[len]   = '\0';
+
+   /* the core may have printed anything before, NULs included */
+   for (p = out; p + marker_len <= out + len; p++)
+      if (!memcmp(p, marker, marker_len))
+         record = p + marker_len;
+   if (!record)
+      return false;
+
+   for (i = 0, p = record; i < 7; i++)
+   {
+      char *eol = strchr(p, '\n');
+      if (!eol)
+         return false;
+      *eol      = '\0';
+      fields[i] = p;
+      p         = eol + 1;
+   }
+   if (strcmp(fields[6], "end"))
+      return false;
+
+   probe->api_version      = (uint32_t)strtoul(fields[0], NULL, 10);
+   probe->flags            = CORE_INFO_CACHE_VALID;
+   if (atoi(fields[1]))
+      probe->flags        |= CORE_INFO_CACHE_NEED_FULLPATH;
+   if (atoi(fields[2]))
+      probe->flags        |= CORE_INFO_CACHE_BLOCK_EXTRACT;
+   probe->library_name     = fields[3];
+   probe->library_version  = fields[4];
+   probe->valid_extensions = fields[5];
+   return true;
+}
+
+#ifdef _WIN32
+static wchar_t *core_probe_widen(const char *str)
+{
+   int len      = MultiByteToWideChar(CP_UTF8, 0, str, -1, NULL, 0);
+   wchar_t *out = len > 0 ? (wchar_t*)malloc(len * sizeof(wchar_t)) : NULL;
+
+   if (out && !MultiByteToWideChar(CP_UTF8, 0, str, -1, out, len))
+   {
+      free(out);
+      return NULL;
+   }
+   return out;
+}
+
+static bool core_probe_run(struct core_probe_pool *pool, struct core_probe *probe,
+      char *out, size_t *len)
+{
+   char cmd[PATH_MAX_LENGTH * 2 + 64];
+   SECURITY_ATTRIBUTES sa = { sizeof(sa), NULL, FALSE };
+   STARTUPINFOW si;
+   PROCESS_INFORMATION pi;
+   HANDLE read_end, write_end, nul;
+   retro_time_t deadline = cpu_features_get_time_usec()
+      + (retro_time_t)pool->timeout_ms * 1000;
+   wchar_t *wcmd;
+   BOOL started;
+
+   snprintf(cmd, sizeof(cmd), "\"%s\" " CORE_INFO_PROBE_ARG " \"%s\"",
+         pool->exe, probe->path);
+   if (!(wcmd = core_probe_widen(cmd)))
+      return false;
+   if (!CreatePipe(&read_end, &write_end, &sa, 65536))
+   {
+      free(wcmd);
+      return false;
+   }
+   nul = CreateFileW(L"NUL", GENERIC_READ | GENERIC_WRITE,
+         FILE_SHARE_READ | FILE_SHARE_WRITE, &sa, OPEN_EXISTING, 0, NULL);
+
+   memset(&si, 0, sizeof(si));
+   si.cb         = sizeof(si);
+   si.dwFlags    = STARTF_USESTDHANDLES;
+   si.hStdInput  = nul;
+   si.hStdOutput = write_end;
+   si.hStdError  = nul;
+
+   /* Handles are only inheritable while this probe starts. */
+   PROBE_LOCK(pool);
+   SetHandleInformation(write_end, HANDLE_FLAG_INHERIT, HANDLE_FLAG_INHERIT);
+   if (nul != INVALID_HANDLE_VALUE)
+      SetHandleInformation(nul, HANDLE_FLAG_INHERIT, HANDLE_FLAG_INHERIT);
+   started = CreateProcessW(NULL, wcmd, NULL, NULL, TRUE, CREATE_NO_WINDOW,
+         NULL, NULL, &si, &pi);
+   SetHandleInformation(write_end, HANDLE_FLAG_INHERIT, 0);
+   if (nul != INVALID_HANDLE_VALUE)
+      SetHandleInformation(nul, HANDLE_FLAG_INHERIT, 0);
+   PROBE_UNLOCK(pool);
+
+   free(wcmd);
+   CloseHandle(write_end);
+   if (nul != INVALID_HANDLE_VALUE)
+      CloseHandle(nul);
+   if (!started)
+   {
+      CloseHandle(read_end);
+      return false;
+   }
+
+   for (;;)
+   {
+      char chunk[4096];
+      DWORD avail = 0, got = 0;
+      DWORD wait  = WaitForSingleObject(pi.hProcess, 10);
+
+      /* drained while it runs, a chatty core would fill the pipe */
+      while (PeekNamedPipe(read_end, NULL, 0, NULL, &avail, NULL) && avail
+            && ReadFile(read_end, chunk, avail < sizeof(chunk) ? avail : sizeof(chunk), &got, NULL)
+            && got)
+         core_probe_append(out, len, chunk, got);
+
+      if (wait != WAIT_TIMEOUT)
+         break;
+      if (cpu_features_get_time_usec() > deadline)
+      {
+         TerminateProcess(pi.hProcess, ERROR_TIMEOUT);
+         WaitForSingleObject(pi.hProcess, INFINITE);
+         break;
+      }
+   }
+
+   CloseHandle(pi.hThread);
+   CloseHandle(pi.hProcess);
+   CloseHandle(read_end);
+   return true;
+}
+#else
+static bool core_probe_run(struct core_probe_pool *pool, struct core_probe *probe,
+      char *out, size_t *len)
+{
+   posix_spawn_file_actions_t actions;
+   char *argv[4];
+   int fds[2];
+   pid_t pid;
+   int status, err;
+   retro_time_t deadline = cpu_features_get_time_usec()
+      + (retro_time_t)pool->timeout_ms * 1000;
+
+   argv[0] = (char*)pool->exe;
+   argv[1] = (char*)CORE_INFO_PROBE_ARG;
+   argv[2] = (char*)probe->path;
+   argv[3] = NULL;
+
+   if (posix_spawn_file_actions_init(&actions) != 0)
+      return false;
+   posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+   posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 0);
+
+   /* The pipe is close-on-exec before anyone else can spawn, or another
+    * probe would hold its write end and delay the EOF. */
+   PROBE_LOCK(pool);
+   if (pipe(fds) != 0)
+   {
+      PROBE_UNLOCK(pool);
+      posix_spawn_file_actions_destroy(&actions);
+      return false;
+   }
+   fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+   fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+   posix_spawn_file_actions_adddup2(&actions, fds[1], 1);
+   err = posix_spawn(&pid, pool->exe, &actions, NULL, argv, environ);
+   PROBE_UNLOCK(pool);
+
+   posix_spawn_file_actions_destroy(&actions);
+   close(fds[1]);
+   if (err != 0)
+   {
+      close(fds[0]);
+      return false;
+   }
+
+   for (;;)
+   {
+      char chunk[4096];
+      struct pollfd pfd;
+      retro_time_t left = deadline - cpu_features_get_time_usec();
+      ssize_t got;
+      int ready;
+
+      if (left <= 0)
+      {
+         kill(pid, SIGKILL);
+         break;
+      }
+
+      pfd.fd      = fds[0];
+      pfd.events  = POLLIN;
+      pfd.revents = 0;
+      ready       = poll(&pfd, 1, (int)((left + 999) / 1000));
+      if (ready < 0 && errno == EINTR)
+         continue;
+      if (ready <= 0)
+         continue;
+
+      got = read(fds[0], chunk, sizeof(chunk));
+      if (got < 0 && errno == EINTR)
+         continue;
+      if (got <= 0)
+         break;
+      core_probe_append(out, len, chunk, (size_t)got);
+   }
+
+   close(fds[0]);
+   while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+   return true;
+}
+#endif
+
+static void core_probe_worker(void *data)
+{
+   struct core_probe_pool *pool = (struct core_probe_pool*)data;
+
+   for (;;)
+   {
+      struct core_probe *probe = NULL;
+      size_t len               = 0;
+      char *out;
+
+      PROBE_LOCK(pool);
+      while (pool->next < pool->count && !pool->probes[pool->next].pending)
+         pool->next++;
+      if (pool->next < pool->count)
+         probe = &pool->probes[pool->next++];
+      PROBE_UNLOCK(pool);
+
+      if (!probe)
+         break;
+
+      /* Whatever happens, it's done; a failed probe is cached as such. */
+      probe->pending = false;
+      probe->flags   = 0;
+      if (!(out = (char*)malloc(PROBE_OUTPUT_MAX + 1)))
+         continue;
+      if (core_probe_run(pool, probe, out, &len) && core_probe_parse(probe, out, len))
+         probe->output = out;
+      else
+         free(out);
+   }
+}
+
+static int core_probe_compare(const void *a_, const void *b_)
+{
+   const struct core_probe *a = (const struct core_probe*)a_;
+   const struct core_probe *b = (const struct core_probe*)b_;
+   return strcmp(a->path, b->path);
+}
+
+static size_t core_probe_strings_size(const struct core_probe *probe)
+{
+   size_t size = strlen(probe->path) + 1;
+
+   if (probe->flags & CORE_INFO_CACHE_VALID)
+      size += strlen(probe->library_name) + strlen(probe->library_version)
+         + strlen(probe->valid_extensions) + 3;
+   return size;
+}
+
+static uint32_t core_probe_put_string(char *pool, size_t *pool_size, const char *str)
+{
+   uint32_t offset = (uint32_t)*pool_size;
+   size_t len      = strlen(str) + 1;
+
+   memcpy(pool + *pool_size, str, len);
+   *pool_size += len;
+   return offset;
+}
+
+/* Lays the probes, sorted, out as a new file image for @cache. */
+static bool core_info_cache_rebuild(core_info_cache_t *cache,
+      const struct core_probe *probes, size_t count)
+{
+   core_info_cache_header_t *header;
+   core_info_cache_entry_t *entries;
+   char *pool;
+   size_t pool_size = 0;
+   size_t size;
+   size_t i;
+   void *data;
+
+   for (i = 0; i < count; i++)
+      pool_size += core_probe_strings_size(&probes[i]);
+
+   size = sizeof(*header) + count * sizeof(*entries) + pool_size;
+   if (!(data = malloc(size)))
+      return false;
+
+   header            = (core_info_cache_header_t*)data;
+   entries           = (core_info_cache_entry_t*)(header + 1);
+   pool              = (char*)(entries + count);
+   header->magic     = CORE_INFO_CACHE_MAGIC;
+   header->version   = CORE_INFO_CACHE_VERSION;
+   header->count     = (uint32_t)count;
+   header->pool_size = (uint32_t)pool_size;
+
+   pool_size = 0;
+   for (i = 0; i < count; i++)
+   {
+      const struct core_probe *probe = &probes[i];
+      core_info_cache_entry_t *entry = &entries[i];
+
+      entry->file_size   = probe->size;
+      entry->file_mtime  = probe->mtime;
+      entry->api_version = probe->api_version;
+      entry->flags       = probe->flags;
+      entry->path        = core_probe_put_string(pool, &pool_size, probe->path);
+      if (probe->flags & CORE_INFO_CACHE_VALID)
+      {
+         entry->library_name     = core_probe_put_string(pool, &pool_size, probe->library_name);
+         entry->library_version  = core_probe_put_string(pool, &pool_size, probe->library_version);
+         entry->valid_extensions = core_probe_put_string(pool, &pool_size, probe->valid_extensions);
+      }
+      else
+      {
+         /* the empty tail of the path */
+         entry->library_name     = entry->path + (uint32_t)strlen(probe->path);
+         entry->library_version  = entry->library_name;
+         entry->valid_extensions = entry->library_name;
+      }
+   }
+
+   free(cache->data);
+   cache->data = data;
+   cache->size = size;
+   core_info_cache_attach(cache);
+   return true;
+}
+
+static bool core_probe_self_exe(char *s, size_t len)
+{
+#if defined(_WIN32)
+   wchar_t path[PATH_MAX_LENGTH];
+   DWORD got = GetModuleFileNameW(NULL, path, PATH_MAX_LENGTH);
+   return got && got < PATH_MAX_LENGTH
+      && WideCharToMultiByte(CP_UTF8, 0, path, -1, s, (int)len, NULL, NULL) > 0;
+#elif defined(__linux__)
+   ssize_t got = readlink("/proc/self/exe", s, len - 1);
+   if (got <= 0)
+      return false;
+   s[got] = '\0';
+   return true;
+#else
+   return false;
+#endif
+}
+
+bool core_info_cache_refresh(core_info_cache_t *cache, const char *dir,
+      const char *probe_exe, unsigned threads, unsigned timeout_ms,
+      core_info_cache_stats_t *stats)
+{
+   char exe[PATH_MAX_LENGTH];
+   struct core_probe_pool pool;
+   core_info_cache_stats_t st;
+   struct string_list *list = NULL;
+   bool ret                 = false;
+   size_t kept              = 0;
+   size_t i;
+#ifdef HAVE_THREADS
+   sthread_t **workers = NULL;
+   unsigned started    = 0;
+   unsigned t;
+#endif
+
+   memset(&pool, 0, sizeof(pool));
+   memset(&st, 0, sizeof(st));
+
+   if (!(list = dir_list_new(dir, CORE_EXT, false, false, false, false)))
+      goto end;
+   if (!(pool.probes = (struct core_probe*)calloc(list->size + 1, sizeof(*pool.probes))))
+      goto end;
+
+   for (i = 0; i < list->size; i++)
+   {
+      struct core_probe *probe = &pool.probes[pool.count];
+      ssize_t found;
+
+      probe->path = list->elems[i].data;
+      if (!path_get_size_mtime(probe->path, &probe->size, &probe->mtime))
+         continue;
+      pool.count++;
+
+      if ((found = core_info_cache_find(cache, probe->path)) >= 0)
+         kept++;
+      if (found >= 0
+            && cache->entries[found].file_size  == probe->size
+            && cache->entries[found].file_mtime == probe->mtime)
+      {
+         const core_info_cache_entry_t *entry = &cache->entries[found];
+         probe->library_name     = cache->pool + entry->library_name;
+         probe->library_version  = cache->pool + entry->library_version;
+         probe->valid_extensions = cache->pool + entry->valid_extensions;
+         probe->api_version      = entry->api_version;
+         probe->flags            = entry->flags;
+         st.reused++;
+      }
+      else
+      {
+         probe->probed  = true;
+         probe->pending = true;
+         st.probed++;
+      }
+   }
+   st.cores   = (unsigned)pool.count;
+   st.removed = (unsigned)(core_info_cache_count(cache) - kept);
+
+   if (st.probed)
+   {
+      if (!probe_exe)
+      {
+         if (!core_probe_self_exe(exe, sizeof(exe)))
+            goto end;
+         probe_exe = exe;
+      }
+      pool.exe        = probe_exe;
+      pool.timeout_ms = timeout_ms;
+
+      if (!threads)
+         threads = cpu_features_get_core_amount();
+      if (threads > st.probed)
+         threads = st.probed;
+
+#ifdef HAVE_THREADS
+      if (!(pool.lock = slock_new()))
+         goto end;
+      if (threads > 1)
+         workers = (sthread_t**)calloc(threads - 1, sizeof(*workers));
+      for (t = 0; workers && t < threads - 1; t++, started++)
+         if (!(workers[t] = sthread_create(core_probe_worker, &pool)))
+            break;
+#endif
+
+      core_probe_worker(&pool);
+
+#ifdef HAVE_THREADS
+      for (t = 0; t < started; t++)
+         sthread_join(workers[t]);
+      free(workers);
+#endif
+
+      for (i = 0; i < pool.count; i++)
+         if (pool.probes[i].probed && !(pool.probes[i].flags & CORE_INFO_CACHE_VALID))
+            st.failed++;
+   }
+
+   if (st.probed || st.removed)
+   {
+      qsort(pool.probes, pool.count, sizeof(*pool.probes), core_probe_compare);
+      if (!core_info_cache_rebuild(cache, pool.probes, pool.count))
+         goto end;
+   }
+   ret = true;
+
+end:
+   if (stats)
+      *stats = st;
+   for (i = 0; pool.probes && i < pool.count; i++)
+      free(pool.probes[i].output);
+   free(pool.probes);
+   string_list_free(list);
+#ifdef HAVE_THREADS
+   if (pool.lock)
+      slock_free(pool.lock);
+#endif
+   return ret;
+}
+
+/* Newlines would end the field early; nothing sane puts one in there. */
+static void core_probe_put_field(char *s, size_t len, const char *str)
+{
+   size_t used = strlen(s);
+   char *p;
+
+   if (used >= len)
+      return;
+   strlcpy(s + used, str ? str : "", len - used);
+   for (p = s + used; *p; p++)
+      if (*p == '\n' || *p == '\r')
+         *p = ' ';
+   strlcat(s, "\n", len);
+}
+
+int core_info_probe_main(const char *core_path)
+{
+   char record[PROBE_OUTPUT_MAX];
+   struct retro_system_info info;
+   unsigned (*api_version)(void);
+   void (*get_system_info)(struct retro_system_info*);
+   size_t len;
+#ifdef _WIN32
+   HMODULE lib;
+   wchar_t *wpath;
+   DWORD written;
+
+   /* a crashing core should end this process, not wait on an error dialog */
+   SetErrorMode(SEM_FAILCRITICALERRORS | SEM_NOGPFAULTERRORBOX | SEM_NOOPENFILEERRORBOX);
+   if (!(wpath = core_probe_widen(core_path)))
+      return 1;
+   lib = LoadLibraryExW(wpath, NULL, LOAD_WITH_ALTERED_SEARCH_PATH);
+   free(wpath);
+   if (!lib)
+      return 1;
+   api_version     = (unsigned (*)(void))GetProcAddress(lib, "retro_api_version");
+   get_system_info = (void (*)(struct retro_system_info*))GetProcAddress(lib, "retro_get_system_info");
+#else
+   struct rlimit lim;
+   void *lib;
+
+   /* no core files from a crashing core, and no spinning forever
+    * should the parent be gone and unable to kill us */
+   lim.rlim_cur = lim.rlim_max = 0;
+   setrlimit(RLIMIT_CORE, &lim);
+   lim.rlim_cur = lim.rlim_max = PROBE_CPU_SECONDS;
+   setrlimit(RLIMIT_CPU, &lim);
+
+   if (!(lib = dlopen(core_path, RTLD_NOW | RTLD_LOCAL)))
+      return 1;
+   *(void**)&api_version     = dlsym(lib, "retro_api_version");
+   *(void**)&get_system_info = dlsym(lib, "retro_get_system_info");
+#endif
+
+   if (!api_version || !get_system_info)
+      return 1;
+
+   memset(&info, 0, sizeof(info));
+   get_system_info(&info);
+
+   snprintf(record, sizeof(record), "\ncore-info %u\n%u\n%d\n%d\n",
+         CORE_INFO_CACHE_VERSION, api_version(),
+         info.need_fullpath ? 1 : 0, info.block_extract ? 1 : 0);
+   core_probe_put_field(record, sizeof(record), info.library_name);
+   core_probe_put_field(record, sizeof(record), info.library_version);
+   core_probe_put_field(record, sizeof(record), info.valid_extensions);
+   strlcat(record, "end\n", sizeof(record));
+   len = strlen(record);
+
+   /* past stdio, the core may have buffered output of its own there */
+   fflush(stdout);
+#ifdef _WIN32
+   return WriteFile(GetStdHandle(STD_OUTPUT_HANDLE), record, (DWORD)len, &written, NULL)
+      && written == len ? 0 : 1;
+#else
+   return write(1, record, len) == (ssize_t)len ? 0 : 1;
+#endif
+}
@@ -23,6 +23,14 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include <boolean.h>
+#include <features/features_cpu.h>
+
+#if (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)) && !defined(DONT_WANT_X86_OPTIMIZATIONS)
+#define CRC32_PCLMUL
+#include <immintrin.h>
+#endif
+
 static const uint32_t crc32_table[256] = {
   0x00000000L, 0x77073096L, 0xee0e612cL, 0x990951baL, 0x076dc419L,
   0x706af48fL, 0xe963a535L, 0x9e6495a3L, 0x0edb8832L, 0x79dcb8a4L,
@@ -78,12 +86,162 @@ static const uint32_t crc32_table[256] = {
   0x2d02ef8dL
 };
 
-uint32_t encoding_crc32(uint32_t crc, const uint8_t *buf, size_t len)
+/* crc32_slice[k][b] is the CRC of byte b followed by k zero bytes,
+ * so eight table lookups retire eight input bytes at once. */
+static uint32_t crc32_slice[8][256];
+static bool crc32_initialized    = false;
+#if defined(CRC32_PCLMUL)
+static bool crc32_pclmul_enabled = false;
+#endif
+
+static void crc32_init(void)
 {
-   crc = crc ^ 0xffffffff;
+   unsigned i, k;
+
+   for (i = 0; i < 256; i++)
+      crc32_slice[0][i] = crc32_table[i];
+   for (k = 1; k < 8; k++)
+      for (i = 0; i < 256; i++)
+         crc32_slice[k][i] = (crc32_slice[k - 1][i] >> 8)
+            ^ crc32_table[crc32_slice[k - 1][i] & 0xff];
+
+#if defined(CRC32_PCLMUL)
+   {
+      uint64_t cpu = cpu_features_get();
+      if ((cpu & RETRO_SIMD_PCLMUL) && (cpu & RETRO_SIMD_SSE4))
+         crc32_pclmul_enabled = true;
+   }
+#endif
+
+   /* Every caller computes the same tables, so a race here is harmless. */
+   crc32_initialized = true;
+}
+
+/* Works on the inverted CRC. */
+static uint32_t crc32_slice8(uint32_t crc, const uint8_t *buf, size_t len)
+{
+   for (; len >= 8; buf += 8, len -= 8)
+   {
+      uint32_t one = crc ^ (buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24));
+      uint32_t two = buf[4] | (buf[5] << 8) | (buf[6] << 16) | ((uint32_t)buf[7] << 24);
+
+      crc = crc32_slice[7][one & 0xff]         ^ crc32_slice[6][(one >> 8) & 0xff]
+          ^ crc32_slice[5][(one >> 16) & 0xff] ^ crc32_slice[4][one >> 24]
+          ^ crc32_slice[3][two & 0xff]         ^ crc32_slice[2][(two >> 8) & 0xff]
+          ^ crc32_slice[1][(two >> 16) & 0xff] ^ crc32_slice[0][two >> 24];
+   }
 
    while (len--)
       crc = crc32_table[(crc ^ (*buf++)) & 0xff] ^ (crc >> 8);
 
-   return crc ^ 0xffffffff;
+   return crc;
+}
+
+#if defined(CRC32_PCLMUL)
+/* Carry-less multiply folding (Gopal et al., "Fast CRC Computation for
+ * Generic Polynomials Using PCLMULQDQ Instruction", Intel 2009): four
+ * 128-bit lanes are folded 64 bytes at a time, then into one lane and
+ * Barrett-reduced. Works on the inverted CRC; len must be a multiple of
+ * 16 and at least 64. Compiled for PCLMUL regardless of the global target
+ * so that baseline x86 builds still get it through runtime dispatch. */
+#if defined(__GNUC__)
+__attribute__((target("sse4.1,pclmul")))
+#endif
+static uint32_t crc32_pclmul(uint32_t crc, const uint8_t *buf, size_t len)
+{
+   /* Bit-reflected x^(k) mod P constants and the Barrett pair from the paper. */
+   const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+   const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+   const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124LL);
+   const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+   const __m128i low  = _mm_setr_epi32(~0, 0, ~0, 0);
+   __m128i x1, x2, x3, x4, x5, x6, x7, x8;
+
+   x1 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+   x2 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+   x3 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+   x4 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+   x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+   buf += 64;
+   len -= 64;
+
+   /* Fold 64 bytes at a time. */
+   for (; len >= 64; buf += 64, len -= 64)
+   {
+      x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+      x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+      x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+      x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+
+      x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+      x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+      x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+      x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)(buf + 0x00)));
+      x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(buf + 0x10)));
+      x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(buf + 0x20)));
+      x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(buf + 0x30)));
+   }
+
+   /* Fold the four lanes into one. */
+   x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+   x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+   x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+   x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+   x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+   x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+   /* Then whatever 16-byte blocks are left. */
+   for (; len >= 16; buf += 16, len -= 16)
+   {
+      x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+      x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)buf)), x5);
+   }
+
+   /* 128 bits down to 64. */
+   x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+   x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+   x2 = _mm_srli_si128(x1, 4);
+   x1 = _mm_and_si128(x1, low);
+   x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+   x1 = _mm_xor_si128(x1, x2);
+
+   /* Barrett reduction to 32. */
+   x2 = _mm_and_si128(x1, low);
+   x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+   x2 = _mm_and_si128(x2, low);
+   x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+   x1 = _mm_xor_si128(x1, x2);
+
+   return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+#endif
+
+uint32_t encoding_crc32(uint32_t crc, const uint8_t *buf, size_t len)
+{
+   if (!crc32_initialized)
+      crc32_init();
+
+   crc = crc ^ 0xffffffff;
+
+#if defined(CRC32_PCLMUL)
+   /* Folding has some setup cost; short buffers stay on the tables. */
+   if (crc32_pclmul_enabled && len >= 256)
+   {
+      size_t bulk = len & ~(size_t)15;
+      crc  = crc32_pclmul(crc, buf, bulk);
+      buf += bulk;
+      len -= bulk;
+   }
+#endif
+
+   return crc32_slice8(crc, buf, len) ^ 0xffffffff;
 }
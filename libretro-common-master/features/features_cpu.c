@@ -39,6 +39,10 @@
 #include <windows.h>
 #endif
 
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
 #if defined(__CELLOS_LV2__)
 #ifndef _PPU_INTRINSICS_H
 #include <ppu_intrinsics.h>
@@ -135,7 +139,13 @@ static int ra_clock_gettime(int clk_ik, struct timespec *t)
 retro_perf_tick_t cpu_features_get_perf_counter(void)
 {
    retro_perf_tick_t time_ticks = 0;
-#if defined(_WIN32)
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+   time_ticks = __rdtsc();
+#elif defined(_WIN32) && !defined(_XBOX)
+   LARGE_INTEGER count;
+   if (QueryPerformanceCounter(&count))
+      time_ticks = count.QuadPart;
+#elif defined(_WIN32)
    long tv_sec, tv_usec;
    static const unsigned __int64 epoch = 11644473600000000ULL;
    FILETIME file_time;
@@ -242,6 +252,7 @@ retro_time_t cpu_features_get_time_usec(void)
 #endif
 
 #if defined(CPU_X86) && !defined(__MACH__)
+/* Sub-leaf 0 for the leaves that have them (7 holds AVX2 and SHA). */
 void x86_cpuid(int func, int flags[4])
 {
    /* On Android, we compile RetroArch with PIC, and we
@@ -260,9 +271,9 @@ void x86_cpuid(int func, int flags[4])
          "cpuid\n"
          "xchg %%" REG_b ", %%" REG_S "\n"
          : "=a"(flags[0]), "=S"(flags[1]), "=c"(flags[2]), "=d"(flags[3])
-         : "a"(func));
+         : "a"(func), "2"(0));
 #elif defined(_MSC_VER)
-   __cpuid(flags, func);
+   __cpuidex(flags, func, 0);
 #else
    printf("Unknown compiler. Cannot check CPUID with inline assembly.\n");
    memset(flags, 0, 4 * sizeof(int));
@@ -546,7 +557,7 @@ uint64_t cpu_features_get(void)
    const int avx_flags = (1 << 27) | (1 << 28);
 #endif
 
-   char buf[sizeof(" MMX MMXEXT SSE SSE2 SSE3 SSSE3 SS4 SSE4.2 AES AVX AVX2 NEON VMX VMX128 VFPU PS")];
+   char buf[sizeof(" MMX MMXEXT SSE SSE2 SSE3 SSSE3 SS4 SSE4.2 AES PCLMUL SHA AVX AVX2 NEON VMX VMX128 VFPU PS")];
 
    memset(buf, 0, sizeof(buf));
 
@@ -677,6 +688,9 @@ uint64_t cpu_features_get(void)
    if (flags[2] & (1 << 25))
       cpu |= RETRO_SIMD_AES;
 
+   if (flags[2] & (1 << 1))
+      cpu |= RETRO_SIMD_PCLMUL;
+
 
    /* Must only perform xgetbv check if we have
     * AVX CPU support (guaranteed to have at least i686). */
@@ -689,6 +703,8 @@ uint64_t cpu_features_get(void)
       x86_cpuid(7, flags);
       if (flags[1] & (1 << 5))
          cpu |= RETRO_SIMD_AVX2;
+      if (flags[1] & (1 << 29))
+         cpu |= RETRO_SIMD_SHA;
    }
 
    x86_cpuid(0x80000000, flags);
@@ -760,6 +776,8 @@ uint64_t cpu_features_get(void)
    if (cpu & RETRO_SIMD_SSE4)   strlcat(buf, " SSE4", sizeof(buf));
    if (cpu & RETRO_SIMD_SSE42)  strlcat(buf, " SSE4.2", sizeof(buf));
    if (cpu & RETRO_SIMD_AES)    strlcat(buf, " AES", sizeof(buf));
+   if (cpu & RETRO_SIMD_PCLMUL) strlcat(buf, " PCLMUL", sizeof(buf));
+   if (cpu & RETRO_SIMD_SHA)    strlcat(buf, " SHA", sizeof(buf));
    if (cpu & RETRO_SIMD_AVX)    strlcat(buf, " AVX", sizeof(buf));
    if (cpu & RETRO_SIMD_AVX2)   strlcat(buf, " AVX2", sizeof(buf));
    if (cpu & RETRO_SIMD_NEON)   strlcat(buf, " NEON", sizeof(buf));
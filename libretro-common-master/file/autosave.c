@@ -0,0 +1,336 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (autosave.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <io.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+#include <compat/posix_string.h>
+#include <features/features_cpu.h>
+#include <file/autosave.h>
+#include <retro_miscellaneous.h>
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+/* Unit of change: one compare, and one copy into the shadow if it differs. */
+#define AUTOSAVE_BLOCK 4096
+
+struct autosave
+{
+   uint8_t *data;    /* the core's memory */
+   uint8_t *shadow;  /* what it held at the last check */
+   uint8_t *pending; /* queued for the writer */
+   uint8_t *writing; /* the writer's, while it writes */
+   size_t size;
+   char *path;
+
+   retro_time_t settle_usec;
+   retro_time_t max_usec;
+   /* 0 while the shadow matches what was last queued */
+   retro_time_t first_change;
+   retro_time_t last_change;
+
+   /* under the lock with threads */
+   bool queued;
+   bool busy;
+   bool quit;
+   bool write_failed;
+   autosave_stats_t stats;
+
+#ifdef HAVE_THREADS
+   sthread_t *thread;
+   slock_t *lock;
+   scond_t *work;
+   scond_t *idle;
+#endif
+};
+
+/* Brings the shadow up to date; returns the number of blocks that changed.
+ * libc memcmp is already vectorised and beat hand-written SSE2/AVX2 loops
+ * on every size measured. */
+static size_t autosave_compare(autosave_t *save)
+{
+   size_t changed = 0;
+   size_t off;
+
+   for (off = 0; off < save->size; off += AUTOSAVE_BLOCK)
+   {
+      size_t len = save->size - off < AUTOSAVE_BLOCK ? save->size - off : AUTOSAVE_BLOCK;
+
+      if (memcmp(save->data + off, save->shadow + off, len))
+      {
+         memcpy(save->shadow + off, save->data + off, len);
+         changed++;
+      }
+   }
+
+   return changed;
+}
+
+static bool autosave_write(const char *path, const void *data, size_t size)
+{
+   char tmp[PATH_MAX_LENGTH];
+   FILE *fp;
+   bool ret;
+
+   snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+   if (!(fp = fopen(tmp, "wb")))
+      return false;
+
+   ret = fwrite(data, 1, size, fp) == size && fflush(fp) == 0;
+   /* on disk before the rename makes it the save */
+#if defined(_WIN32)
+   if (ret && _commit(_fileno(fp)) != 0)
+      ret = false;
+#elif defined(__unix__) || defined(__APPLE__)
+   if (ret && fsync(fileno(fp)) != 0)
+      ret = false;
+#endif
+   if (fclose(fp) != 0)
+      ret = false;
+
+   if (ret)
+   {
+#ifdef _WIN32
+      ret = MoveFileExA(tmp, path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+      ret = rename(tmp, path) == 0;
+#endif
+   }
+   if (!ret)
+      remove(tmp);
+   return ret;
+}
+
+#ifdef HAVE_THREADS
+static void autosave_thread(void *data)
+{
+   autosave_t *save = (autosave_t*)data;
+
+   slock_lock(save->lock);
+   for (;;)
+   {
+      uint8_t *buf;
+      bool ok;
+
+      while (!save->queued && !save->quit)
+         scond_wait(save->work, save->lock);
+      /* what was queued before autosave_free() still goes out */
+      if (!save->queued)
+         break;
+
+      buf            = save->pending;
+      save->pending  = save->writing;
+      save->writing  = buf;
+      save->queued   = false;
+      save->busy     = true;
+      slock_unlock(save->lock);
+
+      ok = autosave_write(save->path, save->writing, save->size);
+
+      slock_lock(save->lock);
+      save->busy = false;
+      if (ok)
+         save->stats.writes++;
+      else
+      {
+         save->stats.failed++;
+         save->write_failed = true;
+      }
+      scond_signal(save->idle);
+   }
+   slock_unlock(save->lock);
+}
+#endif
+
+/* Hands the shadow over; the writer replaces anything still queued. */
+static void autosave_queue(autosave_t *save)
+{
+#ifdef HAVE_THREADS
+   slock_lock(save->lock);
+   memcpy(save->pending, save->shadow, save->size);
+   save->queued = true;
+   scond_signal(save->work);
+   slock_unlock(save->lock);
+#else
+   if (autosave_write(save->path, save->shadow, save->size))
+      save->stats.writes++;
+   else
+   {
+      save->stats.failed++;
+      save->write_failed = true;
+   }
+#endif
+   save->first_change = 0;
+}
+
+autosave_t *autosave_new(void *data, size_t size, const char *path)
+{
+   autosave_t *save;
+   FILE *fp;
+
+   if (!data || !size)
+      return NULL;
+   if (!(save = (autosave_t*)calloc(1, sizeof(*save))))
+      return NULL;
+
+   save->data        = (uint8_t*)data;
+   save->size        = size;
+   save->settle_usec = (retro_time_t)AUTOSAVE_SETTLE_MS * 1000;
+   save->max_usec    = (retro_time_t)AUTOSAVE_MAX_MS * 1000;
+   save->path        = strdup(path);
+   save->shadow      = (uint8_t*)malloc(size);
+   save->pending     = (uint8_t*)malloc(size);
+   save->writing     = (uint8_t*)malloc(size);
+   if (!save->path || !save->shadow || !save->pending || !save->writing)
+      goto error;
+
+   if ((fp = fopen(path, "rb")))
+   {
+      size_t got = fread(save->data, 1, size, fp);
+      (void)got;
+      fclose(fp);
+   }
+   memcpy(save->shadow, save->data, size);
+
+#ifdef HAVE_THREADS
+   save->lock = slock_new();
+   save->work = scond_new();
+   save->idle = scond_new();
+   if (!save->lock || !save->work || !save->idle)
+      goto error;
+   if (!(save->thread = sthread_create(autosave_thread, save)))
+      goto error;
+#endif
+
+   return save;
+
+error:
+   autosave_free(save);
+   return NULL;
+}
+
+void autosave_free(autosave_t *save)
+{
+   if (!save)
+      return;
+
+#ifdef HAVE_THREADS
+   if (save->thread)
+   {
+      slock_lock(save->lock);
+      save->quit = true;
+      scond_signal(save->work);
+      slock_unlock(save->lock);
+      sthread_join(save->thread);
+   }
+   if (save->lock)
+      slock_free(save->lock);
+   if (save->work)
+      scond_free(save->work);
+   if (save->idle)
+      scond_free(save->idle);
+#endif
+   free(save->shadow);
+   free(save->pending);
+   free(save->writing);
+   free(save->path);
+   free(save);
+}
+
+bool autosave_check(autosave_t *save)
+{
+   size_t changed = autosave_compare(save);
+   retro_time_t now;
+
+   save->stats.checks++;
+   if (!changed && !save->first_change)
+      return false;
+
+   now = cpu_features_get_time_usec();
+   if (changed)
+   {
+      save->stats.changes++;
+      save->stats.blocks += changed;
+      if (!save->first_change)
+         save->first_change = now;
+      save->last_change = now;
+   }
+
+   /* Games write a save in pieces over several frames; wait for the
+    * last piece, unless they never stop writing. */
+   if (     now - save->last_change  >= save->settle_usec
+         || now - save->first_change >= save->max_usec)
+      autosave_queue(save);
+
+   return changed != 0;
+}
+
+bool autosave_flush(autosave_t *save)
+{
+   bool ok;
+
+   if (autosave_compare(save) || save->first_change)
+      autosave_queue(save);
+
+#ifdef HAVE_THREADS
+   slock_lock(save->lock);
+   while (save->queued || save->busy)
+      scond_wait(save->idle, save->lock);
+#endif
+   ok                 = !save->write_failed;
+   save->write_failed = false;
+#ifdef HAVE_THREADS
+   slock_unlock(save->lock);
+#endif
+   return ok;
+}
+
+void autosave_set_delays(autosave_t *save, unsigned settle_ms, unsigned max_ms)
+{
+   save->settle_usec = (retro_time_t)settle_ms * 1000;
+   save->max_usec    = (retro_time_t)max_ms * 1000;
+}
+
+void autosave_get_stats(autosave_t *save, autosave_stats_t *stats)
+{
+#ifdef HAVE_THREADS
+   slock_lock(save->lock);
+#endif
+   *stats = save->stats;
+#ifdef HAVE_THREADS
+   slock_unlock(save->lock);
+#endif
+}
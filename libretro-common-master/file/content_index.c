@@ -0,0 +1,382 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (content_index.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <compat/strl.h>
+#include <file/content_index.h>
+#include <file/file_path.h>
+#include <retro_miscellaneous.h>
+#include <streams/file_stream.h>
+
+struct content_index
+{
+#ifdef HAVE_MMAP
+   int fd;
+#endif
+   void *data;
+   size_t size;
+
+   const content_index_entry_t *entries;
+   const uint32_t *by_crc;
+   const char *pool;
+   size_t count;
+};
+
+struct content_index_writer
+{
+   content_index_entry_t *entries;
+   size_t count;
+   size_t capacity;
+
+   char *pool;
+   size_t pool_size;
+   size_t pool_capacity;
+};
+
+/* Checks the header and every path offset, then points into the data. */
+static void content_index_attach(content_index_t *index)
+{
+   const content_index_header_t *header = (const content_index_header_t*)index->data;
+   const uint8_t *data = (const uint8_t*)index->data;
+   size_t record       = sizeof(content_index_entry_t) + sizeof(uint32_t);
+   size_t i;
+
+   if (index->size < sizeof(*header))
+      return;
+   if (header->magic != CONTENT_INDEX_MAGIC || header->version != CONTENT_INDEX_VERSION)
+      return;
+   if (header->count > (index->size - sizeof(*header)) / record)
+      return;
+   if (sizeof(*header) + header->count * record + header->pool_size != index->size)
+      return;
+
+   index->entries = (const content_index_entry_t*)(data + sizeof(*header));
+   index->by_crc  = (const uint32_t*)(index->entries + header->count);
+   index->pool    = (const char*)(index->by_crc + header->count);
+
+   if (header->count && (!header->pool_size || index->pool[header->pool_size - 1]))
+      return;
+   for (i = 0; i < header->count; i++)
+      if (index->entries[i].path >= header->pool_size || index->by_crc[i] >= header->count)
+         return;
+
+   index->count = header->count;
+}
+
+content_index_t *content_index_open(const char *path)
+{
+   content_index_t *index = (content_index_t*)calloc(1, sizeof(*index));
+
+   if (!index)
+      return NULL;
+
+#ifdef HAVE_MMAP
+   index->fd = open(path, O_RDONLY);
+   if (index->fd < 0)
+      return index;
+
+   {
+      struct stat buf;
+      if (fstat(index->fd, &buf) == 0 && buf.st_size > 0)
+      {
+         index->size = (size_t)buf.st_size;
+         index->data = mmap(NULL, index->size, PROT_READ, MAP_SHARED, index->fd, 0);
+         if (index->data == MAP_FAILED)
+         {
+            index->data = NULL;
+            index->size = 0;
+         }
+      }
+   }
+#else
+   {
+      ssize_t len = 0;
+      if (path_file_exists(path) && filestream_read_file(path, &index->data, &len) && len > 0)
+         index->size = (size_t)len;
+   }
+#endif
+
+   if (index->data)
+      content_index_attach(index);
+   return index;
+}
+
+void content_index_free(content_index_t *index)
+{
+   if (!index)
+      return;
+
+#ifdef HAVE_MMAP
+   if (index->data)
+      munmap(index->data, index->size);
+   if (index->fd >= 0)
+      close(index->fd);
+#else
+   free(index->data);
+#endif
+   free(index);
+}
+
+size_t content_index_count(const content_index_t *index)
+{
+   return index ? index->count : 0;
+}
+
+const content_index_entry_t *content_index_get(const content_index_t *index, size_t i)
+{
+   return &index->entries[i];
+}
+
+const char *content_index_path(const content_index_t *index,
+      const content_index_entry_t *entry)
+{
+   return index->pool + entry->path;
+}
+
+ssize_t content_index_find_path(const content_index_t *index, const char *path)
+{
+   size_t lo = 0;
+   size_t hi = content_index_count(index);
+
+   while (lo < hi)
+   {
+      size_t mid = lo + (hi - lo) / 2;
+      int cmp    = strcmp(index->pool + index->entries[mid].path, path);
+
+      if (!cmp)
+         return (ssize_t)mid;
+      if (cmp < 0)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+
+   return -1;
+}
+
+size_t content_index_find_crc(const content_index_t *index, uint32_t crc,
+      size_t *first)
+{
+   size_t lo    = 0;
+   size_t count = content_index_count(index);
+   size_t hi    = count;
+   size_t end;
+
+   while (lo < hi)
+   {
+      size_t mid = lo + (hi - lo) / 2;
+      if (index->entries[index->by_crc[mid]].crc32 < crc)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+
+   for (end = lo; end < count && index->entries[index->by_crc[end]].crc32 == crc; end++);
+
+   if (first)
+      *first = lo;
+   return end - lo;
+}
+
+const content_index_entry_t *content_index_get_by_crc(
+      const content_index_t *index, size_t i)
+{
+   return &index->entries[index->by_crc[i]];
+}
+
+content_index_writer_t *content_index_writer_new(void)
+{
+   return (content_index_writer_t*)calloc(1, sizeof(content_index_writer_t));
+}
+
+void content_index_writer_free(content_index_writer_t *writer)
+{
+   if (!writer)
+      return;
+
+   free(writer->entries);
+   free(writer->pool);
+   free(writer);
+}
+
+bool content_index_writer_add(content_index_writer_t *writer,
+      const char *path, const content_index_entry_t *entry)
+{
+   size_t len = strlen(path) + 1;
+
+   if (writer->count == writer->capacity)
+   {
+      size_t capacity                = writer->capacity ? writer->capacity * 2 : 1024;
+      content_index_entry_t *entries = (content_index_entry_t*)
+         realloc(writer->entries, capacity * sizeof(*entries));
+      if (!entries)
+         return false;
+      writer->entries  = entries;
+      writer->capacity = capacity;
+   }
+
+   if (writer->pool_size + len > writer->pool_capacity)
+   {
+      size_t capacity = writer->pool_capacity ? writer->pool_capacity * 2 : 65536;
+      char *pool;
+
+      while (capacity < writer->pool_size + len)
+         capacity *= 2;
+      if (!(pool = (char*)realloc(writer->pool, capacity)))
+         return false;
+      writer->pool          = pool;
+      writer->pool_capacity = capacity;
+   }
+
+   memcpy(writer->pool + writer->pool_size, path, len);
+   writer->entries[writer->count]      = *entry;
+   writer->entries[writer->count].path = (uint32_t)writer->pool_size;
+   writer->pool_size                  += len;
+   writer->count++;
+   return true;
+}
+
+size_t content_index_writer_count(const content_index_writer_t *writer)
+{
+   return writer->count;
+}
+
+struct sort_key
+{
+   const char *path;
+   uint32_t crc32;
+   uint32_t entry;
+};
+
+static int sort_by_path(const void *a_, const void *b_)
+{
+   const struct sort_key *a = (const struct sort_key*)a_;
+   const struct sort_key *b = (const struct sort_key*)b_;
+   return strcmp(a->path, b->path);
+}
+
+static int sort_by_crc(const void *a_, const void *b_)
+{
+   const struct sort_key *a = (const struct sort_key*)a_;
+   const struct sort_key *b = (const struct sort_key*)b_;
+
+   if (a->crc32 != b->crc32)
+      return a->crc32 < b->crc32 ? -1 : 1;
+   return a->entry < b->entry ? -1 : a->entry > b->entry;
+}
+
+bool content_index_writer_save(content_index_writer_t *writer, const char *path)
+{
+   char tmp[PATH_MAX_LENGTH];
+   content_index_header_t header;
+   struct sort_key *keys          = NULL;
+   content_index_entry_t *entries = NULL;
+   uint32_t *by_crc               = NULL;
+   char *pool                     = NULL;
+   RFILE *file                    = NULL;
+   bool ret                       = false;
+   size_t pool_size               = 0;
+   size_t i;
+
+   keys    = (struct sort_key*)malloc((writer->count + 1) * sizeof(*keys));
+   entries = (content_index_entry_t*)malloc((writer->count + 1) * sizeof(*entries));
+   by_crc  = (uint32_t*)malloc((writer->count + 1) * sizeof(*by_crc));
+   pool    = (char*)malloc(writer->pool_size + 1);
+   if (!keys || !entries || !by_crc || !pool)
+      goto end;
+
+   for (i = 0; i < writer->count; i++)
+   {
+      keys[i].path  = writer->pool + writer->entries[i].path;
+      keys[i].entry = (uint32_t)i;
+   }
+   qsort(keys, writer->count, sizeof(*keys), sort_by_path);
+
+   /* Lay the pool out in entry order too, a lookup then stays local. */
+   for (i = 0; i < writer->count; i++)
+   {
+      size_t len      = strlen(keys[i].path) + 1;
+
+      entries[i]      = writer->entries[keys[i].entry];
+      entries[i].path = (uint32_t)pool_size;
+      memcpy(pool + pool_size, keys[i].path, len);
+      pool_size      += len;
+
+      keys[i].crc32   = entries[i].crc32;
+      keys[i].entry   = (uint32_t)i;
+   }
+   qsort(keys, writer->count, sizeof(*keys), sort_by_crc);
+   for (i = 0; i < writer->count; i++)
+      by_crc[i] = keys[i].entry;
+
+   header.magic     = CONTENT_INDEX_MAGIC;
+   header.version   = CONTENT_INDEX_VERSION;
+   header.count     = (uint32_t)writer->count;
+   header.pool_size = (uint32_t)pool_size;
+
+   snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+   if (!(file = filestream_open(tmp, RFILE_MODE_WRITE, -1)))
+      goto end;
+
+   ret = filestream_write(file, &header, sizeof(header)) == sizeof(header)
+      && filestream_write(file, entries, writer->count * sizeof(*entries))
+         == (ssize_t)(writer->count * sizeof(*entries))
+      && filestream_write(file, by_crc, writer->count * sizeof(*by_crc))
+         == (ssize_t)(writer->count * sizeof(*by_crc))
+      && filestream_write(file, pool, pool_size) == (ssize_t)pool_size;
+
+   if (filestream_close(file) != 0)
+      ret = false;
+
+   if (ret)
+   {
+#ifdef _WIN32
+      /* rename() won't replace an existing file here. */
+      remove(path);
+#endif
+      ret = rename(tmp, path) == 0;
+   }
+   if (!ret)
+      remove(tmp);
+
+end:
+   free(keys);
+   free(entries);
+   free(by_crc);
+   free(pool);
+   return ret;
+}
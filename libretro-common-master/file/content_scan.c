@@ -0,0 +1,526 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (content_scan.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <compat/posix_string.h>
+#include <compat/strl.h>
+#include <file/archive_file.h>
+#include <file/content_index.h>
+#include <file/content_scan.h>
+#include <file/file_path.h>
+#include <features/features_cpu.h>
+#include <hash/content_hash.h>
+#include <lists/dir_list.h>
+#include <lists/string_list.h>
+#include <retro_miscellaneous.h>
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#ifdef HAVE_THREADS
+#define SCAN_LOCK(scan)   slock_lock((scan)->lock)
+#define SCAN_UNLOCK(scan) slock_unlock((scan)->lock)
+#else
+#define SCAN_LOCK(scan)   do { } while (0)
+#define SCAN_UNLOCK(scan) do { } while (0)
+#endif
+
+enum scan_job_type
+{
+   SCAN_JOB_DIR = 0,
+   SCAN_JOB_FILE,
+   SCAN_JOB_ARCHIVE
+};
+
+struct scan_job
+{
+   char *path;
+   int64_t size;
+   int64_t mtime;
+   enum scan_job_type type;
+};
+
+struct scan_member
+{
+   char *name;
+   uint32_t size;
+   uint32_t crc32;
+};
+
+/* Handed to the archive backend; it only knows the userdata part. */
+struct scan_archive
+{
+   struct archive_extract_userdata userdata;
+   struct string_list *ext_list;
+   struct scan_member *members;
+   size_t count;
+   size_t capacity;
+};
+
+struct scan_state
+{
+   const char *exts;
+   struct string_list *ext_list;
+   unsigned types;
+   content_index_t *old;
+
+   /* Everything below is guarded by 'lock'. */
+   content_index_writer_t *writer;
+   content_scan_stats_t stats;
+   struct scan_job *jobs;     /* a stack: files of the directory just listed run first */
+   size_t count;
+   size_t capacity;
+   unsigned busy;             /* workers holding a job, they may queue more */
+   bool failed;
+#ifdef HAVE_THREADS
+   slock_t *lock;
+   scond_t *cond;             /* jobs were queued, or the scan is over */
+#endif
+};
+
+/* Takes ownership of job->path. Call with the lock held. */
+static bool scan_push(struct scan_state *scan, const struct scan_job *job)
+{
+   if (scan->count == scan->capacity)
+   {
+      size_t capacity       = scan->capacity ? scan->capacity * 2 : 256;
+      struct scan_job *jobs = (struct scan_job*)
+         realloc(scan->jobs, capacity * sizeof(*jobs));
+
+      if (!jobs)
+      {
+         free(job->path);
+         scan->failed = true;
+         return false;
+      }
+      scan->jobs     = jobs;
+      scan->capacity = capacity;
+   }
+
+   scan->jobs[scan->count++] = *job;
+   return true;
+}
+
+/* Call with the lock held. */
+static void scan_add(struct scan_state *scan, const char *path,
+      const content_index_entry_t *entry)
+{
+   if (!content_index_writer_add(scan->writer, path, entry))
+      scan->failed = true;
+}
+
+/* An entry can be reused when the file is unchanged and the entry has
+ * every hash asked for this time. */
+static ssize_t scan_lookup(const struct scan_state *scan,
+      const char *path, int64_t size, int64_t mtime, bool archive)
+{
+   const content_index_entry_t *entry;
+   ssize_t pos = content_index_find_path(scan->old, path);
+
+   if (pos < 0)
+      return -1;
+
+   entry = content_index_get(scan->old, pos);
+   if (entry->file_size != size || entry->file_mtime != mtime)
+      return -1;
+   /* An archive the backend couldn't read was hashed as a plain file,
+    * that entry is as good as any. */
+   if ((entry->flags & CONTENT_INDEX_ARCHIVE) && !archive)
+      return -1;
+   if (!(entry->flags & CONTENT_INDEX_ARCHIVE))
+   {
+      if ((scan->types & CONTENT_HASH_MD5) && !(entry->flags & CONTENT_INDEX_HAS_MD5))
+         return -1;
+      if ((scan->types & CONTENT_HASH_SHA1) && !(entry->flags & CONTENT_INDEX_HAS_SHA1))
+         return -1;
+   }
+
+   return pos;
+}
+
+/* Copies an old entry and, for an archive, its members. Call with the
+ * lock held. */
+static void scan_reuse(struct scan_state *scan, size_t pos)
+{
+   const content_index_entry_t *entry = content_index_get(scan->old, pos);
+   const char *path                   = content_index_path(scan->old, entry);
+   size_t len                         = strlen(path);
+   size_t count                       = content_index_count(scan->old);
+
+   scan_add(scan, path, entry);
+   scan->stats.reused++;
+   scan->stats.entries++;
+
+   if (!(entry->flags & CONTENT_INDEX_ARCHIVE))
+      return;
+
+   /* Members sort right after the archive: "a.zip" < "a.zip#..." */
+   for (pos++; pos < count; pos++)
+   {
+      const content_index_entry_t *member = content_index_get(scan->old, pos);
+      const char *name                    = content_index_path(scan->old, member);
+
+      if (strncmp(name, path, len) || name[len] != '#')
+         break;
+      scan_add(scan, name, member);
+      scan->stats.entries++;
+   }
+}
+
+static void scan_dir(struct scan_state *scan, const char *dir)
+{
+   size_t i;
+   struct scan_job *jobs = NULL;
+   ssize_t *reuse        = NULL;
+   size_t job_count      = 0;
+   size_t reuse_count    = 0;
+   unsigned files        = 0;
+   struct string_list *list = dir_list_new(dir, scan->exts,
+         true, false, true, false);
+
+   if (!list)
+      return;
+
+   /* Stat and look up outside the lock, then hand everything over at once. */
+   jobs  = (struct scan_job*)malloc((list->size + 1) * sizeof(*jobs));
+   reuse = (ssize_t*)malloc((list->size + 1) * sizeof(*reuse));
+   if (!jobs || !reuse)
+      goto end;
+
+   for (i = 0; i < list->size; i++)
+   {
+      struct scan_job job;
+      const char *path = list->elems[i].data;
+      ssize_t pos;
+
+      job.size  = 0;
+      job.mtime = 0;
+
+      if (list->elems[i].attr.i == RARCH_DIRECTORY)
+         job.type = SCAN_JOB_DIR;
+      else
+      {
+         job.type = list->elems[i].attr.i == RARCH_COMPRESSED_ARCHIVE
+            ? SCAN_JOB_ARCHIVE : SCAN_JOB_FILE;
+         if (!path_get_size_mtime(path, &job.size, &job.mtime))
+            continue;
+         files++;
+
+         pos = scan_lookup(scan, path, job.size, job.mtime, job.type == SCAN_JOB_ARCHIVE);
+         if (pos >= 0)
+         {
+            reuse[reuse_count++] = pos;
+            continue;
+         }
+      }
+
+      if (!(job.path = strdup(path)))
+         continue;
+      jobs[job_count++] = job;
+   }
+
+end:
+   SCAN_LOCK(scan);
+   scan->stats.dirs++;
+   scan->stats.files += files;
+   for (i = 0; i < reuse_count; i++)
+      scan_reuse(scan, reuse[i]);
+   /* Pushed in reverse so they run in listing order. */
+   for (i = job_count; i-- > 0; )
+      scan_push(scan, &jobs[i]);
+#ifdef HAVE_THREADS
+   if (job_count)
+      scond_broadcast(scan->cond);
+#endif
+   SCAN_UNLOCK(scan);
+
+   free(jobs);
+   free(reuse);
+   dir_list_free(list);
+}
+
+static void scan_file(struct scan_state *scan, const struct scan_job *job)
+{
+   content_hash_result_t result;
+   content_index_entry_t entry;
+
+   if (!content_hash_file(job->path, scan->types, &result))
+      return;
+
+   memset(&entry, 0, sizeof(entry));
+   entry.file_size  = job->size;
+   entry.file_mtime = job->mtime;
+   entry.length     = (uint64_t)job->size;
+   entry.crc32      = result.crc32;
+   if (scan->types & CONTENT_HASH_MD5)
+   {
+      memcpy(entry.md5, result.md5, sizeof(entry.md5));
+      entry.flags |= CONTENT_INDEX_HAS_MD5;
+   }
+   if (scan->types & CONTENT_HASH_SHA1)
+   {
+      memcpy(entry.sha1, result.sha1, sizeof(entry.sha1));
+      entry.flags |= CONTENT_INDEX_HAS_SHA1;
+   }
+
+   SCAN_LOCK(scan);
+   scan_add(scan, job->path, &entry);
+   scan->stats.hashed++;
+   scan->stats.entries++;
+   scan->stats.bytes += (uint64_t)job->size;
+   SCAN_UNLOCK(scan);
+}
+
+static int scan_archive_cb(const char *name, const char *valid_exts,
+      const uint8_t *cdata, unsigned cmode, uint32_t csize, uint32_t size,
+      uint32_t crc32, struct archive_extract_userdata *userdata)
+{
+   struct scan_archive *archive = (struct scan_archive*)userdata;
+   size_t len                   = strlen(name);
+
+   (void)valid_exts;
+   (void)cdata;
+   (void)cmode;
+   (void)csize;
+
+   /* Skip directories, and members the caller doesn't want. */
+   if (!len || name[len - 1] == '/' || name[len - 1] == '\\')
+      return 1;
+   if (archive->ext_list && !string_list_find_elem_prefix(
+            archive->ext_list, ".", path_get_extension(name)))
+      return 1;
+
+   if (archive->count == archive->capacity)
+   {
+      size_t capacity             = archive->capacity ? archive->capacity * 2 : 16;
+      struct scan_member *members = (struct scan_member*)
+         realloc(archive->members, capacity * sizeof(*members));
+      if (!members)
+         return 0;
+      archive->members  = members;
+      archive->capacity = capacity;
+   }
+
+   if (!(archive->members[archive->count].name = strdup(name)))
+      return 0;
+   archive->members[archive->count].size  = size;
+   archive->members[archive->count].crc32 = crc32;
+   archive->count++;
+   return 1;
+}
+
+static bool scan_archive(struct scan_state *scan, const struct scan_job *job)
+{
+   file_archive_transfer_t state;
+   content_index_entry_t entry;
+   size_t i;
+   bool returnerr                = true;
+   struct scan_archive *archive  = (struct scan_archive*)calloc(1, sizeof(*archive));
+
+   if (!archive)
+      return false;
+
+   archive->ext_list = scan->ext_list;
+
+   state.type         = ARCHIVE_TRANSFER_INIT;
+   state.archive_size = 0;
+   state.handle       = NULL;
+   state.stream       = NULL;
+   state.footer       = NULL;
+   state.directory    = NULL;
+   state.data         = NULL;
+   state.backend      = NULL;
+
+   for (;;)
+   {
+      if (file_archive_parse_file_iterate(&state, &returnerr, job->path,
+            NULL, scan_archive_cb, &archive->userdata) != 0)
+         break;
+   }
+
+   if (returnerr)
+   {
+      memset(&entry, 0, sizeof(entry));
+      entry.file_size  = job->size;
+      entry.file_mtime = job->mtime;
+      entry.length     = (uint64_t)job->size;
+      entry.flags      = CONTENT_INDEX_ARCHIVE;
+
+      SCAN_LOCK(scan);
+      scan_add(scan, job->path, &entry);
+      scan->stats.hashed++;
+      scan->stats.entries++;
+
+      for (i = 0; i < archive->count; i++)
+      {
+         char path[PATH_MAX_LENGTH];
+
+         snprintf(path, sizeof(path), "%s#%s", job->path, archive->members[i].name);
+         entry.length = archive->members[i].size;
+         entry.crc32  = archive->members[i].crc32;
+         entry.flags  = CONTENT_INDEX_MEMBER;
+         scan_add(scan, path, &entry);
+         scan->stats.entries++;
+      }
+      SCAN_UNLOCK(scan);
+   }
+
+   for (i = 0; i < archive->count; i++)
+      free(archive->members[i].name);
+   free(archive->members);
+   free(archive);
+   return returnerr;
+}
+
+static void scan_worker(void *data)
+{
+   struct scan_state *scan = (struct scan_state*)data;
+
+   SCAN_LOCK(scan);
+   for (;;)
+   {
+      struct scan_job job;
+
+#ifdef HAVE_THREADS
+      while (!scan->count && scan->busy && !scan->failed)
+         scond_wait(scan->cond, scan->lock);
+#endif
+      /* Nothing queued and nobody left who could queue more. */
+      if (!scan->count || scan->failed)
+         break;
+
+      job = scan->jobs[--scan->count];
+      scan->busy++;
+      SCAN_UNLOCK(scan);
+
+      switch (job.type)
+      {
+         case SCAN_JOB_DIR:
+            scan_dir(scan, job.path);
+            break;
+         case SCAN_JOB_ARCHIVE:
+            /* Not something the backend can read after all, hash it whole. */
+            if (!scan_archive(scan, &job))
+               scan_file(scan, &job);
+            break;
+         case SCAN_JOB_FILE:
+            scan_file(scan, &job);
+            break;
+      }
+      free(job.path);
+
+      SCAN_LOCK(scan);
+      scan->busy--;
+#ifdef HAVE_THREADS
+      if (!scan->busy && !scan->count)
+         scond_broadcast(scan->cond);
+#endif
+   }
+#ifdef HAVE_THREADS
+   /* Wake the others when leaving on failure. */
+   scond_broadcast(scan->cond);
+#endif
+   SCAN_UNLOCK(scan);
+}
+
+bool content_scan(const char *dir, const char *exts, const char *index_path,
+      unsigned types, unsigned threads, content_scan_stats_t *stats)
+{
+   struct scan_state scan;
+   struct scan_job root;
+   bool ret = false;
+#ifdef HAVE_THREADS
+   sthread_t **workers = NULL;
+   unsigned i, started = 0;
+#endif
+
+   memset(&scan, 0, sizeof(scan));
+   scan.exts  = exts;
+   scan.types = types | CONTENT_HASH_CRC32;
+
+   if (exts && !(scan.ext_list = string_split(exts, "|")))
+      return false;
+   if (!(scan.old = content_index_open(index_path)))
+      goto end;
+   if (!(scan.writer = content_index_writer_new()))
+      goto end;
+   if (!(root.path = strdup(dir)))
+      goto end;
+   root.type  = SCAN_JOB_DIR;
+   root.size  = 0;
+   root.mtime = 0;
+   if (!scan_push(&scan, &root))
+      goto end;
+
+   if (!threads)
+      threads = cpu_features_get_core_amount();
+
+#ifdef HAVE_THREADS
+   scan.lock = slock_new();
+   scan.cond = scond_new();
+   if (!scan.lock || !scan.cond)
+      goto end;
+
+   if (threads > 1)
+      workers = (sthread_t**)calloc(threads - 1, sizeof(*workers));
+   for (i = 0; workers && i < threads - 1; i++, started++)
+      if (!(workers[i] = sthread_create(scan_worker, &scan)))
+         break;
+#endif
+
+   scan_worker(&scan);
+
+#ifdef HAVE_THREADS
+   for (i = 0; i < started; i++)
+      sthread_join(workers[i]);
+   free(workers);
+#endif
+
+   if (!scan.failed)
+   {
+      /* Unmapped first, Windows won't rename over a mapped file. */
+      content_index_free(scan.old);
+      scan.old = NULL;
+      ret = content_index_writer_save(scan.writer, index_path);
+   }
+
+end:
+   while (scan.count)
+      free(scan.jobs[--scan.count].path);
+   free(scan.jobs);
+   if (stats)
+      *stats = scan.stats;
+   content_index_writer_free(scan.writer);
+   content_index_free(scan.old);
+   string_list_free(scan.ext_list);
+#ifdef HAVE_THREADS
+   if (scan.lock)
+      slock_free(scan.lock);
+   if (scan.cond)
+      scond_free(scan.cond);
+#endif
+   return ret;
+}
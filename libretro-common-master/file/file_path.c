@@ -184,6 +184,30 @@ int32_t path_get_size(const char *path)
    return -1;
 }
 
+bool path_get_size_mtime(const char *path, int64_t *size, int64_t *mtime)
+{
+#if defined(VITA) || defined(PSP) || defined(__CELLOS_LV2__) || defined(_XBOX)
+   int32_t len = 0;
+   if (!path_stat(path, IS_VALID, &len))
+      return false;
+   *size  = len;
+   *mtime = 0;
+#else
+#if defined(_WIN32)
+   struct __stat64 buf;
+   if (_stat64(path, &buf) != 0)
+      return false;
+#else
+   struct stat buf;
+   if (stat(path, &buf) < 0)
+      return false;
+#endif
+   *size  = (int64_t)buf.st_size;
+   *mtime = (int64_t)buf.st_mtime;
+#endif
+   return true;
+}
+
 /**
  * path_mkdir:
  * @dir                : directory
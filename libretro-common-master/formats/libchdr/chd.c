@@ -58,6 +58,10 @@ typedef unsigned char Byte;
 #include <stdio.h>
 
 #include <retro_inline.h>
+#include <features/features_cpu.h>
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
 
 #define TRUE 1
 #define FALSE 0
@@ -99,6 +103,9 @@ typedef unsigned char Byte;
 
 #define NO_MATCH					(~0)
 
+#define DEFAULT_CACHE_HUNKS			1			/* hunks cached until chd_set_cache() says otherwise */
+#define READ_AHEAD_STREAMS			4			/* sequential readers tracked at once (CD data + audio, ...) */
+
 static const uint8_t s_cd_sync_header[12] = { 0x00,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0x00 };
 
 // V3-V4 entry types
@@ -156,6 +163,25 @@ enum
 
 #define EARLY_EXIT(x)				do { (void)(x); goto cleanup; } while (0)
 
+/* cachelock guards the hunk cache, decodelock the decoder chd_read uses,
+   filelock the file position; without threads there is only ever one
+   reader, so they all go away */
+#ifdef HAVE_THREADS
+#define CACHE_LOCK(chd)				slock_lock((chd)->cachelock)
+#define CACHE_UNLOCK(chd)			slock_unlock((chd)->cachelock)
+#define DECODE_LOCK(chd)			slock_lock((chd)->decodelock)
+#define DECODE_UNLOCK(chd)			slock_unlock((chd)->decodelock)
+#define FILE_LOCK(chd)				slock_lock((chd)->filelock)
+#define FILE_UNLOCK(chd)			slock_unlock((chd)->filelock)
+#else
+#define CACHE_LOCK(chd)				do { } while (0)
+#define CACHE_UNLOCK(chd)			do { } while (0)
+#define DECODE_LOCK(chd)			do { } while (0)
+#define DECODE_UNLOCK(chd)			do { } while (0)
+#define FILE_LOCK(chd)				do { } while (0)
+#define FILE_UNLOCK(chd)			do { } while (0)
+#endif
+
 
 
 /***************************************************************************
@@ -271,6 +297,59 @@ struct _cdfl_codec_data {
 	uint8_t*	buffer;
 };
 
+/* everything one thread needs to decompress hunks */
+typedef struct _hunk_decoder hunk_decoder;
+struct _hunk_decoder
+{
+	UINT8 *					compressed;		/* pointer to buffer for compressed data */
+	zlib_codec_data			zlib_codec_data;		/* zlib codec data */
+	cdzl_codec_data			cdzl_codec_data;		/* cdzl codec data */
+	cdlz_codec_data			cdlz_codec_data;		/* cdlz codec data */
+	cdfl_codec_data			cdfl_codec_data;		/* cdfl codec data */
+};
+
+/* one slot of the hunk cache */
+typedef struct _hunk_cache_entry hunk_cache_entry;
+struct _hunk_cache_entry
+{
+	UINT32					hunknum;		/* hunk held here, or ~0 */
+	UINT32					stamp;			/* last use, for LRU eviction */
+	UINT8					loading;		/* being decompressed, don't evict or read */
+	UINT8					prefetched;		/* filled by the read-ahead thread, not yet used */
+	UINT8 *					data;
+};
+
+/* state shared by the workers of one chd_read_hunks/chd_stream_hunks call */
+typedef struct _bulk_read bulk_read;
+struct _bulk_read
+{
+	chd_file *				chd;
+	UINT32					first;			/* first hunk to read */
+	UINT32					count;			/* number of hunks to read */
+	UINT8 *					output;			/* chd_read_hunks: where hunk 'first' goes */
+	UINT8 *					window;			/* chd_stream_hunks: ring of decoded hunks */
+	UINT8 *					ready;			/* chd_stream_hunks: which ring slots are decoded */
+	UINT32					windowhunks;	/* size of the ring */
+	UINT32					next;			/* next hunk (relative) for a worker to claim */
+	UINT32					emitted;		/* hunks handed to the callback so far */
+	chd_error				err;			/* first error, stops everyone */
+#ifdef HAVE_THREADS
+	slock_t *				lock;
+	scond_t *				cond;
+#endif
+};
+
+/* one sequential reader seen by chd_read */
+typedef struct _read_ahead_stream read_ahead_stream;
+struct _read_ahead_stream
+{
+	UINT32					last;			/* last hunk it read */
+	UINT32					run;			/* how many of those were sequential */
+	UINT32					stamp;			/* last use, to recycle the oldest */
+	UINT32					next;			/* next hunk to decode ahead of it */
+	UINT32					end;			/* one past the last hunk to decode ahead */
+};
+
 /* internal representation of an open CHD file */
 struct _chd_file
 {
@@ -284,19 +363,27 @@ struct _chd_file
 
 	map_entry *				map;			/* array of map entries */
 
-	UINT8 *					cache;			/* hunk cache pointer */
-	UINT32					cachehunk;		/* index of currently cached hunk */
+	hunk_cache_entry *		cache;			/* LRU hunk cache */
+	UINT32					cachehunks;		/* number of cache slots */
+	UINT32					cachestamp;		/* LRU clock */
+	chd_cache_stats			cachestats;		/* hit/miss counters */
+	read_ahead_stream		streams[READ_AHEAD_STREAMS];	/* sequential access detector */
+	UINT32					streamstamp;	/* LRU clock for the streams */
+#ifdef HAVE_THREADS
+	slock_t *				cachelock;		/* guards the cache slots and read-ahead state */
+	slock_t *				decodelock;		/* guards 'decoder' */
+	slock_t *				filelock;		/* guards the file position */
+	scond_t *				cachecond;		/* slot finished loading, or read-ahead has work */
+	sthread_t *				prefetcher;		/* read-ahead thread, or NULL */
+	UINT32					prefetchdepth;	/* hunks to keep decoded ahead of each stream */
+	UINT8					prefetchquit;
+#endif
 
 	UINT8 *					compare;		/* hunk compare pointer */
 	UINT32					comparehunk;	/* index of current compare data */
 
-	UINT8 *					compressed;		/* pointer to buffer for compressed data */
 	const codec_interface *	codecintf[4];	/* interface to the codec */
-
-	zlib_codec_data			zlib_codec_data;		/* zlib codec data */
-	cdzl_codec_data			cdzl_codec_data;		/* cdzl codec data */
-	cdlz_codec_data			cdlz_codec_data;		/* cdlz codec data */
-	cdfl_codec_data			cdfl_codec_data;		/* cdfl codec data */
+	hunk_decoder			decoder;		/* decoder used by chd_read */
 
 	crcmap_entry *			crcmap;			/* CRC map entries */
 	crcmap_entry *			crcfree;		/* free list CRC entries */
@@ -348,8 +435,29 @@ static chd_error header_read(core_file *file, chd_header *header);
 
 
 /* internal hunk read/write */
-static chd_error hunk_read_into_cache(chd_file *chd, UINT32 hunknum);
-static chd_error hunk_read_into_memory(chd_file *chd, UINT32 hunknum, UINT8 *dest);
+static chd_error cache_alloc(chd_file *chd, UINT32 hunks);
+static void cache_free(chd_file *chd);
+static hunk_cache_entry *cache_find(chd_file *chd, UINT32 hunknum);
+static hunk_cache_entry *cache_victim(chd_file *chd, int readahead);
+static void read_ahead_update(chd_file *chd, UINT32 hunknum);
+static void read_ahead_stop(chd_file *chd);
+#ifdef HAVE_THREADS
+static void read_ahead_thread(void *param);
+#endif
+static chd_error hunk_read_timed(chd_file *chd, UINT32 hunknum, UINT8 *dest, UINT64 *usec);
+static chd_error hunk_read_into_memory(chd_file *chd, hunk_decoder *decoder, UINT32 hunknum, UINT8 *dest);
+static UINT32 file_read(chd_file *chd, UINT64 offset, void *dest, UINT32 length);
+#ifdef HAVE_THREADS
+static UINT32 bulk_threads(UINT32 threads, UINT32 count);
+static chd_error bulk_start(bulk_read *job, sthread_t **workers, UINT32 threads);
+static void bulk_finish(bulk_read *job, sthread_t **workers, UINT32 threads);
+static void bulk_worker(void *param);
+#endif
+
+/* decoder state */
+static void *decoder_codec(chd_file *chd, hunk_decoder *decoder, int decompnum);
+static chd_error decoder_init(chd_file *chd, hunk_decoder *decoder);
+static void decoder_free(chd_file *chd, hunk_decoder *decoder);
 
 /* internal map access */
 static chd_error map_read(chd_file *chd);
@@ -1290,7 +1398,7 @@ chd_error chd_open_file(core_file *file, int mode, chd_file *parent, chd_file **
 {
 	chd_file *newchd = NULL;
 	chd_error err;
-	int intfnum;
+	int intfnum, streamnum;
 
 	/* verify parameters */
 	if (file == NULL)
@@ -1360,18 +1468,24 @@ chd_error chd_open_file(core_file *file, int mode, chd_file *parent, chd_file **
 	}
 
 	/* allocate and init the hunk cache */
-	newchd->cache = (UINT8 *)malloc(newchd->header.hunkbytes);
+#ifdef HAVE_THREADS
+	newchd->cachelock = slock_new();
+	newchd->decodelock = slock_new();
+	newchd->filelock = slock_new();
+	newchd->cachecond = scond_new();
+	if (newchd->cachelock == NULL || newchd->decodelock == NULL || newchd->filelock == NULL || newchd->cachecond == NULL)
+		EARLY_EXIT(err = CHDERR_OUT_OF_MEMORY);
+#endif
+	err = cache_alloc(newchd, DEFAULT_CACHE_HUNKS);
+	if (err != CHDERR_NONE)
+		EARLY_EXIT(err);
+	for (streamnum = 0; streamnum < READ_AHEAD_STREAMS; streamnum++)
+		newchd->streams[streamnum].last = ~0;
 	newchd->compare = (UINT8 *)malloc(newchd->header.hunkbytes);
-	if (newchd->cache == NULL || newchd->compare == NULL)
+	if (newchd->compare == NULL)
 		EARLY_EXIT(err = CHDERR_OUT_OF_MEMORY);
-	newchd->cachehunk = ~0;
 	newchd->comparehunk = ~0;
 
-	/* allocate the temporary compressed buffer */
-	newchd->compressed = (UINT8 *)malloc(newchd->header.hunkbytes);
-	if (newchd->compressed == NULL)
-		EARLY_EXIT(err = CHDERR_OUT_OF_MEMORY);
-
 	/* find the codec interface */
 	if (newchd->header.version < 5)
 	{
@@ -1383,10 +1497,6 @@ chd_error chd_open_file(core_file *file, int mode, chd_file *parent, chd_file **
 			}
 		if (intfnum == ARRAY_LENGTH(codec_interfaces))
 			EARLY_EXIT(err = CHDERR_UNSUPPORTED_FORMAT);
-
-		/* initialize the codec */
-		if (newchd->codecintf[0]->init != NULL)
-			err = (*newchd->codecintf[0]->init)(&newchd->zlib_codec_data, newchd->header.hunkbytes);
 	}
 	else
 	{
@@ -1403,35 +1513,16 @@ chd_error chd_open_file(core_file *file, int mode, chd_file *parent, chd_file **
 					newchd->codecintf[decompnum] = &codec_interfaces[i];
 					if (newchd->codecintf[decompnum] == NULL && newchd->header.compression[decompnum] != 0)
 						err = CHDERR_UNSUPPORTED_FORMAT;
-
-					/* initialize the codec */
-					if (newchd->codecintf[decompnum]->init != NULL) 
-					{
-						void* codec = NULL;
-						switch (newchd->header.compression[decompnum])
-						{
-							case CHD_CODEC_CD_ZLIB:
-								codec = &newchd->cdzl_codec_data;
-								break;
-
-							case CHD_CODEC_CD_LZMA:
-								codec = &newchd->cdlz_codec_data;
-								break;
-
-							case CHD_CODEC_CD_FLAC:
-								codec = &newchd->cdfl_codec_data;
-								break;
-						}
-						if (codec != NULL)
-						{
-							err = (*newchd->codecintf[decompnum]->init)(codec, newchd->header.hunkbytes);
-						}
-					}
 				}
 			}
 		}
 	}
 
+	/* allocate the compressed buffer and initialize the codecs */
+	err = decoder_init(newchd, &newchd->decoder);
+	if (err == CHDERR_OUT_OF_MEMORY)
+		EARLY_EXIT(err);
+
 	// HACK
 	//if (err != CHDERR_NONE)
 	//	EARLY_EXIT(err);
@@ -1501,53 +1592,33 @@ void chd_close(chd_file *chd)
 	if (chd == NULL || chd->cookie != COOKIE_VALUE)
 		return;
 
-	/* deinit the codec */
-	if (chd->header.version < 5)
-	{
-	if (chd->codecintf[0] != NULL && chd->codecintf[0]->free != NULL)
-		(*chd->codecintf[0]->free)(&chd->zlib_codec_data);
-	}
-	else
-	{
-      int i;
-		// Free the codecs
-		for (i = 0 ; i < 4 ; i++)
-		{
-			void* codec = NULL;
-			switch (chd->codecintf[i]->compression)
-			{
-				case CHD_CODEC_CD_LZMA:
-					codec = &chd->cdlz_codec_data;
-					break;
-
-				case CHD_CODEC_CD_ZLIB:
-					codec = &chd->cdzl_codec_data;
-					break;
+	/* stop the read-ahead thread before anything it uses goes away */
+	read_ahead_stop(chd);
 
-				case CHD_CODEC_CD_FLAC:
-					codec = &chd->cdfl_codec_data;
-					break;
-			}		
-			if (codec)
-			{
-				(*chd->codecintf[i]->free)(codec);
-			}
-		}
+	/* deinit the codecs and free the compressed data buffer */
+	decoder_free(chd, &chd->decoder);
 
+	if (chd->header.version >= 5)
+	{
 		// Free the raw map
 		if (chd->header.rawmap != NULL)
 			free(chd->header.rawmap);
 	}
 
-	/* free the compressed data buffer */
-	if (chd->compressed != NULL)
-		free(chd->compressed);
-
 	/* free the hunk cache and compare data */
 	if (chd->compare != NULL)
 		free(chd->compare);
-	if (chd->cache != NULL)
-		free(chd->cache);
+	cache_free(chd);
+#ifdef HAVE_THREADS
+	if (chd->cachecond != NULL)
+		scond_free(chd->cachecond);
+	if (chd->decodelock != NULL)
+		slock_free(chd->decodelock);
+	if (chd->filelock != NULL)
+		slock_free(chd->filelock);
+	if (chd->cachelock != NULL)
+		slock_free(chd->cachelock);
+#endif
 
 	/* free the hunk map */
 	if (chd->map != NULL)
@@ -1657,6 +1728,10 @@ const chd_header *chd_get_header(chd_file *chd)
 
 chd_error chd_read(chd_file *chd, UINT32 hunknum, void *buffer)
 {
+	hunk_cache_entry *slot;
+	chd_error err;
+	UINT64 usec;
+
 	/* punt if NULL or invalid */
 	if (chd == NULL || chd->cookie != COOKIE_VALUE)
 		return CHDERR_INVALID_PARAMETER;
@@ -1665,8 +1740,264 @@ chd_error chd_read(chd_file *chd, UINT32 hunknum, void *buffer)
 	if (hunknum >= chd->header.totalhunks)
 		return CHDERR_HUNK_OUT_OF_RANGE;
 
-	/* perform the read */
-	return hunk_read_into_memory(chd, hunknum, (UINT8 *)buffer);
+	CACHE_LOCK(chd);
+	if (hunknum > chd->maxhunk)
+		chd->maxhunk = hunknum;
+	read_ahead_update(chd, hunknum);
+
+	/* if someone else is decompressing this hunk, wait for them */
+	for (;;)
+	{
+		slot = cache_find(chd, hunknum);
+		if (slot == NULL || !slot->loading)
+			break;
+		chd->cachestats.waits++;
+#ifdef HAVE_THREADS
+		scond_wait(chd->cachecond, chd->cachelock);
+#endif
+	}
+
+	/* cache hit: copy it out */
+	if (slot != NULL)
+	{
+		chd->cachestats.hits++;
+		if (slot->prefetched)
+		{
+			chd->cachestats.prefetch_hits++;
+			slot->prefetched = 0;
+		}
+		slot->stamp = ++chd->cachestamp;
+		memcpy(buffer, slot->data, chd->header.hunkbytes);
+		CACHE_UNLOCK(chd);
+		return CHDERR_NONE;
+	}
+
+	/* cache miss: claim the least recently used slot and decompress into it */
+	chd->cachestats.misses++;
+	slot = cache_victim(chd, FALSE);
+	if (slot != NULL)
+	{
+		slot->hunknum = hunknum;
+		slot->stamp = ++chd->cachestamp;
+		slot->loading = 1;
+		slot->prefetched = 0;
+	}
+	CACHE_UNLOCK(chd);
+
+	/* decode into the slot, or straight into the caller's buffer if every
+	   slot was busy loading */
+	DECODE_LOCK(chd);
+	err = hunk_read_timed(chd, hunknum, slot != NULL ? slot->data : (UINT8 *)buffer, &usec);
+	DECODE_UNLOCK(chd);
+	if (slot != NULL && err == CHDERR_NONE)
+		memcpy(buffer, slot->data, chd->header.hunkbytes);
+
+	CACHE_LOCK(chd);
+	chd->cachestats.decompress_usec += usec;
+	if (slot != NULL)
+	{
+		slot->loading = 0;
+		if (err != CHDERR_NONE)
+			slot->hunknum = ~0;
+#ifdef HAVE_THREADS
+		scond_broadcast(chd->cachecond);
+#endif
+	}
+	CACHE_UNLOCK(chd);
+	return err;
+}
+
+
+/*-------------------------------------------------
+    chd_set_cache - resize the hunk cache and
+    start or stop the read-ahead thread
+-------------------------------------------------*/
+
+chd_error chd_set_cache(chd_file *chd, UINT32 hunks, UINT32 prefetch)
+{
+	chd_error err;
+
+	/* punt if NULL or invalid */
+	if (chd == NULL || chd->cookie != COOKIE_VALUE)
+		return CHDERR_INVALID_PARAMETER;
+
+	/* read-ahead needs room to land without evicting what's being read */
+	if (hunks == 0)
+		hunks = 1;
+	if (prefetch >= hunks)
+		prefetch = hunks - 1;
+
+	read_ahead_stop(chd);
+	err = cache_alloc(chd, hunks);
+	if (err != CHDERR_NONE)
+		return err;
+
+#ifdef HAVE_THREADS
+	if (prefetch > 0)
+	{
+		UINT32 i;
+		for (i = 0; i < READ_AHEAD_STREAMS; i++)
+			chd->streams[i].next = chd->streams[i].end = 0;
+		chd->prefetchdepth = prefetch;
+		chd->prefetchquit = 0;
+		chd->prefetcher = sthread_create(read_ahead_thread, chd);
+		if (chd->prefetcher == NULL)
+			return CHDERR_OUT_OF_MEMORY;
+	}
+#endif
+	return CHDERR_NONE;
+}
+
+
+/*-------------------------------------------------
+    chd_read_hunks - read a run of hunks into
+    one buffer, decompressing them in parallel
+-------------------------------------------------*/
+
+chd_error chd_read_hunks(chd_file *chd, UINT32 hunknum, UINT32 count, void *buffer, UINT32 threads)
+{
+	bulk_read job;
+	UINT32 index;
+
+	/* punt if NULL or invalid */
+	if (chd == NULL || chd->cookie != COOKIE_VALUE || buffer == NULL)
+		return CHDERR_INVALID_PARAMETER;
+
+	/* if we're past the end, fail */
+	if (hunknum >= chd->header.totalhunks || count > chd->header.totalhunks - hunknum)
+		return CHDERR_HUNK_OUT_OF_RANGE;
+
+	memset(&job, 0, sizeof(job));
+	job.chd = chd;
+	job.first = hunknum;
+	job.count = count;
+	job.output = (UINT8 *)buffer;
+
+#ifdef HAVE_THREADS
+	threads = bulk_threads(threads, count);
+	if (threads > 1)
+	{
+		/* the calling thread is one of the workers */
+		sthread_t **workers = (sthread_t **)calloc(threads - 1, sizeof(*workers));
+		chd_error err = (workers != NULL) ? bulk_start(&job, workers, threads - 1) : CHDERR_OUT_OF_MEMORY;
+		if (err == CHDERR_NONE)
+			bulk_worker(&job);
+		bulk_finish(&job, workers, threads - 1);
+		free(workers);
+		return (err != CHDERR_NONE) ? err : job.err;
+	}
+#endif
+
+	/* one thread: plain sequential decode with chd_read's decoder */
+	for (index = 0; index < count && job.err == CHDERR_NONE; index++)
+	{
+		DECODE_LOCK(chd);
+		job.err = hunk_read_into_memory(chd, &chd->decoder, hunknum + index, job.output + (size_t)index * chd->header.hunkbytes);
+		DECODE_UNLOCK(chd);
+	}
+	return job.err;
+}
+
+
+/*-------------------------------------------------
+    chd_stream_hunks - decompress a run of hunks
+    in parallel, handing them to a callback in
+    order
+-------------------------------------------------*/
+
+chd_error chd_stream_hunks(chd_file *chd, UINT32 hunknum, UINT32 count, UINT32 threads, chd_hunk_callback callback, void *param)
+{
+	bulk_read job;
+	UINT32 index;
+
+	/* punt if NULL or invalid */
+	if (chd == NULL || chd->cookie != COOKIE_VALUE || callback == NULL)
+		return CHDERR_INVALID_PARAMETER;
+
+	/* if we're past the end, fail */
+	if (hunknum >= chd->header.totalhunks || count > chd->header.totalhunks - hunknum)
+		return CHDERR_HUNK_OUT_OF_RANGE;
+
+	memset(&job, 0, sizeof(job));
+	job.chd = chd;
+	job.first = hunknum;
+	job.count = count;
+
+#ifdef HAVE_THREADS
+	threads = bulk_threads(threads, count);
+	if (threads > 1)
+	{
+		/* the calling thread hands hunks out in order while the workers
+		   decode up to a few hunks each ahead of it */
+		sthread_t **workers = (sthread_t **)calloc(threads, sizeof(*workers));
+		chd_error err = CHDERR_OUT_OF_MEMORY;
+
+		job.windowhunks = threads * 4;
+		job.window = (UINT8 *)malloc((size_t)job.windowhunks * chd->header.hunkbytes);
+		job.ready = (UINT8 *)calloc(job.windowhunks, 1);
+		if (workers != NULL && job.window != NULL && job.ready != NULL)
+			err = bulk_start(&job, workers, threads);
+		if (err == CHDERR_NONE)
+		{
+			slock_lock(job.lock);
+			while (job.emitted < job.count && job.err == CHDERR_NONE)
+			{
+				UINT32 slot = job.emitted % job.windowhunks;
+				if (!job.ready[slot])
+				{
+					scond_wait(job.cond, job.lock);
+					continue;
+				}
+				slock_unlock(job.lock);
+				err = (*callback)(param, job.first + job.emitted, job.window + (size_t)slot * chd->header.hunkbytes);
+				slock_lock(job.lock);
+				job.ready[slot] = 0;
+				job.emitted++;
+				if (err != CHDERR_NONE && job.err == CHDERR_NONE)
+					job.err = err;
+				scond_broadcast(job.cond);
+			}
+			slock_unlock(job.lock);
+		}
+		bulk_finish(&job, workers, threads);
+		free(workers);
+		free(job.window);
+		free(job.ready);
+		return (err != CHDERR_NONE) ? err : job.err;
+	}
+#endif
+
+	/* one thread: decode and hand out each hunk in turn */
+	job.window = (UINT8 *)malloc(chd->header.hunkbytes);
+	if (job.window == NULL)
+		return CHDERR_OUT_OF_MEMORY;
+	for (index = 0; index < count && job.err == CHDERR_NONE; index++)
+	{
+		DECODE_LOCK(chd);
+		job.err = hunk_read_into_memory(chd, &chd->decoder, hunknum + index, job.window);
+		DECODE_UNLOCK(chd);
+		if (job.err == CHDERR_NONE)
+			job.err = (*callback)(param, hunknum + index, job.window);
+	}
+	free(job.window);
+	return job.err;
+}
+
+
+/*-------------------------------------------------
+    chd_get_cache_stats - return the hunk cache
+    counters
+-------------------------------------------------*/
+
+void chd_get_cache_stats(chd_file *chd, chd_cache_stats *stats)
+{
+	/* punt if NULL or invalid */
+	if (chd == NULL || chd->cookie != COOKIE_VALUE || stats == NULL)
+		return;
+
+	CACHE_LOCK(chd);
+	*stats = chd->cachestats;
+	CACHE_UNLOCK(chd);
 }
 
 
@@ -1689,7 +2020,9 @@ chd_error chd_get_metadata(chd_file *chd, UINT32 searchtag, UINT32 searchindex,
 	UINT32 count;
 
 	/* if we didn't find it, just return */
+	FILE_LOCK(chd);
 	err = metadata_find_entry(chd, searchtag, searchindex, &metaentry);
+	FILE_UNLOCK(chd);
 	if (err != CHDERR_NONE)
 	{
 		/* unless we're an old version and they are requesting hard disk metadata */
@@ -1717,8 +2050,7 @@ chd_error chd_get_metadata(chd_file *chd, UINT32 searchtag, UINT32 searchindex,
 
 	/* read the metadata */
 	outputlen = MIN(outputlen, metaentry.length);
-	core_fseek(chd->file, metaentry.offset + METADATA_HEADER_SIZE, SEEK_SET);
-	count = core_fread(chd->file, output, outputlen);
+	count = file_read(chd, metaentry.offset + METADATA_HEADER_SIZE, output, outputlen);
 	if (count != outputlen)
 		return CHDERR_READ_ERROR;
 
@@ -1963,40 +2295,388 @@ static chd_error header_read(core_file *file, chd_header *header)
 ***************************************************************************/
 
 /*-------------------------------------------------
-    hunk_read_into_cache - read a hunk into
-    the CHD's hunk cache
+    cache_alloc - replace the hunk cache with
+    an empty one of the given size
 -------------------------------------------------*/
 
-static chd_error hunk_read_into_cache(chd_file *chd, UINT32 hunknum)
+static chd_error cache_alloc(chd_file *chd, UINT32 hunks)
 {
-	chd_error err;
+	hunk_cache_entry *cache;
+	UINT8 *data;
+	UINT32 i;
 
-	/* track the max */
-	if (hunknum > chd->maxhunk)
-		chd->maxhunk = hunknum;
+	/* one block for all the hunk data, so the slots stay contiguous */
+	cache = (hunk_cache_entry *)calloc(hunks, sizeof(*cache));
+	data = (UINT8 *)malloc((size_t)hunks * chd->header.hunkbytes);
+	if (cache == NULL || data == NULL)
+	{
+		free(cache);
+		free(data);
+		return CHDERR_OUT_OF_MEMORY;
+	}
+	for (i = 0; i < hunks; i++)
+	{
+		cache[i].hunknum = ~0;
+		cache[i].data = data + (size_t)i * chd->header.hunkbytes;
+	}
 
-	/* if we're already in the cache, we're done */
-	if (chd->cachehunk == hunknum)
-		return CHDERR_NONE;
-	chd->cachehunk = ~0;
+	cache_free(chd);
+	chd->cache = cache;
+	chd->cachehunks = hunks;
+	return CHDERR_NONE;
+}
 
-	/* otherwise, read the data */
-	err = hunk_read_into_memory(chd, hunknum, chd->cache);
-	if (err != CHDERR_NONE)
-		return err;
 
-	/* mark the hunk successfully cached in */
-	chd->cachehunk = hunknum;
+/*-------------------------------------------------
+    cache_free - free the hunk cache
+-------------------------------------------------*/
+
+static void cache_free(chd_file *chd)
+{
+	if (chd->cache == NULL)
+		return;
+	free(chd->cache[0].data);
+	free(chd->cache);
+	chd->cache = NULL;
+	chd->cachehunks = 0;
+}
+
+
+/*-------------------------------------------------
+    cache_find - return the slot holding the
+    given hunk, or NULL; cachelock held
+-------------------------------------------------*/
+
+static hunk_cache_entry *cache_find(chd_file *chd, UINT32 hunknum)
+{
+	UINT32 i;
+
+	for (i = 0; i < chd->cachehunks; i++)
+		if (chd->cache[i].hunknum == hunknum)
+			return &chd->cache[i];
+	return NULL;
+}
+
+
+/*-------------------------------------------------
+    cache_victim - return the slot to reuse for
+    a new hunk, or NULL; cachelock held
+-------------------------------------------------*/
+
+static hunk_cache_entry *cache_victim(chd_file *chd, int readahead)
+{
+	hunk_cache_entry *victim = NULL, *spare = NULL;
+	UINT32 i, j;
+
+	/* least recently used first, but read-ahead that hasn't been used yet
+	   only goes when nothing else can; the read-ahead thread itself never
+	   evicts it, nor the hunk a stream is reading right now */
+	for (i = 0; i < chd->cachehunks; i++)
+	{
+		hunk_cache_entry *slot = &chd->cache[i];
+		hunk_cache_entry **best = slot->prefetched ? &spare : &victim;
+		if (slot->loading)
+			continue;
+		if (slot->hunknum == (UINT32)~0)
+			return slot;
+		if (readahead)
+		{
+			if (slot->prefetched)
+				continue;
+			for (j = 0; j < READ_AHEAD_STREAMS; j++)
+				if (chd->streams[j].last == slot->hunknum)
+					break;
+			if (j < READ_AHEAD_STREAMS)
+				continue;
+		}
+		/* stamps wrap; compare by age so the ordering survives it */
+		if (*best == NULL || (UINT32)(chd->cachestamp - slot->stamp) > (UINT32)(chd->cachestamp - (*best)->stamp))
+			*best = slot;
+	}
+	return victim != NULL ? victim : spare;
+}
+
+
+/*-------------------------------------------------
+    read_ahead_update - track sequential reads
+    and move the read-ahead window; cachelock
+    held
+-------------------------------------------------*/
+
+static void read_ahead_update(chd_file *chd, UINT32 hunknum)
+{
+	read_ahead_stream *stream = NULL;
+	UINT32 i;
+
+	/* rereading the same hunk (several sectors per hunk) keeps a run going;
+	   anything else starts a new stream in place of the oldest */
+	for (i = 0; i < READ_AHEAD_STREAMS; i++)
+	{
+		read_ahead_stream *cur = &chd->streams[i];
+		if (hunknum == cur->last || hunknum == cur->last + 1)
+		{
+			stream = cur;
+			break;
+		}
+		if (stream == NULL || (UINT32)(chd->streamstamp - cur->stamp) > (UINT32)(chd->streamstamp - stream->stamp))
+			stream = cur;
+	}
+	if (i == READ_AHEAD_STREAMS)
+	{
+		/* whatever was read ahead for the old stream is plain cache now */
+		for (i = 0; i < chd->cachehunks; i++)
+			if (chd->cache[i].prefetched && chd->cache[i].hunknum > stream->last && chd->cache[i].hunknum < stream->end)
+				chd->cache[i].prefetched = 0;
+		stream->run = 0;
+		stream->next = stream->end = 0;
+	}
+	else if (hunknum == stream->last + 1)
+		stream->run++;
+	stream->last = hunknum;
+	stream->stamp = ++chd->streamstamp;
+
+#ifdef HAVE_THREADS
+	if (chd->prefetcher == NULL || stream->run < 2)
+		return;
+
+	/* keep the window 'prefetchdepth' hunks ahead of the reader */
+	stream->end = hunknum + 1 + chd->prefetchdepth;
+	if (stream->end > chd->header.totalhunks)
+		stream->end = chd->header.totalhunks;
+	if (stream->next <= hunknum || stream->next > stream->end)
+		stream->next = hunknum + 1;
+	if (stream->next < stream->end)
+		scond_broadcast(chd->cachecond);
+#endif
+}
+
+
+#ifdef HAVE_THREADS
+/*-------------------------------------------------
+    read_ahead_thread - decompress the hunks in
+    the read-ahead window into the cache
+-------------------------------------------------*/
+
+static void read_ahead_thread(void *param)
+{
+	chd_file *chd = (chd_file *)param;
+
+	CACHE_LOCK(chd);
+	while (!chd->prefetchquit)
+	{
+		read_ahead_stream *stream = NULL;
+		hunk_cache_entry *slot;
+		chd_error err;
+		UINT32 hunknum, i;
+		UINT64 usec;
+
+		/* serve the stream whose window is least far ahead of its reader */
+		for (i = 0; i < READ_AHEAD_STREAMS; i++)
+		{
+			read_ahead_stream *cur = &chd->streams[i];
+			if (cur->next < cur->end && (stream == NULL || cur->next - cur->last < stream->next - stream->last))
+				stream = cur;
+		}
+		if (stream == NULL)
+		{
+			scond_wait(chd->cachecond, chd->cachelock);
+			continue;
+		}
+		hunknum = stream->next++;
+		if (cache_find(chd, hunknum) != NULL)
+			continue;
+		slot = cache_victim(chd, TRUE);
+		if (slot == NULL)
+		{
+			/* nothing it may evict; try again once one finishes */
+			stream->next--;
+			scond_wait(chd->cachecond, chd->cachelock);
+			continue;
+		}
+		slot->hunknum = hunknum;
+		slot->stamp = ++chd->cachestamp;
+		slot->loading = 1;
+		slot->prefetched = 1;
+		CACHE_UNLOCK(chd);
+
+		DECODE_LOCK(chd);
+		err = hunk_read_timed(chd, hunknum, slot->data, &usec);
+		DECODE_UNLOCK(chd);
+
+		CACHE_LOCK(chd);
+		slot->loading = 0;
+		if (err != CHDERR_NONE)
+		{
+			slot->hunknum = ~0;
+			slot->prefetched = 0;
+		}
+		else
+			chd->cachestats.prefetched++;
+		chd->cachestats.prefetch_usec += usec;
+		scond_broadcast(chd->cachecond);
+	}
+	CACHE_UNLOCK(chd);
+}
+#endif
+
+
+/*-------------------------------------------------
+    read_ahead_stop - stop the read-ahead thread
+-------------------------------------------------*/
+
+static void read_ahead_stop(chd_file *chd)
+{
+#ifdef HAVE_THREADS
+	if (chd->prefetcher == NULL)
+		return;
+	CACHE_LOCK(chd);
+	chd->prefetchquit = 1;
+	scond_broadcast(chd->cachecond);
+	CACHE_UNLOCK(chd);
+	sthread_join(chd->prefetcher);
+	chd->prefetcher = NULL;
+#endif
+}
+
+
+#ifdef HAVE_THREADS
+/*-------------------------------------------------
+    bulk_threads - pick a worker count for a
+    bulk read; 0 means one per core
+-------------------------------------------------*/
+
+static UINT32 bulk_threads(UINT32 threads, UINT32 count)
+{
+	if (threads == 0)
+		threads = cpu_features_get_core_amount();
+	if (threads > count)
+		threads = count;
+	return threads;
+}
+
+
+/*-------------------------------------------------
+    bulk_start - create a bulk read's lock and
+    start its worker threads
+-------------------------------------------------*/
+
+static chd_error bulk_start(bulk_read *job, sthread_t **workers, UINT32 threads)
+{
+	UINT32 i;
+
+	job->lock = slock_new();
+	job->cond = scond_new();
+	if (job->lock == NULL || job->cond == NULL)
+		return CHDERR_OUT_OF_MEMORY;
+
+	for (i = 0; i < threads; i++)
+	{
+		workers[i] = sthread_create(bulk_worker, job);
+		if (workers[i] == NULL)
+		{
+			/* stop the ones already running */
+			slock_lock(job->lock);
+			job->err = CHDERR_OUT_OF_MEMORY;
+			slock_unlock(job->lock);
+			return CHDERR_OUT_OF_MEMORY;
+		}
+	}
 	return CHDERR_NONE;
 }
 
 
+/*-------------------------------------------------
+    bulk_finish - stop and join a bulk read's
+    workers and free its lock
+-------------------------------------------------*/
+
+static void bulk_finish(bulk_read *job, sthread_t **workers, UINT32 threads)
+{
+	UINT32 i;
+
+	for (i = 0; workers != NULL && i < threads; i++)
+		if (workers[i] != NULL)
+			sthread_join(workers[i]);
+
+	if (job->cond != NULL)
+		scond_free(job->cond);
+	if (job->lock != NULL)
+		slock_free(job->lock);
+}
+
+
+/*-------------------------------------------------
+    bulk_worker - decode hunks of a bulk read
+    with a private decoder until none are left
+-------------------------------------------------*/
+
+static void bulk_worker(void *param)
+{
+	bulk_read *job = (bulk_read *)param;
+	chd_file *chd = job->chd;
+	hunk_decoder decoder;
+	chd_error err;
+
+	/* codec init errors only matter for hunks that use the codec */
+	err = decoder_init(chd, &decoder);
+
+	slock_lock(job->lock);
+	if (err == CHDERR_OUT_OF_MEMORY && job->err == CHDERR_NONE)
+		job->err = err;
+	while (job->err == CHDERR_NONE && job->next < job->count)
+	{
+		UINT32 index = job->next;
+		UINT8 *dest;
+
+		/* streaming: don't run more than a ring's worth ahead of the callback */
+		if (job->window != NULL && index >= job->emitted + job->windowhunks)
+		{
+			scond_wait(job->cond, job->lock);
+			continue;
+		}
+		job->next++;
+		if (job->window != NULL)
+			dest = job->window + (size_t)(index % job->windowhunks) * chd->header.hunkbytes;
+		else
+			dest = job->output + (size_t)index * chd->header.hunkbytes;
+		slock_unlock(job->lock);
+
+		err = hunk_read_into_memory(chd, &decoder, job->first + index, dest);
+
+		slock_lock(job->lock);
+		if (err != CHDERR_NONE && job->err == CHDERR_NONE)
+			job->err = err;
+		if (job->window != NULL)
+			job->ready[index % job->windowhunks] = 1;
+		scond_broadcast(job->cond);
+	}
+	slock_unlock(job->lock);
+
+	decoder_free(chd, &decoder);
+}
+#endif
+
+
+/*-------------------------------------------------
+    hunk_read_timed - hunk_read_into_memory,
+    also returning how long it took
+-------------------------------------------------*/
+
+static chd_error hunk_read_timed(chd_file *chd, UINT32 hunknum, UINT8 *dest, UINT64 *usec)
+{
+	retro_time_t start = cpu_features_get_time_usec();
+	chd_error err = hunk_read_into_memory(chd, &chd->decoder, hunknum, dest);
+	*usec = (UINT64)(cpu_features_get_time_usec() - start);
+	return err;
+}
+
+
 /*-------------------------------------------------
     hunk_read_into_memory - read a hunk into
     memory at the given location
 -------------------------------------------------*/
 
-static chd_error hunk_read_into_memory(chd_file *chd, UINT32 hunknum, UINT8 *dest)
+static chd_error hunk_read_into_memory(chd_file *chd, hunk_decoder *decoder, UINT32 hunknum, UINT8 *dest)
 {
 	chd_error err;
 
@@ -2020,17 +2700,16 @@ static chd_error hunk_read_into_memory(chd_file *chd, UINT32 hunknum, UINT8 *des
 			case V34_MAP_ENTRY_TYPE_COMPRESSED:
             {
                void* codec;
-                  /* read it into the decompression buffer */
-                  core_fseek(chd->file, entry->offset, SEEK_SET);
-               bytes = core_fread(chd->file, chd->compressed, entry->length);
+               /* read it into the decompression buffer */
+               bytes = file_read(chd, entry->offset, decoder->compressed, entry->length);
                if (bytes != entry->length)
                   return CHDERR_READ_ERROR;
 
                /* now decompress using the codec */
                err   = CHDERR_NONE;
-               codec = &chd->zlib_codec_data;
+               codec = decoder_codec(chd, decoder, 0);
                if (chd->codecintf[0]->decompress != NULL)
-                  err = (*chd->codecintf[0]->decompress)(codec, chd->compressed, entry->length, dest, chd->header.hunkbytes);
+                  err = (*chd->codecintf[0]->decompress)(codec, decoder->compressed, entry->length, dest, chd->header.hunkbytes);
                if (err != CHDERR_NONE)
                   return err;
             }
@@ -2038,8 +2717,7 @@ static chd_error hunk_read_into_memory(chd_file *chd, UINT32 hunknum, UINT8 *des
 
 			/* uncompressed data */
 			case V34_MAP_ENTRY_TYPE_UNCOMPRESSED:
-				core_fseek(chd->file, entry->offset, SEEK_SET);
-				bytes = core_fread(chd->file, dest, chd->header.hunkbytes);
+				bytes = file_read(chd, entry->offset, dest, chd->header.hunkbytes);
 				if (bytes != chd->header.hunkbytes)
 					return CHDERR_READ_ERROR;
 				break;
@@ -2053,13 +2731,14 @@ static chd_error hunk_read_into_memory(chd_file *chd, UINT32 hunknum, UINT8 *des
 
 			/* self-referenced data */
 			case V34_MAP_ENTRY_TYPE_SELF_HUNK:
-				if (chd->cachehunk == entry->offset && dest == chd->cache)
-					break;
-				return hunk_read_into_memory(chd, entry->offset, dest);
+				return hunk_read_into_memory(chd, decoder, entry->offset, dest);
 
 			/* parent-referenced data */
 			case V34_MAP_ENTRY_TYPE_PARENT_HUNK:
-				err = hunk_read_into_memory(chd->parent, entry->offset, dest);
+				/* the parent may be shared with other children reading in parallel */
+				DECODE_LOCK(chd->parent);
+				err = hunk_read_into_memory(chd->parent, &chd->parent->decoder, entry->offset, dest);
+				DECODE_UNLOCK(chd->parent);
 				if (err != CHDERR_NONE)
 					return err;
 				break;
@@ -2102,38 +2781,23 @@ static chd_error hunk_read_into_memory(chd_file *chd, UINT32 hunknum, UINT8 *des
 			case COMPRESSION_TYPE_1:
 			case COMPRESSION_TYPE_2:
 			case COMPRESSION_TYPE_3:
-				core_fseek(chd->file, blockoffs, SEEK_SET);
-				core_fread(chd->file, chd->compressed, blocklen);
-				switch (chd->codecintf[rawmap[0]]->compression)
-				{
-					case CHD_CODEC_CD_LZMA:
-						codec = &chd->cdlz_codec_data;
-						break;
-
-					case CHD_CODEC_CD_ZLIB:
-						codec = &chd->cdzl_codec_data;
-						break;
-
-					case CHD_CODEC_CD_FLAC:
-						codec = &chd->cdfl_codec_data;
-						break;
-				}
+				file_read(chd, blockoffs, decoder->compressed, blocklen);
+				codec = decoder_codec(chd, decoder, rawmap[0]);
 				if (codec==NULL)
 					return CHDERR_DECOMPRESSION_ERROR;
-				chd->codecintf[rawmap[0]]->decompress(codec, chd->compressed, blocklen, dest, chd->header.hunkbytes);
+				chd->codecintf[rawmap[0]]->decompress(codec, decoder->compressed, blocklen, dest, chd->header.hunkbytes);
 				if (dest != NULL && crc16(dest, chd->header.hunkbytes) != blockcrc)
 					return CHDERR_DECOMPRESSION_ERROR;
 				return CHDERR_NONE;
 
 			case COMPRESSION_NONE:
-				core_fseek(chd->file, blockoffs, SEEK_SET);
-				core_fread(chd->file, dest, chd->header.hunkbytes);
+				file_read(chd, blockoffs, dest, chd->header.hunkbytes);
 				if (crc16(dest, chd->header.hunkbytes) != blockcrc)
 					return CHDERR_DECOMPRESSION_ERROR;
 				return CHDERR_NONE;
 
 			case COMPRESSION_SELF:
-				return hunk_read_into_memory(chd, blockoffs, dest);
+				return hunk_read_into_memory(chd, decoder, blockoffs, dest);
 
 			case COMPRESSION_PARENT:
 				// TODO
@@ -2150,6 +2814,107 @@ static chd_error hunk_read_into_memory(chd_file *chd, UINT32 hunknum, UINT8 *des
 }
 
 
+/*-------------------------------------------------
+    file_read - read raw bytes from the CHD
+    file at the given offset
+-------------------------------------------------*/
+
+static UINT32 file_read(chd_file *chd, UINT64 offset, void *dest, UINT32 length)
+{
+	UINT32 bytes;
+
+	FILE_LOCK(chd);
+	core_fseek(chd->file, offset, SEEK_SET);
+	bytes = core_fread(chd->file, dest, length);
+	FILE_UNLOCK(chd);
+	return bytes;
+}
+
+
+/***************************************************************************
+    INTERNAL DECODER STATE
+***************************************************************************/
+
+/*-------------------------------------------------
+    decoder_codec - return the decoder's state
+    for the given codec slot, or NULL
+-------------------------------------------------*/
+
+static void *decoder_codec(chd_file *chd, hunk_decoder *decoder, int decompnum)
+{
+	if (chd->header.version < 5)
+		return &decoder->zlib_codec_data;
+
+	if (chd->codecintf[decompnum] == NULL)
+		return NULL;
+	switch (chd->codecintf[decompnum]->compression)
+	{
+		case CHD_CODEC_CD_ZLIB:
+			return &decoder->cdzl_codec_data;
+
+		case CHD_CODEC_CD_LZMA:
+			return &decoder->cdlz_codec_data;
+
+		case CHD_CODEC_CD_FLAC:
+			return &decoder->cdfl_codec_data;
+	}
+	return NULL;
+}
+
+
+/*-------------------------------------------------
+    decoder_init - allocate a decoder's buffer
+    and initialize its codecs
+-------------------------------------------------*/
+
+static chd_error decoder_init(chd_file *chd, hunk_decoder *decoder)
+{
+	chd_error err = CHDERR_NONE;
+	int decompnum;
+
+	memset(decoder, 0, sizeof(*decoder));
+	decoder->compressed = (UINT8 *)malloc(chd->header.hunkbytes);
+	if (decoder->compressed == NULL)
+		return CHDERR_OUT_OF_MEMORY;
+
+	/* codec errors are reported but not fatal; the hunks using a codec
+	   that failed to come up fail when they're read */
+	for (decompnum = 0; decompnum < ARRAY_LENGTH(chd->codecintf); decompnum++)
+	{
+		void *codec = decoder_codec(chd, decoder, decompnum);
+		if (codec != NULL && chd->codecintf[decompnum]->init != NULL)
+			err = (*chd->codecintf[decompnum]->init)(codec, chd->header.hunkbytes);
+		if (chd->header.version < 5)
+			break;
+	}
+	return err;
+}
+
+
+/*-------------------------------------------------
+    decoder_free - release a decoder's codecs
+    and buffer
+-------------------------------------------------*/
+
+static void decoder_free(chd_file *chd, hunk_decoder *decoder)
+{
+	int decompnum;
+
+	for (decompnum = 0; decompnum < ARRAY_LENGTH(chd->codecintf); decompnum++)
+	{
+		void *codec = decoder_codec(chd, decoder, decompnum);
+		if (codec != NULL && chd->codecintf[decompnum]->free != NULL)
+			(*chd->codecintf[decompnum]->free)(codec);
+		if (chd->header.version < 5)
+			break;
+	}
+
+	if (decoder->compressed != NULL)
+		free(decoder->compressed);
+	decoder->compressed = NULL;
+}
+
+
 /***************************************************************************
     INTERNAL MAP ACCESS
 ***************************************************************************/
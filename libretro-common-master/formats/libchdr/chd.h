@@ -332,6 +332,19 @@ struct _chd_verify_result
 };
 
 
+/* structure for returning hunk cache counters */
+typedef struct _chd_cache_stats chd_cache_stats;
+struct _chd_cache_stats
+{
+	UINT64		hits;						/* chd_read served from the cache */
+	UINT64		misses;						/* chd_read had to decompress */
+	UINT64		waits;						/* chd_read waited for a hunk being decompressed */
+	UINT64		prefetched;					/* hunks decompressed by the read-ahead thread */
+	UINT64		prefetch_hits;				/* of those, hunks chd_read later used */
+	UINT64		decompress_usec;			/* time spent decompressing for chd_read */
+	UINT64		prefetch_usec;				/* time spent decompressing ahead */
+};
+
 
 /***************************************************************************
     FUNCTION PROTOTYPES
@@ -374,6 +387,24 @@ const chd_header *chd_get_header(chd_file *chd);
 /* read one hunk from the CHD file */
 chd_error chd_read(chd_file *chd, UINT32 hunknum, void *buffer);
 
+/* keep up to 'hunks' decompressed hunks in an LRU cache; with HAVE_THREADS a
+   read-ahead thread keeps up to 'prefetch' hunks decoded ahead of sequential
+   reads (0 disables it). chd_read may then be called from several threads. */
+chd_error chd_set_cache(chd_file *chd, UINT32 hunks, UINT32 prefetch);
+
+/* return the hunk cache counters since open */
+void chd_get_cache_stats(chd_file *chd, chd_cache_stats *stats);
+
+/* read 'count' hunks starting at 'hunknum' into 'buffer' (count * hunkbytes
+   bytes), decompressing on 'threads' threads (0 = one per core); bypasses
+   the hunk cache */
+chd_error chd_read_hunks(chd_file *chd, UINT32 hunknum, UINT32 count, void *buffer, UINT32 threads);
+
+/* same, but hands each hunk to 'callback' in order, from the calling thread;
+   a callback returning anything but CHDERR_NONE stops the read with that error */
+typedef chd_error (*chd_hunk_callback)(void *param, UINT32 hunknum, const void *data);
+chd_error chd_stream_hunks(chd_file *chd, UINT32 hunknum, UINT32 count, UINT32 threads, chd_hunk_callback callback, void *param);
+
 
 
 /* ----- metadata management ----- */
@@ -0,0 +1,476 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (content_hash.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <retro_inline.h>
+
+#include <hash/content_hash.h>
+#include <encodings/crc32.h>
+#include <features/features_cpu.h>
+#include <streams/file_stream.h>
+
+#if (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)) && !defined(DONT_WANT_X86_OPTIMIZATIONS)
+#define CONTENT_HASH_X86
+#include <immintrin.h>
+#endif
+
+/* content_hash_update() runs every hash over this much before moving on,
+ * so the data is still in L1/L2 for the second and third pass. */
+#define CONTENT_HASH_CHUNK (32 * 1024)
+#define CONTENT_HASH_READ  (1024 * 1024)
+
+#define SHA1_ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+typedef void (*sha1_blocks_t)(uint32_t *h, const uint8_t *data, size_t blocks);
+
+static const uint32_t sha1_iv[5] = {
+   0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+};
+
+static sha1_blocks_t sha1_blocks  = NULL;
+static const char *sha1_impl_name = "scalar";
+#if defined(CONTENT_HASH_X86)
+static bool sha1_avx2_enabled     = false;
+#endif
+
+static INLINE uint32_t load_be32(const uint8_t *p)
+{
+   return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void sha1_blocks_scalar(uint32_t *h, const uint8_t *data, size_t blocks)
+{
+   for (; blocks; blocks--, data += 64)
+   {
+      uint32_t w[16];
+      uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+      unsigned t;
+
+      for (t = 0; t < 80; t++)
+      {
+         uint32_t f, tmp;
+
+         if (t < 16)
+            w[t] = load_be32(data + 4 * t);
+         else
+         {
+            tmp       = w[(t - 3) & 15] ^ w[(t - 8) & 15] ^ w[(t - 14) & 15] ^ w[t & 15];
+            w[t & 15] = SHA1_ROL(tmp, 1);
+         }
+
+         if (t < 20)
+            f = (d ^ (b & (c ^ d))) + 0x5a827999;
+         else if (t < 40)
+            f = (b ^ c ^ d) + 0x6ed9eba1;
+         else if (t < 60)
+            f = ((b & c) | (d & (b | c))) + 0x8f1bbcdc;
+         else
+            f = (b ^ c ^ d) + 0xca62c1d6;
+
+         tmp = SHA1_ROL(a, 5) + f + e + w[t & 15];
+         e   = d;
+         d   = c;
+         c   = SHA1_ROL(b, 30);
+         b   = a;
+         a   = tmp;
+      }
+
+      h[0] += a;
+      h[1] += b;
+      h[2] += c;
+      h[3] += d;
+      h[4] += e;
+   }
+}
+
+#if defined(CONTENT_HASH_X86)
+/* Four rounds with the SHA extensions. i is the group (0..19), f its
+ * round function (i / 5); m[i & 3] holds w[4i..4i+3] and the schedule
+ * for groups i+1..i+3 is advanced alongside, as in Intel's reference
+ * code. All indices are constants, so the array lives in registers. */
+#define SHA1_NI_ROUNDS(i, f, ecur, enext) \
+   if ((i) < 4) \
+      m[(i) & 3] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16 * (i))), bswap); \
+   ecur  = (i) == 0 ? _mm_add_epi32(ecur, m[0]) : _mm_sha1nexte_epu32(ecur, m[(i) & 3]); \
+   enext = abcd; \
+   if ((i) >= 3 && (i) <= 18) \
+      m[((i) + 1) & 3] = _mm_sha1msg2_epu32(m[((i) + 1) & 3], m[(i) & 3]); \
+   abcd  = _mm_sha1rnds4_epu32(abcd, ecur, f); \
+   if ((i) >= 1 && (i) <= 16) \
+      m[((i) + 3) & 3] = _mm_sha1msg1_epu32(m[((i) + 3) & 3], m[(i) & 3]); \
+   if ((i) >= 2 && (i) <= 17) \
+      m[((i) + 2) & 3] = _mm_xor_si128(m[((i) + 2) & 3], m[(i) & 3])
+
+/* Compiled for SHA regardless of the global target so that baseline x86
+ * builds still get it through runtime dispatch. */
+#if defined(__GNUC__)
+__attribute__((target("sha,sse4.1")))
+#endif
+static void sha1_blocks_shani(uint32_t *h, const uint8_t *data, size_t blocks)
+{
+   const __m128i bswap = _mm_set_epi64x(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+   __m128i abcd        = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)h), 0x1b);
+   __m128i e0          = _mm_set_epi32((int)h[4], 0, 0, 0);
+   __m128i e1, abcd_save, e0_save;
+   __m128i m[4];
+
+   for (; blocks; blocks--, data += 64)
+   {
+      abcd_save = abcd;
+      e0_save   = e0;
+
+      SHA1_NI_ROUNDS( 0, 0, e0, e1);
+      SHA1_NI_ROUNDS( 1, 0, e1, e0);
+      SHA1_NI_ROUNDS( 2, 0, e0, e1);
+      SHA1_NI_ROUNDS( 3, 0, e1, e0);
+      SHA1_NI_ROUNDS( 4, 0, e0, e1);
+      SHA1_NI_ROUNDS( 5, 1, e1, e0);
+      SHA1_NI_ROUNDS( 6, 1, e0, e1);
+      SHA1_NI_ROUNDS( 7, 1, e1, e0);
+      SHA1_NI_ROUNDS( 8, 1, e0, e1);
+      SHA1_NI_ROUNDS( 9, 1, e1, e0);
+      SHA1_NI_ROUNDS(10, 2, e0, e1);
+      SHA1_NI_ROUNDS(11, 2, e1, e0);
+      SHA1_NI_ROUNDS(12, 2, e0, e1);
+      SHA1_NI_ROUNDS(13, 2, e1, e0);
+      SHA1_NI_ROUNDS(14, 2, e0, e1);
+      SHA1_NI_ROUNDS(15, 3, e1, e0);
+      SHA1_NI_ROUNDS(16, 3, e0, e1);
+      SHA1_NI_ROUNDS(17, 3, e1, e0);
+      SHA1_NI_ROUNDS(18, 3, e0, e1);
+      SHA1_NI_ROUNDS(19, 3, e1, e0);
+
+      e0   = _mm_sha1nexte_epu32(e0, e0_save);
+      abcd = _mm_add_epi32(abcd, abcd_save);
+   }
+
+   _mm_storeu_si128((__m128i*)h, _mm_shuffle_epi32(abcd, 0x1b));
+   h[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+
+#define SHA1_ROL8(x, n) _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - (n)))
+
+/* Eight independent messages, one per 32-bit lane; h is laid out
+ * h[word][lane]. Every lane advances by the same number of blocks. */
+#if defined(__GNUC__)
+__attribute__((target("avx2")))
+#endif
+static void sha1_blocks_avx2_x8(uint32_t h[5][8], const uint8_t *const *data, size_t blocks)
+{
+   __m256i s[5];
+   size_t off;
+   unsigned i;
+
+   for (i = 0; i < 5; i++)
+      s[i] = _mm256_loadu_si256((const __m256i*)h[i]);
+
+   for (off = 0; off < blocks * 64; off += 64)
+   {
+      __m256i w[16];
+      __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4];
+      unsigned t;
+
+      for (t = 0; t < 16; t++)
+         w[t] = _mm256_setr_epi32(
+               (int)load_be32(data[0] + off + 4 * t), (int)load_be32(data[1] + off + 4 * t),
+               (int)load_be32(data[2] + off + 4 * t), (int)load_be32(data[3] + off + 4 * t),
+               (int)load_be32(data[4] + off + 4 * t), (int)load_be32(data[5] + off + 4 * t),
+               (int)load_be32(data[6] + off + 4 * t), (int)load_be32(data[7] + off + 4 * t));
+
+      for (t = 0; t < 80; t++)
+      {
+         __m256i f, tmp;
+
+         if (t >= 16)
+         {
+            tmp = _mm256_xor_si256(_mm256_xor_si256(w[(t - 3) & 15], w[(t - 8) & 15]),
+                  _mm256_xor_si256(w[(t - 14) & 15], w[t & 15]));
+            w[t & 15] = SHA1_ROL8(tmp, 1);
+         }
+
+         if (t < 20)
+            f = _mm256_add_epi32(_mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d))),
+                  _mm256_set1_epi32(0x5a827999));
+         else if (t < 40)
+            f = _mm256_add_epi32(_mm256_xor_si256(_mm256_xor_si256(b, c), d),
+                  _mm256_set1_epi32(0x6ed9eba1));
+         else if (t < 60)
+            f = _mm256_add_epi32(_mm256_or_si256(_mm256_and_si256(b, c),
+                     _mm256_and_si256(d, _mm256_or_si256(b, c))),
+                  _mm256_set1_epi32((int)0x8f1bbcdc));
+         else
+            f = _mm256_add_epi32(_mm256_xor_si256(_mm256_xor_si256(b, c), d),
+                  _mm256_set1_epi32((int)0xca62c1d6));
+
+         tmp = _mm256_add_epi32(_mm256_add_epi32(SHA1_ROL8(a, 5), f),
+               _mm256_add_epi32(e, w[t & 15]));
+         e   = d;
+         d   = c;
+         c   = SHA1_ROL8(b, 30);
+         b   = a;
+         a   = tmp;
+      }
+
+      s[0] = _mm256_add_epi32(s[0], a);
+      s[1] = _mm256_add_epi32(s[1], b);
+      s[2] = _mm256_add_epi32(s[2], c);
+      s[3] = _mm256_add_epi32(s[3], d);
+      s[4] = _mm256_add_epi32(s[4], e);
+   }
+
+   for (i = 0; i < 5; i++)
+      _mm256_storeu_si256((__m256i*)h[i], s[i]);
+}
+#endif
+
+static void sha1_init_simd(void)
+{
+   sha1_blocks_t blocks = sha1_blocks_scalar;
+#if defined(CONTENT_HASH_X86)
+   uint64_t cpu = cpu_features_get();
+
+   if ((cpu & RETRO_SIMD_SHA) && (cpu & RETRO_SIMD_SSE4))
+   {
+      blocks         = sha1_blocks_shani;
+      sha1_impl_name = "SHA-NI";
+   }
+
+   /* RETRO_SIMD_AVX implies the OS saves the YMM state. */
+   if ((cpu & RETRO_SIMD_AVX) && (cpu & RETRO_SIMD_AVX2))
+      sha1_avx2_enabled = true;
+#endif
+
+   /* Every caller picks the same one, so a race here is harmless. */
+   sha1_blocks = blocks;
+}
+
+const char *content_sha1_impl(void)
+{
+   if (!sha1_blocks)
+      sha1_init_simd();
+   return sha1_impl_name;
+}
+
+void content_sha1_init(content_sha1_t *sha1)
+{
+   if (!sha1_blocks)
+      sha1_init_simd();
+
+   memcpy(sha1->h, sha1_iv, sizeof(sha1_iv));
+   sha1->length = 0;
+   sha1->fill   = 0;
+}
+
+void content_sha1_update(content_sha1_t *sha1, const void *data, size_t len)
+{
+   const uint8_t *in = (const uint8_t*)data;
+
+   sha1->length += len;
+
+   if (sha1->fill)
+   {
+      size_t take = 64 - sha1->fill;
+      if (take > len)
+         take = len;
+      memcpy(sha1->block + sha1->fill, in, take);
+      sha1->fill += (unsigned)take;
+      in         += take;
+      len        -= take;
+      if (sha1->fill < 64)
+         return;
+      sha1_blocks(sha1->h, sha1->block, 1);
+      sha1->fill = 0;
+   }
+
+   if (len >= 64)
+   {
+      size_t blocks = len / 64;
+      sha1_blocks(sha1->h, in, blocks);
+      in  += blocks * 64;
+      len -= blocks * 64;
+   }
+
+   memcpy(sha1->block, in, len);
+   sha1->fill = (unsigned)len;
+}
+
+void content_sha1_final(content_sha1_t *sha1, uint8_t *digest)
+{
+   uint64_t bits = sha1->length * 8;
+   unsigned i;
+
+   sha1->block[sha1->fill++] = 0x80;
+   if (sha1->fill > 56)
+   {
+      memset(sha1->block + sha1->fill, 0, 64 - sha1->fill);
+      sha1_blocks(sha1->h, sha1->block, 1);
+      sha1->fill = 0;
+   }
+   memset(sha1->block + sha1->fill, 0, 56 - sha1->fill);
+   for (i = 0; i < 8; i++)
+      sha1->block[56 + i] = (uint8_t)(bits >> (56 - 8 * i));
+   sha1_blocks(sha1->h, sha1->block, 1);
+
+   for (i = 0; i < 5; i++)
+   {
+      digest[4 * i + 0] = (uint8_t)(sha1->h[i] >> 24);
+      digest[4 * i + 1] = (uint8_t)(sha1->h[i] >> 16);
+      digest[4 * i + 2] = (uint8_t)(sha1->h[i] >> 8);
+      digest[4 * i + 3] = (uint8_t)(sha1->h[i]);
+   }
+}
+
+void content_sha1_multi(const uint8_t *const *data, const size_t *len,
+      unsigned count, uint8_t *digest)
+{
+   unsigned i = 0;
+
+   if (!sha1_blocks)
+      sha1_init_simd();
+
+#if defined(CONTENT_HASH_X86)
+   /* The common prefix of each group of eight goes through the lanes,
+    * each tail is finished on its own. */
+   if (sha1_avx2_enabled)
+   {
+      for (; count - i >= 2; i += 8)
+      {
+         uint32_t h[5][8];
+         const uint8_t *lane[8];
+         unsigned lanes = count - i < 8 ? count - i : 8;
+         size_t blocks  = (size_t)-1;
+         unsigned l, k;
+
+         for (l = 0; l < 8; l++)
+         {
+            /* spare lanes rehash lane 0 and are thrown away */
+            unsigned src = l < lanes ? i + l : i;
+            lane[l]      = data[src];
+            if (len[src] / 64 < blocks)
+               blocks = len[src] / 64;
+            for (k = 0; k < 5; k++)
+               h[k][l] = sha1_iv[k];
+         }
+
+         sha1_blocks_avx2_x8(h, lane, blocks);
+
+         for (l = 0; l < lanes; l++)
+         {
+            content_sha1_t sha1;
+            for (k = 0; k < 5; k++)
+               sha1.h[k] = h[k][l];
+            sha1.length = blocks * 64;
+            sha1.fill   = 0;
+            content_sha1_update(&sha1, data[i + l] + blocks * 64, len[i + l] - blocks * 64);
+            content_sha1_final(&sha1, digest + (size_t)(i + l) * CONTENT_SHA1_SIZE);
+         }
+
+         if (lanes < 8)
+         {
+            i = count;
+            break;
+         }
+      }
+   }
+#endif
+
+   for (; i < count; i++)
+   {
+      content_sha1_t sha1;
+      content_sha1_init(&sha1);
+      content_sha1_update(&sha1, data[i], len[i]);
+      content_sha1_final(&sha1, digest + (size_t)i * CONTENT_SHA1_SIZE);
+   }
+}
+
+void content_hash_init(content_hash_t *hash, unsigned types)
+{
+   hash->types = types;
+   hash->crc32 = 0;
+   if (types & CONTENT_HASH_MD5)
+      MD5_Init(&hash->md5);
+   if (types & CONTENT_HASH_SHA1)
+      content_sha1_init(&hash->sha1);
+}
+
+void content_hash_update(content_hash_t *hash, const void *data, size_t len)
+{
+   const uint8_t *in = (const uint8_t*)data;
+
+   while (len)
+   {
+      size_t chunk = len < CONTENT_HASH_CHUNK ? len : CONTENT_HASH_CHUNK;
+
+      if (hash->types & CONTENT_HASH_CRC32)
+         hash->crc32 = encoding_crc32(hash->crc32, in, chunk);
+      if (hash->types & CONTENT_HASH_MD5)
+         MD5_Update(&hash->md5, in, (unsigned long)chunk);
+      if (hash->types & CONTENT_HASH_SHA1)
+         content_sha1_update(&hash->sha1, in, chunk);
+
+      in  += chunk;
+      len -= chunk;
+   }
+}
+
+void content_hash_final(content_hash_t *hash, content_hash_result_t *result)
+{
+   memset(result, 0, sizeof(*result));
+   result->crc32 = hash->crc32;
+   if (hash->types & CONTENT_HASH_MD5)
+      MD5_Final(result->md5, &hash->md5);
+   if (hash->types & CONTENT_HASH_SHA1)
+      content_sha1_final(&hash->sha1, result->sha1);
+}
+
+bool content_hash_file(const char *path, unsigned types,
+      content_hash_result_t *result)
+{
+   content_hash_t hash;
+   ssize_t got;
+   uint8_t *buf = NULL;
+   RFILE *fd    = filestream_open(path, RFILE_MODE_READ | RFILE_HINT_MMAP, -1);
+
+   if (!fd)
+      return false;
+
+   buf = (uint8_t*)malloc(CONTENT_HASH_READ);
+   if (!buf)
+   {
+      filestream_close(fd);
+      return false;
+   }
+
+   content_hash_init(&hash, types);
+   while ((got = filestream_read(fd, buf, CONTENT_HASH_READ)) > 0)
+      content_hash_update(&hash, buf, (size_t)got);
+
+   free(buf);
+   filestream_close(fd);
+   if (got < 0)
+      return false;
+
+   content_hash_final(&hash, result);
+   return true;
+}
@@ -0,0 +1,170 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (core_info_cache.h).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __LIBRETRO_SDK_CORE_INFO_CACHE_H
+#define __LIBRETRO_SDK_CORE_INFO_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include <retro_common_api.h>
+#include <boolean.h>
+
+RETRO_BEGIN_DECLS
+
+/* What every core in a directory reports from retro_get_system_info(),
+ * cached so listing cores doesn't mean loading each of them.
+ *
+ * Cores are probed out of process: the host executable is started again
+ * as "exe --core-info-probe core" and must hand that over to
+ * core_info_probe_main(). A core that crashes, hangs or isn't a libretro
+ * core only takes its probe down; it is cached as failed and left alone
+ * until the file changes.
+ *
+ * The cache file is read in one go and used as is:
+ *   header
+ *   entries[count]    sorted by path (strcmp)
+ *   pool              NUL-terminated strings
+ * Host byte order; a foreign or stale file reads as empty. */
+
+#define CORE_INFO_CACHE_MAGIC   0x43494643 /* "CFIC" */
+#define CORE_INFO_CACHE_VERSION 1
+
+#define CORE_INFO_PROBE_ARG     "--core-info-probe"
+
+enum core_info_cache_flags
+{
+   CORE_INFO_CACHE_VALID         = 1 << 0, /* the probe got the system info */
+   CORE_INFO_CACHE_NEED_FULLPATH = 1 << 1,
+   CORE_INFO_CACHE_BLOCK_EXTRACT = 1 << 2
+};
+
+typedef struct core_info_cache_header
+{
+   uint32_t magic;
+   uint32_t version;
+   uint32_t count;
+   uint32_t pool_size;
+} core_info_cache_header_t;
+
+typedef struct core_info_cache_entry
+{
+   int64_t  file_size;
+   int64_t  file_mtime;
+   /* offsets into the pool */
+   uint32_t path;
+   uint32_t library_name;
+   uint32_t library_version;
+   uint32_t valid_extensions;
+   uint32_t api_version;
+   uint32_t flags;            /* CORE_INFO_CACHE_* */
+} core_info_cache_entry_t;
+
+typedef struct core_info_cache_stats
+{
+   unsigned cores;   /* found in the directory */
+   unsigned reused;  /* unchanged since the cache was written */
+   unsigned probed;  /* new or changed, probed again */
+   unsigned failed;  /* of those, the probes that got nothing */
+   unsigned removed; /* cached but gone from the directory */
+} core_info_cache_stats_t;
+
+typedef struct core_info_cache core_info_cache_t;
+
+/**
+ * core_info_cache_load:
+ * @path              : Cache file.
+ *
+ * A missing, truncated or foreign file gives an empty cache.
+ *
+ * Returns: the cache, NULL only when out of memory.
+ **/
+core_info_cache_t *core_info_cache_load(const char *path);
+
+void core_info_cache_free(core_info_cache_t *cache);
+
+/**
+ * core_info_cache_save:
+ * @cache             : Cache.
+ * @path              : Cache file to replace.
+ *
+ * Writes to "@path.tmp" and renames it over @path.
+ *
+ * Returns: true on success.
+ **/
+bool core_info_cache_save(const core_info_cache_t *cache, const char *path);
+
+size_t core_info_cache_count(const core_info_cache_t *cache);
+
+const core_info_cache_entry_t *core_info_cache_get(
+      const core_info_cache_t *cache, size_t i);
+
+/* Resolves one of the entry's string offsets. */
+const char *core_info_cache_string(const core_info_cache_t *cache,
+      uint32_t offset);
+
+/**
+ * core_info_cache_find:
+ * @cache             : Cache.
+ * @path              : Core path, as found by core_info_cache_refresh().
+ *
+ * Returns: position of the entry for @path, or -1.
+ **/
+ssize_t core_info_cache_find(const core_info_cache_t *cache, const char *path);
+
+/**
+ * core_info_cache_refresh:
+ * @cache             : Cache to bring up to date.
+ * @dir               : Core directory, not searched recursively.
+ * @probe_exe         : Executable that handles CORE_INFO_PROBE_ARG,
+ *                      NULL for the running one.
+ * @threads           : Probes to run at once, 0 for one per CPU.
+ * @timeout_ms        : How long a probe may take before it is killed.
+ * @stats             : Optional, receives what was done.
+ *
+ * Keeps every entry whose core still has the same size and mtime, probes
+ * the rest and drops cores that are gone. Only writes anything to @cache;
+ * save it when @stats shows cores were probed or removed.
+ *
+ * Returns: false if @dir can't be read or memory ran out; @cache is then
+ * left as it was.
+ **/
+bool core_info_cache_refresh(core_info_cache_t *cache, const char *dir,
+      const char *probe_exe, unsigned threads, unsigned timeout_ms,
+      core_info_cache_stats_t *stats);
+
+/**
+ * core_info_probe_main:
+ * @core_path         : Core to load.
+ *
+ * Body of the probe process. Loads @core_path and prints its system info
+ * on stdout for the parent; call it from main() for CORE_INFO_PROBE_ARG
+ * and exit with its result. Never call it in a process you care about.
+ *
+ * Returns: exit code, 0 when the core reported its info.
+ **/
+int core_info_probe_main(const char *core_path);
+
+RETRO_END_DECLS
+
+#endif
@@ -50,6 +50,12 @@ retro_perf_tick_t cpu_features_get_perf_counter(void);
  **/
 retro_time_t cpu_features_get_time_usec(void);
 
+/* Extra features cpu_features_get() reports on top of libretro.h's
+ * RETRO_SIMD_* set. They live above bit 31 so they cannot collide with
+ * future RETRO_SIMD_* flags; cores handed this mask just ignore them. */
+#define RETRO_SIMD_PCLMUL   (UINT64_C(1) << 32)
+#define RETRO_SIMD_SHA      (UINT64_C(1) << 33)
+
 /**
  * cpu_features_get:
  *
@@ -0,0 +1,114 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (autosave.h).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __LIBRETRO_SDK_AUTOSAVE_H
+#define __LIBRETRO_SDK_AUTOSAVE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <retro_common_api.h>
+#include <boolean.h>
+
+RETRO_BEGIN_DECLS
+
+/* Battery saves for a block of core memory, usually SRAM.
+ *
+ * autosave_check() runs once a frame. It compares the memory against a
+ * shadow copy block by block, copying only what changed. Once a change
+ * has been quiet for AUTOSAVE_SETTLE_MS, or has waited AUTOSAVE_MAX_MS
+ * regardless, the shadow is handed to a writer thread. That thread
+ * writes "path.tmp" and renames it over the file, so a crash mid-write
+ * never leaves a torn save. Unchanged memory is never written. */
+
+#define AUTOSAVE_SETTLE_MS 1000
+#define AUTOSAVE_MAX_MS    10000
+
+typedef struct autosave_stats
+{
+   uint64_t checks;     /* autosave_check() calls */
+   uint64_t changes;    /* of those, ones that found changed blocks */
+   uint64_t blocks;     /* changed blocks copied to the shadow */
+   uint64_t writes;     /* files written */
+   uint64_t failed;     /* writes that failed */
+} autosave_stats_t;
+
+typedef struct autosave autosave_t;
+
+/**
+ * autosave_new:
+ * @data              : Memory to save, owned by the caller (the core).
+ * @size              : Size of @data.
+ * @path              : Save file.
+ *
+ * Loads @path into @data first. A file of another size fills what fits
+ * and leaves the rest alone, as a core resized its SRAM would expect.
+ *
+ * Returns: the autosave, NULL when out of memory or @size is 0.
+ **/
+autosave_t *autosave_new(void *data, size_t size, const char *path);
+
+/**
+ * autosave_free:
+ * @save              : Autosave.
+ *
+ * Stops the writer once it is idle. Doesn't save anything; call
+ * autosave_flush() first while @data is still valid.
+ **/
+void autosave_free(autosave_t *save);
+
+/**
+ * autosave_check:
+ * @save              : Autosave.
+ *
+ * Call once a frame, from the thread running the core.
+ *
+ * Returns: true if the memory changed since the last check.
+ **/
+bool autosave_check(autosave_t *save);
+
+/**
+ * autosave_flush:
+ * @save              : Autosave.
+ *
+ * Writes any change right away and waits until it is on disk.
+ *
+ * Returns: false if a write failed.
+ **/
+bool autosave_flush(autosave_t *save);
+
+/**
+ * autosave_set_delays:
+ * @save              : Autosave.
+ * @settle_ms         : Quiet time after a change before it is written.
+ * @max_ms            : Longest a change waits while the memory keeps changing.
+ *
+ * Defaults are AUTOSAVE_SETTLE_MS and AUTOSAVE_MAX_MS.
+ **/
+void autosave_set_delays(autosave_t *save, unsigned settle_ms, unsigned max_ms);
+
+/* From the thread running the core, like autosave_check(). */
+void autosave_get_stats(autosave_t *save, autosave_stats_t *stats);
+
+RETRO_END_DECLS
+
+#endif
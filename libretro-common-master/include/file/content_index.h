@@ -0,0 +1,163 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (content_index.h).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __LIBRETRO_SDK_CONTENT_INDEX_H
+#define __LIBRETRO_SDK_CONTENT_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include <retro_common_api.h>
+#include <boolean.h>
+
+RETRO_BEGIN_DECLS
+
+/* Persistent index of scanned content, written by content_scan().
+ *
+ * The file is used in place, mapped where the platform can:
+ *   header
+ *   entries[count]    sorted by path (strcmp)
+ *   by_crc[count]     entry numbers sorted by CRC32
+ *   pool              NUL-terminated paths
+ * Everything is host byte order and naturally aligned. A file written
+ * with the other byte order fails the magic check and reads as empty,
+ * which just means the next scan starts cold.
+ *
+ * Archive members are stored as "archive.zip#member"; sorting by path
+ * keeps every member of an archive right after the archive itself. */
+
+#define CONTENT_INDEX_MAGIC   0x58444943 /* "CIDX" */
+#define CONTENT_INDEX_VERSION 1
+
+enum content_index_flags
+{
+   CONTENT_INDEX_ARCHIVE  = 1 << 0, /* the archive itself; its members follow */
+   CONTENT_INDEX_MEMBER   = 1 << 1, /* inside an archive, CRC32 from its directory */
+   CONTENT_INDEX_HAS_MD5  = 1 << 2,
+   CONTENT_INDEX_HAS_SHA1 = 1 << 3
+};
+
+typedef struct content_index_header
+{
+   uint32_t magic;
+   uint32_t version;
+   uint32_t count;
+   uint32_t pool_size;
+} content_index_header_t;
+
+typedef struct content_index_entry
+{
+   int64_t  file_size;  /* on disk; the archive's for members */
+   int64_t  file_mtime; /* seconds; the archive's for members */
+   uint64_t length;     /* content bytes */
+   uint32_t path;       /* offset into the pool */
+   uint32_t crc32;
+   uint32_t flags;      /* CONTENT_INDEX_* */
+   uint8_t  md5[16];
+   uint8_t  sha1[20];
+} content_index_entry_t;
+
+typedef struct content_index content_index_t;
+
+/**
+ * content_index_open:
+ * @path              : Index file.
+ *
+ * Maps @path. A missing, truncated or foreign file gives an empty
+ * index rather than an error.
+ *
+ * Returns: the index, NULL only when out of memory.
+ **/
+content_index_t *content_index_open(const char *path);
+
+void content_index_free(content_index_t *index);
+
+size_t content_index_count(const content_index_t *index);
+
+const content_index_entry_t *content_index_get(const content_index_t *index, size_t i);
+
+const char *content_index_path(const content_index_t *index,
+      const content_index_entry_t *entry);
+
+/**
+ * content_index_find_path:
+ * @index             : Index.
+ * @path              : Exact path, "archive#member" for archive members.
+ *
+ * Returns: position of the entry for @path, or -1.
+ **/
+ssize_t content_index_find_path(const content_index_t *index, const char *path);
+
+/**
+ * content_index_find_crc:
+ * @index             : Index.
+ * @crc               : CRC32 to look for.
+ * @first             : Receives the position in the CRC order of the first match.
+ *
+ * Walk the matches with content_index_get_by_crc(@first + n).
+ *
+ * Returns: number of entries with @crc.
+ **/
+size_t content_index_find_crc(const content_index_t *index, uint32_t crc,
+      size_t *first);
+
+const content_index_entry_t *content_index_get_by_crc(
+      const content_index_t *index, size_t i);
+
+/* Collects entries in any order and writes them out sorted. */
+typedef struct content_index_writer content_index_writer_t;
+
+content_index_writer_t *content_index_writer_new(void);
+
+void content_index_writer_free(content_index_writer_t *writer);
+
+/**
+ * content_index_writer_add:
+ * @writer            : Writer.
+ * @path              : Entry path.
+ * @entry             : Entry; its path field is ignored.
+ *
+ * Not thread-safe; content_scan() serialises calls.
+ *
+ * Returns: false when out of memory.
+ **/
+bool content_index_writer_add(content_index_writer_t *writer,
+      const char *path, const content_index_entry_t *entry);
+
+size_t content_index_writer_count(const content_index_writer_t *writer);
+
+/**
+ * content_index_writer_save:
+ * @writer            : Writer.
+ * @path              : Index file to replace.
+ *
+ * Writes to "@path.tmp" and renames it over @path, so a reader never
+ * sees half a file. Paths must be unique.
+ *
+ * Returns: true on success.
+ **/
+bool content_index_writer_save(content_index_writer_t *writer, const char *path);
+
+RETRO_END_DECLS
+
+#endif
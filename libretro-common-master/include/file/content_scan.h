@@ -0,0 +1,67 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (content_scan.h).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __LIBRETRO_SDK_CONTENT_SCAN_H
+#define __LIBRETRO_SDK_CONTENT_SCAN_H
+
+#include <stdint.h>
+
+#include <retro_common_api.h>
+#include <boolean.h>
+
+RETRO_BEGIN_DECLS
+
+typedef struct content_scan_stats
+{
+   unsigned dirs;
+   unsigned files;      /* plain files and archives found */
+   unsigned hashed;     /* read this time */
+   unsigned reused;     /* same size and mtime as in the previous index */
+   unsigned entries;    /* written to the index, archive members included */
+   uint64_t bytes;      /* read for hashing */
+} content_scan_stats_t;
+
+/**
+ * content_scan:
+ * @dir               : Directory to scan, recursively.
+ * @exts              : Extensions to take, "sfc|smc|bin", or NULL for all.
+ *                      Archives are always looked into.
+ * @index_path        : Index to update (see content_index.h).
+ * @types             : CONTENT_HASH_* for plain files; CRC32 is always taken.
+ * @threads           : Threads including the caller's, 0 for one per core.
+ * @stats             : Optional, receives what the scan did.
+ *
+ * Walks @dir with a pool of workers that share one queue of directories
+ * and files. Files whose size and mtime match @index_path keep their old
+ * entry without being opened; the rest are hashed through
+ * content_hash_file(). Archives aren't decompressed: each member is
+ * listed with the CRC32 from the archive's directory. Entries for files
+ * that are gone are dropped, so the index always mirrors @dir.
+ *
+ * Returns: true if the index was written.
+ **/
+bool content_scan(const char *dir, const char *exts, const char *index_path,
+      unsigned types, unsigned threads, content_scan_stats_t *stats);
+
+RETRO_END_DECLS
+
+#endif
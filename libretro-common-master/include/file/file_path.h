@@ -466,6 +466,19 @@ bool path_is_valid(const char *path);
 
 int32_t path_get_size(const char *path);
 
+/**
+ * path_get_size_mtime:
+ * @path               : path
+ * @size               : receives the size in bytes
+ * @mtime              : receives the modification time in seconds,
+ *                       0 where the platform can't tell
+ *
+ * Enough to tell whether a file changed without reading it.
+ *
+ * Returns: true (1) if path exists, otherwise false (0).
+ */
+bool path_get_size_mtime(const char *path, int64_t *size, int64_t *mtime);
+
 RETRO_END_DECLS
 
 #endif
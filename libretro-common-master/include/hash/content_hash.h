@@ -0,0 +1,126 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (content_hash.h).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIBRETRO_HASH_CONTENT_HASH_H
+#define _LIBRETRO_HASH_CONTENT_HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <retro_common_api.h>
+#include <boolean.h>
+#include <utils/md5.h>
+
+RETRO_BEGIN_DECLS
+
+/* Hashes used to identify content. SHA-1 uses SHA-NI or, for several
+ * buffers at once, AVX2 when the CPU has them; CRC32 goes through
+ * encoding_crc32(); MD5 is the scalar utils/md5.c. */
+
+#define CONTENT_SHA1_SIZE 20
+#define CONTENT_MD5_SIZE  16
+
+enum content_hash_type
+{
+   CONTENT_HASH_CRC32 = 1 << 0,
+   CONTENT_HASH_MD5   = 1 << 1,
+   CONTENT_HASH_SHA1  = 1 << 2,
+   CONTENT_HASH_ALL   = CONTENT_HASH_CRC32 | CONTENT_HASH_MD5 | CONTENT_HASH_SHA1
+};
+
+typedef struct content_sha1
+{
+   uint32_t h[5];
+   uint64_t length;     /* bytes hashed so far */
+   uint8_t  block[64];  /* partial block */
+   unsigned fill;
+} content_sha1_t;
+
+typedef struct content_hash
+{
+   unsigned types;      /* CONTENT_HASH_* */
+   uint32_t crc32;
+   MD5_CTX md5;
+   content_sha1_t sha1;
+} content_hash_t;
+
+typedef struct content_hash_result
+{
+   uint32_t crc32;
+   uint8_t md5[CONTENT_MD5_SIZE];
+   uint8_t sha1[CONTENT_SHA1_SIZE];
+} content_hash_result_t;
+
+void content_sha1_init(content_sha1_t *sha1);
+
+void content_sha1_update(content_sha1_t *sha1, const void *data, size_t len);
+
+void content_sha1_final(content_sha1_t *sha1, uint8_t *digest);
+
+/**
+ * content_sha1_multi:
+ * @data              : Buffers to hash.
+ * @len               : Their sizes.
+ * @count             : Number of buffers.
+ * @digest            : Receives @count digests of CONTENT_SHA1_SIZE bytes.
+ *
+ * Hashes independent buffers together, eight at a time with AVX2.
+ * SHA-1 cannot be split within one buffer, so this is the way to use
+ * wide vectors for it (a batch of ROMs, every track of a disc).
+ **/
+void content_sha1_multi(const uint8_t *const *data, const size_t *len,
+      unsigned count, uint8_t *digest);
+
+/**
+ * content_hash_init:
+ * @hash              : Context.
+ * @types             : CONTENT_HASH_* to compute.
+ *
+ * Starts a one-pass hash: every chunk given to content_hash_update()
+ * runs through all of @types while it's still in cache.
+ **/
+void content_hash_init(content_hash_t *hash, unsigned types);
+
+void content_hash_update(content_hash_t *hash, const void *data, size_t len);
+
+void content_hash_final(content_hash_t *hash, content_hash_result_t *result);
+
+/**
+ * content_hash_file:
+ * @path              : File to hash.
+ * @types             : CONTENT_HASH_* to compute.
+ * @result            : Receives the hashes.
+ *
+ * Reads @path once (mapped where the file stream supports it) and
+ * computes every requested hash on the way.
+ *
+ * Returns: true on success.
+ **/
+bool content_hash_file(const char *path, unsigned types,
+      content_hash_result_t *result);
+
+/* Name of the SHA-1 implementation in use, for logs. */
+const char *content_sha1_impl(void);
+
+RETRO_END_DECLS
+
+#endif
@@ -0,0 +1,206 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (ram_search.h).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __LIBRETRO_SDK_RAM_SEARCH_H
+#define __LIBRETRO_SDK_RAM_SEARCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include <retro_common_api.h>
+#include <boolean.h>
+
+RETRO_BEGIN_DECLS
+
+/* Cheat-finder style search over core memory.
+ *
+ * A search starts with every address as a candidate and narrows it down
+ * pass by pass; each pass compares the value at every remaining address
+ * with a constant, with the memory as it was at the previous pass, or
+ * with a snapshot taken earlier. Values are 8, 16 or 32 bits, little
+ * endian, and may start at any byte unless RAM_SEARCH_ALIGNED is given.
+ *
+ * Candidates are a bitmap, one bit per address, and a pass looks at 32
+ * addresses at a time, skipping any group with no candidates left. */
+
+enum ram_search_op
+{
+   RAM_SEARCH_EQ = 0,
+   RAM_SEARCH_NE,
+   RAM_SEARCH_LT,
+   RAM_SEARCH_GT,
+   RAM_SEARCH_LE,
+   RAM_SEARCH_GE
+};
+
+enum ram_search_flags
+{
+   RAM_SEARCH_SIGNED  = 1 << 0,
+   RAM_SEARCH_ALIGNED = 1 << 1  /* only addresses that are a multiple of the width */
+};
+
+/* A copy of core memory to compare against later. */
+typedef struct ram_snapshot
+{
+   uint8_t *data;
+   size_t size;
+} ram_snapshot_t;
+
+ram_snapshot_t *ram_snapshot_new(const void *data, size_t size);
+
+void ram_snapshot_free(ram_snapshot_t *snapshot);
+
+typedef struct ram_search ram_search_t;
+
+/**
+ * ram_search_new:
+ * @data              : Core memory, e.g. retro_get_memory_data(RETRO_MEMORY_SYSTEM_RAM).
+ * @size              : Its size.
+ * @width             : Value size in bytes: 1, 2 or 4.
+ * @flags             : RAM_SEARCH_*.
+ *
+ * @data must stay valid while the search is used; it is read on every
+ * pass, never written.
+ *
+ * Returns: a search with every address a candidate, NULL on bad
+ * arguments or when out of memory.
+ **/
+ram_search_t *ram_search_new(const void *data, size_t size,
+      unsigned width, unsigned flags);
+
+void ram_search_free(ram_search_t *search);
+
+/* Every address a candidate again, and the memory as it is now the
+ * previous value. */
+void ram_search_reset(ram_search_t *search);
+
+/**
+ * ram_search_filter_value:
+ * @search            : Search.
+ * @op                : Keep candidates where "value now @op @value" holds.
+ * @value             : Constant, truncated to the width.
+ *
+ * Returns: candidates left.
+ **/
+size_t ram_search_filter_value(ram_search_t *search,
+      enum ram_search_op op, uint32_t value);
+
+/**
+ * ram_search_filter_previous:
+ * @search            : Search.
+ * @op                : Keep candidates where "value now @op value before" holds.
+ *
+ * "Before" is the previous pass (or ram_search_new/reset): NE keeps what
+ * changed, GT what increased and so on.
+ *
+ * Returns: candidates left.
+ **/
+size_t ram_search_filter_previous(ram_search_t *search, enum ram_search_op op);
+
+/**
+ * ram_search_filter_snapshot:
+ * @search            : Search.
+ * @op                : Keep candidates where "value now @op value in @snapshot" holds.
+ * @snapshot          : Snapshot of the same memory, at least as large.
+ *
+ * Returns: candidates left.
+ **/
+size_t ram_search_filter_snapshot(ram_search_t *search,
+      enum ram_search_op op, const ram_snapshot_t *snapshot);
+
+size_t ram_search_count(const ram_search_t *search);
+
+/**
+ * ram_search_next:
+ * @search            : Search.
+ * @from              : First address to consider.
+ *
+ * Walk the candidates with addr = ram_search_next(search, 0) and then
+ * ram_search_next(search, addr + 1).
+ *
+ * Returns: the first candidate at or after @from, or -1.
+ **/
+ssize_t ram_search_next(const ram_search_t *search, size_t from);
+
+/* The value at @addr now, and at the previous pass. */
+uint32_t ram_search_value(const ram_search_t *search, size_t addr);
+
+uint32_t ram_search_previous(const ram_search_t *search, size_t addr);
+
+/* Name of the compare kernels in use, for benchmarks. */
+const char *ram_search_impl(void);
+
+/* Values sampled once a frame into a ring, newest last. */
+typedef struct ram_watch ram_watch_t;
+
+/**
+ * ram_watch_new:
+ * @frames            : Frames of history to keep.
+ *
+ * Returns: an empty watch list, NULL when out of memory.
+ **/
+ram_watch_t *ram_watch_new(size_t frames);
+
+void ram_watch_free(ram_watch_t *watch);
+
+/**
+ * ram_watch_add:
+ * @watch             : Watch list.
+ * @addr              : Address of the value.
+ * @width             : Value size in bytes: 1, 2 or 4.
+ * @flags             : RAM_SEARCH_SIGNED to sign-extend.
+ *
+ * Clears the history.
+ *
+ * Returns: index of the watch, -1 on bad arguments or out of memory.
+ **/
+int ram_watch_add(ram_watch_t *watch, size_t addr, unsigned width, unsigned flags);
+
+unsigned ram_watch_count(const ram_watch_t *watch);
+
+/**
+ * ram_watch_sample:
+ * @watch             : Watch list.
+ * @data              : Core memory.
+ * @size              : Its size; watches past the end read 0.
+ *
+ * Call once a frame; the oldest frame drops out when the ring is full.
+ **/
+void ram_watch_sample(ram_watch_t *watch, const void *data, size_t size);
+
+/* Frames in the ring, at most the @frames given to ram_watch_new(). */
+size_t ram_watch_frames(const ram_watch_t *watch);
+
+/**
+ * ram_watch_get:
+ * @watch             : Watch list.
+ * @index             : Watch, as returned by ram_watch_add().
+ * @frame             : 0 for the oldest frame in the ring.
+ *
+ * Returns: the value, sign-extended for signed watches.
+ **/
+uint32_t ram_watch_get(const ram_watch_t *watch, unsigned index, size_t frame);
+
+RETRO_END_DECLS
+
+#endif
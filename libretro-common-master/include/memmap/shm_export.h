@@ -0,0 +1,225 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (shm_export.h).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __LIBRETRO_SDK_SHM_EXPORT_H
+#define __LIBRETRO_SDK_SHM_EXPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <retro_common_api.h>
+#include <boolean.h>
+
+RETRO_BEGIN_DECLS
+
+/* Video frames and audio published into shared memory for other
+ * processes: a POSIX shared memory object (shm_open) or, on Windows, a
+ * named file mapping ("Local\name").
+ *
+ * The segment holds a header and one ring of fixed-size slots per
+ * stream. The producer never waits: it writes the next slot whether or
+ * not anybody read it. Every slot is guarded by a sequence count the
+ * producer makes odd while writing and even again when done (a seqlock);
+ * readers check it is the same even value before and after looking at
+ * the slot, and give up on it when the producer lapped them.
+ *
+ * Layout, native byte order:
+ *   struct shm_export_header
+ *   video ring at stream[SHM_EXPORT_VIDEO].offset
+ *   audio ring at stream[SHM_EXPORT_AUDIO].offset
+ * A ring is @slots slots of SHM_EXPORT_SLOT_HEADER bytes of
+ * struct shm_export_slot followed by @slot_size bytes of payload, padded
+ * to 64 bytes. */
+
+#define SHM_EXPORT_MAGIC        0x584d4853 /* "SHMX" */
+#define SHM_EXPORT_VERSION      1
+#define SHM_EXPORT_SLOT_HEADER  64
+
+enum shm_export_stream
+{
+   SHM_EXPORT_VIDEO = 0,
+   SHM_EXPORT_AUDIO,
+   SHM_EXPORT_STREAMS
+};
+
+struct shm_export_ring
+{
+   uint64_t offset;
+   uint32_t slots;
+   uint32_t slot_size;
+   /* slots published so far; the newest is (head - 1) % slots */
+   uint32_t head;
+   uint32_t pad;
+};
+
+struct shm_export_header
+{
+   uint32_t magic;
+   uint32_t version;
+   uint64_t size;                 /* of the whole segment */
+   uint32_t producer_pid;
+   uint32_t closed;               /* set when the producer goes away */
+   struct shm_export_ring stream[SHM_EXPORT_STREAMS];
+};
+
+/* What a slot holds. Video payload is packed rows (pitch = width * bytes
+ * per pixel) in RETRO_PIXEL_FORMAT_* @format; audio payload is @width
+ * interleaved stereo int16 frames at @pitch Hz, @height and @format 0. */
+struct shm_export_slot
+{
+   uint32_t seq;                  /* odd while the producer writes the slot */
+   uint32_t index;                /* head when it was published */
+   uint64_t frame;                /* producer frame number */
+   int64_t time_usec;             /* cpu_features_get_time_usec() at publish */
+   uint32_t size;                 /* payload bytes */
+   uint32_t width;
+   uint32_t height;
+   uint32_t pitch;
+   uint32_t format;
+};
+
+typedef struct shm_export shm_export_t;
+
+/**
+ * shm_export_new:
+ * @name              : Segment name, e.g. "einweggerat-video"; a leading
+ *                      '/' is added on POSIX.
+ * @video_slot_size   : Largest frame in bytes.
+ * @video_slots       : Frames kept.
+ * @audio_slot_size   : Largest audio batch in bytes.
+ * @audio_slots       : Batches kept.
+ *
+ * On POSIX a segment of that name left behind by a crashed producer is
+ * replaced; Windows removes a mapping with its last handle.
+ *
+ * Returns: the producer, NULL on failure.
+ **/
+shm_export_t *shm_export_new(const char *name,
+      size_t video_slot_size, unsigned video_slots,
+      size_t audio_slot_size, unsigned audio_slots);
+
+/* Marks the segment closed and removes its name; readers keep what they
+ * mapped. */
+void shm_export_free(shm_export_t *shm);
+
+/**
+ * shm_export_video:
+ * @shm               : Producer.
+ * @frame             : Frame number.
+ * @data              : First row, as given to retro_video_refresh_t.
+ * @width             : Width in pixels.
+ * @height            : Height in rows.
+ * @pitch             : Bytes from one row to the next in @data.
+ * @format            : RETRO_PIXEL_FORMAT_*.
+ *
+ * Never blocks.
+ *
+ * Returns: false when the frame does not fit a slot.
+ **/
+bool shm_export_video(shm_export_t *shm, uint64_t frame, const void *data,
+      unsigned width, unsigned height, size_t pitch, unsigned format);
+
+/**
+ * shm_export_audio:
+ * @shm               : Producer.
+ * @frame             : Video frame the audio belongs to.
+ * @data              : Interleaved stereo samples.
+ * @frames            : Stereo frames in @data.
+ * @rate              : Sample rate in Hz.
+ *
+ * Batches larger than a slot take several.
+ *
+ * Returns: false when there is nothing to publish.
+ **/
+bool shm_export_audio(shm_export_t *shm, uint64_t frame,
+      const int16_t *data, size_t frames, unsigned rate);
+
+typedef struct shm_reader shm_reader_t;
+
+/**
+ * shm_reader_open:
+ * @name              : Name given to shm_export_new().
+ *
+ * Reads what is published from now on.
+ *
+ * Returns: the reader, NULL when there is no such segment or it is not
+ * one of ours.
+ **/
+shm_reader_t *shm_reader_open(const char *name);
+
+void shm_reader_close(shm_reader_t *reader);
+
+const struct shm_export_header *shm_reader_header(const shm_reader_t *reader);
+
+/**
+ * shm_reader_acquire:
+ * @reader            : Reader.
+ * @stream            : SHM_EXPORT_VIDEO or SHM_EXPORT_AUDIO.
+ * @info              : Filled with the slot header.
+ *
+ * Looks at the oldest slot not read yet, in place. Slots the producer
+ * overwrote before the reader got to them are skipped and counted in
+ * shm_reader_dropped(). The payload may be overwritten while in use;
+ * only trust what was read if shm_reader_release() says so.
+ *
+ * Returns: the payload, NULL when nothing new was published.
+ **/
+const void *shm_reader_acquire(shm_reader_t *reader,
+      enum shm_export_stream stream, struct shm_export_slot *info);
+
+/**
+ * shm_reader_release:
+ * @reader            : Reader.
+ * @stream            : Stream of the last shm_reader_acquire().
+ *
+ * Returns: true when the slot stayed intact since it was acquired; on
+ * false it was overwritten and counts as dropped.
+ **/
+bool shm_reader_release(shm_reader_t *reader, enum shm_export_stream stream);
+
+/**
+ * shm_reader_read:
+ * @reader            : Reader.
+ * @stream            : SHM_EXPORT_VIDEO or SHM_EXPORT_AUDIO.
+ * @info              : Filled with the slot header.
+ * @buf               : Receives the payload.
+ * @size              : Size of @buf.
+ *
+ * shm_reader_acquire() and shm_reader_release() around a copy, retried
+ * while the producer laps the reader.
+ *
+ * Returns: 1 with a slot in @buf, 0 when nothing new was published, -1
+ * when @buf is too small for the slot (it is skipped).
+ **/
+int shm_reader_read(shm_reader_t *reader, enum shm_export_stream stream,
+      struct shm_export_slot *info, void *buf, size_t size);
+
+/* Skips to the newest slot published, for readers that only want the
+ * latest frame; what it skips is not counted as dropped. */
+void shm_reader_seek_latest(shm_reader_t *reader, enum shm_export_stream stream);
+
+/* Slots of @stream the reader lost to the producer lapping it. */
+uint64_t shm_reader_dropped(const shm_reader_t *reader, enum shm_export_stream stream);
+
+RETRO_END_DECLS
+
+#endif
@@ -0,0 +1,154 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (net_rollback.h).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIBRETRO_SDK_NET_ROLLBACK_H
+#define _LIBRETRO_SDK_NET_ROLLBACK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <retro_common_api.h>
+#include <boolean.h>
+
+RETRO_BEGIN_DECLS
+
+/* Two-player rollback over UDP.
+ *
+ * Each peer sends its joypad state for every frame to the other, and
+ * does not wait for the other's: frames whose remote input has not
+ * arrived run with a prediction (the last input received). The state
+ * before every frame is saved in a ring as deep as the rollback window;
+ * when an input arrives that differs from what was predicted, the state
+ * of that frame is loaded back and the frames since are run again.
+ * A peer more than a window ahead of the other stalls until the other
+ * catches up.
+ *
+ * Every packet repeats all inputs the other side has not acknowledged,
+ * so a lost packet costs nothing while the next one arrives; packets
+ * also carry a CRC32 of the state at a confirmed frame now and then, to
+ * catch cores that diverge.
+ *
+ * Latency, jitter and loss can be injected on the sending side for
+ * tests on one machine. */
+
+#define ROLLBACK_MAX_WINDOW 64
+
+/* What the netcode needs from the emulator. Inputs are
+ * RETRO_DEVICE_ID_JOYPAD_* bitmasks, one per player. */
+struct rollback_callbacks
+{
+   void *data;
+   size_t (*serialize_size)(void *data);
+   bool (*serialize)(void *data, void *buf, size_t size);
+   bool (*unserialize)(void *data, const void *buf, size_t size);
+   /* Runs one frame; @replay is set while re-running frames after a
+    * rollback, when video and audio can be skipped. */
+   void (*run)(void *data, const uint16_t input[2], bool replay);
+};
+
+struct rollback_config
+{
+   unsigned player;          /* 0 or 1, must differ between the peers */
+   uint16_t local_port;
+   const char *remote_host;
+   uint16_t remote_port;
+   unsigned window;          /* frames of rollback, at most ROLLBACK_MAX_WINDOW */
+   unsigned input_delay;     /* frames local input is held back, same on both peers */
+   unsigned sync_interval;   /* frames between state CRC exchanges, 0 for none */
+   /* injected on packets sent */
+   unsigned latency_ms;
+   unsigned jitter_ms;
+   float loss;               /* 0..1 */
+   uint32_t seed;            /* for jitter and loss */
+};
+
+struct rollback_stats
+{
+   uint64_t frames;             /* frames advanced */
+   uint64_t stalls;             /* rollback_frame() calls that could not advance */
+   uint64_t predicted;          /* frames first run on a predicted input */
+   uint64_t rollbacks;
+   uint64_t resimulated;        /* frames run again */
+   unsigned max_depth;          /* deepest rollback, in frames */
+   uint64_t serializes;
+   double serialize_usec;
+   uint64_t unserializes;
+   double unserialize_usec;
+   double resimulate_usec;      /* running frames again, excluding loads */
+   uint64_t packets_sent;
+   uint64_t packets_dropped;    /* by the injected loss */
+   uint64_t packets_received;
+   uint64_t packets_rejected;   /* from anyone but the peer */
+   uint64_t syncs_checked;
+   uint64_t desyncs;
+   unsigned confirmed;          /* frames with both inputs known */
+};
+
+typedef struct rollback rollback_t;
+
+/**
+ * rollback_new:
+ * @config            : Session settings, copied.
+ * @cb                : Emulator callbacks, copied.
+ *
+ * Binds @config->local_port; the core must have its game loaded.
+ *
+ * Returns: the session, NULL on bad settings or when the socket or the
+ * savestate ring can't be set up.
+ **/
+rollback_t *rollback_new(const struct rollback_config *config,
+      const struct rollback_callbacks *cb);
+
+void rollback_free(rollback_t *rb);
+
+/**
+ * rollback_frame:
+ * @rb                : Session.
+ * @input             : Local joypad state.
+ *
+ * Takes in what arrived from the peer, rolls back if a prediction was
+ * wrong and runs the next frame. Call once per frame; when it returns
+ * false nothing ran and @input was not taken: call again with it next
+ * frame.
+ *
+ * Returns: whether a frame ran.
+ **/
+bool rollback_frame(rollback_t *rb, uint16_t input);
+
+/**
+ * rollback_poll:
+ * @rb                : Session.
+ *
+ * rollback_frame() without running a new frame: sends, receives and
+ * rolls back. For keeping the peer fed while waiting on it, and after
+ * the last frame until rollback_get_stats() reports it confirmed.
+ **/
+void rollback_poll(rollback_t *rb);
+
+/* Frame about to run. */
+unsigned rollback_current_frame(const rollback_t *rb);
+
+void rollback_get_stats(const rollback_t *rb, struct rollback_stats *stats);
+
+RETRO_END_DECLS
+
+#endif
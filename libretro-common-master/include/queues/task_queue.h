@@ -42,6 +42,19 @@ enum task_type
    TASK_TYPE_BLOCKING
 };
 
+enum task_priority
+{
+   TASK_PRIORITY_NORMAL = 0,
+   /* Picked before any queued normal task. */
+   TASK_PRIORITY_HIGH,
+   /* Only picked when nothing else is queued. */
+   TASK_PRIORITY_LOW
+};
+
+/* Upper bound for task_queue_set_workers(), one bit
+ * per worker in retro_task.affinity. */
+#define TASK_QUEUE_MAX_WORKERS 32
+
 
 typedef struct retro_task retro_task_t;
 typedef void (*retro_task_callback_t)(void *task_data,
@@ -108,8 +121,17 @@ struct retro_task
 
    enum task_type type;
 
+   /* threaded mode only, ignored by the regular queue. */
+   enum task_priority priority;
+
+   /* threaded mode only: bitmask of the workers allowed to
+    * run this task, 0 = any. Pinning handlers that are not
+    * reentrant to a single worker keeps them off each other. */
+   uint32_t affinity;
+
    /* don't touch this. */
    retro_task_t *next;
+   retro_task_t *sched_next;
 };
 
 typedef struct task_finder_data
@@ -177,6 +199,15 @@ void task_queue_unset_threaded(void);
 
 bool task_queue_is_threaded(void);
 
+/* Sets the number of worker threads used in threaded mode,
+ * 0 = one per CPU core. A running pool is resized by the
+ * next task_queue_check(). */
+void task_queue_set_workers(unsigned count);
+
+/* Returns the number of worker threads currently running,
+ * 0 when tasks run on the main thread. */
+unsigned task_queue_get_workers(void);
+
 /**		
  * Calls func for every running task		
  * until it returns true.		
@@ -0,0 +1,587 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (ram_search.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <retro_inline.h>
+#include <features/features_cpu.h>
+#include <memmap/ram_search.h>
+
+#if (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)) && !defined(DONT_WANT_X86_OPTIMIZATIONS)
+#define RAM_SEARCH_X86
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+struct ram_search
+{
+   const uint8_t *data;
+   /* memory at the previous pass, kept up to date for candidates only */
+   uint8_t *prev;
+   /* bit n of bits[n / 32] set while address n is a candidate */
+   uint32_t *bits;
+   size_t size;
+   size_t words;
+   size_t count;
+   unsigned width;
+   unsigned flags;
+};
+
+struct ram_watch_entry
+{
+   size_t addr;
+   unsigned width;
+   unsigned flags;
+};
+
+struct ram_watch
+{
+   struct ram_watch_entry *entries;
+   unsigned count;
+   /* capacity rows of count values */
+   uint32_t *ring;
+   size_t capacity;
+   size_t head;   /* row the next sample goes to */
+   size_t frames;
+};
+
+static int ram_search_avx2 = -1;
+
+static INLINE unsigned ram_popcount(uint32_t v)
+{
+   v = v - ((v >> 1) & 0x55555555);
+   v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+   return (((v + (v >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+}
+
+static INLINE unsigned ram_ctz(uint32_t v)
+{
+#if defined(__GNUC__)
+   return (unsigned)__builtin_ctz(v);
+#elif defined(_MSC_VER)
+   unsigned long i;
+   _BitScanForward(&i, v);
+   return (unsigned)i;
+#else
+   unsigned i = 0;
+   while (!(v & 1))
+   {
+      v >>= 1;
+      i++;
+   }
+   return i;
+#endif
+}
+
+/* Little endian whatever the host, as the cores lay out their RAM. */
+static INLINE uint32_t ram_read(const uint8_t *p, unsigned width)
+{
+   switch (width)
+   {
+      case 1:
+         return p[0];
+      case 2:
+         return p[0] | ((uint32_t)p[1] << 8);
+      default:
+         return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+   }
+}
+
+/* Sign-extends for signed searches, then flips the sign bit so both
+ * kinds compare as unsigned. */
+static INLINE uint32_t ram_order_key(uint32_t v, unsigned width, unsigned flags)
+{
+   unsigned shift = 32 - width * 8;
+
+   if (flags & RAM_SEARCH_SIGNED)
+      return (uint32_t)((int32_t)(v << shift) >> shift) ^ 0x80000000u;
+   return v;
+}
+
+static INLINE uint32_t ram_op_mask(enum ram_search_op op, uint32_t eq, uint32_t gt)
+{
+   switch (op)
+   {
+      case RAM_SEARCH_EQ:
+         return eq;
+      case RAM_SEARCH_NE:
+         return ~eq;
+      case RAM_SEARCH_LT:
+         return ~(eq | gt);
+      case RAM_SEARCH_GT:
+         return gt;
+      case RAM_SEARCH_LE:
+         return ~gt;
+      case RAM_SEARCH_GE:
+         return eq | gt;
+   }
+   return 0;
+}
+
+/* One group of 32 addresses, only looking at the candidates. */
+static void ram_compare_scalar(const ram_search_t *search, size_t off,
+      const uint8_t *ref, uint32_t value, uint32_t cand, uint32_t *eq, uint32_t *gt)
+{
+   unsigned width = search->width;
+   uint32_t b     = ram_order_key(value, width, search->flags);
+
+   *eq = 0;
+   *gt = 0;
+   while (cand)
+   {
+      unsigned i  = ram_ctz(cand);
+      uint32_t a  = ram_order_key(ram_read(search->data + off + i, width), width, search->flags);
+
+      if (ref)
+         b = ram_order_key(ram_read(ref + off + i, width), width, search->flags);
+      if (a == b)
+         *eq |= 1u << i;
+      else if (a > b)
+         *gt |= 1u << i;
+      cand &= cand - 1;
+   }
+}
+
+/* The previous values of the group at @off: its own bytes, which also
+ * end the values of the group before. Called in address order, after
+ * the group has been compared. */
+static INLINE void ram_keep_prev(ram_search_t *search, size_t off)
+{
+   if (off + 32 <= search->size)
+      memcpy(search->prev + off, search->data + off, 32);
+   else
+      memcpy(search->prev + off, search->data + off, search->size - off);
+}
+
+#if defined(RAM_SEARCH_X86)
+/* Values of @width at 32 consecutive addresses: one compare per byte
+ * offset within the width, each covering the addresses at that offset,
+ * then one bit per address out of the byte masks. Unsigned order comes
+ * from flipping the sign bits and comparing signed. */
+#if defined(__GNUC__)
+__attribute__((target("avx2")))
+#endif
+static INLINE void ram_compare_avx2(const uint8_t *cur, const uint8_t *ref,
+      __m256i value, __m256i bias, unsigned width, uint32_t *eq, uint32_t *gt)
+{
+   uint32_t e = 0, g = 0;
+   unsigned j;
+
+   switch (width)
+   {
+      case 1:
+      {
+         __m256i a = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)cur), bias);
+         __m256i b = ref ? _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)ref), bias) : value;
+         e = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+         g = (uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi8(a, b));
+         break;
+      }
+      case 2:
+         for (j = 0; j < 2; j++)
+         {
+            __m256i a = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(cur + j)), bias);
+            __m256i b = ref ? _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(ref + j)), bias) : value;
+            e |= ((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi16(a, b)) & 0x55555555u) << j;
+            g |= ((uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi16(a, b)) & 0x55555555u) << j;
+         }
+         break;
+      default:
+         for (j = 0; j < 4; j++)
+         {
+            __m256i a = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(cur + j)), bias);
+            __m256i b = ref ? _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(ref + j)), bias) : value;
+            e |= ((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi32(a, b)) & 0x11111111u) << j;
+            g |= ((uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi32(a, b)) & 0x11111111u) << j;
+         }
+         break;
+   }
+
+   *eq = e;
+   *gt = g;
+}
+
+#if defined(__GNUC__)
+__attribute__((target("avx2")))
+#endif
+static size_t ram_filter_avx2(ram_search_t *search, enum ram_search_op op,
+      const uint8_t *ref, uint32_t value)
+{
+   __m256i vvalue, bias;
+   size_t count  = 0;
+   uint32_t last = 0;
+   size_t w;
+   /* the last group whose every value can be loaded whole */
+   size_t simd_end = search->size >= 31 + search->width ? search->size - 31 - search->width + 1 : 0;
+
+   switch (search->width)
+   {
+      case 1:
+         bias   = _mm256_set1_epi8((search->flags & RAM_SEARCH_SIGNED) ? 0 : (char)0x80);
+         vvalue = _mm256_xor_si256(_mm256_set1_epi8((char)value), bias);
+         break;
+      case 2:
+         bias   = _mm256_set1_epi16((search->flags & RAM_SEARCH_SIGNED) ? 0 : (short)0x8000);
+         vvalue = _mm256_xor_si256(_mm256_set1_epi16((short)value), bias);
+         break;
+      default:
+         bias   = _mm256_set1_epi32((search->flags & RAM_SEARCH_SIGNED) ? 0 : (int)0x80000000u);
+         vvalue = _mm256_xor_si256(_mm256_set1_epi32((int)value), bias);
+         break;
+   }
+
+   for (w = 0; w < search->words; w++)
+   {
+      uint32_t cand = search->bits[w];
+      size_t off    = w * 32;
+      uint32_t eq, gt;
+
+      if (!cand)
+      {
+         if (last)
+            ram_keep_prev(search, off);
+         last = 0;
+         continue;
+      }
+      if (off < simd_end)
+         ram_compare_avx2(search->data + off, ref ? ref + off : NULL,
+               vvalue, bias, search->width, &eq, &gt);
+      else
+         ram_compare_scalar(search, off, ref, value, cand, &eq, &gt);
+
+      cand            &= ram_op_mask(op, eq, gt);
+      search->bits[w]  = cand;
+      count           += ram_popcount(cand);
+      if (cand || last)
+         ram_keep_prev(search, off);
+      last             = cand;
+   }
+
+   return count;
+}
+#endif
+
+static size_t ram_filter_scalar(ram_search_t *search, enum ram_search_op op,
+      const uint8_t *ref, uint32_t value)
+{
+   size_t count  = 0;
+   uint32_t last = 0;
+   size_t w;
+
+   for (w = 0; w < search->words; w++)
+   {
+      uint32_t cand = search->bits[w];
+      uint32_t eq, gt;
+
+      if (!cand)
+      {
+         if (last)
+            ram_keep_prev(search, w * 32);
+         last = 0;
+         continue;
+      }
+      ram_compare_scalar(search, w * 32, ref, value, cand, &eq, &gt);
+      cand            &= ram_op_mask(op, eq, gt);
+      search->bits[w]  = cand;
+      count           += ram_popcount(cand);
+      if (cand || last)
+         ram_keep_prev(search, w * 32);
+      last             = cand;
+   }
+
+   return count;
+}
+
+static void ram_search_init_simd(void)
+{
+   int avx2 = 0;
+#if defined(RAM_SEARCH_X86)
+   uint64_t cpu = cpu_features_get();
+
+   /* RETRO_SIMD_AVX implies the OS saves the YMM state. */
+   avx2 = (cpu & RETRO_SIMD_AVX) && (cpu & RETRO_SIMD_AVX2);
+#endif
+   ram_search_avx2 = avx2;
+}
+
+const char *ram_search_impl(void)
+{
+   if (ram_search_avx2 < 0)
+      ram_search_init_simd();
+   return ram_search_avx2 ? "AVX2" : "scalar";
+}
+
+static size_t ram_search_filter(ram_search_t *search, enum ram_search_op op,
+      const uint8_t *ref, uint32_t value)
+{
+   if (ram_search_avx2 < 0)
+      ram_search_init_simd();
+
+   if (search->width < 4)
+      value &= (1u << (search->width * 8)) - 1;
+
+#if defined(RAM_SEARCH_X86)
+   if (ram_search_avx2)
+      search->count = ram_filter_avx2(search, op, ref, value);
+   else
+#endif
+      search->count = ram_filter_scalar(search, op, ref, value);
+
+   return search->count;
+}
+
+ram_snapshot_t *ram_snapshot_new(const void *data, size_t size)
+{
+   ram_snapshot_t *snapshot = (ram_snapshot_t*)calloc(1, sizeof(*snapshot));
+
+   if (!snapshot)
+      return NULL;
+   if (!(snapshot->data = (uint8_t*)malloc(size ? size : 1)))
+   {
+      free(snapshot);
+      return NULL;
+   }
+   memcpy(snapshot->data, data, size);
+   snapshot->size = size;
+   return snapshot;
+}
+
+void ram_snapshot_free(ram_snapshot_t *snapshot)
+{
+   if (!snapshot)
+      return;
+
+   free(snapshot->data);
+   free(snapshot);
+}
+
+ram_search_t *ram_search_new(const void *data, size_t size,
+      unsigned width, unsigned flags)
+{
+   ram_search_t *search;
+
+   if (!data || size < width || (width != 1 && width != 2 && width != 4))
+      return NULL;
+   if (!(search = (ram_search_t*)calloc(1, sizeof(*search))))
+      return NULL;
+
+   search->data  = (const uint8_t*)data;
+   search->size  = size;
+   search->width = width;
+   search->flags = flags;
+   search->words = (size + 31) / 32;
+   search->prev  = (uint8_t*)malloc(size);
+   search->bits  = (uint32_t*)malloc(search->words * sizeof(uint32_t));
+   if (!search->prev || !search->bits)
+   {
+      ram_search_free(search);
+      return NULL;
+   }
+
+   ram_search_reset(search);
+   return search;
+}
+
+void ram_search_free(ram_search_t *search)
+{
+   if (!search)
+      return;
+
+   free(search->prev);
+   free(search->bits);
+   free(search);
+}
+
+void ram_search_reset(ram_search_t *search)
+{
+   /* the last value ends at the last byte */
+   size_t last    = search->size - search->width;
+   uint32_t every = 0xffffffffu;
+   size_t w;
+
+   if (search->flags & RAM_SEARCH_ALIGNED)
+      every = search->width == 4 ? 0x11111111u : search->width == 2 ? 0x55555555u : every;
+
+   for (w = 0; w < search->words; w++)
+      search->bits[w] = every;
+   if ((last + 1) % 32)
+      search->bits[last / 32] &= (1u << ((last + 1) % 32)) - 1;
+   for (w = last / 32 + 1; w < search->words; w++)
+      search->bits[w] = 0;
+
+   search->count = 0;
+   for (w = 0; w < search->words; w++)
+      search->count += ram_popcount(search->bits[w]);
+
+   memcpy(search->prev, search->data, search->size);
+}
+
+size_t ram_search_filter_value(ram_search_t *search,
+      enum ram_search_op op, uint32_t value)
+{
+   return ram_search_filter(search, op, NULL, value);
+}
+
+size_t ram_search_filter_previous(ram_search_t *search, enum ram_search_op op)
+{
+   return ram_search_filter(search, op, search->prev, 0);
+}
+
+size_t ram_search_filter_snapshot(ram_search_t *search,
+      enum ram_search_op op, const ram_snapshot_t *snapshot)
+{
+   if (snapshot->size < search->size)
+      return search->count;
+   return ram_search_filter(search, op, snapshot->data, 0);
+}
+
+size_t ram_search_count(const ram_search_t *search)
+{
+   return search->count;
+}
+
+ssize_t ram_search_next(const ram_search_t *search, size_t from)
+{
+   size_t w = from / 32;
+   uint32_t bits;
+
+   if (w >= search->words)
+      return -1;
+
+   bits = search->bits[w] & (0xffffffffu << (from % 32));
+   while (!bits)
+   {
+      if (++w >= search->words)
+         return -1;
+      bits = search->bits[w];
+   }
+
+   return (ssize_t)(w * 32 + ram_ctz(bits));
+}
+
+uint32_t ram_search_value(const ram_search_t *search, size_t addr)
+{
+   return ram_read(search->data + addr, search->width);
+}
+
+uint32_t ram_search_previous(const ram_search_t *search, size_t addr)
+{
+   return ram_read(search->prev + addr, search->width);
+}
+
+ram_watch_t *ram_watch_new(size_t frames)
+{
+   ram_watch_t *watch = (ram_watch_t*)calloc(1, sizeof(*watch));
+
+   if (watch)
+      watch->capacity = frames ? frames : 1;
+   return watch;
+}
+
+void ram_watch_free(ram_watch_t *watch)
+{
+   if (!watch)
+      return;
+
+   free(watch->entries);
+   free(watch->ring);
+   free(watch);
+}
+
+int ram_watch_add(ram_watch_t *watch, size_t addr, unsigned width, unsigned flags)
+{
+   struct ram_watch_entry *entries;
+   uint32_t *ring;
+
+   if (width != 1 && width != 2 && width != 4)
+      return -1;
+
+   entries = (struct ram_watch_entry*)realloc(watch->entries,
+         (watch->count + 1) * sizeof(*entries));
+   if (!entries)
+      return -1;
+   watch->entries = entries;
+
+   ring = (uint32_t*)realloc(watch->ring,
+         watch->capacity * (watch->count + 1) * sizeof(*ring));
+   if (!ring)
+      return -1;
+   watch->ring = ring;
+
+   entries[watch->count].addr  = addr;
+   entries[watch->count].width = width;
+   entries[watch->count].flags = flags;
+   watch->head   = 0;
+   watch->frames = 0;
+   return (int)watch->count++;
+}
+
+unsigned ram_watch_count(const ram_watch_t *watch)
+{
+   return watch->count;
+}
+
+void ram_watch_sample(ram_watch_t *watch, const void *data, size_t size)
+{
+   uint32_t *row = watch->ring + watch->head * watch->count;
+   unsigned i;
+
+   if (!watch->count)
+      return;
+
+   for (i = 0; i < watch->count; i++)
+   {
+      const struct ram_watch_entry *entry = &watch->entries[i];
+      uint32_t v                          = 0;
+
+      if (entry->addr + entry->width <= size)
+      {
+         v = ram_read((const uint8_t*)data + entry->addr, entry->width);
+         if ((entry->flags & RAM_SEARCH_SIGNED) && entry->width < 4)
+         {
+            unsigned shift = 32 - entry->width * 8;
+            v = (uint32_t)((int32_t)(v << shift) >> shift);
+         }
+      }
+      row[i] = v;
+   }
+
+   if (++watch->head == watch->capacity)
+      watch->head = 0;
+   if (watch->frames < watch->capacity)
+      watch->frames++;
+}
+
+size_t ram_watch_frames(const ram_watch_t *watch)
+{
+   return watch->frames;
+}
+
+uint32_t ram_watch_get(const ram_watch_t *watch, unsigned index, size_t frame)
+{
+   size_t row = (watch->head + watch->capacity - watch->frames + frame) % watch->capacity;
+   return watch->ring[row * watch->count + index];
+}
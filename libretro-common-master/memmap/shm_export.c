@@ -0,0 +1,502 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (shm_export.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <libretro.h>
+#include <features/features_cpu.h>
+#include <compat/strl.h>
+#include <memmap/shm_export.h>
+
+/* The header and slot sequence counts are shared with other processes;
+ * everything else in a slot is only trusted once its count checks out. */
+#if defined(__GNUC__)
+#define SHM_LOAD_ACQUIRE(p)      __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define SHM_LOAD_RELAXED(p)      __atomic_load_n(p, __ATOMIC_RELAXED)
+#define SHM_STORE_RELEASE(p, v)  __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define SHM_STORE_RELAXED(p, v)  __atomic_store_n(p, v, __ATOMIC_RELAXED)
+#define SHM_FENCE_ACQUIRE()      __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define SHM_FENCE_RELEASE()      __atomic_thread_fence(__ATOMIC_RELEASE)
+#elif defined(_WIN32)
+#define SHM_LOAD_ACQUIRE(p)      shm_load_acquire(p)
+#define SHM_LOAD_RELAXED(p)      (*(volatile uint32_t*)(p))
+#define SHM_STORE_RELEASE(p, v)  do { MemoryBarrier(); *(volatile uint32_t*)(p) = (v); } while (0)
+#define SHM_STORE_RELAXED(p, v)  (*(volatile uint32_t*)(p) = (v))
+#define SHM_FENCE_ACQUIRE()      MemoryBarrier()
+#define SHM_FENCE_RELEASE()      MemoryBarrier()
+
+static uint32_t shm_load_acquire(const uint32_t *p)
+{
+   uint32_t v = *(volatile const uint32_t*)p;
+   MemoryBarrier();
+   return v;
+}
+#endif
+
+#define SHM_NAME_SIZE 256
+
+struct shm_export
+{
+   uint8_t *base;
+   struct shm_export_header *header;
+   size_t size;
+#ifdef _WIN32
+   HANDLE mapping;
+#endif
+   char name[SHM_NAME_SIZE];
+};
+
+struct shm_reader_stream
+{
+   uint32_t next;
+   uint32_t seq;
+   const struct shm_export_slot *slot;
+   uint64_t dropped;
+};
+
+struct shm_reader
+{
+   const uint8_t *base;
+   const struct shm_export_header *header;
+   size_t size;
+#ifdef _WIN32
+   HANDLE mapping;
+#endif
+   struct shm_reader_stream stream[SHM_EXPORT_STREAMS];
+};
+
+static size_t shm_slot_stride(uint32_t slot_size)
+{
+   return SHM_EXPORT_SLOT_HEADER + (((size_t)slot_size + 63) & ~(size_t)63);
+}
+
+static struct shm_export_slot *shm_slot(const uint8_t *base,
+      const struct shm_export_ring *ring, uint32_t index)
+{
+   return (struct shm_export_slot*)(base + ring->offset
+         + (size_t)(index % ring->slots) * shm_slot_stride(ring->slot_size));
+}
+
+/* "Local\name" on Windows, "/name" elsewhere. */
+static void shm_path(char *path, size_t size, const char *name)
+{
+#ifdef _WIN32
+   strlcpy(path, "Local\\", size);
+#else
+   strlcpy(path, name[0] == '/' ? "" : "/", size);
+#endif
+   strlcat(path, name, size);
+}
+
+shm_export_t *shm_export_new(const char *name,
+      size_t video_slot_size, unsigned video_slots,
+      size_t audio_slot_size, unsigned audio_slots)
+{
+   shm_export_t *shm;
+   struct shm_export_header *header;
+   size_t size = (sizeof(struct shm_export_header) + 63) & ~(size_t)63;
+   size_t video, audio;
+#ifndef _WIN32
+   int fd;
+#endif
+
+   if (!name || !*name || !video_slots || !audio_slots
+         || video_slot_size > 0xffffffffu || audio_slot_size > 0xffffffffu)
+      return NULL;
+   if (!(shm = (shm_export_t*)calloc(1, sizeof(*shm))))
+      return NULL;
+   shm_path(shm->name, sizeof(shm->name), name);
+
+   video     = size;
+   size     += shm_slot_stride((uint32_t)video_slot_size) * video_slots;
+   audio     = size;
+   size     += shm_slot_stride((uint32_t)audio_slot_size) * audio_slots;
+   shm->size = size;
+
+#ifdef _WIN32
+   shm->mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+         (DWORD)((uint64_t)size >> 32), (DWORD)size, shm->name);
+   if (shm->mapping && GetLastError() == ERROR_ALREADY_EXISTS)
+   {
+      /* another producer, or readers still holding an old one */
+      CloseHandle(shm->mapping);
+      shm->mapping = NULL;
+   }
+   if (!shm->mapping)
+   {
+      free(shm);
+      return NULL;
+   }
+   shm->base = (uint8_t*)MapViewOfFile(shm->mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+   if (!shm->base)
+   {
+      CloseHandle(shm->mapping);
+      free(shm);
+      return NULL;
+   }
+#else
+   shm_unlink(shm->name);
+   fd = shm_open(shm->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+   if (fd < 0)
+   {
+      free(shm);
+      return NULL;
+   }
+   if (ftruncate(fd, (off_t)size) != 0
+         || (shm->base = (uint8_t*)mmap(NULL, size, PROT_READ | PROT_WRITE,
+               MAP_SHARED, fd, 0)) == (uint8_t*)MAP_FAILED)
+   {
+      close(fd);
+      shm_unlink(shm->name);
+      free(shm);
+      return NULL;
+   }
+   close(fd);
+#endif
+
+   /* fresh pages are zero: every slot count even, nothing published */
+   header                                     = (struct shm_export_header*)shm->base;
+   header->version                            = SHM_EXPORT_VERSION;
+   header->size                               = size;
+#ifdef _WIN32
+   header->producer_pid                       = (uint32_t)GetCurrentProcessId();
+#else
+   header->producer_pid                       = (uint32_t)getpid();
+#endif
+   header->stream[SHM_EXPORT_VIDEO].offset    = video;
+   header->stream[SHM_EXPORT_VIDEO].slots     = video_slots;
+   header->stream[SHM_EXPORT_VIDEO].slot_size = (uint32_t)video_slot_size;
+   header->stream[SHM_EXPORT_AUDIO].offset    = audio;
+   header->stream[SHM_EXPORT_AUDIO].slots     = audio_slots;
+   header->stream[SHM_EXPORT_AUDIO].slot_size = (uint32_t)audio_slot_size;
+   /* last, readers check it before anything else */
+   SHM_STORE_RELEASE(&header->magic, SHM_EXPORT_MAGIC);
+   shm->header                                = header;
+   return shm;
+}
+
+void shm_export_free(shm_export_t *shm)
+{
+   if (!shm)
+      return;
+
+   SHM_STORE_RELEASE(&shm->header->closed, 1);
+#ifdef _WIN32
+   UnmapViewOfFile(shm->base);
+   CloseHandle(shm->mapping);
+#else
+   munmap(shm->base, shm->size);
+   shm_unlink(shm->name);
+#endif
+   free(shm);
+}
+
+/* Odd count: readers that see it, or see it change, drop the slot. */
+static struct shm_export_slot *shm_export_begin(shm_export_t *shm,
+      enum shm_export_stream stream)
+{
+   struct shm_export_ring *ring = &shm->header->stream[stream];
+   struct shm_export_slot *slot = shm_slot(shm->base, ring, ring->head);
+
+   SHM_STORE_RELAXED(&slot->seq, slot->seq + 1);
+   SHM_FENCE_RELEASE();
+   slot->index = ring->head;
+   return slot;
+}
+
+static void shm_export_end(shm_export_t *shm, enum shm_export_stream stream,
+      struct shm_export_slot *slot)
+{
+   struct shm_export_ring *ring = &shm->header->stream[stream];
+
+   slot->time_usec = cpu_features_get_time_usec();
+   SHM_STORE_RELEASE(&slot->seq, slot->seq + 1);
+   SHM_STORE_RELEASE(&ring->head, ring->head + 1);
+}
+
+bool shm_export_video(shm_export_t *shm, uint64_t frame, const void *data,
+      unsigned width, unsigned height, size_t pitch, unsigned format)
+{
+   struct shm_export_slot *slot;
+   const uint8_t *src = (const uint8_t*)data;
+   size_t row         = width * (format == RETRO_PIXEL_FORMAT_XRGB8888 ? 4 : 2);
+   uint8_t *dst;
+   unsigned y;
+
+   if (!data || row * height > shm->header->stream[SHM_EXPORT_VIDEO].slot_size)
+      return false;
+
+   slot = shm_export_begin(shm, SHM_EXPORT_VIDEO);
+   dst  = (uint8_t*)slot + SHM_EXPORT_SLOT_HEADER;
+   if (pitch == row)
+      memcpy(dst, src, row * height);
+   else
+      for (y = 0; y < height; y++, src += pitch, dst += row)
+         memcpy(dst, src, row);
+
+   slot->frame  = frame;
+   slot->size   = (uint32_t)(row * height);
+   slot->width  = width;
+   slot->height = height;
+   slot->pitch  = (uint32_t)row;
+   slot->format = format;
+   shm_export_end(shm, SHM_EXPORT_VIDEO, slot);
+   return true;
+}
+
+bool shm_export_audio(shm_export_t *shm, uint64_t frame,
+      const int16_t *data, size_t frames, unsigned rate)
+{
+   size_t per_slot = shm->header->stream[SHM_EXPORT_AUDIO].slot_size / (2 * sizeof(int16_t));
+
+   if (!data || !frames || !per_slot)
+      return false;
+
+   while (frames)
+   {
+      struct shm_export_slot *slot = shm_export_begin(shm, SHM_EXPORT_AUDIO);
+      size_t n                     = frames < per_slot ? frames : per_slot;
+
+      memcpy((uint8_t*)slot + SHM_EXPORT_SLOT_HEADER, data, n * 2 * sizeof(int16_t));
+      slot->frame  = frame;
+      slot->size   = (uint32_t)(n * 2 * sizeof(int16_t));
+      slot->width  = (uint32_t)n;
+      slot->height = 0;
+      slot->pitch  = rate;
+      slot->format = 0;
+      shm_export_end(shm, SHM_EXPORT_AUDIO, slot);
+
+      data   += n * 2;
+      frames -= n;
+   }
+
+   return true;
+}
+
+static void shm_reader_unmap(shm_reader_t *reader)
+{
+#ifdef _WIN32
+   UnmapViewOfFile((void*)reader->base);
+   CloseHandle(reader->mapping);
+#else
+   munmap((void*)reader->base, reader->size);
+#endif
+}
+
+shm_reader_t *shm_reader_open(const char *name)
+{
+   char path[SHM_NAME_SIZE];
+   shm_reader_t *reader;
+   const struct shm_export_header *header;
+   unsigned i;
+#ifndef _WIN32
+   struct stat st;
+   int fd;
+#endif
+
+   if (!name || !*name)
+      return NULL;
+   if (!(reader = (shm_reader_t*)calloc(1, sizeof(*reader))))
+      return NULL;
+   shm_path(path, sizeof(path), name);
+
+#ifdef _WIN32
+   if (!(reader->mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, path)))
+   {
+      free(reader);
+      return NULL;
+   }
+   reader->base = (const uint8_t*)MapViewOfFile(reader->mapping, FILE_MAP_READ, 0, 0, 0);
+   if (!reader->base)
+   {
+      CloseHandle(reader->mapping);
+      free(reader);
+      return NULL;
+   }
+   {
+      MEMORY_BASIC_INFORMATION mbi;
+      VirtualQuery(reader->base, &mbi, sizeof(mbi));
+      reader->size = mbi.RegionSize;
+   }
+#else
+   if ((fd = shm_open(path, O_RDONLY, 0)) < 0)
+   {
+      free(reader);
+      return NULL;
+   }
+   if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(*header)
+         || (reader->base = (const uint8_t*)mmap(NULL, (size_t)st.st_size,
+               PROT_READ, MAP_SHARED, fd, 0)) == (const uint8_t*)MAP_FAILED)
+   {
+      close(fd);
+      free(reader);
+      return NULL;
+   }
+   close(fd);
+   reader->size = (size_t)st.st_size;
+#endif
+
+   header = (const struct shm_export_header*)reader->base;
+   if (reader->size < sizeof(*header)
+         || SHM_LOAD_ACQUIRE(&header->magic) != SHM_EXPORT_MAGIC
+         || header->version != SHM_EXPORT_VERSION
+         || header->size > reader->size)
+   {
+      shm_reader_unmap(reader);
+      free(reader);
+      return NULL;
+   }
+
+   for (i = 0; i < SHM_EXPORT_STREAMS; i++)
+   {
+      const struct shm_export_ring *ring = &header->stream[i];
+
+      if (!ring->slots || ring->offset
+            + shm_slot_stride(ring->slot_size) * ring->slots > header->size)
+      {
+         shm_reader_unmap(reader);
+         free(reader);
+         return NULL;
+      }
+      reader->stream[i].next = SHM_LOAD_ACQUIRE(&ring->head);
+   }
+
+   reader->header = header;
+   return reader;
+}
+
+void shm_reader_close(shm_reader_t *reader)
+{
+   if (!reader)
+      return;
+
+   shm_reader_unmap(reader);
+   free(reader);
+}
+
+const struct shm_export_header *shm_reader_header(const shm_reader_t *reader)
+{
+   return reader->header;
+}
+
+const void *shm_reader_acquire(shm_reader_t *reader,
+      enum shm_export_stream stream, struct shm_export_slot *info)
+{
+   const struct shm_export_ring *ring = &reader->header->stream[stream];
+   struct shm_reader_stream *rs       = &reader->stream[stream];
+
+   for (;;)
+   {
+      const struct shm_export_slot *slot;
+      uint32_t head = SHM_LOAD_ACQUIRE(&ring->head);
+      uint32_t seq;
+
+      if (head == rs->next)
+         return NULL;
+      /* lapped: the oldest slots are gone */
+      if (head - rs->next > ring->slots)
+      {
+         rs->dropped += head - rs->next - ring->slots;
+         rs->next     = head - ring->slots;
+      }
+
+      slot = shm_slot(reader->base, ring, rs->next);
+      seq  = SHM_LOAD_ACQUIRE(&slot->seq);
+      if (!(seq & 1))
+      {
+         memcpy(info, slot, sizeof(*info));
+         SHM_FENCE_ACQUIRE();
+         if (SHM_LOAD_RELAXED(&slot->seq) == seq && info->index == rs->next
+               && info->size <= ring->slot_size)
+         {
+            rs->seq  = seq;
+            rs->slot = slot;
+            return (const uint8_t*)slot + SHM_EXPORT_SLOT_HEADER;
+         }
+      }
+
+      /* being rewritten for the next lap */
+      rs->dropped++;
+      rs->next++;
+   }
+}
+
+bool shm_reader_release(shm_reader_t *reader, enum shm_export_stream stream)
+{
+   struct shm_reader_stream *rs = &reader->stream[stream];
+   bool intact;
+
+   if (!rs->slot)
+      return false;
+
+   SHM_FENCE_ACQUIRE();
+   intact   = SHM_LOAD_RELAXED(&rs->slot->seq) == rs->seq;
+   rs->slot = NULL;
+   rs->next++;
+   if (!intact)
+      rs->dropped++;
+   return intact;
+}
+
+int shm_reader_read(shm_reader_t *reader, enum shm_export_stream stream,
+      struct shm_export_slot *info, void *buf, size_t size)
+{
+   for (;;)
+   {
+      const void *payload = shm_reader_acquire(reader, stream, info);
+
+      if (!payload)
+         return 0;
+      if (info->size > size)
+      {
+         shm_reader_release(reader, stream);
+         return -1;
+      }
+      memcpy(buf, payload, info->size);
+      if (shm_reader_release(reader, stream))
+         return 1;
+   }
+}
+
+void shm_reader_seek_latest(shm_reader_t *reader, enum shm_export_stream stream)
+{
+   struct shm_reader_stream *rs = &reader->stream[stream];
+   uint32_t head                = SHM_LOAD_ACQUIRE(&reader->header->stream[stream].head);
+
+   if (head != rs->next)
+      rs->next = head - 1;
+}
+
+uint64_t shm_reader_dropped(const shm_reader_t *reader, enum shm_export_stream stream)
+{
+   return reader->stream[stream].dropped;
+}
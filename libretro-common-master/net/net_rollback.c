@@ -0,0 +1,492 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (net_rollback.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <net/net_compat.h>
+#include <net/net_socket.h>
+#include <net/net_rollback.h>
+#include <encodings/crc32.h>
+#include <features/features_cpu.h>
+
+#define ROLLBACK_MAGIC       0x314b4252 /* "RBK1" */
+/* inputs kept per side; well past window + delay + what is in flight */
+#define ROLLBACK_RING        256
+/* inputs repeated per packet at most */
+#define ROLLBACK_MAX_SEND    128
+#define ROLLBACK_HEADER_SIZE 22
+#define ROLLBACK_PACKET_SIZE (ROLLBACK_HEADER_SIZE + 2 * ROLLBACK_MAX_SEND)
+/* packets held back by the injected latency */
+#define ROLLBACK_QUEUE       512
+#define ROLLBACK_SYNCS       32
+#define ROLLBACK_NONE        0xffffffffu
+
+struct rollback_queued
+{
+   retro_time_t due;
+   size_t size;
+   uint8_t data[ROLLBACK_PACKET_SIZE];
+};
+
+struct rollback_sync
+{
+   unsigned frame;
+   uint32_t crc;
+};
+
+struct rollback
+{
+   struct rollback_config config;
+   struct rollback_callbacks cb;
+   struct rollback_stats stats;
+   int fd;
+   struct sockaddr_in peer;
+
+   unsigned frame;            /* next frame to run */
+   unsigned local_count;      /* local inputs known for frames below */
+   unsigned remote_count;     /* remote inputs known for frames below */
+   unsigned acked;            /* local inputs the peer has */
+   unsigned rollback_to;      /* first frame run on a wrong prediction */
+   uint16_t local[ROLLBACK_RING];
+   uint16_t remote[ROLLBACK_RING];
+   uint16_t used[ROLLBACK_RING]; /* remote input each frame last ran with */
+
+   /* state before frame f in slot f % state_slots */
+   uint8_t *states;
+   size_t state_size;
+   unsigned state_slots;
+
+   struct rollback_sync syncs[ROLLBACK_SYNCS];
+   unsigned sync_count;
+   struct rollback_sync last_sync;   /* newest local one, sent along */
+   struct rollback_sync remote_sync; /* newest the peer sent */
+   unsigned checked_sync;
+
+   struct rollback_queued *queue;
+   unsigned queued;
+   uint32_t rng;
+};
+
+static uint32_t rollback_rand(rollback_t *rb)
+{
+   rb->rng ^= rb->rng << 13;
+   rb->rng ^= rb->rng >> 17;
+   rb->rng ^= rb->rng << 5;
+   return rb->rng;
+}
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+   p[0] = (uint8_t)v;
+   p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+   p[0] = (uint8_t)v;
+   p[1] = (uint8_t)(v >> 8);
+   p[2] = (uint8_t)(v >> 16);
+   p[3] = (uint8_t)(v >> 24);
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+   return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+   return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool rollback_resolve_host(const char *host, uint16_t port, struct sockaddr_in *out)
+{
+   struct addrinfo hints;
+   struct addrinfo *res = NULL;
+   char port_buf[16];
+
+   memset(&hints, 0, sizeof(hints));
+   hints.ai_family   = AF_INET;
+   hints.ai_socktype = SOCK_DGRAM;
+   snprintf(port_buf, sizeof(port_buf), "%hu", (unsigned short)port);
+   if (getaddrinfo_retro(host, port_buf, &hints, &res) != 0 || !res)
+      return false;
+   memcpy(out, res->ai_addr, sizeof(*out));
+   freeaddrinfo_retro(res);
+   return true;
+}
+
+/* Compares a local and a remote state CRC once both are there. */
+static void rollback_check_sync(rollback_t *rb)
+{
+   unsigned i;
+
+   if (!rb->remote_sync.frame || rb->remote_sync.frame <= rb->checked_sync)
+      return;
+
+   for (i = 0; i < rb->sync_count && i < ROLLBACK_SYNCS; i++)
+   {
+      const struct rollback_sync *sync = &rb->syncs[i];
+
+      if (sync->frame == rb->remote_sync.frame)
+      {
+         rb->stats.syncs_checked++;
+         if (sync->crc != rb->remote_sync.crc)
+            rb->stats.desyncs++;
+         rb->checked_sync = sync->frame;
+         return;
+      }
+   }
+}
+
+static bool rollback_save(rollback_t *rb, unsigned frame)
+{
+   uint8_t *buf       = rb->states + (size_t)(frame % rb->state_slots) * rb->state_size;
+   retro_time_t start = cpu_features_get_time_usec();
+   bool ok            = rb->cb.serialize(rb->cb.data, buf, rb->state_size);
+
+   rb->stats.serialize_usec += (double)(cpu_features_get_time_usec() - start);
+   rb->stats.serializes++;
+   return ok;
+}
+
+/* CRC of the next sync frame's state once it is final: every input
+ * before it known and any rollback done. Called after resolving. */
+static void rollback_sync_state(rollback_t *rb)
+{
+   unsigned next = rb->last_sync.frame + rb->config.sync_interval;
+
+   if (!rb->config.sync_interval || next >= rb->frame
+         || next > rb->remote_count || next > rb->local_count)
+      return;
+
+   rb->last_sync.frame = next;
+   /* still in the ring? otherwise let this one go */
+   if (next + rb->config.window < rb->frame)
+      return;
+   rb->last_sync.crc = encoding_crc32(0,
+         rb->states + (size_t)(next % rb->state_slots) * rb->state_size, rb->state_size);
+   rb->syncs[rb->sync_count++ % ROLLBACK_SYNCS] = rb->last_sync;
+   rollback_check_sync(rb);
+}
+
+static void rollback_run(rollback_t *rb, unsigned frame, bool replay)
+{
+   uint16_t input[2];
+   uint16_t remote;
+
+   if (frame < rb->remote_count)
+      remote = rb->remote[frame % ROLLBACK_RING];
+   else
+   {
+      /* the peer tends to hold buttons: repeat its last known input */
+      remote = rb->remote_count ? rb->remote[(rb->remote_count - 1) % ROLLBACK_RING] : 0;
+      if (!replay)
+         rb->stats.predicted++;
+   }
+
+   rb->used[frame % ROLLBACK_RING] = remote;
+   input[rb->config.player]        = rb->local[frame % ROLLBACK_RING];
+   input[!rb->config.player]       = remote;
+   rb->cb.run(rb->cb.data, input, replay);
+}
+
+static void rollback_send_raw(rollback_t *rb, const uint8_t *data, size_t size)
+{
+   sendto(rb->fd, (const char*)data, size, 0,
+         (const struct sockaddr*)&rb->peer, sizeof(rb->peer));
+}
+
+static void rollback_flush(rollback_t *rb)
+{
+   retro_time_t now = cpu_features_get_time_usec();
+   unsigned i       = 0;
+
+   /* jitter reorders packets, as it does on a real network */
+   while (i < rb->queued)
+   {
+      if (rb->queue[i].due <= now)
+      {
+         rollback_send_raw(rb, rb->queue[i].data, rb->queue[i].size);
+         rb->queue[i] = rb->queue[--rb->queued];
+      }
+      else
+         i++;
+   }
+}
+
+/* Every input the peer has not acknowledged, our view of its inputs,
+ * and the newest state CRC. */
+static void rollback_send(rollback_t *rb)
+{
+   uint8_t packet[ROLLBACK_PACKET_SIZE];
+   unsigned start = rb->acked;
+   unsigned count, i;
+   size_t size;
+
+   if (rb->local_count - start > ROLLBACK_MAX_SEND)
+      start = rb->local_count - ROLLBACK_MAX_SEND;
+   count = rb->local_count - start;
+
+   put_u32(packet, ROLLBACK_MAGIC);
+   put_u32(packet + 4, rb->remote_count);
+   put_u32(packet + 8, start);
+   put_u16(packet + 12, (uint16_t)count);
+   put_u32(packet + 14, rb->last_sync.frame);
+   put_u32(packet + 18, rb->last_sync.crc);
+   for (i = 0; i < count; i++)
+      put_u16(packet + ROLLBACK_HEADER_SIZE + i * 2, rb->local[(start + i) % ROLLBACK_RING]);
+   size = ROLLBACK_HEADER_SIZE + count * 2;
+
+   rb->stats.packets_sent++;
+   if (rb->config.loss > 0.0f
+         && (rollback_rand(rb) & 0xffffff) < (uint32_t)(rb->config.loss * 0x1000000))
+   {
+      rb->stats.packets_dropped++;
+      return;
+   }
+
+   if (!rb->config.latency_ms && !rb->config.jitter_ms)
+   {
+      rollback_send_raw(rb, packet, size);
+      return;
+   }
+   if (rb->queued < ROLLBACK_QUEUE)
+   {
+      struct rollback_queued *q = &rb->queue[rb->queued++];
+      q->due  = cpu_features_get_time_usec() + (retro_time_t)rb->config.latency_ms * 1000
+         + (rb->config.jitter_ms ? rollback_rand(rb) % (rb->config.jitter_ms * 1000 + 1) : 0);
+      q->size = size;
+      memcpy(q->data, packet, size);
+   }
+}
+
+static void rollback_receive(rollback_t *rb)
+{
+   uint8_t packet[ROLLBACK_PACKET_SIZE];
+
+   for (;;)
+   {
+      struct sockaddr_in from;
+      socklen_t from_len = sizeof(from);
+      unsigned ack, start, count, i;
+      int ret = (int)recvfrom(rb->fd, (char*)packet, sizeof(packet), 0,
+            (struct sockaddr*)&from, &from_len);
+
+      if (ret <= 0)
+         break;
+      /* only the configured peer gets to supply remote inputs */
+      if (from_len < (socklen_t)sizeof(from)
+            || from.sin_family != AF_INET
+            || from.sin_addr.s_addr != rb->peer.sin_addr.s_addr
+            || from.sin_port != rb->peer.sin_port)
+      {
+         rb->stats.packets_rejected++;
+         continue;
+      }
+      if (ret < ROLLBACK_HEADER_SIZE || get_u32(packet) != ROLLBACK_MAGIC)
+         continue;
+      ack   = get_u32(packet + 4);
+      start = get_u32(packet + 8);
+      count = get_u16(packet + 12);
+      if (count > ROLLBACK_MAX_SEND || (unsigned)ret < ROLLBACK_HEADER_SIZE + count * 2)
+         continue;
+      rb->stats.packets_received++;
+
+      if (ack > rb->acked && ack <= rb->local_count)
+         rb->acked = ack;
+
+      /* runs always start at or before what we have, unless reordered */
+      for (i = 0; i < count; i++)
+      {
+         unsigned frame = start + i;
+         uint16_t input;
+
+         if (frame < rb->remote_count)
+            continue;
+         if (frame > rb->remote_count)
+            break;
+         input                              = get_u16(packet + ROLLBACK_HEADER_SIZE + i * 2);
+         rb->remote[frame % ROLLBACK_RING]  = input;
+         rb->remote_count++;
+         if (frame < rb->frame && rb->used[frame % ROLLBACK_RING] != input
+               && (rb->rollback_to == ROLLBACK_NONE || frame < rb->rollback_to))
+            rb->rollback_to = frame;
+      }
+
+      if (get_u32(packet + 14) > rb->remote_sync.frame)
+      {
+         rb->remote_sync.frame = get_u32(packet + 14);
+         rb->remote_sync.crc   = get_u32(packet + 18);
+         rollback_check_sync(rb);
+      }
+   }
+}
+
+/* Back to the first mispredicted frame and forward again with what is
+ * known now. */
+static void rollback_resolve(rollback_t *rb)
+{
+   unsigned target = rb->rollback_to;
+   unsigned depth, frame;
+   retro_time_t start;
+
+   if (target == ROLLBACK_NONE)
+      return;
+   rb->rollback_to = ROLLBACK_NONE;
+
+   depth = rb->frame - target;
+   start = cpu_features_get_time_usec();
+   rb->cb.unserialize(rb->cb.data,
+         rb->states + (size_t)(target % rb->state_slots) * rb->state_size, rb->state_size);
+   rb->stats.unserialize_usec += (double)(cpu_features_get_time_usec() - start);
+   rb->stats.unserializes++;
+
+   for (frame = target; frame < rb->frame; frame++)
+   {
+      if (frame != target)
+         rollback_save(rb, frame);
+      start = cpu_features_get_time_usec();
+      rollback_run(rb, frame, true);
+      rb->stats.resimulate_usec += (double)(cpu_features_get_time_usec() - start);
+   }
+
+   rb->stats.rollbacks++;
+   rb->stats.resimulated += depth;
+   if (depth > rb->stats.max_depth)
+      rb->stats.max_depth = depth;
+}
+
+rollback_t *rollback_new(const struct rollback_config *config,
+      const struct rollback_callbacks *cb)
+{
+   rollback_t *rb;
+   struct sockaddr_in local;
+
+   if (config->player > 1 || !config->window || config->window > ROLLBACK_MAX_WINDOW
+         || config->input_delay > ROLLBACK_MAX_WINDOW || !config->remote_host)
+      return NULL;
+   if (!network_init())
+      return NULL;
+   if (!(rb = (rollback_t*)calloc(1, sizeof(*rb))))
+      return NULL;
+
+   rb->config             = *config;
+   rb->config.remote_host = NULL;
+   rb->cb                 = *cb;
+   rb->fd                 = -1;
+   rb->rollback_to        = ROLLBACK_NONE;
+   rb->rng                = config->seed ? config->seed : 0x9e3779b9;
+   rb->state_slots        = config->window + 1;
+   rb->state_size         = cb->serialize_size(cb->data);
+
+   /* frames inside the input delay run with nothing pressed */
+   rb->local_count  = config->input_delay;
+   rb->remote_count = config->input_delay;
+   rb->acked        = config->input_delay;
+
+   if (!rb->state_size
+         || !(rb->states = (uint8_t*)malloc(rb->state_size * rb->state_slots))
+         || !(rb->queue = (struct rollback_queued*)malloc(ROLLBACK_QUEUE * sizeof(*rb->queue)))
+         || !rollback_resolve_host(config->remote_host, config->remote_port, &rb->peer))
+      goto error;
+
+   if ((rb->fd = (int)socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+      goto error;
+   memset(&local, 0, sizeof(local));
+   local.sin_family      = AF_INET;
+   local.sin_port        = htons(config->local_port);
+   local.sin_addr.s_addr = htonl(INADDR_ANY);
+   if (bind(rb->fd, (struct sockaddr*)&local, sizeof(local)) < 0
+         || !socket_nonblock(rb->fd))
+      goto error;
+
+   return rb;
+
+error:
+   rollback_free(rb);
+   return NULL;
+}
+
+void rollback_free(rollback_t *rb)
+{
+   if (!rb)
+      return;
+
+   if (rb->fd >= 0)
+      socket_close(rb->fd);
+   free(rb->states);
+   free(rb->queue);
+   free(rb);
+}
+
+bool rollback_frame(rollback_t *rb, uint16_t input)
+{
+   rollback_receive(rb);
+   rollback_resolve(rb);
+   rollback_sync_state(rb);
+
+   /* a prediction may not reach further back than the ring of states,
+    * nor may unacknowledged inputs overrun theirs */
+   if (rb->frame >= rb->remote_count + rb->config.window
+         || rb->local_count - rb->acked >= ROLLBACK_MAX_SEND)
+   {
+      rb->stats.stalls++;
+      rollback_send(rb);
+      rollback_flush(rb);
+      return false;
+   }
+
+   rb->local[(rb->frame + rb->config.input_delay) % ROLLBACK_RING] = input;
+   rb->local_count = rb->frame + rb->config.input_delay + 1;
+
+   rollback_save(rb, rb->frame);
+   rollback_run(rb, rb->frame, false);
+   rb->frame++;
+   rb->stats.frames++;
+
+   rollback_send(rb);
+   rollback_flush(rb);
+   return true;
+}
+
+void rollback_poll(rollback_t *rb)
+{
+   rollback_receive(rb);
+   rollback_resolve(rb);
+   rollback_sync_state(rb);
+   rollback_send(rb);
+   rollback_flush(rb);
+}
+
+unsigned rollback_current_frame(const rollback_t *rb)
+{
+   return rb->frame;
+}
+
+void rollback_get_stats(const rollback_t *rb, struct rollback_stats *stats)
+{
+   *stats           = rb->stats;
+   stats->confirmed = rb->remote_count < rb->local_count ? rb->remote_count : rb->local_count;
+}
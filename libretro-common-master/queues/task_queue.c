@@ -28,6 +28,7 @@
 
 #ifdef HAVE_THREADS
 #include <rthreads/rthreads.h>
+#include <features/features_cpu.h>
 #define SLOCK_LOCK(x) slock_lock(x)
 #define SLOCK_UNLOCK(x) slock_unlock(x)
 #else
@@ -61,6 +62,7 @@ static task_queue_t tasks_finished = {NULL, NULL};
 
 static struct retro_task_impl *impl_current = NULL;
 static bool task_threaded_enable            = false;
+static unsigned workers_wanted              = 0;
 
 static void task_queue_msg_push(retro_task_t *task,
       unsigned prio, unsigned duration,
@@ -282,13 +284,185 @@ static struct retro_task_impl impl_regular = {
 };
 
 #ifdef HAVE_THREADS
+/* Threaded mode runs tasks on a pool of workers. Every worker
+ * owns a queue per priority level; pushes are spread round robin
+ * over the workers a task is allowed on, and a worker whose own
+ * queues are empty steals from the others, so one long handler
+ * only ever holds up the worker running it. tasks_running still
+ * lists every unfinished task for find/retrieve/cancel. */
+typedef struct
+{
+   slock_t *lock;
+   sthread_t *thread;
+   /* picked in order: high, normal, low */
+   task_queue_t level[3];
+   unsigned id;
+   bool stop; /* use lock when touching it */
+} task_worker_t;
+
 static slock_t *running_lock    = NULL;
 static slock_t *finished_lock   = NULL;
 static slock_t *property_lock   = NULL;
 static slock_t *queue_lock      = NULL;
+static slock_t *idle_lock       = NULL;
 static scond_t *worker_cond     = NULL;
-static sthread_t *worker_thread = NULL;
-static bool worker_continue     = true; /* use running_lock when touching it */
+static task_worker_t *workers   = NULL;
+static unsigned workers_count   = 0;
+
+/* use idle_lock when touching these */
+static unsigned workers_idle    = 0;
+static unsigned workers_next    = 0;
+static unsigned sched_generation = 0;
+
+static unsigned task_workers_wanted(void)
+{
+   unsigned count = workers_wanted;
+
+   if (count == 0)
+      count = cpu_features_get_core_amount();
+   if (count < 1)
+      count = 1;
+   if (count > TASK_QUEUE_MAX_WORKERS)
+      count = TASK_QUEUE_MAX_WORKERS;
+
+   return count;
+}
+
+static unsigned task_level(const retro_task_t *task)
+{
+   switch (task->priority)
+   {
+      case TASK_PRIORITY_HIGH:
+         return 0;
+      case TASK_PRIORITY_LOW:
+         return 2;
+      default:
+         break;
+   }
+
+   return 1;
+}
+
+/* Workers allowed to run the task. An affinity naming no
+ * existing worker folds onto one, rather than stranding
+ * the task. */
+static uint32_t task_worker_mask(const retro_task_t *task)
+{
+   uint32_t all  = (workers_count >= 32) ? 0xffffffffu
+      : ((1u << workers_count) - 1);
+   uint32_t mask = task->affinity & all;
+   unsigned bit  = 0;
+
+   if (!task->affinity)
+      return all;
+   if (mask)
+      return mask;
+
+   while (!(task->affinity & (1u << bit)))
+      bit++;
+
+   return 1u << (bit % workers_count);
+}
+
+static void task_sched_put(task_queue_t *queue, retro_task_t *task)
+{
+   task->sched_next = NULL;
+
+   if (queue->front)
+      queue->back->sched_next = task;
+   else
+      queue->front = task;
+
+   queue->back = task;
+}
+
+/* Takes the oldest task worker 'id' may run. */
+static retro_task_t *task_sched_take(task_queue_t *queue, unsigned id)
+{
+   retro_task_t *prev = NULL;
+   retro_task_t *task = queue->front;
+
+   for (; task; prev = task, task = task->sched_next)
+   {
+      if (!(task_worker_mask(task) & (1u << id)))
+         continue;
+
+      if (prev)
+         prev->sched_next = task->sched_next;
+      else
+         queue->front     = task->sched_next;
+
+      if (queue->back == task)
+         queue->back      = prev;
+
+      task->sched_next    = NULL;
+      return task;
+   }
+
+   return NULL;
+}
+
+static void task_sched_push(retro_task_t *task)
+{
+   uint32_t mask        = 0;
+   unsigned i           = 0;
+   task_worker_t *owner = NULL;
+
+   slock_lock(idle_lock);
+   mask = task_worker_mask(task);
+
+   for (i = 0; i < workers_count; i++)
+   {
+      owner = &workers[(workers_next + i) % workers_count];
+      if (mask & (1u << owner->id))
+         break;
+   }
+
+   workers_next = owner->id + 1;
+
+   slock_lock(owner->lock);
+   task_sched_put(&owner->level[task_level(task)], task);
+   slock_unlock(owner->lock);
+
+   /* Bumped after the task is visible, so a worker that
+    * scanned the queues too early won't go to sleep. */
+   sched_generation++;
+
+   if (workers_idle)
+   {
+      /* any idle worker can steal an unpinned task, a pinned
+       * one needs the right worker awake */
+      if (task->affinity)
+         scond_broadcast(worker_cond);
+      else
+         scond_signal(worker_cond);
+   }
+
+   slock_unlock(idle_lock);
+}
+
+static retro_task_t *task_worker_steal(task_worker_t *self)
+{
+   unsigned level, i;
+
+   for (level = 0; level < 3; level++)
+   {
+      for (i = 1; i < workers_count; i++)
+      {
+         task_worker_t *victim = &workers[(self->id + i) % workers_count];
+         retro_task_t *task    = NULL;
+
+         slock_lock(victim->lock);
+         task = task_sched_take(&victim->level[level], self->id);
+         slock_unlock(victim->lock);
+
+         if (task)
+            return task;
+      }
+   }
+
+   return NULL;
+}
 
 static void task_queue_remove(task_queue_t *queue, retro_task_t *task)
 {
@@ -320,6 +494,9 @@ static void task_queue_remove(task_queue_t *queue, retro_task_t *task)
       {
          t->next    = task->next;
          task->next = NULL;
+
+         if (queue->back == task)
+            queue->back = t;
          break;
       }
 
@@ -333,9 +510,10 @@ static void retro_task_threaded_push_running(retro_task_t *task)
    slock_lock(running_lock);
    slock_lock(queue_lock);
    task_queue_put(&tasks_running, task);
-   scond_signal(worker_cond);
    slock_unlock(queue_lock);
    slock_unlock(running_lock);
+
+   task_sched_push(task);
 }
 
 static void retro_task_threaded_cancel(void *task)
@@ -381,9 +559,13 @@ static void retro_task_threaded_wait(retro_task_condition_fn_t cond, void* data)
    {
       retro_task_threaded_gather();
 
+      /* A task finishing during the gather is already off
+       * the running list but its callback hasn't run yet. */
       slock_lock(running_lock);
-      wait = (tasks_running.front != NULL) &&
+      slock_lock(finished_lock);
+      wait = (tasks_running.front != NULL || tasks_finished.front != NULL) &&
              (!cond || cond(data));
+      slock_unlock(finished_lock);
       slock_unlock(running_lock);
    } while (wait);
 }
@@ -433,91 +615,151 @@ static void retro_task_threaded_retrieve(task_retriever_data_t *data)
 
 static void threaded_worker(void *userdata)
 {
-   (void)userdata;
+   task_worker_t *self = (task_worker_t*)userdata;
+   unsigned generation = 0;
+
+   slock_lock(idle_lock);
+   generation = sched_generation;
+   slock_unlock(idle_lock);
 
    for (;;)
    {
       retro_task_t *task  = NULL;
-      bool finished = false;
-
-      if (!worker_continue)
-         break; /* should we keep running until all tasks finished? */
+      bool finished       = false;
+      bool stop           = false;
+      unsigned level;
+
+      /* Own queues first, oldest task of the highest level */
+      slock_lock(self->lock);
+      stop = self->stop;
+      for (level = 0; !stop && !task && level < 3; level++)
+         task = task_sched_take(&self->level[level], self->id);
+      slock_unlock(self->lock);
+
+      if (stop)
+         break;
 
-      slock_lock(running_lock);
+      if (!task)
+         task = task_worker_steal(self);
 
-      /* Get first task to run */
-      task = tasks_running.front;
-      if (task == NULL)
+      if (!task)
       {
-         scond_wait(worker_cond, running_lock);
-         slock_unlock(running_lock);
+         /* Nothing we may run; sleep unless something was
+          * pushed since the last look at the generation. */
+         slock_lock(idle_lock);
+         if (generation == sched_generation)
+         {
+            workers_idle++;
+            scond_wait(worker_cond, idle_lock);
+            workers_idle--;
+         }
+         generation = sched_generation;
+         slock_unlock(idle_lock);
          continue;
       }
 
-      slock_unlock(running_lock);
-
       task->handler(task);
 
       slock_lock(property_lock);
       finished = task->finished;
       slock_unlock(property_lock);
 
+      if (!finished)
+      {
+         /* Back of our own queue, so the tasks queued behind
+          * this one get their turn first. */
+         slock_lock(self->lock);
+         task_sched_put(&self->level[task_level(task)], task);
+         slock_unlock(self->lock);
+         continue;
+      }
+
       slock_lock(running_lock);
       task_queue_remove(&tasks_running, task);
       slock_unlock(running_lock);
 
-      /* Update queue */
-      if (!finished)
-      {
-         /* Re-add task to running queue */
-         retro_task_threaded_push_running(task);
-      }
-      else
-      {
-         /* Add task to finished queue */
-         slock_lock(finished_lock);
-         task_queue_put(&tasks_finished, task);
-         slock_unlock(finished_lock);
-      }
+      /* Add task to finished queue */
+      slock_lock(finished_lock);
+      task_queue_put(&tasks_finished, task);
+      slock_unlock(finished_lock);
    }
 }
 
 static void retro_task_threaded_init(void)
 {
+   retro_task_t *task = NULL;
+   unsigned i;
+
    running_lock  = slock_new();
    finished_lock = slock_new();
    property_lock = slock_new();
    queue_lock    = slock_new();
+   idle_lock     = slock_new();
    worker_cond   = scond_new();
 
-   slock_lock(running_lock);
-   worker_continue = true;
-   slock_unlock(running_lock);
+   workers_count    = task_workers_wanted();
+   workers_idle     = 0;
+   workers_next     = 0;
+   sched_generation = 0;
+   workers          = (task_worker_t*)calloc(workers_count, sizeof(*workers));
 
-   worker_thread = sthread_create(threaded_worker, NULL);
+   for (i = 0; i < workers_count; i++)
+   {
+      workers[i].id   = i;
+      workers[i].lock = slock_new();
+   }
+
+   /* Tasks left on hold by a previous deinit, or pushed
+    * while the regular queue was active */
+   for (task = tasks_running.front; task; task = task->next)
+      task_sched_push(task);
+
+   for (i = 0; i < workers_count; i++)
+      workers[i].thread = sthread_create(threaded_worker, &workers[i]);
 }
 
 static void retro_task_threaded_deinit(void)
 {
-   slock_lock(running_lock);
-   worker_continue = false;
-   scond_signal(worker_cond);
-   slock_unlock(running_lock);
+   unsigned i;
 
-   sthread_join(worker_thread);
+   /* Workers finish the handler call they are in, queued
+    * tasks stay on tasks_running */
+   for (i = 0; i < workers_count; i++)
+   {
+      slock_lock(workers[i].lock);
+      workers[i].stop = true;
+      slock_unlock(workers[i].lock);
+   }
+
+   slock_lock(idle_lock);
+   sched_generation++;
+   scond_broadcast(worker_cond);
+   slock_unlock(idle_lock);
+
+   for (i = 0; i < workers_count; i++)
+   {
+      if (workers[i].thread)
+         sthread_join(workers[i].thread);
+      slock_free(workers[i].lock);
+   }
+
+   free(workers);
 
    scond_free(worker_cond);
    slock_free(running_lock);
    slock_free(finished_lock);
    slock_free(property_lock);
    slock_free(queue_lock);
+   slock_free(idle_lock);
 
-   worker_thread = NULL;
+   workers       = NULL;
+   workers_count = 0;
    worker_cond   = NULL;
    running_lock  = NULL;
    finished_lock = NULL;
    property_lock = NULL;
-   queue_lock = NULL;
+   queue_lock    = NULL;
+   idle_lock     = NULL;
 }
 
 static struct retro_task_impl impl_threaded = {
@@ -578,6 +820,20 @@ bool task_queue_is_threaded(void)
    return task_threaded_enable;
 }
 
+void task_queue_set_workers(unsigned count)
+{
+   workers_wanted = count;
+}
+
+unsigned task_queue_get_workers(void)
+{
+#ifdef HAVE_THREADS
+   if (impl_current == &impl_threaded)
+      return workers_count;
+#endif
+   return 0;
+}
+
 bool task_queue_find(task_finder_data_t *find_data)
 {
    if (!impl_current->find(find_data->func, find_data->userdata))
@@ -596,7 +852,8 @@ void task_queue_check(void)
    bool current_threaded = (impl_current == &impl_threaded);
    bool want_threaded    = task_queue_is_threaded();
 
-   if (want_threaded != current_threaded)
+   if (want_threaded != current_threaded ||
+         (current_threaded && workers_count != task_workers_wanted()))
       task_queue_deinit();
 
    if (!impl_current)
@@ -0,0 +1,147 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (conversion_bench.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <features/features_cpu.h>
+#include <audio/conversion/s16_to_float.h>
+#include <audio/conversion/float_to_s16.h>
+
+#define MAX_SAMPLES (1 << 16)
+#define ITERATIONS  2000
+
+/* Buffers are over-allocated so the unaligned runs can start
+ * one element in without running off the end. */
+static int16_t s16_in[MAX_SAMPLES + 16];
+static int16_t s16_out[MAX_SAMPLES + 16];
+static float   float_in[MAX_SAMPLES + 16];
+static float   float_out[MAX_SAMPLES + 16];
+
+static const size_t lengths[] = { 7, 1023, 2048, 4097, MAX_SAMPLES - 1 };
+
+static double samples_per_sec(retro_time_t start, size_t samples)
+{
+   retro_time_t elapsed = cpu_features_get_time_usec() - start;
+   if (elapsed <= 0)
+      elapsed = 1;
+   return (double)samples * ITERATIONS * 1000000.0 / (double)elapsed;
+}
+
+static int check_s16_to_float(const float *out,
+      const int16_t *in, size_t samples, float gain)
+{
+   size_t i;
+   for (i = 0; i < samples; i++)
+   {
+      float expected = (float)in[i] * gain / 0x8000;
+      if (fabsf(out[i] - expected) > 1e-6f)
+      {
+         fprintf(stderr, "s16_to_float mismatch at %u: %f != %f\n",
+               (unsigned)i, out[i], expected);
+         return 1;
+      }
+   }
+   return 0;
+}
+
+static int check_float_to_s16(const int16_t *out,
+      const float *in, size_t samples)
+{
+   size_t i;
+   for (i = 0; i < samples; i++)
+   {
+      int32_t expected = (int32_t)(in[i] * 0x8000);
+      if (expected > 0x7FFF)
+         expected = 0x7FFF;
+      else if (expected < -0x8000)
+         expected = -0x8000;
+      /* The SIMD paths round, the C path truncates. */
+      if (abs(out[i] - expected) > 1)
+      {
+         fprintf(stderr, "float_to_s16 mismatch at %u: %d != %d\n",
+               (unsigned)i, out[i], (int)expected);
+         return 1;
+      }
+   }
+   return 0;
+}
+
+static int run(unsigned offset, size_t samples)
+{
+   unsigned j;
+   retro_time_t start;
+   const float gain  = 0.75f;
+   int16_t *s16_src  = s16_in    + offset;
+   int16_t *s16_dst  = s16_out   + offset;
+   float   *flt_src  = float_in  + offset;
+   float   *flt_dst  = float_out + offset;
+
+   start = cpu_features_get_time_usec();
+   for (j = 0; j < ITERATIONS; j++)
+      convert_s16_to_float(flt_dst, s16_src, samples, gain);
+   printf("s16_to_float %-9s %6u samples: %8.1f Msamples/s\n",
+         offset ? "unaligned" : "aligned", (unsigned)samples,
+         samples_per_sec(start, samples) / 1e6);
+   if (check_s16_to_float(flt_dst, s16_src, samples, gain))
+      return 1;
+
+   start = cpu_features_get_time_usec();
+   for (j = 0; j < ITERATIONS; j++)
+      convert_float_to_s16(s16_dst, flt_src, samples);
+   printf("float_to_s16 %-9s %6u samples: %8.1f Msamples/s\n",
+         offset ? "unaligned" : "aligned", (unsigned)samples,
+         samples_per_sec(start, samples) / 1e6);
+   return check_float_to_s16(s16_dst, flt_src, samples);
+}
+
+int main(int argc, char *argv[])
+{
+   unsigned i;
+   uint64_t cpu = cpu_features_get();
+
+   for (i = 0; i < MAX_SAMPLES + 16; i++)
+   {
+      s16_in[i]   = (int16_t)(rand() - RAND_MAX / 2);
+      float_in[i] = (float)rand() / RAND_MAX * 2.2f - 1.1f;
+   }
+
+   /* No dispatch set up yet: these are the baseline kernels. */
+   printf("== baseline ==\n");
+   for (i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++)
+      if (run(0, lengths[i]) || run(1, lengths[i]))
+         return 1;
+
+   convert_s16_to_float_init_simd();
+   convert_float_to_s16_init_simd();
+
+   printf("== dispatched (%s) ==\n",
+         (cpu & RETRO_SIMD_AVX2) ? "AVX2" : "no AVX2");
+   for (i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++)
+      if (run(0, lengths[i]) || run(1, lengths[i]))
+         return 1;
+
+   return 0;
+}
@@ -0,0 +1,247 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (core_info_cache_bench.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <dynamic/core_info_cache.h>
+#include <features/features_cpu.h>
+#include <file/file_path.h>
+#include <lists/dir_list.h>
+#include <lists/string_list.h>
+#include <retro_miscellaneous.h>
+#include <libretro.h>
+
+#define TIMEOUT_MS 2000
+
+static int copy_file(const char *from, const char *to)
+{
+   char buf[65536];
+   size_t got;
+   FILE *in  = fopen(from, "rb");
+   FILE *out = in ? fopen(to, "wb") : NULL;
+   int ret   = in && out ? 0 : 1;
+
+   while (!ret && (got = fread(buf, 1, sizeof(buf), in)) > 0)
+      if (fwrite(buf, 1, got, out) != got)
+         ret = 1;
+   if (in)
+      fclose(in);
+   if (out && fclose(out) != 0)
+      ret = 1;
+   return ret;
+}
+
+/* <dir>/coreNNNN_libretro.so copies of the test core, plus one core that
+ * crashes, one that hangs and one that isn't a library at all. */
+static int make_cores(const char *dir, unsigned cores)
+{
+   char path[PATH_MAX_LENGTH];
+   FILE *fp;
+   unsigned i;
+
+   mkdir(dir, 0755);
+   for (i = 0; i < cores; i++)
+   {
+      snprintf(path, sizeof(path), "%s/core%04u_libretro.so", dir, i);
+      if (!path_file_exists(path) && copy_file("test_core.so", path))
+         return 1;
+   }
+
+   snprintf(path, sizeof(path), "%s/crash_libretro.so", dir);
+   if (copy_file("test_core_crash.so", path))
+      return 1;
+   snprintf(path, sizeof(path), "%s/hang_libretro.so", dir);
+   if (copy_file("test_core_hang.so", path))
+      return 1;
+   snprintf(path, sizeof(path), "%s/broken_libretro.so", dir);
+   if (!(fp = fopen(path, "wb")))
+      return 1;
+   fputs("not a shared object\n", fp);
+   fclose(fp);
+   return 0;
+}
+
+/* What listing cores costs without a cache, healthy cores only. */
+static int run_dlopen(const char *dir)
+{
+   size_t i;
+   unsigned loaded          = 0;
+   retro_time_t start       = cpu_features_get_time_usec();
+   struct string_list *list = dir_list_new(dir, "so", false, false, false, false);
+
+   if (!list)
+      return 1;
+   for (i = 0; i < list->size; i++)
+   {
+      struct retro_system_info info;
+      void (*get_system_info)(struct retro_system_info*);
+      void *lib;
+
+      if (strncmp(path_basename(list->elems[i].data), "core", 4))
+         continue;
+      if (!(lib = dlopen(list->elems[i].data, RTLD_NOW | RTLD_LOCAL)))
+         continue;
+      *(void**)&get_system_info = dlsym(lib, "retro_get_system_info");
+      if (get_system_info)
+      {
+         get_system_info(&info);
+         loaded++;
+      }
+      dlclose(lib);
+   }
+   printf("%-12s %9.3f ms  %u cores\n", "dlopen",
+         (cpu_features_get_time_usec() - start) / 1000.0, loaded);
+   string_list_free(list);
+   return 0;
+}
+
+static int run(const char *name, const char *dir, const char *cache_path,
+      const char *exe, unsigned threads, unsigned expect_probed)
+{
+   core_info_cache_stats_t stats;
+   core_info_cache_t *cache;
+   retro_time_t start = cpu_features_get_time_usec();
+   double ms;
+
+   if (!(cache = core_info_cache_load(cache_path)))
+      return 1;
+   if (!core_info_cache_refresh(cache, dir, exe, threads, TIMEOUT_MS, &stats))
+   {
+      fprintf(stderr, "%s: refresh failed\n", name);
+      core_info_cache_free(cache);
+      return 1;
+   }
+   if ((stats.probed || stats.removed) && !core_info_cache_save(cache, cache_path))
+   {
+      fprintf(stderr, "%s: save failed\n", name);
+      core_info_cache_free(cache);
+      return 1;
+   }
+   ms = (cpu_features_get_time_usec() - start) / 1000.0;
+   core_info_cache_free(cache);
+
+   printf("%-12s %9.3f ms  %u cores, probed %u, failed %u, reused %u\n",
+         name, ms, stats.cores, stats.probed, stats.failed, stats.reused);
+
+   if (stats.probed != expect_probed)
+   {
+      fprintf(stderr, "%s: probed %u cores, expected %u\n",
+            name, stats.probed, expect_probed);
+      return 1;
+   }
+   return 0;
+}
+
+/* Every core is there once; only the healthy ones have info. */
+static int check_cache(const char *cache_path, unsigned cores)
+{
+   size_t i;
+   unsigned valid           = 0;
+   core_info_cache_t *cache = core_info_cache_load(cache_path);
+   retro_time_t start       = cpu_features_get_time_usec();
+   int ret                  = 1;
+
+   if (!cache || core_info_cache_count(cache) != cores + 3)
+      goto end;
+
+   for (i = 0; i < core_info_cache_count(cache); i++)
+   {
+      const core_info_cache_entry_t *entry = core_info_cache_get(cache, i);
+      const char *path = core_info_cache_string(cache, entry->path);
+      bool healthy     = !strncmp(path_basename(path), "core", 4);
+
+      if (core_info_cache_find(cache, path) != (ssize_t)i)
+         goto end;
+      if (healthy != !!(entry->flags & CORE_INFO_CACHE_VALID))
+         goto end;
+      if (!healthy)
+         continue;
+      if (     strcmp(core_info_cache_string(cache, entry->library_name), "Test core")
+            || strcmp(core_info_cache_string(cache, entry->valid_extensions), "bin|rom")
+            || entry->api_version != RETRO_API_VERSION
+            || !(entry->flags & CORE_INFO_CACHE_NEED_FULLPATH))
+         goto end;
+      valid++;
+   }
+   if (valid == cores)
+      ret = 0;
+   printf("%-12s %9.3f ms  %u cores with info\n", "load+find",
+         (cpu_features_get_time_usec() - start) / 1000.0, valid);
+
+end:
+   if (ret)
+      fprintf(stderr, "cache check failed\n");
+   core_info_cache_free(cache);
+   return ret;
+}
+
+int main(int argc, char *argv[])
+{
+   char cache_path[PATH_MAX_LENGTH];
+   char path[PATH_MAX_LENGTH];
+   FILE *fp;
+   const char *dir;
+   unsigned cores, threads;
+
+   if (argc > 2 && !strcmp(argv[1], CORE_INFO_PROBE_ARG))
+      return core_info_probe_main(argv[2]);
+
+   dir     = argc > 1 ? argv[1] : "cores";
+   cores   = argc > 2 ? (unsigned)atoi(argv[2]) : 300;
+   threads = argc > 3 ? (unsigned)atoi(argv[3]) : 0;
+
+   if (make_cores(dir, cores))
+      return 1;
+   snprintf(cache_path, sizeof(cache_path), "%s.cache", dir);
+   printf("%u cores + 3 broken ones, %u threads, %u CPUs, %u ms probe timeout\n",
+         cores, threads ? threads : cpu_features_get_core_amount(),
+         cpu_features_get_core_amount(), TIMEOUT_MS);
+
+   if (run_dlopen(dir))
+      return 1;
+
+   remove(cache_path);
+   if (run("cold", dir, cache_path, NULL, threads, cores + 3))
+      return 1;
+   if (check_cache(cache_path, cores))
+      return 1;
+   if (run("warm", dir, cache_path, NULL, threads, 0))
+      return 1;
+
+   /* One core replaced by a build of a different size. */
+   snprintf(path, sizeof(path), "%s/core0000_libretro.so", dir);
+   if (!(fp = fopen(path, "ab")))
+      return 1;
+   fputc(0, fp);
+   fclose(fp);
+   if (run("1 changed", dir, cache_path, NULL, threads, 1))
+      return 1;
+
+   return check_cache(cache_path, cores);
+}
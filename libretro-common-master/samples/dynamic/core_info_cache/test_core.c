@@ -0,0 +1,49 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (test_core.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Just enough of a core for core_info_cache_bench. TEST_CORE_CRASH and
+ * TEST_CORE_HANG build cores whose probe never comes back. */
+
+#include <string.h>
+
+#include <libretro.h>
+
+RETRO_API unsigned retro_api_version(void)
+{
+   return RETRO_API_VERSION;
+}
+
+RETRO_API void retro_get_system_info(struct retro_system_info *info)
+{
+#if defined(TEST_CORE_CRASH)
+   *(volatile int*)info = 0;
+   *(volatile int*)0    = 0;
+#elif defined(TEST_CORE_HANG)
+   for (;;)
+      *(volatile int*)info = 0;
+#endif
+   memset(info, 0, sizeof(*info));
+   info->library_name     = "Test core";
+   info->library_version  = "1.0";
+   info->valid_extensions = "bin|rom";
+   info->need_fullpath    = true;
+}
@@ -0,0 +1,191 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (autosave_bench.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include <encodings/crc32.h>
+#include <features/features_cpu.h>
+#include <file/autosave.h>
+#include <libretro.h>
+
+#include "stub_core.h"
+
+#define CHECKS 20000
+
+static volatile uint32_t sink;
+
+/* Per-frame cost of telling whether clean SRAM changed, three ways. */
+static int bench_check(size_t size)
+{
+   autosave_t *save;
+   uint8_t *copy;
+   retro_time_t start;
+   double ours, cmp, crc;
+   unsigned i;
+
+   stub_core_init(size, 0);
+   remove("bench.srm");
+   if (!(save = autosave_new(retro_get_memory_data(RETRO_MEMORY_SAVE_RAM), size, "bench.srm")))
+      return 1;
+   copy = (uint8_t*)malloc(size);
+   memcpy(copy, retro_get_memory_data(RETRO_MEMORY_SAVE_RAM), size);
+
+   start = cpu_features_get_time_usec();
+   for (i = 0; i < CHECKS; i++)
+      sink += autosave_check(save);
+   ours = (double)(cpu_features_get_time_usec() - start) / CHECKS;
+
+   start = cpu_features_get_time_usec();
+   for (i = 0; i < CHECKS; i++)
+      sink += memcmp(retro_get_memory_data(RETRO_MEMORY_SAVE_RAM), copy, size) != 0;
+   cmp = (double)(cpu_features_get_time_usec() - start) / CHECKS;
+
+   start = cpu_features_get_time_usec();
+   for (i = 0; i < CHECKS / 10; i++)
+      sink += encoding_crc32(0, (const uint8_t*)retro_get_memory_data(RETRO_MEMORY_SAVE_RAM), size);
+   crc = (double)(cpu_features_get_time_usec() - start) / (CHECKS / 10);
+
+   printf("%7u KB   autosave_check %7.2f us   memcmp %7.2f us   crc32 %7.2f us\n",
+         (unsigned)(size / 1024), ours, cmp, crc);
+
+   free(copy);
+   autosave_free(save);
+   stub_core_deinit();
+   remove("bench.srm");
+   return 0;
+}
+
+static int file_matches(const char *path, const void *data, size_t size)
+{
+   uint8_t *buf = (uint8_t*)malloc(size + 1);
+   FILE *fp     = fopen(path, "rb");
+   int ok       = 0;
+
+   if (fp && buf)
+      ok = fread(buf, 1, size + 1, fp) == size && !memcmp(buf, data, size);
+   if (fp)
+      fclose(fp);
+   free(buf);
+   return ok;
+}
+
+/* Runs the stub core at about 1000 fps with scaled-down delays: every
+ * finished save must reach the disk exactly once, and the frame thread
+ * must never wait on the disk. */
+static int bench_session(size_t size, unsigned frames, unsigned save_every)
+{
+   autosave_stats_t stats;
+   autosave_t *save;
+   retro_time_t worst = 0, total = 0;
+   unsigned i;
+   int ret = 1;
+
+   stub_core_init(size, save_every);
+   remove("session.srm");
+   if (!(save = autosave_new(retro_get_memory_data(RETRO_MEMORY_SAVE_RAM), size, "session.srm")))
+      return 1;
+   autosave_set_delays(save, 20, 200);
+
+   for (i = 0; i < frames; i++)
+   {
+      retro_time_t start;
+
+      retro_run();
+      start = cpu_features_get_time_usec();
+      autosave_check(save);
+      start = cpu_features_get_time_usec() - start;
+      total += start;
+      if (start > worst)
+         worst = start;
+      usleep(1000);
+   }
+
+   if (!autosave_flush(save))
+   {
+      fprintf(stderr, "flush failed\n");
+      goto end;
+   }
+   autosave_get_stats(save, &stats);
+   printf("session: %u frames, %u saves by the game, %u files written, "
+         "%u blocks copied, check avg %.2f us worst %u us\n",
+         frames, stub_core_saves(), (unsigned)stats.writes, (unsigned)stats.blocks,
+         (double)total / frames, (unsigned)worst);
+
+   if (stats.writes != stub_core_saves() || stats.failed)
+   {
+      fprintf(stderr, "expected one write per save\n");
+      goto end;
+   }
+   if (!file_matches("session.srm", retro_get_memory_data(RETRO_MEMORY_SAVE_RAM), size))
+   {
+      fprintf(stderr, "save file doesn't match SRAM\n");
+      goto end;
+   }
+   ret = 0;
+
+end:
+   autosave_free(save);
+   return ret;
+}
+
+/* A new session picks the save up again. */
+static int bench_reload(size_t size)
+{
+   uint8_t *expect = (uint8_t*)malloc(size);
+   autosave_t *save;
+   int ret = 1;
+
+   memcpy(expect, retro_get_memory_data(RETRO_MEMORY_SAVE_RAM), size);
+   stub_core_init(size, 0);
+   if ((save = autosave_new(retro_get_memory_data(RETRO_MEMORY_SAVE_RAM), size, "session.srm")))
+   {
+      if (!memcmp(retro_get_memory_data(RETRO_MEMORY_SAVE_RAM), expect, size)
+            && !autosave_check(save))
+         ret = 0;
+      autosave_free(save);
+   }
+   if (ret)
+      fprintf(stderr, "reload didn't restore SRAM\n");
+   free(expect);
+   stub_core_deinit();
+   remove("session.srm");
+   return ret;
+}
+
+int main(int argc, char *argv[])
+{
+   static const size_t sizes[] = { 8 << 10, 32 << 10, 128 << 10, 512 << 10, 2 << 20 };
+   unsigned i;
+
+   for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+      if (bench_check(sizes[i]))
+         return 1;
+
+   if (bench_session(128 << 10, 3000, 400))
+      return 1;
+   return bench_reload(128 << 10);
+}
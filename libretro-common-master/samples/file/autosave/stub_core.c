@@ -0,0 +1,98 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (stub_core.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* A core that only does what matters to autosave: it keeps SRAM and,
+ * like most games, writes a save in a few pieces over consecutive
+ * frames, while scratch RAM changes every frame. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libretro.h>
+
+#include "stub_core.h"
+
+/* a save slot, written SAVE_PIECES frames in a row */
+#define SAVE_SLOT   8192
+#define SAVE_PIECES 4
+
+static uint8_t *sram;
+static size_t sram_size;
+static uint8_t wram[2048];
+static unsigned frame;
+static unsigned save_every;
+static unsigned saves;
+
+void stub_core_init(size_t size, unsigned save_interval)
+{
+   free(sram);
+   sram       = (uint8_t*)calloc(1, size);
+   sram_size  = size;
+   frame      = 0;
+   saves      = 0;
+   save_every = save_interval;
+}
+
+void stub_core_deinit(void)
+{
+   free(sram);
+   sram      = NULL;
+   sram_size = 0;
+}
+
+unsigned stub_core_saves(void)
+{
+   return saves;
+}
+
+void *retro_get_memory_data(unsigned id)
+{
+   return id == RETRO_MEMORY_SAVE_RAM ? sram : NULL;
+}
+
+size_t retro_get_memory_size(unsigned id)
+{
+   return id == RETRO_MEMORY_SAVE_RAM ? sram_size : 0;
+}
+
+void retro_run(void)
+{
+   unsigned phase = save_every ? frame % save_every : 1;
+
+   wram[frame % sizeof(wram)]++;
+
+   if (phase < SAVE_PIECES && frame >= save_every)
+   {
+      size_t slots = sram_size / SAVE_SLOT;
+      size_t slot  = (frame / save_every) % (slots ? slots : 1);
+      size_t piece = SAVE_SLOT / SAVE_PIECES;
+      size_t off   = slot * SAVE_SLOT + phase * piece;
+
+      if (off + piece <= sram_size)
+         memset(sram + off, (int)(frame & 0xff) | 1, piece);
+      if (phase == SAVE_PIECES - 1)
+         saves++;
+   }
+
+   frame++;
+}
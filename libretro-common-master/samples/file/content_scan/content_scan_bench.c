@@ -0,0 +1,211 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (content_scan_bench.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <features/features_cpu.h>
+#include <file/content_index.h>
+#include <file/content_scan.h>
+#include <file/file_path.h>
+#include <hash/content_hash.h>
+#include <retro_miscellaneous.h>
+
+#define FILES_PER_DIR 100
+#define MAX_FILE_SIZE (32 * 1024)
+
+/* Builds <root>/dNNNN/fNNNNNN.bin with 1-32 KB of noise each, unless
+ * the first file is already there. */
+static int make_tree(const char *root, unsigned files)
+{
+   static uint8_t data[MAX_FILE_SIZE];
+   char path[PATH_MAX_LENGTH];
+   unsigned i, j;
+
+   snprintf(path, sizeof(path), "%s/d0000/f000000.bin", root);
+   if (path_file_exists(path))
+      return 0;
+
+   printf("creating %u files under %s\n", files, root);
+   mkdir(root, 0755);
+   for (i = 0; i < files; i++)
+   {
+      FILE *fp;
+      size_t size = 1024 + (size_t)(rand() % (MAX_FILE_SIZE - 1024));
+
+      if (i % FILES_PER_DIR == 0)
+      {
+         snprintf(path, sizeof(path), "%s/d%04u", root, i / FILES_PER_DIR);
+         mkdir(path, 0755);
+      }
+      for (j = 0; j < size; j++)
+         data[j] = (uint8_t)rand();
+
+      snprintf(path, sizeof(path), "%s/d%04u/f%06u.bin", root, i / FILES_PER_DIR, i);
+      if (!(fp = fopen(path, "wb")))
+         return 1;
+      fwrite(data, 1, size, fp);
+      fclose(fp);
+   }
+
+   return 0;
+}
+
+/* Rewrites every 100th file with new contents and a later mtime. */
+static void touch_tree(const char *root, unsigned files)
+{
+   char path[PATH_MAX_LENGTH];
+   unsigned i;
+
+   for (i = 0; i < files; i += 100)
+   {
+      FILE *fp;
+
+      snprintf(path, sizeof(path), "%s/d%04u/f%06u.bin", root, i / FILES_PER_DIR, i);
+      if ((fp = fopen(path, "r+b")))
+      {
+         fputc(rand() & 0xff, fp);
+         fclose(fp);
+      }
+   }
+}
+
+/* Needs root; returns false when the page cache couldn't be dropped. */
+static bool drop_caches(void)
+{
+   FILE *fp;
+
+   sync();
+   if (!(fp = fopen("/proc/sys/vm/drop_caches", "w")))
+      return false;
+   fputs("3", fp);
+   return fclose(fp) == 0;
+}
+
+static int run(const char *name, const char *root, const char *index,
+      unsigned types, unsigned threads, unsigned expect)
+{
+   content_scan_stats_t stats;
+   retro_time_t start = cpu_features_get_time_usec();
+   double sec;
+
+   if (!content_scan(root, NULL, index, types, threads, &stats))
+   {
+      fprintf(stderr, "%s: scan failed\n", name);
+      return 1;
+   }
+   sec = (cpu_features_get_time_usec() - start) / 1e6;
+
+   printf("%-12s %7.3f s %9.0f files/s %7.1f MB/s  hashed %6u reused %6u dirs %u\n",
+         name, sec, stats.files / sec, stats.bytes / sec / 1e6,
+         stats.hashed, stats.reused, stats.dirs);
+
+   if (stats.files != expect || stats.entries != expect)
+   {
+      fprintf(stderr, "%s: found %u files, wrote %u entries, expected %u\n",
+            name, stats.files, stats.entries, expect);
+      return 1;
+   }
+   return 0;
+}
+
+/* Every path is found again, and so is every CRC. */
+static int check_index(const char *index_path, unsigned files)
+{
+   size_t i;
+   content_index_t *index = content_index_open(index_path);
+   int ret                = 1;
+
+   if (!index || content_index_count(index) != files)
+      goto end;
+
+   for (i = 0; i < content_index_count(index); i++)
+   {
+      size_t first, n;
+      const content_index_entry_t *entry = content_index_get(index, i);
+      const char *path                   = content_index_path(index, entry);
+
+      if (content_index_find_path(index, path) != (ssize_t)i)
+         goto end;
+      n = content_index_find_crc(index, entry->crc32, &first);
+      while (n && content_index_get_by_crc(index, first + n - 1) != entry)
+         n--;
+      if (!n)
+         goto end;
+   }
+   ret = 0;
+
+end:
+   if (ret)
+      fprintf(stderr, "index check failed\n");
+   content_index_free(index);
+   return ret;
+}
+
+int main(int argc, char *argv[])
+{
+   char index[PATH_MAX_LENGTH];
+   const char *root = argc > 1 ? argv[1] : "scan_tree";
+   unsigned files   = argc > 2 ? (unsigned)atoi(argv[2]) : 100000;
+   unsigned threads = argc > 3 ? (unsigned)atoi(argv[3]) : 0;
+   unsigned types   = CONTENT_HASH_ALL;
+
+   if (make_tree(root, files))
+      return 1;
+
+   snprintf(index, sizeof(index), "%s.idx", root);
+   printf("%u files, %u threads, %u cores\n", files,
+         threads ? threads : cpu_features_get_core_amount(),
+         cpu_features_get_core_amount());
+
+   /* Cold: no index and, when allowed, nothing in the page cache. */
+   remove(index);
+   if (drop_caches() && run("cold, disk", root, index, types, threads, files))
+      return 1;
+
+   remove(index);
+   if (run("cold", root, index, types, threads, files))
+      return 1;
+   if (check_index(index, files))
+      return 1;
+   if (run("warm", root, index, types, threads, files))
+      return 1;
+
+   /* The same single-threaded, for the pool's share of the win. */
+   remove(index);
+   if (run("cold 1T", root, index, types, 1, files))
+      return 1;
+   if (run("warm 1T", root, index, types, 1, files))
+      return 1;
+
+   touch_tree(root, files);
+   if (run("1% changed", root, index, types, threads, files))
+      return 1;
+
+   return check_index(index, files);
+}
@@ -0,0 +1,191 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (chd_bulk_bench.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Whole-image decode throughput of chd_read_hunks and chd_stream_hunks
+ * at 1 to 16 threads, checked hunk for hunk against chd_read.
+ *
+ * The reference image is read once through chd_read. Every bulk run
+ * must reproduce it byte for byte; chd_stream_hunks must also deliver
+ * the hunks in order. Each setting is timed best of 3.
+ *
+ * usage: chd_bulk_bench [chd file]
+ *
+ * A missing chd file is generated first, as in chd_cache_bench. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <features/features_cpu.h>
+
+#include "chd.h"
+#include "chd_fixture.h"
+
+#define REPEAT 3
+
+static const UINT32 thread_counts[] = { 1, 2, 4, 8, 16 };
+
+struct stream_check
+{
+   const uint8_t *reference;
+   uint32_t hunkbytes;
+   uint32_t next;
+   uint32_t mismatches;
+};
+
+static chd_error stream_hunk(void *param, UINT32 hunknum, const void *data)
+{
+   struct stream_check *check = (struct stream_check*)param;
+
+   if (hunknum != check->next++)
+      return CHDERR_INVALID_DATA;
+   if (memcmp(data, check->reference + (size_t)hunknum * check->hunkbytes,
+            check->hunkbytes))
+      check->mismatches++;
+   return CHDERR_NONE;
+}
+
+/* hunks in buf that differ from the reference */
+static uint32_t compare_hunks(const uint8_t *buf, const uint8_t *reference,
+      uint32_t total, uint32_t hunkbytes)
+{
+   uint32_t bad = 0;
+   uint32_t h;
+   for (h = 0; h < total; h++)
+      if (memcmp(buf + (size_t)h * hunkbytes,
+               reference + (size_t)h * hunkbytes, hunkbytes))
+         bad++;
+   return bad;
+}
+
+int main(int argc, char *argv[])
+{
+   const char *path = argc > 1 ? argv[1] : "chd_cache_test.chd";
+   uint8_t *reference, *buf;
+   uint32_t total, hunkbytes, h;
+   double bytes;
+   chd_file *chd;
+   FILE *fp;
+   unsigned i;
+   int ret = 0;
+
+   if (!(fp = fopen(path, "rb")))
+   {
+      printf("Generating %s (%u hunks)\n", path, CHD_FIXTURE_HUNKS);
+      if (chd_fixture_write(path, CHD_FIXTURE_HUNKS) != 0)
+      {
+         fprintf(stderr, "Can't write %s\n", path);
+         return 1;
+      }
+   }
+   else
+      fclose(fp);
+
+   if (chd_open(path, CHD_OPEN_READ, NULL, &chd) != CHDERR_NONE)
+   {
+      fprintf(stderr, "Can't open %s\n", path);
+      return 1;
+   }
+   total     = chd_get_header(chd)->totalhunks;
+   hunkbytes = chd_get_header(chd)->hunkbytes;
+   bytes     = (double)total * hunkbytes;
+   reference = (uint8_t*)malloc((size_t)total * hunkbytes);
+   buf       = (uint8_t*)malloc((size_t)total * hunkbytes);
+   if (!reference || !buf)
+   {
+      fprintf(stderr, "Out of memory for %u hunks\n", total);
+      return 1;
+   }
+
+   for (h = 0; h < total; h++)
+   {
+      chd_error err = chd_read(chd, h, reference + (size_t)h * hunkbytes);
+      if (err != CHDERR_NONE)
+      {
+         fprintf(stderr, "chd_read(%u): %s\n", h, chd_error_string(err));
+         return 1;
+      }
+   }
+
+   printf("%s: %u hunks of %u bytes (%.1f MB), best of %d\n\n",
+         path, total, hunkbytes, bytes / 1e6, REPEAT);
+
+   for (i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++)
+   {
+      UINT32 threads     = thread_counts[i];
+      retro_time_t bulk  = 0;
+      retro_time_t strm  = 0;
+      uint32_t bulk_bad  = 0;
+      uint32_t strm_bad  = 0;
+      int rep;
+
+      for (rep = 0; rep < REPEAT; rep++)
+      {
+         struct stream_check check;
+         retro_time_t t;
+         chd_error err;
+
+         memset(buf, 0, (size_t)total * hunkbytes);
+         t   = cpu_features_get_time_usec();
+         err = chd_read_hunks(chd, 0, total, buf, threads);
+         t   = cpu_features_get_time_usec() - t;
+         if (err != CHDERR_NONE)
+         {
+            fprintf(stderr, "chd_read_hunks, %u threads: %s\n", threads, chd_error_string(err));
+            return 1;
+         }
+         if (!rep || t < bulk)
+            bulk = t;
+         bulk_bad += compare_hunks(buf, reference, total, hunkbytes);
+
+         check.reference  = reference;
+         check.hunkbytes  = hunkbytes;
+         check.next       = 0;
+         check.mismatches = 0;
+         t   = cpu_features_get_time_usec();
+         err = chd_stream_hunks(chd, 0, total, threads, stream_hunk, &check);
+         t   = cpu_features_get_time_usec() - t;
+         if (err != CHDERR_NONE || check.next != total)
+         {
+            fprintf(stderr, "chd_stream_hunks, %u threads: %s after %u hunks\n",
+                  threads, err != CHDERR_NONE ? chd_error_string(err) : "stopped", check.next);
+            return 1;
+         }
+         if (!rep || t < strm)
+            strm = t;
+         strm_bad += check.mismatches;
+      }
+
+      printf("threads %2u: chd_read_hunks %.3f GB/s %s, chd_stream_hunks %.3f GB/s %s\n",
+            threads, bulk ? bytes / bulk / 1e3 : 0.0, bulk_bad ? "MISMATCH" : "ok",
+            strm ? bytes / strm / 1e3 : 0.0, strm_bad ? "MISMATCH" : "ok");
+      if (bulk_bad || strm_bad)
+         ret = 1;
+   }
+
+   chd_close(chd);
+   free(buf);
+   free(reference);
+   printf(ret ? "\nFAILED\n" : "\nEvery run matched chd_read hunk for hunk\n");
+   return ret;
+}
@@ -0,0 +1,292 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (chd_cache_bench.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Replays disc-style read traces through chd_read, the way a core
+ * reads a CD image: every hunk holds 8 sectors and is read once per
+ * sector, with some emulation work in between. Reports the time spent
+ * inside chd_read and the hunk cache counters for a few cache and
+ * read-ahead settings, and checks every read against the data the
+ * fixture was generated from.
+ *
+ * Traces:
+ *   sequential   hunks in order
+ *   alternating  a data track and an audio track read in lockstep
+ *   seek         60 random seeks, each followed by a 32-hunk run
+ *
+ * usage: chd_cache_bench [chd file] [usec of work per read]
+ *
+ * A missing chd file is generated first (CHD_FIXTURE_HUNKS hunks,
+ * about 18 MB), chd_cache_test.chd by default. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <features/features_cpu.h>
+
+#include "chd.h"
+#include "chd_fixture.h"
+
+#define SECTORS_PER_HUNK 8
+#define SEEKS            60
+#define SEEK_RUN         32
+
+enum trace
+{
+   TRACE_SEQUENTIAL = 0,
+   TRACE_ALTERNATING,
+   TRACE_SEEK,
+   TRACE_COUNT
+};
+
+static const char *trace_names[TRACE_COUNT] = { "sequential", "alternating", "seek" };
+
+struct config
+{
+   unsigned hunks;
+   unsigned prefetch;
+};
+
+static const struct config configs[] = {
+   { 1,  0 },
+   { 4,  0 },
+   { 16, 4 }
+};
+
+#define CONFIG_COUNT (sizeof(configs) / sizeof(configs[0]))
+
+struct replay
+{
+   chd_file *chd;
+   uint8_t *buf;
+   uint32_t hunkbytes;
+   /* sampled hash of each hunk as generated, NULL for foreign files */
+   const uint32_t *expected;
+   double work_usec;
+   retro_time_t in_read;
+   unsigned reads;
+   uint32_t checksum;
+   int bad;
+};
+
+static uint32_t hunk_hash(const uint8_t *buf, uint32_t size)
+{
+   uint32_t h = 0;
+   uint32_t i;
+   for (i = 0; i < size; i += 61)
+      h = h * 31 + buf[i];
+   return h;
+}
+
+static void work(double usec)
+{
+   retro_time_t end = cpu_features_get_time_usec() + (retro_time_t)usec;
+   while (cpu_features_get_time_usec() < end);
+}
+
+static void replay_read(struct replay *r, uint32_t hunknum)
+{
+   retro_time_t start = cpu_features_get_time_usec();
+   chd_error err      = chd_read(r->chd, hunknum, r->buf);
+   uint32_t hash;
+
+   r->in_read += cpu_features_get_time_usec() - start;
+   r->reads++;
+   if (err != CHDERR_NONE)
+   {
+      fprintf(stderr, "chd_read(%u): %s\n", hunknum, chd_error_string(err));
+      r->bad = 1;
+      return;
+   }
+   hash        = hunk_hash(r->buf, r->hunkbytes);
+   r->checksum = r->checksum * 1000003 + hash;
+   if (r->expected && hash != r->expected[hunknum] && !r->bad)
+   {
+      fprintf(stderr, "hunk %u doesn't match the fixture\n", hunknum);
+      r->bad = 1;
+   }
+   work(r->work_usec);
+}
+
+static void replay_trace(struct replay *r, enum trace trace, uint32_t total)
+{
+   uint32_t h, s;
+   int i;
+
+   switch (trace)
+   {
+      case TRACE_SEQUENTIAL:
+         for (h = 0; h < total; h++)
+            for (s = 0; s < SECTORS_PER_HUNK; s++)
+               replay_read(r, h);
+         break;
+      case TRACE_ALTERNATING:
+         for (h = 0; h < total / 2; h++)
+            for (s = 0; s < SECTORS_PER_HUNK; s++)
+            {
+               replay_read(r, h);
+               replay_read(r, total / 2 + h);
+            }
+         break;
+      case TRACE_SEEK:
+         srand(7);
+         for (i = 0; i < SEEKS; i++)
+         {
+            uint32_t base = rand() % (total - SEEK_RUN);
+            for (h = base; h < base + SEEK_RUN; h++)
+               for (s = 0; s < SECTORS_PER_HUNK; s++)
+                  replay_read(r, h);
+         }
+         break;
+      default:
+         break;
+   }
+}
+
+/* sampled hashes of every hunk if path is one of our fixtures */
+static uint32_t *fixture_hashes(chd_file *chd)
+{
+   const chd_header *header = chd_get_header(chd);
+   uint8_t *got, *want;
+   uint32_t *hashes = NULL;
+   uint32_t h;
+
+   if (header->hunkbytes != CHD_FIXTURE_HUNKBYTES)
+      return NULL;
+   got  = (uint8_t*)malloc(CHD_FIXTURE_HUNKBYTES);
+   want = (uint8_t*)malloc(CHD_FIXTURE_HUNKBYTES);
+   chd_fixture_hunk(0, want);
+   if (chd_read(chd, 0, got) == CHDERR_NONE
+         && !memcmp(got, want, CHD_FIXTURE_HUNKBYTES))
+   {
+      hashes = (uint32_t*)malloc(header->totalhunks * sizeof(*hashes));
+      for (h = 0; h < header->totalhunks; h++)
+      {
+         chd_fixture_hunk(h, want);
+         hashes[h] = hunk_hash(want, CHD_FIXTURE_HUNKBYTES);
+      }
+   }
+   free(want);
+   free(got);
+   return hashes;
+}
+
+int main(int argc, char *argv[])
+{
+   const char *path  = argc > 1 ? argv[1] : "chd_cache_test.chd";
+   double work_usec  = argc > 2 ? atof(argv[2]) : 20.0;
+   uint32_t *expected;
+   uint32_t total, hunkbytes;
+   chd_file *chd;
+   FILE *fp;
+   unsigned t, c;
+   int ret = 0;
+
+   if (!(fp = fopen(path, "rb")))
+   {
+      printf("Generating %s (%u hunks)\n", path, CHD_FIXTURE_HUNKS);
+      if (chd_fixture_write(path, CHD_FIXTURE_HUNKS) != 0)
+      {
+         fprintf(stderr, "Can't write %s\n", path);
+         return 1;
+      }
+   }
+   else
+      fclose(fp);
+
+   if (chd_open(path, CHD_OPEN_READ, NULL, &chd) != CHDERR_NONE)
+   {
+      fprintf(stderr, "Can't open %s\n", path);
+      return 1;
+   }
+   total     = chd_get_header(chd)->totalhunks;
+   hunkbytes = chd_get_header(chd)->hunkbytes;
+   expected  = fixture_hashes(chd);
+   chd_close(chd);
+   if (total <= SEEK_RUN)
+   {
+      fprintf(stderr, "%s is too small for the seek trace\n", path);
+      return 1;
+   }
+
+   printf("%s: %u hunks of %u bytes, %u reads per hunk, %.0f us of work per read%s\n\n",
+         path, total, hunkbytes, SECTORS_PER_HUNK, work_usec,
+         expected ? "" : " (not a fixture, reads are only checked against each other)");
+
+   for (t = 0; t < TRACE_COUNT; t++)
+   {
+      uint32_t reference = 0;
+
+      for (c = 0; c < CONFIG_COUNT; c++)
+      {
+         struct replay r;
+         chd_cache_stats stats;
+         retro_time_t start;
+
+         memset(&r, 0, sizeof(r));
+         if (chd_open(path, CHD_OPEN_READ, NULL, &r.chd) != CHDERR_NONE)
+         {
+            fprintf(stderr, "Can't open %s\n", path);
+            return 1;
+         }
+         chd_set_cache(r.chd, configs[c].hunks, configs[c].prefetch);
+         r.buf       = (uint8_t*)malloc(hunkbytes);
+         r.hunkbytes = hunkbytes;
+         r.expected  = expected;
+         r.work_usec = work_usec;
+
+         start = cpu_features_get_time_usec();
+         replay_trace(&r, (enum trace)t, total);
+         start = cpu_features_get_time_usec() - start;
+         chd_get_cache_stats(r.chd, &stats);
+         chd_close(r.chd);
+         free(r.buf);
+
+         printf("%-11s cache %2u prefetch %u: %6.0f ms total, %6.0f ms in chd_read, %5.2f us/read\n"
+               "            hits %llu misses %llu waits %llu prefetched %llu (%llu used), decode %llu ms, read-ahead %llu ms\n",
+               trace_names[t], configs[c].hunks, configs[c].prefetch,
+               start / 1000.0, r.in_read / 1000.0, (double)r.in_read / r.reads,
+               (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+               (unsigned long long)stats.waits, (unsigned long long)stats.prefetched,
+               (unsigned long long)stats.prefetch_hits,
+               (unsigned long long)stats.decompress_usec / 1000,
+               (unsigned long long)stats.prefetch_usec / 1000);
+
+         if (!c)
+            reference = r.checksum;
+         else if (r.checksum != reference)
+         {
+            fprintf(stderr, "%s: cache %u prefetch %u read different data than cache 1\n",
+                  trace_names[t], configs[c].hunks, configs[c].prefetch);
+            r.bad = 1;
+         }
+         if (r.bad)
+            ret = 1;
+      }
+      printf("\n");
+   }
+
+   free(expected);
+   printf(ret ? "FAILED\n" : "All reads matched\n");
+   return ret;
+}
@@ -0,0 +1,181 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (chd_fixture.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#include "chd_fixture.h"
+
+#define WORDS    512
+#define WORD_MAX 12
+
+/* v4 header and map layout, see header_read and map_read in chd.c */
+#define V4_HEADER_SIZE 108
+#define MAP_ENTRY_SIZE 16
+#define MAP_ENTRY_TYPE_COMPRESSED 1
+
+static uint8_t words[WORDS][WORD_MAX];
+static uint8_t word_len[WORDS];
+static int words_ready;
+
+static uint32_t rng_next(uint32_t *state)
+{
+   /* xorshift32 */
+   uint32_t x = *state;
+   x ^= x << 13;
+   x ^= x >> 17;
+   x ^= x << 5;
+   return *state = x;
+}
+
+static void make_words(void)
+{
+   uint32_t state = 1;
+   unsigned i, j;
+   for (i = 0; i < WORDS; i++)
+   {
+      word_len[i] = 3 + rng_next(&state) % (WORD_MAX - 2);
+      for (j = 0; j < word_len[i]; j++)
+         words[i][j] = (uint8_t)rng_next(&state);
+   }
+   words_ready = 1;
+}
+
+void chd_fixture_hunk(uint32_t hunknum, uint8_t *buf)
+{
+   uint32_t state = hunknum * 2654435761u + 12345;
+   unsigned pos   = 0;
+
+   if (!words_ready)
+      make_words();
+   while (pos < CHD_FIXTURE_HUNKBYTES)
+   {
+      unsigned w = rng_next(&state) % WORDS;
+      unsigned n = word_len[w];
+      if (n > CHD_FIXTURE_HUNKBYTES - pos)
+         n = CHD_FIXTURE_HUNKBYTES - pos;
+      memcpy(buf + pos, words[w], n);
+      pos += n;
+   }
+}
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+   p[0] = v >> 24;
+   p[1] = v >> 16;
+   p[2] = v >> 8;
+   p[3] = v;
+}
+
+static void put_be64(uint8_t *p, uint64_t v)
+{
+   put_be32(p, (uint32_t)(v >> 32));
+   put_be32(p + 4, (uint32_t)v);
+}
+
+/* raw deflate, which is what the CHD zlib codec expects */
+static uLong deflate_hunk(const uint8_t *in, uint8_t *out, uLong out_size)
+{
+   z_stream z;
+   uLong len;
+
+   memset(&z, 0, sizeof(z));
+   if (deflateInit2(&z, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+      return 0;
+   z.next_in   = (Bytef*)in;
+   z.avail_in  = CHD_FIXTURE_HUNKBYTES;
+   z.next_out  = out;
+   z.avail_out = out_size;
+   len         = deflate(&z, Z_FINISH) == Z_STREAM_END ? z.total_out : 0;
+   deflateEnd(&z);
+   return len;
+}
+
+int chd_fixture_write(const char *path, uint32_t hunks)
+{
+   uint8_t header[V4_HEADER_SIZE];
+   uint8_t *map      = (uint8_t*)calloc(hunks, MAP_ENTRY_SIZE);
+   uint8_t *raw      = (uint8_t*)malloc(CHD_FIXTURE_HUNKBYTES);
+   uLong comp_size   = compressBound(CHD_FIXTURE_HUNKBYTES);
+   uint8_t *comp     = (uint8_t*)malloc(comp_size);
+   FILE *fp          = fopen(path, "wb");
+   uint64_t offset   = V4_HEADER_SIZE + (uint64_t)hunks * MAP_ENTRY_SIZE + 16;
+   int ret           = -1;
+   uint32_t i;
+
+   if (!map || !raw || !comp || !fp)
+      goto end;
+
+   memset(header, 0, sizeof(header));
+   memcpy(header, "MComprHD", 8);
+   put_be32(header + 8, V4_HEADER_SIZE);
+   put_be32(header + 12, 4);
+   put_be32(header + 16, 0);   /* flags */
+   put_be32(header + 20, 1);   /* CHDCOMPRESSION_ZLIB */
+   put_be32(header + 24, hunks);
+   put_be64(header + 28, (uint64_t)hunks * CHD_FIXTURE_HUNKBYTES);
+   put_be64(header + 36, 0);   /* no metadata */
+   put_be32(header + 44, CHD_FIXTURE_HUNKBYTES);
+
+   /* the map comes before the data, so write the data first and
+    * fill the map in as the compressed sizes become known */
+   if (fseek(fp, (long)offset, SEEK_SET) != 0)
+      goto end;
+   for (i = 0; i < hunks; i++)
+   {
+      uint8_t *entry = map + (size_t)i * MAP_ENTRY_SIZE;
+      uLong len;
+
+      chd_fixture_hunk(i, raw);
+      if (!(len = deflate_hunk(raw, comp, comp_size)))
+         goto end;
+      if (fwrite(comp, 1, len, fp) != len)
+         goto end;
+      put_be64(entry, offset);
+      put_be32(entry + 8, (uint32_t)crc32(0, raw, CHD_FIXTURE_HUNKBYTES));
+      entry[12] = (uint8_t)(len >> 8);
+      entry[13] = (uint8_t)len;
+      entry[14] = (uint8_t)(len >> 16);
+      entry[15] = MAP_ENTRY_TYPE_COMPRESSED;
+      offset   += len;
+   }
+
+   rewind(fp);
+   if (fwrite(header, 1, sizeof(header), fp) != sizeof(header))
+      goto end;
+   if (fwrite(map, MAP_ENTRY_SIZE, hunks, fp) != hunks)
+      goto end;
+   if (fwrite("EndOfListCookie", 1, 16, fp) != 16)
+      goto end;
+   ret = 0;
+
+end:
+   if (fp && fclose(fp) != 0)
+      ret = -1;
+   free(comp);
+   free(raw);
+   free(map);
+   return ret;
+}
@@ -0,0 +1,43 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (chd_fixture.h).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __CHD_FIXTURE_H
+#define __CHD_FIXTURE_H
+
+#include <stdint.h>
+
+/* A generated CHD for the libchdr benches: a v4 header, zlib-compressed
+ * hunks of CD-sized sectors (8 x 2448 bytes). The data is made of a
+ * fixed vocabulary of short random words, so it compresses roughly
+ * like real disc data, and any hunk can be regenerated from its index
+ * to check what chd_read returned. */
+
+#define CHD_FIXTURE_HUNKBYTES 19584
+#define CHD_FIXTURE_HUNKS     2000
+
+/* fills buf with CHD_FIXTURE_HUNKBYTES bytes of hunk 'hunknum' */
+void chd_fixture_hunk(uint32_t hunknum, uint8_t *buf);
+
+/* writes a 'hunks'-hunk fixture to path, returns 0 on success */
+int chd_fixture_write(const char *path, uint32_t hunks);
+
+#endif
@@ -0,0 +1,10 @@
+/* Stand-in for libFLAC's header, enough to declare flac_decoder in
+ * flac.h; codec_stubs.c replaces flac.c. */
+
+#ifndef __CHD_STUB_FLAC_ALL_H
+#define __CHD_STUB_FLAC_ALL_H
+
+typedef struct FLAC__StreamDecoder FLAC__StreamDecoder;
+typedef unsigned char FLAC__byte;
+
+#endif
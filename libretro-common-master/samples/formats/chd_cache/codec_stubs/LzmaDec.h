@@ -0,0 +1,59 @@
+/* Stand-in for the LZMA SDK header, which isn't part of libretro-common.
+ * Only what chd.c refers to; the decoder refuses to allocate, so LZMA
+ * CHDs fail to open instead of decoding garbage. The benches use zlib
+ * fixtures. */
+
+#ifndef __CHD_STUB_LZMADEC_H
+#define __CHD_STUB_LZMADEC_H
+
+#include <stddef.h>
+
+typedef size_t SizeT;
+typedef int SRes;
+
+#define SZ_OK 0
+#define SZ_ERROR_UNSUPPORTED 4
+#define LZMA_PROPS_SIZE 5
+
+typedef struct ISzAlloc
+{
+   void *(*Alloc)(void *p, size_t size);
+   void (*Free)(void *p, void *address);
+} ISzAlloc;
+
+typedef struct
+{
+   int unused;
+} CLzmaDec;
+
+typedef enum
+{
+   LZMA_FINISH_ANY,
+   LZMA_FINISH_END
+} ELzmaFinishMode;
+
+typedef enum
+{
+   LZMA_STATUS_NOT_SPECIFIED,
+   LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK
+} ELzmaStatus;
+
+#define LzmaDec_Construct(p) ((void)(p))
+
+static SRes LzmaDec_Allocate(CLzmaDec *p, const unsigned char *props,
+      unsigned size, ISzAlloc *alloc)
+{
+   return SZ_ERROR_UNSUPPORTED;
+}
+
+static void LzmaDec_Free(CLzmaDec *p, ISzAlloc *alloc) { }
+static void LzmaDec_Init(CLzmaDec *p) { }
+
+static SRes LzmaDec_DecodeToBuf(CLzmaDec *p, unsigned char *dest,
+      SizeT *dest_len, const unsigned char *src, SizeT *src_len,
+      ELzmaFinishMode mode, ELzmaStatus *status)
+{
+   return SZ_ERROR_UNSUPPORTED;
+}
+
+#endif
@@ -0,0 +1,32 @@
+/* Stand-in for the LZMA SDK encoder header; chd.c only uses it to work
+ * out the decoder properties. See LzmaDec.h. */
+
+#ifndef __CHD_STUB_LZMAENC_H
+#define __CHD_STUB_LZMAENC_H
+
+#include "LzmaDec.h"
+
+typedef void *CLzmaEncHandle;
+
+typedef struct
+{
+   int level;
+   unsigned reduceSize;
+} CLzmaEncProps;
+
+static void LzmaEncProps_Init(CLzmaEncProps *p) { }
+static void LzmaEncProps_Normalize(CLzmaEncProps *p) { }
+static CLzmaEncHandle LzmaEnc_Create(ISzAlloc *alloc) { return NULL; }
+static void LzmaEnc_Destroy(CLzmaEncHandle p, ISzAlloc *alloc, ISzAlloc *big_alloc) { }
+
+static SRes LzmaEnc_SetProps(CLzmaEncHandle p, const CLzmaEncProps *props)
+{
+   return SZ_ERROR_UNSUPPORTED;
+}
+
+static SRes LzmaEnc_WriteProperties(CLzmaEncHandle p, unsigned char *props, SizeT *size)
+{
+   return SZ_ERROR_UNSUPPORTED;
+}
+
+#endif
@@ -0,0 +1,56 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (codec_stubs.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* flac.c needs libFLAC, which isn't part of libretro-common: these
+ * make every CD FLAC (cdfl) hunk fail to decode. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "flac.h"
+
+void flac_decoder_init(flac_decoder *decoder)
+{
+   decoder->decoder = NULL;
+}
+
+void flac_decoder_free(flac_decoder *decoder)
+{
+}
+
+int flac_decoder_reset(flac_decoder *decoder, uint32_t sample_rate,
+      uint8_t num_channels, uint32_t block_size,
+      const void *buffer, uint32_t length)
+{
+   return 0;
+}
+
+int flac_decoder_decode_interleaved(flac_decoder *decoder,
+      int16_t *samples, uint32_t num_samples, int swap_endian)
+{
+   return 0;
+}
+
+uint32_t flac_decoder_finish(flac_decoder *decoder)
+{
+   return 0;
+}
@@ -0,0 +1,215 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (content_hash_bench.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <features/features_cpu.h>
+#include <encodings/crc32.h>
+#include <hash/content_hash.h>
+#include <streams/file_stream.h>
+#include <utils/md5.h>
+
+#define BUFFER_SIZE (64 << 20)
+#define ITERATIONS  4
+#define LANES       8
+
+static uint8_t *buffer;
+
+/* The byte-at-a-time table encoding_crc32() used before slice-by-8,
+ * kept as the baseline and the reference. */
+static uint32_t crc32_bytewise(uint32_t crc, const uint8_t *data, size_t len)
+{
+   static uint32_t table[256];
+   unsigned i, j;
+
+   if (!table[1])
+      for (i = 0; i < 256; i++)
+      {
+         uint32_t c = i;
+         for (j = 0; j < 8; j++)
+            c = (c & 1) ? (c >> 1) ^ 0xedb88320 : c >> 1;
+         table[i] = c;
+      }
+
+   crc = ~crc;
+   while (len--)
+      crc = table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+   return ~crc;
+}
+
+static double gb_per_sec(retro_time_t start, size_t bytes)
+{
+   retro_time_t elapsed = cpu_features_get_time_usec() - start;
+   if (elapsed <= 0)
+      elapsed = 1;
+   return (double)bytes * 1000000.0 / (double)elapsed / 1e9;
+}
+
+static int check(void)
+{
+   unsigned i;
+   const uint8_t *data[LANES + 3];
+   size_t len[LANES + 3];
+   uint8_t multi[(LANES + 3) * CONTENT_SHA1_SIZE];
+
+   /* Odd lengths and offsets so every tail path runs. */
+   for (i = 0; i < LANES + 3; i++)
+   {
+      data[i] = buffer + i * 7;
+      len[i]  = 100000 + i * 997;
+   }
+   content_sha1_multi(data, len, LANES + 3, multi);
+
+   for (i = 0; i < LANES + 3; i++)
+   {
+      content_hash_t hash;
+      content_hash_result_t result;
+      uint8_t single[CONTENT_SHA1_SIZE];
+      content_sha1_t sha1;
+
+      content_sha1_init(&sha1);
+      content_sha1_update(&sha1, data[i], len[i]);
+      content_sha1_final(&sha1, single);
+      if (memcmp(single, multi + i * CONTENT_SHA1_SIZE, CONTENT_SHA1_SIZE))
+      {
+         fprintf(stderr, "SHA-1 multi-buffer mismatch in lane %u\n", i);
+         return 1;
+      }
+
+      content_hash_init(&hash, CONTENT_HASH_ALL);
+      content_hash_update(&hash, data[i], 1 + i);
+      content_hash_update(&hash, data[i] + 1 + i, len[i] - 1 - i);
+      content_hash_final(&hash, &result);
+      if (memcmp(single, result.sha1, CONTENT_SHA1_SIZE)
+            || result.crc32 != crc32_bytewise(0, data[i], len[i]))
+      {
+         fprintf(stderr, "combined hash mismatch on buffer %u\n", i);
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+int main(int argc, char *argv[])
+{
+   unsigned i, j;
+   retro_time_t start;
+   uint32_t crc = 0;
+   uint64_t cpu = cpu_features_get();
+   const uint8_t *data[LANES];
+   size_t len[LANES];
+   uint8_t digest[LANES * CONTENT_SHA1_SIZE];
+   content_sha1_t sha1;
+   content_hash_t hash;
+   content_hash_result_t result;
+   MD5_CTX md5;
+
+   buffer = (uint8_t*)malloc(BUFFER_SIZE);
+   if (!buffer)
+      return 1;
+   for (i = 0; i < BUFFER_SIZE; i++)
+      buffer[i] = (uint8_t)rand();
+
+   if (check())
+      return 1;
+
+   printf("CPU:%s%s%s, SHA-1: %s\n",
+         (cpu & RETRO_SIMD_PCLMUL) ? " PCLMUL" : "",
+         (cpu & RETRO_SIMD_SHA)    ? " SHA"    : "",
+         (cpu & RETRO_SIMD_AVX2)   ? " AVX2"   : "",
+         content_sha1_impl());
+
+   start = cpu_features_get_time_usec();
+   for (i = 0; i < ITERATIONS; i++)
+      crc = crc32_bytewise(crc, buffer, BUFFER_SIZE);
+   printf("crc32 byte table     %6.2f GB/s\n", gb_per_sec(start, (size_t)BUFFER_SIZE * ITERATIONS));
+
+   /* Calls under 256 bytes stay on slice-by-8. */
+   start = cpu_features_get_time_usec();
+   for (i = 0; i < ITERATIONS; i++)
+      for (j = 0; j + 255 <= BUFFER_SIZE; j += 255)
+         crc = encoding_crc32(crc, buffer + j, 255);
+   printf("crc32 slice-by-8     %6.2f GB/s\n", gb_per_sec(start, (size_t)BUFFER_SIZE * ITERATIONS));
+
+   start = cpu_features_get_time_usec();
+   for (i = 0; i < ITERATIONS; i++)
+      crc = encoding_crc32(crc, buffer, BUFFER_SIZE);
+   printf("crc32 %-14s %6.2f GB/s\n", (cpu & RETRO_SIMD_PCLMUL) ? "PCLMULQDQ" : "slice-by-8",
+         gb_per_sec(start, (size_t)BUFFER_SIZE * ITERATIONS));
+
+   start = cpu_features_get_time_usec();
+   content_sha1_init(&sha1);
+   for (i = 0; i < ITERATIONS; i++)
+      content_sha1_update(&sha1, buffer, BUFFER_SIZE);
+   content_sha1_final(&sha1, digest);
+   printf("sha1 %-15s %6.2f GB/s\n", content_sha1_impl(),
+         gb_per_sec(start, (size_t)BUFFER_SIZE * ITERATIONS));
+
+   for (i = 0; i < LANES; i++)
+   {
+      data[i] = buffer + i * (BUFFER_SIZE / LANES);
+      len[i]  = BUFFER_SIZE / LANES;
+   }
+   start = cpu_features_get_time_usec();
+   for (i = 0; i < ITERATIONS; i++)
+      content_sha1_multi(data, len, LANES, digest);
+   printf("sha1 multi x%-8u %6.2f GB/s\n", LANES, gb_per_sec(start, (size_t)BUFFER_SIZE * ITERATIONS));
+
+   start = cpu_features_get_time_usec();
+   MD5_Init(&md5);
+   for (i = 0; i < ITERATIONS; i++)
+      MD5_Update(&md5, buffer, BUFFER_SIZE);
+   MD5_Final(digest, &md5);
+   printf("md5                  %6.2f GB/s\n", gb_per_sec(start, (size_t)BUFFER_SIZE * ITERATIONS));
+
+   start = cpu_features_get_time_usec();
+   content_hash_init(&hash, CONTENT_HASH_ALL);
+   for (i = 0; i < ITERATIONS; i++)
+      content_hash_update(&hash, buffer, BUFFER_SIZE);
+   content_hash_final(&hash, &result);
+   printf("combined             %6.2f GB/s\n", gb_per_sec(start, (size_t)BUFFER_SIZE * ITERATIONS));
+
+   /* Optionally a real file, read once through the file stream. */
+   if (argc > 1)
+   {
+      long long size;
+      RFILE *fd = filestream_open(argv[1], RFILE_MODE_READ, -1);
+
+      if (!fd)
+         return 1;
+      size = filestream_get_size(fd);
+      filestream_close(fd);
+
+      start = cpu_features_get_time_usec();
+      if (!content_hash_file(argv[1], CONTENT_HASH_ALL, &result))
+         return 1;
+      printf("combined file        %6.2f GB/s  crc32 %08x\n",
+            gb_per_sec(start, (size_t)size), (unsigned)result.crc32);
+   }
+
+   free(buffer);
+   return crc == 0x12345678;
+}
@@ -0,0 +1,295 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (ram_search_bench.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <features/features_cpu.h>
+#include <memmap/ram_search.h>
+
+#define RAM_SIZE  (16 * 1024 * 1024)
+#define PASSES    20
+
+static uint32_t rng = 0x12345678;
+
+static uint32_t next_rand(void)
+{
+   rng ^= rng << 13;
+   rng ^= rng >> 17;
+   rng ^= rng << 5;
+   return rng;
+}
+
+/* A game at work: a few hundred values tick every frame. */
+static void mutate(uint8_t *ram, size_t size, unsigned count)
+{
+   unsigned i;
+   for (i = 0; i < count; i++)
+      ram[next_rand() % size] += (uint8_t)(next_rand() % 5) - 2;
+}
+
+static uint32_t ref_read(const uint8_t *p, unsigned width, unsigned flags)
+{
+   uint32_t v = p[0];
+   if (width > 1)
+      v |= (uint32_t)p[1] << 8;
+   if (width > 2)
+      v |= ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+   if (flags & RAM_SEARCH_SIGNED)
+   {
+      unsigned shift = 32 - width * 8;
+      v = (uint32_t)((int32_t)(v << shift) >> shift) ^ 0x80000000u;
+   }
+   return v;
+}
+
+static int ref_holds(enum ram_search_op op, uint32_t a, uint32_t b)
+{
+   switch (op)
+   {
+      case RAM_SEARCH_EQ: return a == b;
+      case RAM_SEARCH_NE: return a != b;
+      case RAM_SEARCH_LT: return a < b;
+      case RAM_SEARCH_GT: return a > b;
+      case RAM_SEARCH_LE: return a <= b;
+      case RAM_SEARCH_GE: return a >= b;
+   }
+   return 0;
+}
+
+/* One byte per address, the obvious way. ref NULL compares with value. */
+static size_t ref_filter(uint8_t *cand, const uint8_t *ram, const uint8_t *ref,
+      size_t size, unsigned width, unsigned flags, enum ram_search_op op, uint32_t value)
+{
+   size_t addr, count = 0;
+   uint32_t b = ref_read((const uint8_t*)&value, width, flags);
+
+   for (addr = 0; addr + width <= size; addr++)
+   {
+      if (!cand[addr])
+         continue;
+      if (ref)
+         b = ref_read(ref + addr, width, flags);
+      cand[addr] = ref_holds(op, ref_read(ram + addr, width, flags), b);
+      count     += cand[addr];
+   }
+   return count;
+}
+
+static int same_candidates(const ram_search_t *search, const uint8_t *cand, size_t size)
+{
+   ssize_t addr = ram_search_next(search, 0);
+   size_t i;
+
+   for (i = 0; i < size; i++)
+   {
+      if (cand[i] != (addr == (ssize_t)i))
+         return 0;
+      if (addr == (ssize_t)i)
+         addr = ram_search_next(search, i + 1);
+   }
+   return addr == -1;
+}
+
+/* Random searches on a small odd-sized buffer, checked against ref_filter. */
+static int verify(void)
+{
+   static const unsigned widths[] = { 1, 2, 4 };
+   size_t size = 4093;
+   uint8_t *ram  = (uint8_t*)malloc(size);
+   uint8_t *prev = (uint8_t*)malloc(size);
+   uint8_t *cand = (uint8_t*)malloc(size);
+   unsigned round, w, flags;
+   int fails = 0;
+
+   for (round = 0; round < 50; round++)
+   for (w = 0; w < 3; w++)
+   for (flags = 0; flags < 4; flags++)
+   {
+      unsigned width       = widths[w];
+      ram_snapshot_t *snap;
+      ram_search_t *search;
+      size_t addr;
+      unsigned pass;
+
+      /* few distinct values so that every op keeps something */
+      for (addr = 0; addr < size; addr++)
+         ram[addr] = (uint8_t)(next_rand() % 3) | (next_rand() % 4 == 0 ? 0x80 : 0);
+      search = ram_search_new(ram, size, width, flags);
+      snap   = ram_snapshot_new(ram, size);
+      memcpy(prev, ram, size);
+      for (addr = 0; addr < size; addr++)
+         cand[addr] = addr + width <= size && (!(flags & RAM_SEARCH_ALIGNED) || !(addr % width));
+      if (!same_candidates(search, cand, size))
+         fails++;
+
+      for (pass = 0; pass < 4; pass++)
+      {
+         enum ram_search_op op = (enum ram_search_op)(next_rand() % 6);
+         size_t ours, want;
+
+         mutate(ram, size, 200);
+         switch (next_rand() % 3)
+         {
+            case 0:
+            {
+               uint32_t value = ram_search_value(search, ram_search_next(search, 0) >= 0
+                     ? (size_t)ram_search_next(search, 0) : 0);
+               ours = ram_search_filter_value(search, op, value);
+               want = ref_filter(cand, ram, NULL, size, width, flags, op, value);
+               break;
+            }
+            case 1:
+               ours = ram_search_filter_previous(search, op);
+               want = ref_filter(cand, ram, prev, size, width, flags, op, 0);
+               break;
+            default:
+               ours = ram_search_filter_snapshot(search, op, snap);
+               want = ref_filter(cand, ram, snap->data, size, width, flags, op, 0);
+               break;
+         }
+         memcpy(prev, ram, size);
+         if (ours != want || !same_candidates(search, cand, size))
+         {
+            printf("mismatch: width %u flags %u op %d: %u vs %u\n",
+                  width, flags, (int)op, (unsigned)ours, (unsigned)want);
+            fails++;
+            break;
+         }
+      }
+
+      ram_snapshot_free(snap);
+      ram_search_free(search);
+   }
+
+   free(ram);
+   free(prev);
+   free(cand);
+   printf("verify: %s\n", fails ? "FAILED" : "ok");
+   return fails;
+}
+
+/* Worst case first pass (every address a candidate), then how a session
+ * narrows down: "changed", "unchanged" while nothing happens and so on. */
+static void bench(unsigned width)
+{
+   uint8_t *ram  = (uint8_t*)malloc(RAM_SIZE);
+   uint8_t *cand = (uint8_t*)malloc(RAM_SIZE);
+   ram_snapshot_t *snap;
+   ram_search_t *search;
+   retro_time_t start;
+   double t_prev = 0, t_value = 0, t_snap = 0, t_ref;
+   size_t addr, left = 0;
+   unsigned i;
+
+   for (addr = 0; addr < RAM_SIZE; addr++)
+      ram[addr] = (uint8_t)next_rand();
+   snap   = ram_snapshot_new(ram, RAM_SIZE);
+   search = ram_search_new(ram, RAM_SIZE, width, 0);
+
+   for (i = 0; i < PASSES; i++)
+   {
+      mutate(ram, RAM_SIZE, 1000);
+      ram_search_reset(search);
+      start   = cpu_features_get_time_usec();
+      ram_search_filter_previous(search, RAM_SEARCH_EQ);
+      t_prev += cpu_features_get_time_usec() - start;
+
+      ram_search_reset(search);
+      start    = cpu_features_get_time_usec();
+      ram_search_filter_value(search, RAM_SEARCH_NE, 0x42);
+      t_value += cpu_features_get_time_usec() - start;
+
+      ram_search_reset(search);
+      start   = cpu_features_get_time_usec();
+      ram_search_filter_snapshot(search, RAM_SEARCH_LE, snap);
+      t_snap += cpu_features_get_time_usec() - start;
+   }
+
+   memset(cand, 1, RAM_SIZE);
+   start = cpu_features_get_time_usec();
+   ref_filter(cand, ram, snap->data, RAM_SIZE, width, 0, RAM_SEARCH_LE, 0);
+   t_ref = (double)(cpu_features_get_time_usec() - start);
+
+   printf("%2u-bit  full pass: previous %6.2f ms  value %6.2f ms  snapshot %6.2f ms  (byte-at-a-time %6.2f ms)\n",
+         width * 8, t_prev / PASSES / 1000.0, t_value / PASSES / 1000.0,
+         t_snap / PASSES / 1000.0, t_ref / 1000.0);
+
+   /* narrowing: changed, then unchanged a few times */
+   ram_search_reset(search);
+   mutate(ram, RAM_SIZE, 100000);
+   start = cpu_features_get_time_usec();
+   left  = ram_search_filter_previous(search, RAM_SEARCH_NE);
+   printf("        changed:  %8u left  %6.2f ms\n", (unsigned)left,
+         (double)(cpu_features_get_time_usec() - start) / 1000.0);
+   for (i = 0; i < 3; i++)
+   {
+      mutate(ram, RAM_SIZE, 100000);
+      start = cpu_features_get_time_usec();
+      left  = ram_search_filter_previous(search, RAM_SEARCH_EQ);
+      printf("        same:     %8u left  %6.2f ms\n", (unsigned)left,
+            (double)(cpu_features_get_time_usec() - start) / 1000.0);
+   }
+
+   ram_search_free(search);
+   ram_snapshot_free(snap);
+   free(ram);
+   free(cand);
+}
+
+static void bench_watch(void)
+{
+   uint8_t *ram       = (uint8_t*)calloc(1, RAM_SIZE);
+   ram_watch_t *watch = ram_watch_new(60 * 60);
+   retro_time_t start;
+   unsigned i;
+
+   for (i = 0; i < 64; i++)
+      ram_watch_add(watch, next_rand() % RAM_SIZE, 1 << (i % 3), 0);
+
+   start = cpu_features_get_time_usec();
+   for (i = 0; i < 100000; i++)
+   {
+      ram[i % 4096]++;
+      ram_watch_sample(watch, ram, RAM_SIZE);
+   }
+   printf("watch: 64 values, %.3f us per frame, %u frames kept\n",
+         (double)(cpu_features_get_time_usec() - start) / 100000.0,
+         (unsigned)ram_watch_frames(watch));
+
+   ram_watch_free(watch);
+   free(ram);
+}
+
+int main(void)
+{
+   printf("kernels: %s\n", ram_search_impl());
+   if (verify())
+      return 1;
+   bench(1);
+   bench(2);
+   bench(4);
+   bench_watch();
+   return 0;
+}
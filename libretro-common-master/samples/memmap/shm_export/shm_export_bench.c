@@ -0,0 +1,261 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (shm_export_bench.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <libretro.h>
+#include <features/features_cpu.h>
+#include <memmap/shm_export.h>
+
+#define SHM_NAME        "shm_export_bench"
+#define VIDEO_SLOTS     8
+#define AUDIO_SLOTS     16
+#define AUDIO_FRAMES    800            /* 48 kHz at 60 fps */
+#define FRAME_USEC      16667
+
+struct reader_result
+{
+   uint64_t frames;
+   uint64_t dropped;
+   uint64_t torn;                      /* pixels that did not match the frame number */
+   uint64_t audio;
+   double latency_mean;
+   double latency_p99;
+   double latency_max;
+};
+
+static int cmp_double(const void *a, const void *b)
+{
+   double x = *(const double*)a, y = *(const double*)b;
+   return x < y ? -1 : x > y;
+}
+
+/* Every pixel of frame n is n, so a copy that mixes two frames shows. */
+static void fill_frame(uint32_t *pixels, size_t count, uint64_t frame)
+{
+   size_t i;
+   for (i = 0; i < count; i++)
+      pixels[i] = (uint32_t)frame;
+}
+
+/* Producer cost per frame with nobody reading. */
+static void bench_producer(unsigned width, unsigned height, unsigned format)
+{
+   unsigned bpp       = format == RETRO_PIXEL_FORMAT_XRGB8888 ? 4 : 2;
+   size_t pitch       = (width + 64) * bpp;    /* padded, as cores do */
+   uint8_t *frame     = (uint8_t*)calloc(pitch, height);
+   int16_t audio[AUDIO_FRAMES * 2];
+   shm_export_t *shm  = shm_export_new(SHM_NAME, width * height * bpp, VIDEO_SLOTS,
+         sizeof(audio), AUDIO_SLOTS);
+   retro_time_t start;
+   double video, memcpy_us, audio_us;
+   unsigned i, y;
+
+   if (!shm)
+   {
+      printf("shm_export_new failed\n");
+      exit(1);
+   }
+   memset(audio, 0, sizeof(audio));
+
+   start = cpu_features_get_time_usec();
+   for (i = 0; i < 2000; i++)
+      shm_export_video(shm, i, frame, width, height, pitch, format);
+   video = (double)(cpu_features_get_time_usec() - start) / 2000;
+
+   /* the same rows copied to private memory, for scale */
+   {
+      uint8_t *copy = (uint8_t*)malloc(width * height * bpp);
+      start = cpu_features_get_time_usec();
+      for (i = 0; i < 2000; i++)
+         for (y = 0; y < height; y++)
+            memcpy(copy + y * width * bpp, frame + y * pitch, width * bpp);
+      memcpy_us = (double)(cpu_features_get_time_usec() - start) / 2000;
+      free(copy);
+   }
+
+   start = cpu_features_get_time_usec();
+   for (i = 0; i < 20000; i++)
+      shm_export_audio(shm, i, audio, AUDIO_FRAMES, 48000);
+   audio_us = (double)(cpu_features_get_time_usec() - start) / 20000;
+
+   printf("%4ux%-4u %u bpp  video %7.2f us/frame (plain row copy %7.2f us)  audio %5.2f us/batch\n",
+         width, height, bpp * 8, video, memcpy_us, audio_us);
+
+   shm_export_free(shm);
+   free(frame);
+}
+
+/* The consumer side: polls both streams for @usec and checks frames. */
+static void reader_loop(retro_time_t usec, unsigned slow_usec, int fd)
+{
+   struct reader_result result;
+   struct shm_export_slot info;
+   shm_reader_t *reader = NULL;
+   double *latency      = (double*)malloc(100000 * sizeof(double));
+   retro_time_t end;
+   size_t n = 0;
+
+   memset(&result, 0, sizeof(result));
+   while (!(reader = shm_reader_open(SHM_NAME)))
+      sched_yield();
+   end = cpu_features_get_time_usec() + usec;
+
+   while (cpu_features_get_time_usec() < end && !shm_reader_header(reader)->closed)
+   {
+      const uint32_t *pixels;
+      int16_t audio[AUDIO_FRAMES * 2];
+
+      /* a reader that can't keep up wants the newest frame, not the oldest */
+      if (slow_usec)
+         shm_reader_seek_latest(reader, SHM_EXPORT_VIDEO);
+      pixels = (const uint32_t*)shm_reader_acquire(reader, SHM_EXPORT_VIDEO, &info);
+
+      if (pixels)
+      {
+         retro_time_t now = cpu_features_get_time_usec();
+         /* use in place: look at every pixel, then make sure it held */
+         size_t i, count  = info.size / 4;
+         uint64_t bad     = 0;
+
+         for (i = 0; i < count; i++)
+            bad += pixels[i] != (uint32_t)info.frame;
+         if (shm_reader_release(reader, SHM_EXPORT_VIDEO))
+         {
+            result.frames++;
+            result.torn += bad != 0;
+            if (n < 100000)
+               latency[n++] = (double)(now - info.time_usec);
+         }
+         if (slow_usec)
+            usleep(slow_usec);
+      }
+      while (shm_reader_read(reader, SHM_EXPORT_AUDIO, &info, audio, sizeof(audio)) > 0)
+         result.audio++;
+      if (!pixels)
+         sched_yield();
+   }
+
+   result.dropped = shm_reader_dropped(reader, SHM_EXPORT_VIDEO);
+   if (n)
+   {
+      size_t i;
+      double sum = 0;
+      qsort(latency, n, sizeof(double), cmp_double);
+      for (i = 0; i < n; i++)
+         sum += latency[i];
+      result.latency_mean = sum / n;
+      result.latency_p99  = latency[n * 99 / 100];
+      result.latency_max  = latency[n - 1];
+   }
+   if (write(fd, &result, sizeof(result)) != sizeof(result))
+      exit(1);
+   shm_reader_close(reader);
+   free(latency);
+}
+
+/* Producer at 60 fps (or flat out) with a reader in another process. */
+static void bench_pipeline(const char *label, unsigned frames, int paced, unsigned slow_usec)
+{
+   unsigned width = 640, height = 480;
+   uint32_t *pixels = (uint32_t*)malloc(width * height * 4);
+   int16_t audio[AUDIO_FRAMES * 2];
+   struct reader_result result;
+   retro_time_t start, spent = 0, worst = 0;
+   shm_export_t *shm;
+   int fds[2];
+   pid_t pid;
+   unsigned i;
+
+   memset(audio, 0, sizeof(audio));
+   if (pipe(fds) != 0)
+      exit(1);
+   shm = shm_export_new(SHM_NAME, width * height * 4, VIDEO_SLOTS, sizeof(audio), AUDIO_SLOTS);
+   if (!shm)
+      exit(1);
+
+   if ((pid = fork()) == 0)
+   {
+      close(fds[0]);
+      reader_loop((retro_time_t)frames * FRAME_USEC * 2 + 2000000, slow_usec, fds[1]);
+      _exit(0);
+   }
+   close(fds[1]);
+   /* let the reader map the segment */
+   usleep(100000);
+
+   start = cpu_features_get_time_usec();
+   for (i = 0; i < frames; i++)
+   {
+      retro_time_t t = cpu_features_get_time_usec(), took;
+
+      fill_frame(pixels, width * height, i);
+      t = cpu_features_get_time_usec();
+      shm_export_video(shm, i, pixels, width, height, width * 4, RETRO_PIXEL_FORMAT_XRGB8888);
+      shm_export_audio(shm, i, audio, AUDIO_FRAMES, 48000);
+      took   = cpu_features_get_time_usec() - t;
+      spent += took;
+      if (took > worst)
+         worst = took;
+      if (paced)
+      {
+         retro_time_t next = start + (retro_time_t)(i + 1) * FRAME_USEC;
+         retro_time_t now  = cpu_features_get_time_usec();
+         if (next > now)
+            usleep((useconds_t)(next - now));
+      }
+   }
+   shm_export_free(shm);
+
+   if (read(fds[0], &result, sizeof(result)) != sizeof(result))
+      memset(&result, 0, sizeof(result));
+   close(fds[0]);
+   waitpid(pid, NULL, 0);
+
+   printf("%-22s producer %6.1f us/frame (max %5u)  read %5u/%u dropped %5u torn %u audio %u"
+         "  latency mean %7.1f p99 %7.1f max %7.1f us\n",
+         label, (double)spent / frames, (unsigned)worst,
+         (unsigned)result.frames, frames, (unsigned)result.dropped,
+         (unsigned)result.torn, (unsigned)result.audio,
+         result.latency_mean, result.latency_p99, result.latency_max);
+   free(pixels);
+}
+
+int main(void)
+{
+   bench_producer(320, 240, RETRO_PIXEL_FORMAT_RGB565);
+   bench_producer(640, 480, RETRO_PIXEL_FORMAT_XRGB8888);
+   bench_producer(1920, 1080, RETRO_PIXEL_FORMAT_XRGB8888);
+
+   bench_pipeline("60 fps", 300, 1, 0);
+   bench_pipeline("flat out", 3000, 0, 0);
+   bench_pipeline("60 fps, slow reader", 300, 1, 50000);
+   return 0;
+}
@@ -0,0 +1,110 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (shm_export_consumer.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include <features/features_cpu.h>
+#include <memmap/shm_export.h>
+
+/* Follows a producer's frames and audio, prints a line a second and
+ * optionally appends every video frame, as packed rows, to a file. */
+int main(int argc, char **argv)
+{
+   const struct shm_export_header *header;
+   struct shm_export_slot video, sound;
+   shm_reader_t *reader;
+   FILE *out        = NULL;
+   unsigned seconds = argc > 2 ? (unsigned)atoi(argv[2]) : 10;
+   uint8_t *frame;
+   int16_t *audio;
+   retro_time_t end, tick;
+   unsigned frames = 0, batches = 0, samples = 0;
+
+   if (argc < 2)
+   {
+      fprintf(stderr, "usage: %s name [seconds] [frames.raw]\n", argv[0]);
+      return 2;
+   }
+   if (!(reader = shm_reader_open(argv[1])))
+   {
+      fprintf(stderr, "no producer named %s\n", argv[1]);
+      return 1;
+   }
+   header = shm_reader_header(reader);
+   printf("producer pid %u, video %u x %u bytes, audio %u x %u bytes\n",
+         header->producer_pid,
+         header->stream[SHM_EXPORT_VIDEO].slots, header->stream[SHM_EXPORT_VIDEO].slot_size,
+         header->stream[SHM_EXPORT_AUDIO].slots, header->stream[SHM_EXPORT_AUDIO].slot_size);
+   if (argc > 3 && !(out = fopen(argv[3], "wb")))
+      return 1;
+
+   memset(&video, 0, sizeof(video));
+   frame = (uint8_t*)malloc(header->stream[SHM_EXPORT_VIDEO].slot_size);
+   audio = (int16_t*)malloc(header->stream[SHM_EXPORT_AUDIO].slot_size);
+   end   = cpu_features_get_time_usec() + (retro_time_t)seconds * 1000000;
+   tick  = cpu_features_get_time_usec() + 1000000;
+
+   while (!header->closed && cpu_features_get_time_usec() < end)
+   {
+      int got = 0;
+
+      /* copy out rather than use in place, the file write is slow */
+      while (shm_reader_read(reader, SHM_EXPORT_VIDEO, &video, frame,
+               header->stream[SHM_EXPORT_VIDEO].slot_size) > 0)
+      {
+         frames++;
+         got = 1;
+         if (out)
+            fwrite(frame, 1, video.size, out);
+      }
+      while (shm_reader_read(reader, SHM_EXPORT_AUDIO, &sound, audio,
+               header->stream[SHM_EXPORT_AUDIO].slot_size) > 0)
+      {
+         batches++;
+         samples += sound.width;
+         got      = 1;
+      }
+
+      if (cpu_features_get_time_usec() >= tick)
+      {
+         printf("frame %u: %u fps, last %ux%u format %u; audio %u Hz in %u batches; dropped %u\n",
+               (unsigned)video.frame, frames, video.width, video.height, video.format,
+               samples, batches, (unsigned)shm_reader_dropped(reader, SHM_EXPORT_VIDEO));
+         frames = batches = samples = 0;
+         tick  += 1000000;
+      }
+      if (!got)
+         usleep(1000);
+   }
+
+   if (out)
+      fclose(out);
+   free(frame);
+   free(audio);
+   shm_reader_close(reader);
+   return 0;
+}
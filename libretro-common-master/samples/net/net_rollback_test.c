@@ -0,0 +1,338 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (net_rollback_test.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <encodings/crc32.h>
+#include <features/features_cpu.h>
+#include <net/net_rollback.h>
+
+#define FRAMES       300
+#define FRAME_USEC   16667
+#define STATE_WORDS  (64 * 1024 / 4)
+#define INPUT_DELAY  2
+#define WINDOW       10
+
+/* Stand-in core: every frame folds both inputs into its whole state, so
+ * any input applied to the wrong frame changes the end result. */
+struct test_core
+{
+   uint32_t frame;
+   uint32_t words[STATE_WORDS];
+};
+
+static size_t core_serialize_size(void *data)
+{
+   return sizeof(struct test_core);
+}
+
+static bool core_serialize(void *data, void *buf, size_t size)
+{
+   memcpy(buf, data, sizeof(struct test_core));
+   return true;
+}
+
+static bool core_unserialize(void *data, const void *buf, size_t size)
+{
+   memcpy(data, buf, sizeof(struct test_core));
+   return true;
+}
+
+static void core_run(void *data, const uint16_t input[2], bool replay)
+{
+   struct test_core *core = (struct test_core*)data;
+   uint32_t mix           = input[0] | ((uint32_t)input[1] << 16);
+   uint32_t carry         = core->frame++;
+   unsigned i;
+
+   for (i = 0; i < STATE_WORDS; i++)
+   {
+      carry          = core->words[i] * 2654435761u + (carry ^ mix) + i;
+      core->words[i] = carry;
+   }
+}
+
+/* A player's joypad: buttons held for a while, then something else. */
+struct input_script
+{
+   uint32_t rng;
+   uint16_t held;
+};
+
+static uint16_t script_next(struct input_script *script)
+{
+   script->rng ^= script->rng << 13;
+   script->rng ^= script->rng >> 17;
+   script->rng ^= script->rng << 5;
+   if (script->rng % 12 == 0)
+      script->held = (uint16_t)(script->rng >> 8) & 0x0fff;
+   return script->held;
+}
+
+static void script_init(struct input_script *script, unsigned player)
+{
+   script->rng  = 0x1234567u + player * 0x9e3779b9u;
+   script->held = 0;
+}
+
+/* The same frames with both inputs known up front. */
+static uint32_t reference_crc(void)
+{
+   struct test_core *core = (struct test_core*)calloc(1, sizeof(*core));
+   struct input_script scripts[2];
+   unsigned frame;
+   uint32_t crc;
+
+   script_init(&scripts[0], 0);
+   script_init(&scripts[1], 1);
+   for (frame = 0; frame < FRAMES; frame++)
+   {
+      uint16_t input[2] = { 0, 0 };
+      if (frame >= INPUT_DELAY)
+      {
+         input[0] = script_next(&scripts[0]);
+         input[1] = script_next(&scripts[1]);
+      }
+      core_run(core, input, false);
+   }
+   crc = encoding_crc32(0, (const uint8_t*)core, sizeof(*core));
+   free(core);
+   return crc;
+}
+
+struct peer_result
+{
+   uint32_t crc;
+   uint32_t ok;
+   struct rollback_stats stats;
+};
+
+static void run_peer(unsigned player, uint16_t base_port, unsigned latency,
+      unsigned jitter, float loss, int fd)
+{
+   struct test_core *core = (struct test_core*)calloc(1, sizeof(*core));
+   struct rollback_callbacks cb;
+   struct rollback_config config;
+   struct input_script script;
+   struct peer_result result;
+   rollback_t *rb;
+   retro_time_t start, deadline;
+   unsigned tick  = 0;
+   uint16_t input;
+
+   memset(&result, 0, sizeof(result));
+   cb.data           = core;
+   cb.serialize_size = core_serialize_size;
+   cb.serialize      = core_serialize;
+   cb.unserialize    = core_unserialize;
+   cb.run            = core_run;
+
+   memset(&config, 0, sizeof(config));
+   config.player        = player;
+   config.local_port    = base_port + player;
+   config.remote_host   = "127.0.0.1";
+   config.remote_port   = base_port + !player;
+   config.window        = WINDOW;
+   config.input_delay   = INPUT_DELAY;
+   config.sync_interval = 30;
+   config.latency_ms    = latency;
+   config.jitter_ms     = jitter;
+   config.loss          = loss;
+   config.seed          = 77 + player;
+
+   if (!(rb = rollback_new(&config, &cb)))
+   {
+      if (write(fd, &result, sizeof(result)) != sizeof(result))
+         exit(1);
+      return;
+   }
+
+   script_init(&script, player);
+   input = script_next(&script);
+   start    = cpu_features_get_time_usec();
+   /* a session that stops advancing fails instead of hanging the test */
+   deadline = start + (retro_time_t)FRAMES * FRAME_USEC * 4;
+   while (rollback_current_frame(rb) < FRAMES
+         && cpu_features_get_time_usec() < deadline)
+   {
+      retro_time_t next = start + (retro_time_t)++tick * FRAME_USEC;
+      retro_time_t now;
+
+      /* a stalled frame keeps its input for the next try */
+      if (rollback_frame(rb, input))
+         input = script_next(&script);
+      now = cpu_features_get_time_usec();
+      if (next > now)
+         usleep((useconds_t)(next - now));
+   }
+
+   /* settle: until every frame ran on real inputs, and a bit longer so
+    * the peer gets ours */
+   deadline = cpu_features_get_time_usec() + 5000000;
+   for (;;)
+   {
+      rollback_poll(rb);
+      rollback_get_stats(rb, &result.stats);
+      if (result.stats.confirmed >= FRAMES || cpu_features_get_time_usec() > deadline)
+         break;
+      usleep(1000);
+   }
+   result.ok = result.stats.confirmed >= FRAMES;
+   deadline  = cpu_features_get_time_usec() + 300000 + latency * 2000;
+   while (cpu_features_get_time_usec() < deadline)
+   {
+      rollback_poll(rb);
+      usleep(1000);
+   }
+   rollback_get_stats(rb, &result.stats);
+
+   result.crc = encoding_crc32(0, (const uint8_t*)core, sizeof(*core));
+   if (write(fd, &result, sizeof(result)) != sizeof(result))
+      exit(1);
+   rollback_free(rb);
+   free(core);
+}
+
+/* A third host spraying well-formed packets with bogus inputs at both
+ * peers, covering every frame of the session, until it is killed. */
+static void run_intruder(uint16_t base_port)
+{
+   uint8_t packet[22 + 2 * 128];
+   struct sockaddr_in to;
+   unsigned start = 0;
+   int fd         = socket(AF_INET, SOCK_DGRAM, 0);
+   unsigned i;
+
+   if (fd < 0)
+      return;
+   memset(packet, 0, sizeof(packet));
+   /* the wire format, little endian: magic "RBK1", ack, start, count */
+   packet[0] = 0x52; packet[1] = 0x42; packet[2] = 0x4b; packet[3] = 0x31;
+   packet[12] = 128;
+   for (i = 22; i < sizeof(packet); i++)
+      packet[i] = 0xff;
+   memset(&to, 0, sizeof(to));
+   to.sin_family      = AF_INET;
+   to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   for (;;)
+   {
+      unsigned p;
+      packet[8]  = (uint8_t)start;
+      packet[9]  = (uint8_t)(start >> 8);
+      for (p = 0; p < 2; p++)
+      {
+         to.sin_port = htons(base_port + p);
+         sendto(fd, (const char*)packet, sizeof(packet), 0,
+               (const struct sockaddr*)&to, sizeof(to));
+      }
+      start = (start + 8) % FRAMES;
+      usleep(500);
+   }
+}
+
+static int scenario(const char *label, uint16_t port, unsigned latency,
+      unsigned jitter, float loss, bool intruder, uint32_t want)
+{
+   struct peer_result result[2];
+   pid_t pid[2];
+   pid_t intruder_pid = 0;
+   int fds[2][2];
+   int fails = 0;
+   unsigned p;
+
+   if (intruder && (intruder_pid = fork()) == 0)
+   {
+      run_intruder(port);
+      _exit(0);
+   }
+
+   for (p = 0; p < 2; p++)
+   {
+      if (pipe(fds[p]) != 0)
+         return 1;
+      if ((pid[p] = fork()) == 0)
+      {
+         close(fds[p][0]);
+         run_peer(p, port, latency, jitter, loss, fds[p][1]);
+         _exit(0);
+      }
+      close(fds[p][1]);
+   }
+
+   printf("%s\n", label);
+   for (p = 0; p < 2; p++)
+   {
+      const struct rollback_stats *s = &result[p].stats;
+
+      if (read(fds[p][0], &result[p], sizeof(result[p])) != sizeof(result[p]))
+         memset(&result[p], 0, sizeof(result[p]));
+      close(fds[p][0]);
+      waitpid(pid[p], NULL, 0);
+
+      printf("  peer %u: %s  stalls %3u  predicted %3u  rollbacks %3u  resimulated %4u (max %2u)"
+            "  save %5.1f us  load %5.1f us  resim %6.2f ms  syncs %2u desyncs %u  lost %u/%u\n",
+            p, !result[p].ok ? "UNCONFIRMED" : result[p].crc == want ? "match" : "MISMATCH",
+            (unsigned)s->stalls, (unsigned)s->predicted, (unsigned)s->rollbacks,
+            (unsigned)s->resimulated, s->max_depth,
+            s->serializes ? s->serialize_usec / s->serializes : 0.0,
+            s->unserializes ? s->unserialize_usec / s->unserializes : 0.0,
+            s->resimulate_usec / 1000.0, (unsigned)s->syncs_checked, (unsigned)s->desyncs,
+            (unsigned)s->packets_dropped, (unsigned)s->packets_sent);
+      if (intruder)
+         printf("  peer %u: rejected %u packets from the intruder\n",
+               p, (unsigned)s->packets_rejected);
+      if (!result[p].ok || result[p].crc != want || s->desyncs
+            || (intruder && !s->packets_rejected))
+         fails++;
+   }
+   if (intruder_pid > 0)
+   {
+      kill(intruder_pid, SIGKILL);
+      waitpid(intruder_pid, NULL, 0);
+   }
+   return fails;
+}
+
+int main(void)
+{
+   uint32_t want = reference_crc();
+   int fails     = 0;
+
+   printf("%u frames, 64 KB state, window %u, input delay %u\n", FRAMES, WINDOW, INPUT_DELAY);
+   fails += scenario("loopback",                          47100, 0, 0, 0.0f, false, want);
+   fails += scenario("30 ms +-5",                         47110, 30, 5, 0.0f, false, want);
+   fails += scenario("60 ms +-10, 5% loss",               47120, 60, 10, 0.05f, false, want);
+   fails += scenario("100 ms +-20, 20% loss",             47130, 100, 20, 0.2f, false, want);
+   fails += scenario("30 ms +-5, forged packets",         47140, 30, 5, 0.0f, true, want);
+   printf("%s\n", fails ? "FAILED" : "all peers match the reference");
+   return fails ? 1 : 0;
+}
@@ -0,0 +1,235 @@
+/* Copyright  (C) 2010-2017 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (task_queue_bench.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Throughput and tail latency of the threaded task queue under
+ * a mix of short tasks and long ones that run their whole job
+ * in a single handler call (decompression, hashing, scanning).
+ * The same batch runs on one worker, the old layout, and on a
+ * pool: once pushed all at once for throughput, once paced over
+ * main loop ticks for latency, measured from task_queue_push to
+ * the handler being done with it.
+ *
+ * usage: task_queue_bench [workers] [short tasks] [long tasks] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include <features/features_cpu.h>
+#include <queues/task_queue.h>
+
+#define SHORT_USEC 200
+#define LONG_USEC  50000
+/* short tasks pushed per 1 ms tick in the paced run */
+#define PACED_PER_TICK 2
+
+struct sample
+{
+   retro_time_t pushed;
+   retro_time_t done;
+   bool is_long;
+};
+
+static struct sample *samples;
+static unsigned completed;
+static double spins_per_usec;
+static volatile uint32_t sink;
+
+static uint32_t spin(uint64_t count)
+{
+   uint32_t x = 2463534242u;
+   uint64_t i;
+
+   for (i = 0; i < count; i++)
+   {
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+   }
+
+   return x;
+}
+
+/* CPU work rather than wall clock waits, so oversubscribed
+ * workers still compete for the cores. */
+static void busy(unsigned usec)
+{
+   sink += spin((uint64_t)(spins_per_usec * usec));
+}
+
+static void calibrate(void)
+{
+   uint64_t count  = 1 << 20;
+   retro_time_t t0, t1;
+
+   for (;;)
+   {
+      t0   = cpu_features_get_time_usec();
+      sink = spin(count);
+      t1   = cpu_features_get_time_usec();
+      if (t1 - t0 > 20000)
+         break;
+      count *= 2;
+   }
+
+   spins_per_usec = (double)count / (double)(t1 - t0);
+}
+
+static void bench_handler(retro_task_t *task)
+{
+   struct sample *s = (struct sample*)task->state;
+
+   busy(s->is_long ? LONG_USEC : SHORT_USEC);
+   s->done = cpu_features_get_time_usec();
+   task_set_finished(task, true);
+}
+
+static void bench_callback(void *task_data, void *user_data, const char *error)
+{
+   completed++;
+}
+
+static int cmp_time(const void *a, const void *b)
+{
+   retro_time_t x = *(const retro_time_t*)a;
+   retro_time_t y = *(const retro_time_t*)b;
+   return (x > y) - (x < y);
+}
+
+static retro_task_t *make_task(struct sample *s, bool pin_long)
+{
+   retro_task_t *task = (retro_task_t*)calloc(1, sizeof(*task));
+
+   task->handler  = bench_handler;
+   task->callback = bench_callback;
+   task->state    = s;
+   task->progress = -1;
+
+   if (s->is_long && pin_long)
+   {
+      task->priority = TASK_PRIORITY_LOW;
+      task->affinity = 1;
+   }
+
+   s->pushed = cpu_features_get_time_usec();
+   return task;
+}
+
+/* Pushes the batch, either all at once or spread over 1 ms
+ * ticks the way a frontend would from its main loop, and
+ * returns the wall time until every callback has run. */
+static retro_time_t batch(unsigned shorts, unsigned longs,
+      bool pin_long, bool paced)
+{
+   unsigned total     = shorts + longs;
+   unsigned every     = longs ? total / longs : 0;
+   unsigned pushed    = 0;
+   unsigned n         = 0;
+   unsigned i;
+   retro_time_t start;
+
+   memset(samples, 0, total * sizeof(*samples));
+   for (i = 0; i < total; i++)
+      samples[i].is_long = every && (i % every) == 0 && n++ < longs;
+
+   completed = 0;
+   start     = cpu_features_get_time_usec();
+
+   /* a frontend main loop, not task_queue_wait's busy loop */
+   while (completed < total)
+   {
+      unsigned burst = paced ? PACED_PER_TICK : total;
+
+      for (i = 0; i < burst && pushed < total; i++, pushed++)
+         task_queue_push(make_task(&samples[pushed], pin_long));
+
+      task_queue_check();
+      usleep(paced ? 1000 : 500);
+   }
+
+   return cpu_features_get_time_usec() - start;
+}
+
+static void run(const char *name, unsigned workers, unsigned shorts,
+      unsigned longs, bool pin_long)
+{
+   unsigned total     = shorts + longs;
+   unsigned i, n      = 0;
+   retro_time_t *lat  = (retro_time_t*)malloc(total * sizeof(*lat));
+   retro_time_t wall;
+   double long_avg    = 0.0;
+
+   task_queue_set_workers(workers);
+   task_queue_init(true, NULL);
+
+   wall = batch(shorts, longs, pin_long, false);
+   batch(shorts, longs, pin_long, true);
+
+   for (i = 0; i < total; i++)
+   {
+      if (samples[i].is_long)
+         long_avg += samples[i].done - samples[i].pushed;
+      else
+         lat[n++] = samples[i].done - samples[i].pushed;
+   }
+
+   qsort(lat, n, sizeof(*lat), cmp_time);
+
+   printf("%-24s %2u workers  burst %6.0f tasks/s  paced short p50 %6.2f ms p99 %6.2f ms max %6.2f ms  long avg %6.2f ms\n",
+         name, task_queue_get_workers(),
+         total / (wall / 1000000.0),
+         n ? lat[n / 2] / 1000.0 : 0.0,
+         n ? lat[(n * 99) / 100] / 1000.0 : 0.0,
+         n ? lat[n - 1] / 1000.0 : 0.0,
+         longs ? long_avg / longs / 1000.0 : 0.0);
+
+   task_queue_deinit();
+   free(lat);
+}
+
+int main(int argc, char *argv[])
+{
+   unsigned workers = argc > 1 ? (unsigned)atoi(argv[1]) : 4;
+   unsigned shorts  = argc > 2 ? (unsigned)atoi(argv[2]) : 2000;
+   unsigned longs   = argc > 3 ? (unsigned)atoi(argv[3]) : 8;
+
+   if (workers < 2)
+      workers = 2;
+
+   samples = (struct sample*)calloc(shorts + longs, sizeof(*samples));
+   task_queue_set_threaded();
+   calibrate();
+
+   printf("%u cores, short task %u us, long task %u us, %u short + %u long\n",
+         cpu_features_get_core_amount(), SHORT_USEC, LONG_USEC, shorts, longs);
+
+   run("single worker", 1, shorts, longs, false);
+   run("pool", workers, shorts, longs, false);
+   run("pool, long pinned + low", workers, shorts, longs, true);
+   run("pool, short only", workers, shorts, 0, false);
+
+   free(samples);
+   return 0;
+}